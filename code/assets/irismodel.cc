@@ -0,0 +1,208 @@
+#include "assets/irismodel.hh"
+#include "assets/material.hh"
+#include "base/debug.hh"
+
+#include <stdio.h>
+#include <string.h>
+
+static constexpr uint32_t IrisModel_ByteOrder = 0x01020304;
+static constexpr uint32_t IrisModel_Alignment = 16;
+
+static uint64_t AlignIrisModelOffset(uint64_t offset) {
+	return (offset + IrisModel_Alignment - 1) & ~uint64_t(IrisModel_Alignment - 1);
+}
+
+uint32_t IrisModelData::add_string(const char* str) {
+	uint32_t offset = uint32_t(strings.size());
+	strings.insert(strings.end(), str, str + strlen(str) + 1);
+	return offset;
+}
+
+String GetIrisModelPath(const String& source_path) {
+	return String::format("%s.irismodel", source_path.cstr);
+}
+
+// Points out at a section's records, if the section is in bounds and has the expected stride.
+template <typename T> static bool GetIrisModelSection(const MappedFile& file,
+	const IrisModelHeader::Section& section, const T** out, uint32_t* count)
+{
+	if (section.stride != sizeof(T) || section.offset % IrisModel_Alignment != 0) { return false; }
+	if (section.offset > file.size || uint64_t(section.count) * sizeof(T) > file.size - section.offset) {
+		return false;
+	}
+	*out = reinterpret_cast<const T*>(file.data + section.offset);
+	*count = section.count;
+	return true;
+}
+
+static bool IsValidIrisModelView(const IrisModel& model, const IrisModelView& view) {
+	if (view.buffer == IrisModelNone) { return true; }
+	if (view.buffer >= model.num_buffers || view.etype >= ElementType::Count || view.ctype >= ComponentType::Count) {
+		return false;
+	}
+	uint64_t end = view.offset + uint64_t(view.elements) * ElementType(view.etype).components() *
+		ComponentType(view.ctype).bytes();
+	return end <= model.buffers[view.buffer].size;
+}
+
+// Checks every index and string offset in the model, so that loading it can't go out of bounds.
+static bool IsValidIrisModel(const IrisModel& model, uint32_t strings_size) {
+	auto valid_string = [&](uint32_t offset) { return offset < strings_size; };
+	for (uint32_t i = 0; i < model.num_files; i++) {
+		if (!valid_string(model.files[i].path)) { return false; }
+	}
+	for (uint32_t i = 0; i < model.num_buffers; i++) {
+		const IrisModelBuffer& b = model.buffers[i];
+		if (b.file >= model.num_files || b.usage > BufferUsage::Index) { return false; }
+	}
+	for (uint32_t i = 0; i < model.num_textures; i++) {
+		const IrisModelTexture& t = model.textures[i];
+		if (t.path != IrisModelNone && !valid_string(t.path)) { return false; }
+	}
+	for (uint32_t i = 0; i < model.num_materials; i++) {
+		const IrisModelMaterial& m = model.materials[i];
+		if (m.num_uniforms > IrisModelMaterial::MaxUniforms || m.num_samplers > IrisModelMaterial::MaxSamplers ||
+			m.blend_mode > uint8_t(BlendMode::Transparent))
+		{
+			return false;
+		}
+		for (uint32_t j = 0; j < m.num_uniforms; j++) {
+			const IrisModelMaterial::Uniform& u = m.uniforms[j];
+			if (u.index >= CountOf(Uniforms::all) || u.etype >= ElementType::Count || u.ctype >= ComponentType::Count) {
+				return false;
+			}
+		}
+		for (uint32_t j = 0; j < m.num_samplers; j++) {
+			const IrisModelMaterial::Sampler& s = m.samplers[j];
+			bool builtin_texture = (s.texture == IrisModelNone || s.texture == IrisModelTextureWhite ||
+				s.texture == IrisModelTextureBlack);
+			bool builtin_sampler = (s.sampler == IrisModelNone || s.sampler == IrisModelSamplerNearestRepeat);
+			if (s.uniform >= CountOf(Uniforms::all) || (!builtin_texture && s.texture >= model.num_textures) ||
+				(!builtin_sampler && s.sampler >= model.num_samplers))
+			{
+				return false;
+			}
+		}
+	}
+	for (uint32_t i = 0; i < model.num_meshes; i++) {
+		const IrisModelMesh& m = model.meshes[i];
+		if (m.material >= model.num_materials || m.ptype >= PrimitiveType::Count) { return false; }
+		if (!IsValidIrisModelView(model, m.index_buffer)) { return false; }
+		for (const IrisModelView& view : m.vertex_attribs) {
+			if (!IsValidIrisModelView(model, view)) { return false; }
+		}
+	}
+	for (uint32_t i = 0; i < model.num_nodes; i++) {
+		const IrisModelNode& n = model.nodes[i];
+		if ((n.parent != IrisModelNone && n.parent >= model.num_nodes) || n.first_mesh > model.num_meshes ||
+			n.num_meshes > model.num_meshes - n.first_mesh)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool LoadIrisModel(const String& path, const String& source_path, const String& directory, IrisModel* out) {
+	MappedFile file = MapFile(path, MappedFile::Random);
+	if (!file) { return false; }
+
+	IrisModelHeader header;
+	if (file.size < sizeof(header)) { return false; }
+	memcpy(&header, file.data, sizeof(header));
+	if (memcmp(header.magic, IrisModelMagic, sizeof(IrisModelMagic)) != 0 ||
+		header.version != IrisModelVersion || header.byte_order != IrisModel_ByteOrder)
+	{
+		LOG_F(WARNING, "Ignoring %s: not a version %u .irismodel file for this platform", path.cstr, IrisModelVersion);
+		return false;
+	}
+	if (header.schema_hash != IrisModelSchemaHash) {
+		LOG_F(INFO, "Ignoring %s: cooked with a different set of uniforms or vertex attributes", path.cstr);
+		return false;
+	}
+	if (header.source_mtime != GetFileModificationTime(source_path)) { return false; }
+
+	IrisModel model;
+	uint32_t strings_size = 0;
+	bool ok = GetIrisModelSection(file, header.files, &model.files, &model.num_files) &&
+		GetIrisModelSection(file, header.buffers, &model.buffers, &model.num_buffers) &&
+		GetIrisModelSection(file, header.samplers, &model.samplers, &model.num_samplers) &&
+		GetIrisModelSection(file, header.textures, &model.textures, &model.num_textures) &&
+		GetIrisModelSection(file, header.materials, &model.materials, &model.num_materials) &&
+		GetIrisModelSection(file, header.meshes, &model.meshes, &model.num_meshes) &&
+		GetIrisModelSection(file, header.nodes, &model.nodes, &model.num_nodes) &&
+		GetIrisModelSection(file, header.strings, &model.strings, &strings_size);
+	// The string table ends in a terminator, so every offset into it is a valid string
+	ok = ok && strings_size > 0 && model.strings[strings_size - 1] == '\0' && IsValidIrisModel(model, strings_size);
+	if (!ok) {
+		LOG_F(WARNING, "Ignoring %s: truncated or malformed", path.cstr);
+		return false;
+	}
+
+	for (uint32_t i = 0; i < model.num_files; i++) {
+		String file_path = String::frame_format("%s/%s", directory.cstr, model.string(model.files[i].path));
+		if (model.files[i].mtime != GetFileModificationTime(file_path)) { return false; }
+	}
+
+	model.file = std::move(file);
+	*out = std::move(model);
+	return true;
+}
+
+bool WriteIrisModel(const String& path, const IrisModelData& data) {
+	IrisModelHeader header = {};
+	memcpy(header.magic, IrisModelMagic, sizeof(IrisModelMagic));
+	header.version = IrisModelVersion;
+	header.byte_order = IrisModel_ByteOrder;
+	header.source_mtime = data.source_mtime;
+	header.schema_hash = IrisModelSchemaHash;
+
+	struct Chunk {
+		IrisModelHeader::Section* section;
+		const void* data;
+		uint32_t count;
+		uint32_t stride;
+	};
+	Chunk chunks[] = {
+		{&header.files,     data.files.data(),     uint32_t(data.files.size()),     sizeof(IrisModelFile)},
+		{&header.buffers,   data.buffers.data(),   uint32_t(data.buffers.size()),   sizeof(IrisModelBuffer)},
+		{&header.samplers,  data.samplers.data(),  uint32_t(data.samplers.size()),  sizeof(IrisModelSampler)},
+		{&header.textures,  data.textures.data(),  uint32_t(data.textures.size()),  sizeof(IrisModelTexture)},
+		{&header.materials, data.materials.data(), uint32_t(data.materials.size()), sizeof(IrisModelMaterial)},
+		{&header.meshes,    data.meshes.data(),    uint32_t(data.meshes.size()),    sizeof(IrisModelMesh)},
+		{&header.nodes,     data.nodes.data(),     uint32_t(data.nodes.size()),     sizeof(IrisModelNode)},
+		{&header.strings,   data.strings.data(),   uint32_t(data.strings.size()),   1},
+	};
+	uint64_t offset = AlignIrisModelOffset(sizeof(header));
+	for (Chunk& chunk : chunks) {
+		*chunk.section = {.offset = offset, .count = chunk.count, .stride = chunk.stride};
+		offset = AlignIrisModelOffset(offset + uint64_t(chunk.count) * chunk.stride);
+	}
+
+	// Written to a temporary file first, so that other loads never see a partial file
+	String tmp_path = String::format("%s.tmp", path.cstr);
+	FILE* file = fopen(tmp_path.cstr, "wb");
+	if (!file) { return false; }
+	static const uint8_t padding[IrisModel_Alignment] = {};
+	bool ok = (fwrite(&header, 1, sizeof(header), file) == sizeof(header));
+	uint64_t position = sizeof(header);
+	for (uint32_t i = 0; ok && i < CountOf(chunks); i++) {
+		const Chunk& chunk = chunks[i];
+		size_t padding_size = size_t(chunk.section->offset - position);
+		size_t size = size_t(chunk.count) * chunk.stride;
+		ok = (fwrite(padding, 1, padding_size, file) == padding_size) &&
+			(size == 0 || fwrite(chunk.data, 1, size, file) == size);
+		position = chunk.section->offset + size;
+	}
+	ok = (fclose(file) == 0) && ok;
+	if (ok) {
+		// rename() doesn't replace existing files on Windows
+		remove(path.cstr);
+		ok = (rename(tmp_path.cstr, path.cstr) == 0);
+	}
+	if (!ok) {
+		LOG_F(WARNING, "Failed to write %s", path.cstr);
+		remove(tmp_path.cstr);
+	}
+	return ok;
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "base/base.hh"
+#include "base/math.hh"
+#include "base/string.hh"
+#include "base/filesystem.hh"
+#include "graphics/defaults.hh"
+
+#include <vector>
+
+/* Cooked model format (.irismodel).
+ *
+ * Holds everything GetModelFromGLTF works out from a glTF file, as flat arrays of fixed-size records
+ * that refer to each other by index: buffers (byte ranges of the glTF's .bin files), samplers,
+ * textures (paths and load options), materials, meshes (with their vertex and index views resolved
+ * and their bounding boxes and UV densities precomputed) and the node graph. Loading one is a matter
+ * of mapping the file and turning indices into pointers, with no parsing at all.
+ *
+ * Cooked files are written next to the glTF file (model.gltf -> model.gltf.irismodel) the first
+ * time it's loaded. They record the modification times of the glTF file and every .bin file it
+ * uses, and are ignored once any of them changes, or once the engine's uniform and attribute
+ * tables no longer match the ones they were cooked against (see IrisModelSchemaHash). Strings are
+ * offsets into a string table at the end of the file; paths are relative to the glTF file's
+ * directory.
+ *
+ * Files are written in the host's byte order, and rejected on load if it doesn't match.
+ */
+
+static constexpr char IrisModelMagic[8] = {'I', 'R', 'I', 'S', 'M', 'D', 'L', '\0'};
+static constexpr uint32_t IrisModelVersion = 2;
+
+// Materials refer to uniforms by their index into Uniforms::all, and meshes store their vertex
+// attributes in the order of Attributes::all. Cooked files record a hash of both tables, so that
+// adding, removing or reordering uniforms or attributes invalidates them without a version bump.
+static constexpr uint64_t GetIrisModelSchemaHash() {
+	uint64_t hash = FNV_BASIS;
+	auto add = [&](uint64_t value) { hash = (hash ^ value) * FNV_PRIME; };
+	add(CountOf(Uniforms::all));
+	for (const Uniforms::Item& uniform : Uniforms::all) {
+		add(uniform.index);
+		add(uniform.hash);
+	}
+	add(CountOf(Attributes::all));
+	for (const Attributes::Item& attrib : Attributes::all) {
+		add(attrib.index);
+		add(Hash64(attrib.name));
+		add(Hash64(attrib.gltf_name));
+	}
+	return hash;
+}
+static constexpr uint64_t IrisModelSchemaHash = GetIrisModelSchemaHash();
+
+// Index value meaning "no object". Texture and sampler references may also refer to built-ins.
+static constexpr uint32_t IrisModelNone = UINT32_MAX;
+static constexpr uint32_t IrisModelTextureWhite = UINT32_MAX - 1;
+static constexpr uint32_t IrisModelTextureBlack = UINT32_MAX - 2;
+static constexpr uint32_t IrisModelSamplerNearestRepeat = UINT32_MAX - 1;
+
+// A source file the model was cooked from, other than the glTF file itself.
+struct IrisModelFile {
+	uint32_t path; // string
+	uint32_t reserved;
+	uint64_t mtime;
+};
+
+// Becomes a Buffer, see assets/mesh.hh.
+struct IrisModelBuffer {
+	uint32_t file;
+	uint32_t offset;
+	uint32_t size;
+	uint8_t usage; // BufferUsage
+	uint8_t reserved[3];
+};
+
+struct IrisModelSampler {
+	uint32_t min_filter;
+	uint32_t mag_filter;
+	uint32_t wrap_s;
+	uint32_t wrap_t;
+};
+
+// Arguments to GetTexture.
+struct IrisModelTexture {
+	uint32_t path; // string, or IrisModelNone for images that couldn't be loaded
+	uint8_t generate_mips;
+	uint8_t filter; // MipFilter
+	uint8_t srgb;
+	uint8_t compression; // TextureCompression
+	float alpha_cutoff;
+};
+
+struct IrisModelMaterial {
+	uint8_t blend_mode; // BlendMode
+	uint8_t num_uniforms;
+	uint8_t num_samplers;
+	uint8_t reserved;
+	uint32_t face_culling_mode;
+	float stipple_hard_cutoff;
+	float stipple_soft_cutoff;
+	static constexpr uint32_t MaxUniforms = 8;
+	struct Uniform {
+		uint32_t index; // into Uniforms::all
+		uint8_t etype;  // ElementType
+		uint8_t ctype;  // ComponentType
+		uint8_t reserved[2];
+		uint8_t value[16];
+	} uniforms[MaxUniforms];
+	static constexpr uint32_t MaxSamplers = 8;
+	struct Sampler {
+		uint32_t uniform; // index into Uniforms::all
+		uint32_t texture;
+		uint32_t sampler;
+	} samplers[MaxSamplers];
+};
+
+// A BufferView with its buffer as an index.
+struct IrisModelView {
+	uint32_t buffer; // IrisModelNone if unused
+	uint32_t elements;
+	uint32_t offset;
+	uint8_t etype; // ElementType
+	uint8_t ctype; // ComponentType
+	uint8_t reserved[2];
+};
+
+// Becomes a Mesh and the MeshInstance that draws it.
+struct IrisModelMesh {
+	static constexpr uint32_t MaxVertexAttribs = CountOf(Attributes::all);
+	IrisModelView vertex_attribs[MaxVertexAttribs];
+	IrisModelView index_buffer;
+	uint32_t material;
+	uint8_t ptype; // PrimitiveType
+	uint8_t reserved[3];
+	vec3 aabb_half_extents;
+	vec3 aabb_center;
+	float uv_density;
+};
+
+// Becomes a GameObject. Nodes are listed in glTF order, and their meshes are stored contiguously.
+struct IrisModelNode {
+	uint32_t parent; // IrisModelNone for nodes directly under the model's root object
+	uint32_t first_mesh;
+	uint32_t num_meshes;
+	vec3 position;
+	vec3 scale;
+	quat rotation;
+};
+
+struct IrisModelHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order; // 0x01020304 as written by the host
+	uint64_t source_mtime; // of the glTF file
+	uint64_t schema_hash; // IrisModelSchemaHash
+	// Location of each array. stride is checked against the size of the record type on load.
+	struct Section {
+		uint64_t offset; // from the start of the file
+		uint32_t count;
+		uint32_t stride;
+	};
+	Section files;
+	Section buffers;
+	Section samplers;
+	Section textures;
+	Section materials;
+	Section meshes;
+	Section nodes;
+	Section strings; // stride 1
+};
+
+// Contents of a cooked model, as built up before writing.
+struct IrisModelData {
+	uint64_t source_mtime = 0;
+	std::vector<IrisModelFile> files;
+	std::vector<IrisModelBuffer> buffers;
+	std::vector<IrisModelSampler> samplers;
+	std::vector<IrisModelTexture> textures;
+	std::vector<IrisModelMaterial> materials;
+	std::vector<IrisModelMesh> meshes;
+	std::vector<IrisModelNode> nodes;
+	std::vector<char> strings;
+
+	// Adds a string to the string table and returns its offset.
+	uint32_t add_string(const char* str);
+};
+
+// A cooked model mapped into memory. The arrays point into the mapping, and every index in them
+// has been checked to be in range.
+struct IrisModel {
+	MappedFile file;
+	const IrisModelFile* files = nullptr;
+	const IrisModelBuffer* buffers = nullptr;
+	const IrisModelSampler* samplers = nullptr;
+	const IrisModelTexture* textures = nullptr;
+	const IrisModelMaterial* materials = nullptr;
+	const IrisModelMesh* meshes = nullptr;
+	const IrisModelNode* nodes = nullptr;
+	uint32_t num_files = 0;
+	uint32_t num_buffers = 0;
+	uint32_t num_samplers = 0;
+	uint32_t num_textures = 0;
+	uint32_t num_materials = 0;
+	uint32_t num_meshes = 0;
+	uint32_t num_nodes = 0;
+	const char* strings = nullptr;
+
+	const char* string(uint32_t offset) const { return &strings[offset]; }
+};
+
+// Returns the path of the cooked file for the given glTF file.
+String GetIrisModelPath(const String& source_path);
+
+// Maps a cooked model and checks that it's well-formed and that neither the glTF file nor any of
+// the files it was cooked from have changed since. directory is the glTF file's directory. Returns
+// false if there is no such file or it can't be used, in which case the glTF file should be loaded
+// and cooked again.
+bool LoadIrisModel(const String& path, const String& source_path, const String& directory, IrisModel* out);
+
+// Writes a cooked model.
+bool WriteIrisModel(const String& path, const IrisModelData& data);
@@ -0,0 +1,120 @@
+#include "assets/iristex.hh"
+#include "assets/texcompress.hh"
+#include "base/debug.hh"
+
+#include <stdio.h>
+
+static constexpr uint32_t IrisTex_ByteOrder = 0x01020304;
+
+static uint64_t AlignIrisTexOffset(uint64_t offset) {
+	return (offset + IrisTexAlignment - 1) & ~uint64_t(IrisTexAlignment - 1);
+}
+
+size_t IrisTexLevelSize(IrisTexFormat format, uint32_t width, uint32_t height) {
+	switch (format) {
+		case IrisTexFormat::R8:
+		case IrisTexFormat::RG8:
+		case IrisTexFormat::RGB8:
+		case IrisTexFormat::RGBA8: return size_t(width) * height * uint8_t(format);
+		case IrisTexFormat::BC1: return CompressedLevelSize(TextureCompression::BC1, width, height);
+		case IrisTexFormat::BC3: return CompressedLevelSize(TextureCompression::BC3, width, height);
+		case IrisTexFormat::BC4: return CompressedLevelSize(TextureCompression::BC4, width, height);
+		case IrisTexFormat::BC5: return CompressedLevelSize(TextureCompression::BC5, width, height);
+	}
+	return 0;
+}
+
+String GetIrisTexPath(const String& source_path) {
+	return String::format("%s.iristex", source_path.cstr);
+}
+
+bool LoadIrisTex(const String& path, uint64_t source_hash, IrisTex* out) {
+	// Most reads go straight to the upload ring, so the kernel shouldn't bother reading ahead
+	MappedFile file = MapFile(path, MappedFile::Random);
+	if (!file) { return false; }
+
+	IrisTexHeader header;
+	if (file.size < sizeof(header)) { return false; }
+	memcpy(&header, file.data, sizeof(header));
+	if (memcmp(header.magic, IrisTexMagic, sizeof(IrisTexMagic)) != 0 ||
+		header.version != IrisTexVersion || header.byte_order != IrisTex_ByteOrder)
+	{
+		LOG_F(WARNING, "Ignoring %s: not a version %u .iristex file for this platform", path.cstr, IrisTexVersion);
+		return false;
+	}
+	if (header.source_hash != source_hash) { return false; }
+	if (header.num_levels < 1 || header.num_levels > IrisTexMaxLevels) { return false; }
+
+	if (IrisTexLevelSize(header.format, 1, 1) == 0) { return false; }
+	for (uint32_t i = 0; i < header.num_levels; i++) {
+		const IrisTexHeader::Level& l = header.levels[i];
+		uint32_t expected_w = Max(1U, header.width >> i), expected_h = Max(1U, header.height >> i);
+		if (l.width != expected_w || l.height != expected_h ||
+			l.size != IrisTexLevelSize(header.format, l.width, l.height) || l.offset + l.size > file.size)
+		{
+			LOG_F(WARNING, "Ignoring %s: level %u is truncated or malformed", path.cstr, i);
+			return false;
+		}
+	}
+
+	out->width = header.width;
+	out->height = header.height;
+	out->format = header.format;
+	out->num_levels = header.num_levels;
+	for (uint32_t i = 0; i < header.num_levels; i++) {
+		out->levels[i] = file.data + header.levels[i].offset;
+	}
+	out->file = std::move(file);
+	return true;
+}
+
+bool WriteIrisTex(const String& path, uint64_t source_hash, uint32_t width, uint32_t height,
+	IrisTexFormat format, uint8_t num_levels, const uint8_t* const* level_data)
+{
+	CHECK_F(num_levels >= 1 && num_levels <= IrisTexMaxLevels);
+
+	IrisTexHeader header = {};
+	memcpy(header.magic, IrisTexMagic, sizeof(IrisTexMagic));
+	header.version = IrisTexVersion;
+	header.byte_order = IrisTex_ByteOrder;
+	header.source_hash = source_hash;
+	header.width = width;
+	header.height = height;
+	header.format = format;
+	header.num_levels = num_levels;
+	uint64_t offset = AlignIrisTexOffset(sizeof(header));
+	for (uint32_t i = 0; i < num_levels; i++) {
+		IrisTexHeader::Level& l = header.levels[i];
+		l.width = Max(1U, width >> i);
+		l.height = Max(1U, height >> i);
+		l.offset = offset;
+		l.size = IrisTexLevelSize(format, l.width, l.height);
+		offset = AlignIrisTexOffset(offset + l.size);
+	}
+
+	// Written to a temporary file first, so that other loads never see a partial file
+	String tmp_path = String::format("%s.tmp", path.cstr);
+	FILE* file = fopen(tmp_path.cstr, "wb");
+	if (!file) { return false; }
+	static const uint8_t padding[IrisTexAlignment] = {};
+	bool ok = (fwrite(&header, 1, sizeof(header), file) == sizeof(header));
+	uint64_t position = sizeof(header);
+	for (uint32_t i = 0; ok && i < num_levels; i++) {
+		const IrisTexHeader::Level& l = header.levels[i];
+		size_t padding_size = size_t(l.offset - position);
+		ok = (fwrite(padding, 1, padding_size, file) == padding_size) &&
+			(fwrite(level_data[i], 1, size_t(l.size), file) == l.size);
+		position = l.offset + l.size;
+	}
+	ok = (fclose(file) == 0) && ok;
+	if (ok) {
+		// rename() doesn't replace existing files on Windows
+		remove(path.cstr);
+		ok = (rename(tmp_path.cstr, path.cstr) == 0);
+	}
+	if (!ok) {
+		LOG_F(WARNING, "Failed to write %s", path.cstr);
+		remove(tmp_path.cstr);
+	}
+	return ok;
+}
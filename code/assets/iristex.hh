@@ -0,0 +1,81 @@
+#pragma once
+#include "base/base.hh"
+#include "base/string.hh"
+#include "base/filesystem.hh"
+
+/* Cooked texture container (.iristex).
+ *
+ * Holds a texture's full mip chain, ready to upload: a fixed-size header followed by the levels,
+ * largest first, each starting at a multiple of IrisTexAlignment. Rows are tightly packed. Cooked
+ * files are written next to their source image (image.png -> image.png.iristex) the first time the
+ * image is decoded, or ahead of time with --cook-textures. The header records a hash of the source
+ * file's contents and the options it was cooked with, so a cooked file is only used while its
+ * source and options are unchanged.
+ *
+ * Files are written in the host's byte order, and rejected on load if it doesn't match.
+ */
+
+static constexpr char IrisTexMagic[8] = {'I', 'R', 'I', 'S', 'T', 'E', 'X', '\0'};
+static constexpr uint32_t IrisTexVersion = 1;
+static constexpr uint32_t IrisTexAlignment = 64;
+static constexpr uint32_t IrisTexMaxLevels = 16;
+
+// Pixel format of every level in a cooked texture.
+enum class IrisTexFormat : uint8_t {
+	// 8-bit UNORM formats. The value is the number of channels.
+	R8    = 1,
+	RG8   = 2,
+	RGB8  = 3,
+	RGBA8 = 4,
+	// Block-compressed formats, see assets/texcompress.hh. Levels are rows of 4x4 blocks.
+	BC1 = 16,
+	BC3 = 17,
+	BC4 = 18,
+	BC5 = 19,
+};
+
+// Size in bytes of a level of the given format and size, or 0 if the format isn't known.
+size_t IrisTexLevelSize(IrisTexFormat format, uint32_t width, uint32_t height);
+
+struct IrisTexHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order; // 0x01020304 as written by the host
+	// Hash of the source file's contents and of the mipgen and compression options, as computed by
+	// CookedSourceHash in texture.cc from the texture's TextureContentKey
+	uint64_t source_hash;
+	uint32_t width;
+	uint32_t height;
+	IrisTexFormat format;
+	uint8_t num_levels;
+	uint8_t reserved[6];
+	struct Level {
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset; // from the start of the file
+		uint64_t size;
+	} levels[IrisTexMaxLevels];
+};
+
+// A cooked texture mapped into memory. The level pointers point into the mapping.
+struct IrisTex {
+	MappedFile file;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	IrisTexFormat format = IrisTexFormat::RGBA8;
+	uint8_t num_levels = 0;
+	const uint8_t* levels[IrisTexMaxLevels] = {};
+};
+
+// Returns the path of the cooked file for the given source image.
+String GetIrisTexPath(const String& source_path);
+
+// Maps a cooked texture and checks that it was cooked from a source with the given hash and isn't
+// truncated. Returns false if there is no such file or it can't be used, in which case the source
+// should be decoded and cooked again.
+bool LoadIrisTex(const String& path, uint64_t source_hash, IrisTex* out);
+
+// Writes a cooked texture. level_data[i] holds the tightly packed pixels or blocks of level i, whose
+// size is that of level 0 halved i times (but at least 1x1).
+bool WriteIrisTex(const String& path, uint64_t source_hash, uint32_t width, uint32_t height,
+	IrisTexFormat format, uint8_t num_levels, const uint8_t* const* level_data);
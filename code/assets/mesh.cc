@@ -1,4 +1,5 @@
 #include "assets/mesh.hh"
+#include "graphics/upload.hh"
 
 constexpr BufferView::BufferView(Buffer* buffer, ElementType etype, ComponentType ctype, uint32_t elements):
 	buffer{buffer}, etype{etype}, ctype{ctype}, elements{elements}
@@ -22,8 +23,9 @@ Buffer* Buffer::upload() {
 		glGenBuffers(1, &gpu_handle);
 	}
 	glBindBuffer(usage.gl_target(), gpu_handle);
-	glBufferData(usage.gl_target(), size, cpu_buffer, GL_STATIC_DRAW);
+	glBufferData(usage.gl_target(), size, nullptr, GL_STATIC_DRAW);
 	glBindBuffer(usage.gl_target(), 0);
+	UploadBufferData(gpu_handle, 0, size, cpu_buffer);
 	cpu_buffer = nullptr;
 	loaded = true;
 	return this;
@@ -39,8 +41,8 @@ bool Mesh::compute_aabb() {
 	// TODO: Support other formats for the position buffer
 	if (position.etype.v == ElementType::VEC3 || position.ctype.v == ComponentType::F32) {
 		for (size_t i = 0; i < position.elements; i++) {
-			uint8_t* p = &position.buffer->cpu_buffer[position.offset + 3 * i * sizeof(float)];
-			vec3* vp = reinterpret_cast<vec3*>(p); // NOTE: needs -fno-strict-aliasing
+			const uint8_t* p = &position.buffer->cpu_buffer[position.offset + 3 * i * sizeof(float)];
+			const vec3* vp = reinterpret_cast<const vec3*>(p); // NOTE: needs -fno-strict-aliasing
 			aabb_min = vec3(Min(aabb_min.x, vp->x), Min(aabb_min.y, vp->y), Min(aabb_min.z, vp->z));
 			aabb_max = vec3(Max(aabb_max.x, vp->x), Max(aabb_max.y, vp->y), Max(aabb_max.z, vp->z));
 		}
@@ -53,6 +55,62 @@ bool Mesh::compute_aabb() {
 	return true;
 }
 
+bool Mesh::compute_uv_density() {
+	BufferView& position = vertex_attribs[Attributes::Position.index];
+	BufferView& texcoord = vertex_attribs[Attributes::Texcoord0.index];
+	if (!position.buffer || !position.buffer->cpu_buffer || !texcoord.buffer || !texcoord.buffer->cpu_buffer) {
+		return false;
+	}
+	if (ptype.v != PrimitiveType::TRIANGLES) {
+		return false;
+	}
+	// Only float attributes are read. Meshes with quantised positions or texcoords keep a density of
+	// zero, which makes the streamer request their textures at full resolution.
+	if (position.etype.v != ElementType::VEC3 || position.ctype.v != ComponentType::F32 ||
+		texcoord.etype.v != ElementType::VEC2 || texcoord.ctype.v != ComponentType::F32)
+	{
+		LOG_F(WARNING, "Can't compute mesh UV density for %s/%s positions and %s/%s texcoords",
+			position.etype.gltf_type(), position.ctype.name(), texcoord.etype.gltf_type(), texcoord.ctype.name());
+		return false;
+	}
+
+	const BufferView& indices = index_buffer;
+	uint32_t num_indices = indices.buffer ? indices.total_components() : position.elements;
+	if (indices.buffer && !indices.buffer->cpu_buffer) {
+		return false;
+	}
+	auto index = [&](uint32_t i) -> uint32_t {
+		if (!indices.buffer) { return i; }
+		const uint8_t* p = &indices.buffer->cpu_buffer[indices.offset + i * indices.ctype.bytes()];
+		switch (indices.ctype.v) {
+			case ComponentType::U8:  return *p;
+			case ComponentType::U16: return *reinterpret_cast<const uint16_t*>(p);
+			default:                 return *reinterpret_cast<const uint32_t*>(p);
+		}
+	};
+
+	// Sum of triangle areas in local space and in texture space. Their ratio is the squared density.
+	double area = 0.0, uv_area = 0.0;
+	for (uint32_t i = 0; i + 2 < num_indices; i += 3) {
+		vec3 p[3];
+		vec2 t[3];
+		for (uint32_t j = 0; j < 3; j++) {
+			uint32_t v = index(i + j);
+			if (v >= position.elements || v >= texcoord.elements) { return false; }
+			p[j] = *reinterpret_cast<const vec3*>(&position.buffer->cpu_buffer[position.offset + v * position.stride()]);
+			t[j] = *reinterpret_cast<const vec2*>(&texcoord.buffer->cpu_buffer[texcoord.offset + v * texcoord.stride()]);
+		}
+		area += double(glm::length(glm::cross(p[1] - p[0], p[2] - p[0])));
+		vec2 e1 = t[1] - t[0], e2 = t[2] - t[0];
+		uv_area += double(fabsf(e1.x * e2.y - e1.y * e2.x));
+	}
+	if (!(area > 0.0) || !(uv_area > 0.0)) {
+		return false;
+	}
+	uv_density = float(sqrt(uv_area / area));
+	return true;
+}
+
 Mesh* Mesh::upload() {
 	glGenVertexArrays(1, &gl_vertex_array);
 	glBindVertexArray(gl_vertex_array);
@@ -199,8 +199,9 @@ struct BufferUsage {
 struct Buffer {
 	BufferUsage usage = BufferUsage::Unknown;
 	uint32_t size = 0;
-	// Block of CPU-side memory for this buffer, if one exists.
-	uint8_t* cpu_buffer = nullptr;
+	// Block of CPU-side memory for this buffer, if one exists. Read-only, since it may point into a
+	// memory-mapped file.
+	const uint8_t* cpu_buffer = nullptr;
 	// OpenGL handle for this buffer's GPU-side copy, if one exists.
 	GLuint gpu_handle = 0;
 	// Has this buffer been uploaded to the GPU? (Not the same thing as gpu_handle != 0)
@@ -208,7 +209,7 @@ struct Buffer {
 
 	constexpr Buffer() = default;
 	template<typename T> constexpr Buffer(BufferUsage usage, uint32_t size, T* cpu_buffer):
-		usage{usage}, size{size}, cpu_buffer{(uint8_t*)(cpu_buffer)} {}
+		usage{usage}, size{size}, cpu_buffer{(const uint8_t*)(cpu_buffer)} {}
 
 	// Upload this buffer to the GPU, if not already uploaded.
 	Buffer* upload();
@@ -250,6 +251,13 @@ struct Mesh {
 	// if successful or false if the buffer hasn't been set up, or has already been uploaded.
 	bool compute_aabb();
 
+	// Average number of texture-space units per local-space unit along the surface, based on the
+	// Texcoord0 attribute. Used to work out which texture levels need to be resident. 0 if unknown.
+	float uv_density = 0.0f;
+	// Computes uv_density from the staged Position, Texcoord0 and index buffers. Returns false if
+	// they haven't been set up, have already been uploaded, or use unsupported formats.
+	bool compute_uv_density();
+
 	// Upload this mesh to the GPU, if not already uploaded. Uploads any staged buffers and
 	// retrieves an OpenGL Vertex Array Object.
 	Mesh* upload();
@@ -0,0 +1,649 @@
+#include "assets/mipgen.hh"
+#include "base/debug.hh"
+#include "base/jobs.hh"
+#include "engine/profiler.hh"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define MIPGEN_SSE2 1
+#else
+	#define MIPGEN_SSE2 0
+#endif
+
+// SSSE3 and AVX-512 kernels are compiled in regardless of the target's baseline ISA, and selected at
+// runtime, since the engine is built for plain x86-64.
+#if MIPGEN_SSE2 && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+	#include <immintrin.h>
+	#define MIPGEN_X86_DISPATCH 1
+	#if defined(_MSC_VER) && !defined(__clang__)
+		#include <intrin.h>
+		#define MIPGEN_TARGET(isa)
+	#else
+		#define MIPGEN_TARGET(isa) __attribute__((target(isa)))
+	#endif
+#else
+	#define MIPGEN_X86_DISPATCH 0
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+	#include <arm_neon.h>
+	#define MIPGEN_NEON 1
+#else
+	#define MIPGEN_NEON 0
+#endif
+
+// Width of the Kaiser filter in destination texels, and its window shape parameter.
+static constexpr float MipKaiserWidth = 3.0f;
+static constexpr float MipKaiserAlpha = 4.0f;
+// Enough for the Kaiser filter when halving, or when reducing an odd size by a bit more than half.
+static constexpr uint32_t MipMaxTaps = 8;
+
+// Number of output bytes each job works on, roughly.
+static constexpr uint32_t MipBatchBytes = 64 << 10;
+
+struct MipgenTables {
+	float srgb_to_linear[256];
+	float unorm_to_float[256];
+	uint16_t srgb_to_linear16[256]; // linear value * 65535
+	// Low and high bytes of srgb_to_linear16, for byte permutes
+	alignas(64) uint8_t srgb_to_linear16_lo[256];
+	alignas(64) uint8_t srgb_to_linear16_hi[256];
+	uint8_t linear_to_srgb[4097];   // indexed by linear value * 4096
+
+	MipgenTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			srgb_to_linear[i] = SRGBToLinear(float(i) / 255.0f);
+			unorm_to_float[i] = float(i) / 255.0f;
+			srgb_to_linear16[i] = uint16_t(srgb_to_linear[i] * 65535.0f + 0.5f);
+			srgb_to_linear16_lo[i] = uint8_t(srgb_to_linear16[i]);
+			srgb_to_linear16_hi[i] = uint8_t(srgb_to_linear16[i] >> 8);
+		}
+		for (uint32_t i = 0; i < CountOf(linear_to_srgb); i++) {
+			linear_to_srgb[i] = uint8_t(Clamp(LinearToSRGB(float(i) / 4096.0f), 0.0f, 1.0f) * 255.0f + 0.5f);
+		}
+	}
+};
+
+static const MipgenTables& GetMipgenTables() {
+	static const MipgenTables tables;
+	return tables;
+}
+
+#if MIPGEN_X86_DISPATCH
+struct MipgenCPU {
+	bool ssse3 = false;
+	// AVX-512 with byte permutes (VBMI), and the BW and VL subsets the kernels also use
+	bool avx512vbmi = false;
+
+	MipgenCPU() {
+		#if defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			int max_leaf = info[0];
+			__cpuid(info, 1);
+			ssse3 = (info[2] & (1 << 9)) != 0;
+			// AVX-512 also needs the OS to save the ZMM and mask registers, which XGETBV reports
+			bool os_avx512 = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0xE6) == 0xE6;
+			if (os_avx512 && max_leaf >= 7) {
+				__cpuidex(info, 7, 0);
+				bool f = (info[1] & (1 << 16)) != 0, bw = (info[1] & (1 << 30)) != 0;
+				bool vl = (info[1] & (1u << 31)) != 0, vbmi = (info[2] & (1 << 1)) != 0;
+				avx512vbmi = f && bw && vl && vbmi;
+			}
+		#else
+			__builtin_cpu_init();
+			ssse3 = __builtin_cpu_supports("ssse3");
+			avx512vbmi = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+				__builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512vbmi");
+		#endif
+	}
+};
+
+static const MipgenCPU& GetMipgenCPU() {
+	static const MipgenCPU cpu;
+	return cpu;
+}
+#endif
+
+// Images with 2 channels are treated as grey and alpha, like stb_image returns them.
+static FORCEINLINE constexpr bool IsAlphaChannel(uint32_t channels, uint32_t ch) {
+	return (channels == 2 || channels == 4) && ch == channels - 1;
+}
+
+// Source texels and weights that make up one destination texel along one axis.
+struct MipTaps {
+	uint32_t count;
+	uint32_t index[MipMaxTaps];
+	float weight[MipMaxTaps];
+};
+
+static float Bessel0(float x) {
+	// Power series of the zeroth order modified Bessel function of the first kind
+	float sum = 1.0f, term = 1.0f, q = x * x * 0.25f;
+	for (uint32_t k = 1; k < 32 && term > sum * 1e-7f; k++) {
+		term *= q / float(k * k);
+		sum += term;
+	}
+	return sum;
+}
+
+// Kaiser-windowed sinc, with x in destination texels.
+static float KaiserSinc(float x) {
+	float t = x / (MipKaiserWidth * 0.5f);
+	if (fabsf(t) >= 1.0f) { return 0.0f; }
+	float px = float(M_PI) * x;
+	float sinc = (fabsf(px) < 1e-5f) ? 1.0f : sinf(px) / px;
+	return sinc * Bessel0(MipKaiserAlpha * sqrtf(1.0f - t * t)) / Bessel0(MipKaiserAlpha);
+}
+
+static void ComputeMipTaps(MipFilter filter, uint32_t src_size, uint32_t dst_size, MipTaps* taps) {
+	float scale = float(src_size) / float(dst_size);
+	for (uint32_t x = 0; x < dst_size; x++) {
+		MipTaps& t = taps[x];
+		t.count = 0;
+		if (src_size == dst_size) {
+			t.index[0] = x;
+			t.weight[0] = 1.0f;
+			t.count = 1;
+		} else if (filter == MipFilter::Box && src_size == 2 * dst_size) {
+			t.index[0] = 2 * x;
+			t.index[1] = 2 * x + 1;
+			t.weight[0] = t.weight[1] = 0.5f;
+			t.count = 2;
+		} else if (filter == MipFilter::Box && src_size == 2 * dst_size + 1) {
+			// Polyphase box: each destination texel covers 2+1/n source texels, so that the odd
+			// one out is shared between its neighbours instead of being dropped.
+			float n = float(dst_size), w = float(src_size);
+			t.index[0] = 2 * x;
+			t.index[1] = 2 * x + 1;
+			t.index[2] = 2 * x + 2;
+			t.weight[0] = (n - float(x)) / w;
+			t.weight[1] = n / w;
+			t.weight[2] = (float(x) + 1.0f) / w;
+			t.count = 3;
+		} else {
+			// Kaiser, or a box over arbitrary sizes, sampled at source texel centres
+			float center = (float(x) + 0.5f) * scale;
+			float radius = (filter == MipFilter::Kaiser ? MipKaiserWidth * 0.5f : 0.5f) * scale;
+			int32_t first = int32_t(floorf(center - radius));
+			int32_t last = int32_t(ceilf(center + radius));
+			float sum = 0.0f;
+			for (int32_t s = first; s <= last && t.count < MipMaxTaps; s++) {
+				float d = (float(s) + 0.5f - center) / scale;
+				float weight = (filter == MipFilter::Kaiser) ? KaiserSinc(d) : (fabsf(d) < 0.5f ? 1.0f : 0.0f);
+				if (weight == 0.0f) { continue; }
+				t.index[t.count] = uint32_t(Clamp(s, 0, int32_t(src_size) - 1));
+				t.weight[t.count] = weight;
+				t.count++;
+				sum += weight;
+			}
+			for (uint32_t i = 0; i < t.count; i++) { t.weight[i] /= sum; }
+		}
+	}
+}
+
+struct MipLevelJob {
+	const uint8_t* src;
+	uint32_t src_w;
+	uint32_t src_h;
+	uint8_t* dst;
+	uint32_t dst_w;
+	uint32_t dst_h;
+	bool srgb;
+	const MipTaps* taps_x;
+	const MipTaps* taps_y;
+};
+
+// Scalar 2x2 box filter over destination texels begin to end of a row, given the two source rows.
+template <uint32_t C> static FORCEINLINE void BoxTexelsUnorm(const uint8_t* r0, const uint8_t* r1, uint8_t* d,
+	uint32_t begin, uint32_t end)
+{
+	for (uint32_t x = begin; x < end; x++) {
+		for (uint32_t ch = 0; ch < C; ch++) {
+			uint32_t i0 = 2 * x * C + ch, i1 = i0 + C;
+			d[x * C + ch] = uint8_t((r0[i0] + r0[i1] + r1[i0] + r1[i1] + 2) >> 2);
+		}
+	}
+}
+
+// Same as BoxTexelsUnorm for sRGB data. Colour goes through 16-bit linear values; alpha is averaged
+// as is.
+template <uint32_t C> static FORCEINLINE void BoxTexelsSRGB(const MipgenTables& t, const uint8_t* r0,
+	const uint8_t* r1, uint8_t* d, uint32_t begin, uint32_t end)
+{
+	for (uint32_t x = begin; x < end; x++) {
+		for (uint32_t ch = 0; ch < C; ch++) {
+			uint32_t i0 = 2 * x * C + ch, i1 = i0 + C;
+			if (IsAlphaChannel(C, ch)) {
+				d[x * C + ch] = uint8_t((r0[i0] + r0[i1] + r1[i0] + r1[i1] + 2) >> 2);
+			} else {
+				uint32_t sum = t.srgb_to_linear16[r0[i0]] + t.srgb_to_linear16[r0[i1]] +
+					t.srgb_to_linear16[r1[i0]] + t.srgb_to_linear16[r1[i1]];
+				// Average of the four, divided by 16 to index the table
+				d[x * C + ch] = t.linear_to_srgb[(sum + 32) >> 6];
+			}
+		}
+	}
+}
+
+// 2x2 box filter over UNORM data, for levels that are exactly half the size of their source.
+template <uint32_t C> static void BoxRowsUnorm(const MipLevelJob& job, uint32_t begin, uint32_t end) {
+	const size_t src_stride = size_t(job.src_w) * C, dst_stride = size_t(job.dst_w) * C;
+	for (uint32_t y = begin; y < end; y++) {
+		const uint8_t* r0 = job.src + 2 * y * src_stride;
+		const uint8_t* r1 = r0 + src_stride;
+		uint8_t* d = job.dst + y * dst_stride;
+		uint32_t x = 0;
+
+		#if MIPGEN_SSE2
+		const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+		if constexpr (C == 1) {
+			// Each 16-bit lane holds a horizontal pair of texels
+			const __m128i low = _mm_set1_epi16(0x00FF);
+			for (; x + 16 <= job.dst_w; x += 16) {
+				__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 2 * x));
+				__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 2 * x + 16));
+				__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 2 * x));
+				__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 2 * x + 16));
+				__m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, low), _mm_srli_epi16(a0, 8)),
+					_mm_add_epi16(_mm_and_si128(b0, low), _mm_srli_epi16(b0, 8)));
+				__m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, low), _mm_srli_epi16(a1, 8)),
+					_mm_add_epi16(_mm_and_si128(b1, low), _mm_srli_epi16(b1, 8)));
+				s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+				s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d + x), _mm_packus_epi16(s0, s1));
+			}
+		} else if constexpr (C == 2) {
+			// Widened to 16 bits, each texel is one 32-bit lane; even and odd lanes are added up
+			for (; x + 8 <= job.dst_w; x += 8) {
+				__m128i s[2];
+				for (uint32_t half = 0; half < 2; half++) {
+					size_t offset = size_t(x + 4 * half) * 4;
+					__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + offset));
+					__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + offset));
+					__m128 lo = _mm_castsi128_ps(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+					__m128 hi = _mm_castsi128_ps(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+					__m128i even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+					__m128i odd  = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+					s[half] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(even, odd), two), 2);
+				}
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 2 * x), _mm_packus_epi16(s[0], s[1]));
+			}
+		} else if constexpr (C == 4) {
+			// Widened to 16 bits, each 64-bit lane is one texel
+			for (; x + 4 <= job.dst_w; x += 4) {
+				__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 8 * x));
+				__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + 8 * x + 16));
+				__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 8 * x));
+				__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + 8 * x + 16));
+				__m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				__m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				__m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				__m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+				__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+				__m128i s1 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+				s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+				s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(d + 4 * x), _mm_packus_epi16(s0, s1));
+			}
+		}
+		// RGB has no SSE2 kernel, since there's no cheap way to deinterleave 3-byte texels without
+		// SSSE3's pshufb. BoxRowsUnormRGB_SSSE3 is used instead where available.
+		#elif MIPGEN_NEON
+		// De-interleaving loads put each channel in its own vector, so adjacent lanes are the
+		// horizontal pairs to add up
+		if constexpr (C == 1) {
+			for (; x + 8 <= job.dst_w; x += 8) {
+				uint16x8_t s = vpadalq_u8(vpaddlq_u8(vld1q_u8(r0 + 2 * x)), vld1q_u8(r1 + 2 * x));
+				vst1_u8(d + x, vrshrn_n_u16(s, 2));
+			}
+		} else {
+			#define MIPGEN_NEON_BOX(N) \
+				for (; x + 8 <= job.dst_w; x += 8) { \
+					uint8x16x##N##_t a = vld##N##q_u8(r0 + 2 * x * N); \
+					uint8x16x##N##_t b = vld##N##q_u8(r1 + 2 * x * N); \
+					uint8x8x##N##_t out; \
+					for (uint32_t ch = 0; ch < N; ch++) { \
+						out.val[ch] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(a.val[ch]), b.val[ch]), 2); \
+					} \
+					vst##N##_u8(d + x * N, out); \
+				}
+			if constexpr (C == 2) { MIPGEN_NEON_BOX(2) }
+			if constexpr (C == 3) { MIPGEN_NEON_BOX(3) }
+			if constexpr (C == 4) { MIPGEN_NEON_BOX(4) }
+			#undef MIPGEN_NEON_BOX
+		}
+		#endif
+
+		BoxTexelsUnorm<C>(r0, r1, d, x, job.dst_w);
+	}
+}
+
+// 2x2 box filter over sRGB data, see BoxTexelsSRGB.
+template <uint32_t C> static void BoxRowsSRGB(const MipLevelJob& job, uint32_t begin, uint32_t end) {
+	const MipgenTables& t = GetMipgenTables();
+	const size_t src_stride = size_t(job.src_w) * C, dst_stride = size_t(job.dst_w) * C;
+	for (uint32_t y = begin; y < end; y++) {
+		const uint8_t* r0 = job.src + 2 * y * src_stride;
+		BoxTexelsSRGB<C>(t, r0, r0 + src_stride, job.dst + y * dst_stride, 0, job.dst_w);
+	}
+}
+
+#if MIPGEN_X86_DISPATCH
+// Shuffles for splitting a run of source texels into the even and odd texels of each horizontal
+// pair, with one byte per destination channel. The run is loaded as two 16-byte halves; 0x80
+// zeroes a byte, so each half's shuffle fills in its own part and the results are ORed together.
+// RGB runs are 24 bytes (4 destination texels) with overlapping halves, and fill 12 bytes.
+struct MipDeinterleave {
+	alignas(16) int8_t even[2][16];
+	alignas(16) int8_t odd[2][16];
+	uint32_t second_half; // offset of the second half in bytes
+	uint32_t texels;      // destination texels per run
+	uint32_t bytes;       // destination bytes per run
+};
+
+#define Z -128
+static const MipDeinterleave MipDeinterleaves[4] = {
+	{
+		{{0, 2, 4, 6, 8, 10, 12, 14, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 0, 2, 4, 6, 8, 10, 12, 14}},
+		{{1, 3, 5, 7, 9, 11, 13, 15, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 1, 3, 5, 7, 9, 11, 13, 15}},
+		16, 16, 16,
+	}, {
+		{{0, 1, 4, 5, 8, 9, 12, 13, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 0, 1, 4, 5, 8, 9, 12, 13}},
+		{{2, 3, 6, 7, 10, 11, 14, 15, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 2, 3, 6, 7, 10, 11, 14, 15}},
+		16, 8, 16,
+	}, {
+		{{0, 1, 2, 6, 7, 8, 12, 13, 14, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, Z, 10, 11, 12, Z, Z, Z, Z}},
+		{{3, 4, 5, 9, 10, 11, 15, Z, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, 8, 9, 13, 14, 15, Z, Z, Z, Z}},
+		8, 4, 12,
+	}, {
+		{{0, 1, 2, 3, 8, 9, 10, 11, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 0, 1, 2, 3, 8, 9, 10, 11}},
+		{{4, 5, 6, 7, 12, 13, 14, 15, Z, Z, Z, Z, Z, Z, Z, Z}, {Z, Z, Z, Z, Z, Z, Z, Z, 4, 5, 6, 7, 12, 13, 14, 15}},
+		16, 4, 16,
+	},
+};
+#undef Z
+
+// Loads the run of source texels starting at src and splits it into even and odd texels.
+MIPGEN_TARGET("ssse3") static FORCEINLINE void Deinterleave(const MipDeinterleave& m, const uint8_t* src,
+	__m128i* even, __m128i* odd)
+{
+	__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+	__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + m.second_half));
+	*even = _mm_or_si128(
+		_mm_shuffle_epi8(a, _mm_load_si128(reinterpret_cast<const __m128i*>(m.even[0]))),
+		_mm_shuffle_epi8(b, _mm_load_si128(reinterpret_cast<const __m128i*>(m.even[1]))));
+	*odd = _mm_or_si128(
+		_mm_shuffle_epi8(a, _mm_load_si128(reinterpret_cast<const __m128i*>(m.odd[0]))),
+		_mm_shuffle_epi8(b, _mm_load_si128(reinterpret_cast<const __m128i*>(m.odd[1]))));
+}
+
+// Rounded average of four byte vectors, as in BoxTexelsUnorm.
+MIPGEN_TARGET("ssse3") static FORCEINLINE __m128i Average4(__m128i a, __m128i b, __m128i c, __m128i d) {
+	const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+	__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+	__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+		_mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+	return _mm_packus_epi16(lo, hi);
+}
+
+// Stores the 12 bytes of an RGB run, or all 16 bytes of any other run.
+MIPGEN_TARGET("ssse3") static FORCEINLINE void StoreRun(const MipDeinterleave& m, uint8_t* d, __m128i v) {
+	if (m.bytes == 16) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(d), v);
+	} else {
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(d), v);
+		uint32_t tail = uint32_t(_mm_cvtsi128_si32(_mm_srli_si128(v, 8)));
+		memcpy(d + 8, &tail, 4);
+	}
+}
+
+// RGB counterpart of the SSE2 kernels in BoxRowsUnorm.
+MIPGEN_TARGET("ssse3") static void BoxRowsUnormRGB_SSSE3(const MipLevelJob& job, uint32_t begin, uint32_t end) {
+	const MipDeinterleave& m = MipDeinterleaves[2];
+	const size_t src_stride = size_t(job.src_w) * 3, dst_stride = size_t(job.dst_w) * 3;
+	for (uint32_t y = begin; y < end; y++) {
+		const uint8_t* r0 = job.src + 2 * y * src_stride;
+		const uint8_t* r1 = r0 + src_stride;
+		uint8_t* d = job.dst + y * dst_stride;
+		uint32_t x = 0;
+		for (; x + m.texels <= job.dst_w; x += m.texels) {
+			__m128i e0, o0, e1, o1;
+			Deinterleave(m, r0 + 6 * x, &e0, &o0);
+			Deinterleave(m, r1 + 6 * x, &e1, &o1);
+			StoreRun(m, d + 3 * x, Average4(e0, o0, e1, o1));
+		}
+		BoxTexelsUnorm<3>(r0, r1, d, x, job.dst_w);
+	}
+}
+
+#define MIPGEN_TARGET_AVX512VBMI MIPGEN_TARGET("avx512f,avx512bw,avx512vl,avx512vbmi")
+
+// Looks up a 256-entry byte table for 64 bytes at once. Each permute covers 128 entries, and the
+// top bit of the index picks between the two.
+MIPGEN_TARGET_AVX512VBMI static FORCEINLINE __m512i LookupBytes(const uint8_t* table, __m512i index) {
+	const __m512i* t = reinterpret_cast<const __m512i*>(table);
+	__m512i low = _mm512_permutex2var_epi8(_mm512_load_si512(t + 0), index, _mm512_load_si512(t + 1));
+	__m512i high = _mm512_permutex2var_epi8(_mm512_load_si512(t + 2), index, _mm512_load_si512(t + 3));
+	return _mm512_mask_blend_epi8(_mm512_movepi8_mask(index), low, high);
+}
+
+// Adds up the 16-bit values in the four 128-bit lanes, giving 8 sums.
+MIPGEN_TARGET_AVX512VBMI static FORCEINLINE __m256i SumLanes(__m512i words) {
+	__m512i a = _mm512_cvtepu16_epi32(_mm512_castsi512_si256(words));
+	__m512i b = _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(words, 1));
+	__m512i s = _mm512_add_epi32(a, b);
+	return _mm256_add_epi32(_mm512_castsi512_si256(s), _mm512_extracti64x4_epi64(s, 1));
+}
+
+// 2x2 box filter over sRGB data, with exactly the same results as BoxTexelsSRGB. Each run is split
+// into even and odd texels as for RGB above, and the four source bytes of every destination byte
+// are converted to linear with byte permutes, 64 at a time. Converting back to sRGB is a lookup into
+// a 4097-entry table, which is still done one byte at a time. Alpha is averaged separately.
+template <uint32_t C> MIPGEN_TARGET_AVX512VBMI static void BoxRowsSRGB_AVX512(const MipLevelJob& job,
+	uint32_t begin, uint32_t end)
+{
+	const MipgenTables& t = GetMipgenTables();
+	const MipDeinterleave& m = MipDeinterleaves[C - 1];
+	const size_t src_stride = size_t(job.src_w) * C, dst_stride = size_t(job.dst_w) * C;
+	for (uint32_t y = begin; y < end; y++) {
+		const uint8_t* r0 = job.src + 2 * y * src_stride;
+		const uint8_t* r1 = r0 + src_stride;
+		uint8_t* d = job.dst + y * dst_stride;
+		uint32_t x = 0;
+		for (; x + m.texels <= job.dst_w; x += m.texels) {
+			__m128i e0, o0, e1, o1;
+			Deinterleave(m, r0 + 2 * C * x, &e0, &o0);
+			Deinterleave(m, r1 + 2 * C * x, &e1, &o1);
+			__m512i srgb = _mm512_inserti32x4(_mm512_inserti32x4(_mm512_inserti32x4(
+				_mm512_castsi128_si512(e0), e1, 1), o0, 2), o1, 3);
+			__m512i lo = LookupBytes(t.srgb_to_linear16_lo, srgb);
+			__m512i hi = LookupBytes(t.srgb_to_linear16_hi, srgb);
+
+			// Same rounding as BoxTexelsSRGB
+			const __m256i round = _mm256_set1_epi32(32);
+			alignas(32) uint32_t index[16];
+			__m256i sum_lo = SumLanes(_mm512_unpacklo_epi8(lo, hi));
+			__m256i sum_hi = SumLanes(_mm512_unpackhi_epi8(lo, hi));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(index), _mm256_srli_epi32(_mm256_add_epi32(sum_lo, round), 6));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(index + 8), _mm256_srli_epi32(_mm256_add_epi32(sum_hi, round), 6));
+
+			uint8_t* out = d + C * x;
+			if constexpr (C == 2 || C == 4) {
+				StoreRun(m, out, Average4(e0, o0, e1, o1));
+			}
+			for (uint32_t i = 0; i < m.bytes; i++) {
+				if (!IsAlphaChannel(C, i % C)) { out[i] = t.linear_to_srgb[index[i]]; }
+			}
+		}
+		BoxTexelsSRGB<C>(t, r0, r1, d, x, job.dst_w);
+	}
+}
+#endif
+
+// Separable filter with arbitrary taps, in floating point. The source rows the batch needs are
+// decoded to floats once, then filtered vertically into a row buffer, then horizontally into the
+// destination. Taps are in increasing order, so the batch's source rows are a contiguous range.
+template <uint32_t C> static void ResampleRows(const MipLevelJob& job, uint32_t begin, uint32_t end) {
+	const MipgenTables& t = GetMipgenTables();
+	const float* decode[C];
+	for (uint32_t ch = 0; ch < C; ch++) {
+		decode[ch] = (job.srgb && !IsAlphaChannel(C, ch)) ? t.srgb_to_linear : t.unorm_to_float;
+	}
+	const size_t src_stride = size_t(job.src_w) * C, dst_stride = size_t(job.dst_w) * C;
+
+	uint32_t first_row = UINT32_MAX, last_row = 0;
+	for (uint32_t y = begin; y < end; y++) {
+		const MipTaps& ty = job.taps_y[y];
+		for (uint32_t k = 0; k < ty.count; k++) {
+			first_row = Min(first_row, ty.index[k]);
+			last_row = Max(last_row, ty.index[k]);
+		}
+	}
+	size_t decoded_rows = last_row - first_row + 1;
+	float* decoded = static_cast<float*>(malloc((decoded_rows + 1) * src_stride * sizeof(float)));
+	CHECK_NOTNULL_F(decoded);
+	float* row = decoded + decoded_rows * src_stride;
+	for (size_t r = 0; r < decoded_rows; r++) {
+		const uint8_t* s = job.src + (first_row + r) * src_stride;
+		float* out = decoded + r * src_stride;
+		for (uint32_t x = 0; x < job.src_w; x++) {
+			for (uint32_t ch = 0; ch < C; ch++) { out[x * C + ch] = decode[ch][s[x * C + ch]]; }
+		}
+	}
+
+	for (uint32_t y = begin; y < end; y++) {
+		const MipTaps& ty = job.taps_y[y];
+		memset(row, 0, src_stride * sizeof(float));
+		for (uint32_t k = 0; k < ty.count; k++) {
+			const float* s = decoded + (ty.index[k] - first_row) * src_stride;
+			float weight = ty.weight[k];
+			for (size_t i = 0; i < src_stride; i++) { row[i] += weight * s[i]; }
+		}
+
+		uint8_t* d = job.dst + y * dst_stride;
+		for (uint32_t x = 0; x < job.dst_w; x++) {
+			const MipTaps& tx = job.taps_x[x];
+			float v[C] = {};
+			for (uint32_t k = 0; k < tx.count; k++) {
+				const float* s = &row[tx.index[k] * C];
+				for (uint32_t ch = 0; ch < C; ch++) { v[ch] += tx.weight[k] * s[ch]; }
+			}
+			for (uint32_t ch = 0; ch < C; ch++) {
+				// The Kaiser filter's negative lobes can overshoot
+				float c = Clamp(v[ch], 0.0f, 1.0f);
+				if (job.srgb && !IsAlphaChannel(C, ch)) {
+					d[x * C + ch] = t.linear_to_srgb[uint32_t(c * 4096.0f + 0.5f)];
+				} else {
+					d[x * C + ch] = uint8_t(c * 255.0f + 0.5f);
+				}
+			}
+		}
+	}
+	free(decoded);
+}
+
+typedef void (*MipRowsFunction)(const MipLevelJob& job, uint32_t begin, uint32_t end);
+
+#define MIPGEN_SELECT(kernel, channels) \
+	((channels) == 1 ? kernel<1> : (channels) == 2 ? kernel<2> : (channels) == 3 ? kernel<3> : kernel<4>)
+
+void GenerateMip(const uint8_t* src, uint32_t src_w, uint32_t src_h, uint8_t* dst, uint32_t dst_w,
+	uint32_t dst_h, uint8_t channels, const MipgenOptions& options)
+{
+	CHECK_F(channels >= 1 && channels <= 4);
+	CHECK_F(dst_w <= src_w && dst_h <= src_h);
+	MipLevelJob job = {
+		.src = src, .src_w = src_w, .src_h = src_h,
+		.dst = dst, .dst_w = dst_w, .dst_h = dst_h,
+		.srgb = options.srgb,
+		.taps_x = nullptr, .taps_y = nullptr,
+	};
+
+	MipRowsFunction rows;
+	MipTaps* taps = nullptr;
+	if (options.filter == MipFilter::Box && src_w == 2 * dst_w && src_h == 2 * dst_h) {
+		rows = options.srgb ? MIPGEN_SELECT(BoxRowsSRGB, channels) : MIPGEN_SELECT(BoxRowsUnorm, channels);
+		#if MIPGEN_X86_DISPATCH
+		const MipgenCPU& cpu = GetMipgenCPU();
+		if (options.srgb && cpu.avx512vbmi) {
+			rows = MIPGEN_SELECT(BoxRowsSRGB_AVX512, channels);
+		} else if (!options.srgb && channels == 3 && cpu.ssse3) {
+			rows = BoxRowsUnormRGB_SSSE3;
+		}
+		#endif
+	} else {
+		taps = static_cast<MipTaps*>(malloc((dst_w + dst_h) * sizeof(MipTaps)));
+		CHECK_NOTNULL_F(taps);
+		ComputeMipTaps(options.filter, src_w, dst_w, taps);
+		ComputeMipTaps(options.filter, src_h, dst_h, taps + dst_w);
+		job.taps_x = taps;
+		job.taps_y = taps + dst_w;
+		rows = MIPGEN_SELECT(ResampleRows, channels);
+	}
+
+	uint32_t batch_rows = Max(1U, MipBatchBytes / (dst_w * channels));
+	ParallelFor(dst_h, batch_rows, [&](uint32_t begin, uint32_t end) { rows(job, begin, end); });
+	free(taps);
+}
+
+// Fraction of texels whose alpha, multiplied by scale, passes an alpha test against cutoff (0-255).
+static float AlphaCoverage(const uint8_t* data, size_t texels, uint8_t channels, float cutoff, float scale) {
+	const uint8_t* alpha = data + channels - 1;
+	size_t covered = 0;
+	for (size_t i = 0; i < texels; i++) {
+		covered += (float(alpha[i * channels]) * scale >= cutoff);
+	}
+	return float(covered) / float(texels);
+}
+
+// Rescales alpha so that the level's coverage is as close as possible to the given one. Coverage
+// only grows with the scale, so the scale is found by bisection.
+static void PreserveAlphaCoverage(uint8_t* data, size_t texels, uint8_t channels, float cutoff, float coverage) {
+	float best_scale = 1.0f;
+	float best_error = fabsf(AlphaCoverage(data, texels, channels, cutoff, 1.0f) - coverage);
+	float lo = 0.0f, hi = 16.0f;
+	for (uint32_t i = 0; i < 12 && best_error > 0.0f; i++) {
+		float scale = 0.5f * (lo + hi);
+		float level_coverage = AlphaCoverage(data, texels, channels, cutoff, scale);
+		float error = fabsf(level_coverage - coverage);
+		if (error < best_error) {
+			best_scale = scale;
+			best_error = error;
+		}
+		if (level_coverage < coverage) { lo = scale; } else { hi = scale; }
+	}
+	if (best_scale == 1.0f) { return; }
+
+	uint8_t* alpha = data + channels - 1;
+	for (size_t i = 0; i < texels; i++) {
+		alpha[i * channels] = uint8_t(Min(255.0f, float(alpha[i * channels]) * best_scale + 0.5f));
+	}
+}
+
+void GenerateMipChain(uint8_t* const* levels, uint32_t width, uint32_t height, uint8_t channels,
+	uint8_t num_levels, const MipgenOptions& options)
+{
+	ProfileZone("Generate Mipmaps");
+	bool preserve_coverage = (options.alpha_cutoff >= 0.0f && IsAlphaChannel(channels, channels - 1));
+	float cutoff = options.alpha_cutoff * 255.0f;
+	float coverage = 0.0f;
+	if (preserve_coverage) {
+		coverage = AlphaCoverage(levels[0], size_t(width) * height, channels, cutoff, 1.0f);
+	}
+
+	for (uint32_t i = 1; i < num_levels; i++) {
+		uint32_t src_w = Max(1U, width >> (i - 1)), src_h = Max(1U, height >> (i - 1));
+		uint32_t dst_w = Max(1U, width >> i), dst_h = Max(1U, height >> i);
+		GenerateMip(levels[i - 1], src_w, src_h, levels[i], dst_w, dst_h, channels, options);
+		if (preserve_coverage) {
+			PreserveAlphaCoverage(levels[i], size_t(dst_w) * dst_h, channels, cutoff, coverage);
+		}
+	}
+}
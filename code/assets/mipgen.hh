@@ -0,0 +1,52 @@
+#pragma once
+#include "base/base.hh"
+
+#include <math.h>
+
+/* CPU mipmap generation for 8-bit UNORM images.
+ *
+ * Each level is filtered from the one above it. The 2x2 box filter has SIMD kernels for the common
+ * case of even dimensions: SSE2 and NEON, plus SSSE3 for RGB and AVX-512 VBMI for sRGB, which are
+ * picked at runtime if the CPU supports them. Odd dimensions use a 3-tap polyphase box, so that no
+ * source texels are dropped. The Kaiser filter is a windowed sinc, which keeps more detail in the smaller
+ * levels at some cost in speed. Colour channels of sRGB images are filtered in linear space, going
+ * through lookup tables on the way in and out; alpha is always filtered as is. Rows of each level
+ * are split across the job system's threads.
+ *
+ * For alpha-tested textures, the alpha of each generated level can be rescaled so that the fraction
+ * of texels passing the alpha test stays the same as in level 0. Without this, foliage and fences
+ * thin out and disappear in the distance, since averaging pushes alpha towards the cutoff.
+ */
+
+enum class MipFilter : uint8_t {
+	Box,
+	Kaiser,
+};
+
+struct MipgenOptions {
+	MipFilter filter = MipFilter::Box;
+	// Set if the colour channels are sRGB-encoded, e.g. for albedo and emissive textures.
+	bool srgb = false;
+	// If 0 or more, alpha test coverage at this cutoff is preserved. In the same units as the stored
+	// alpha values, i.e. 0 to 1.
+	float alpha_cutoff = -1.0f;
+};
+
+static inline float SRGBToLinear(float srgb) {
+	return (srgb <= 0.04045f) ? srgb / 12.92f : powf((srgb + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline float LinearToSRGB(float linear) {
+	return (linear <= 0.0031308f) ? linear * 12.92f : 1.055f * powf(linear, 1.0f / 2.4f) - 0.055f;
+}
+
+// Generates one level from the level above it. Both are tightly packed and have the same number of
+// channels. The destination is normally half the size of the source in each dimension (rounded
+// down, but at least 1), but any smaller size works.
+void GenerateMip(const uint8_t* src, uint32_t src_w, uint32_t src_h, uint8_t* dst, uint32_t dst_w,
+	uint32_t dst_h, uint8_t channels, const MipgenOptions& options);
+
+// Fills in levels 1 to num_levels-1 of a mip chain, given level 0. levels[i] must point to a buffer
+// for a level of max(1, width >> i) by max(1, height >> i) texels.
+void GenerateMipChain(uint8_t* const* levels, uint32_t width, uint32_t height, uint8_t channels,
+	uint8_t num_levels, const MipgenOptions& options);
@@ -1,18 +1,24 @@
 #include "assets/model.hh"
 #include "assets/asset_loader.hh"
-
-#include <unordered_map>
+#include "assets/irismodel.hh"
 
 #include <SDL.h>
 #include <parson.h>
+#include <algorithm>
 
 #include "base/debug.hh"
 #include "base/filesystem.hh"
+#include "base/hashmap.hh"
 #include "graphics/defaults.hh"
+#include "engine/profiler.hh"
 #include "scene/gameobject.hh"
 
 static bool ModelLoader_Initialised = false;
-static std::unordered_map<uint64_t, Model> ModelLoader_Cache = {};
+static HashMap<StringId, Model*> ModelLoader_Cache = {};
+
+// Cooked models are written next to their glTF file the first time it's loaded. Not on the web,
+// where the data directory is an in-memory copy that doesn't outlive the page.
+static constexpr bool ModelLoader_WriteCooked = !PLATFORM_WEB;
 
 void InitModelLoader() {
 	if (ModelLoader_Initialised) { return; }
@@ -20,14 +26,284 @@ void InitModelLoader() {
 	ModelLoader_Initialised = true;
 }
 
-Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
-	Model& model = ModelLoader_Cache[source_path_hash];
+// Builds a model from a cooked file. Returns false without touching the model if the files its
+// buffers point into can't be read.
+static bool LoadCookedModel(Model& model, const IrisModel& cooked, const String& directory) {
+	ProfileZone("Load Cooked Model");
+	float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
+	uint64_t time_start = SDL_GetPerformanceCounter();
+
+	// Like in the glTF path, the files stay mapped until the buffers have been uploaded
+	auto buffer_files = std::vector<MappedFile>(cooked.num_files);
+	for (uint32_t i = 0; i < cooked.num_files; i++) {
+		String path = String::frame_format("%s/%s", directory.cstr, cooked.string(cooked.files[i].path));
+		buffer_files[i] = MapFile(path, MappedFile::Random);
+		if (!buffer_files[i]) { return false; }
+	}
+	for (uint32_t i = 0; i < cooked.num_buffers; i++) {
+		const IrisModelBuffer& b = cooked.buffers[i];
+		if (uint64_t(b.offset) + b.size > buffer_files[b.file].size) { return false; }
+	}
+
+	auto buffers = std::vector<Buffer*>(cooked.num_buffers);
+	auto gl_buffers = std::vector<GLuint>(buffers.size());
+	glGenBuffers(GLsizei(gl_buffers.size()), gl_buffers.data());
+	for (uint32_t i = 0; i < cooked.num_buffers; i++) {
+		const IrisModelBuffer& b = cooked.buffers[i];
+		buffers[i] = new Buffer(BufferUsage(b.usage), b.size, &buffer_files[b.file].data[b.offset]);
+		buffers[i]->gpu_handle = gl_buffers[i];
+	}
+
+	auto samplers = std::vector<Sampler*>(cooked.num_samplers);
+	for (uint32_t i = 0; i < cooked.num_samplers; i++) {
+		const IrisModelSampler& smp = cooked.samplers[i];
+		samplers[i] = GetSampler({.min_filter = smp.min_filter, .mag_filter = smp.mag_filter,
+			.wrap_s = smp.wrap_s, .wrap_t = smp.wrap_t});
+	}
+
+	auto textures = std::vector<Texture*>(cooked.num_textures);
+	for (uint32_t i = 0; i < cooked.num_textures; i++) {
+		const IrisModelTexture& tex = cooked.textures[i];
+		if (tex.path == IrisModelNone) { continue; }
+		MipgenOptions mipgen = {.filter = MipFilter(tex.filter), .srgb = bool(tex.srgb), .alpha_cutoff = tex.alpha_cutoff};
+		String src = String::frame_format("%s/%s", directory.cstr, cooked.string(tex.path));
+		textures[i] = GetTexture(src, tex.generate_mips, DeferPriority::Normal, mipgen,
+			TextureCompression(tex.compression));
+	}
+
+	auto materials = std::vector<Material*>(cooked.num_materials);
+	for (uint32_t i = 0; i < cooked.num_materials; i++) {
+		const IrisModelMaterial& cm = cooked.materials[i];
+		materials[i] = new Material();
+		Material& m = *materials[i];
+		m.blend_mode = BlendMode(cm.blend_mode);
+		m.face_culling_mode = cm.face_culling_mode;
+		m.stipple_hard_cutoff = cm.stipple_hard_cutoff;
+		m.stipple_soft_cutoff = cm.stipple_soft_cutoff;
+		for (uint32_t j = 0; j < cm.num_uniforms; j++) {
+			const IrisModelMaterial::Uniform& cu = cm.uniforms[j];
+			UniformValue& u = m.uniforms[m.num_uniforms++];
+			u.uniform = Uniforms::all[cu.index];
+			u.etype = ElementType(cu.etype);
+			u.ctype = ComponentType(cu.ctype);
+			// Every member of the value union starts at the same address
+			memcpy(&u.mat4x4, cu.value, sizeof(cu.value));
+		}
+		for (uint32_t j = 0; j < cm.num_samplers; j++) {
+			const IrisModelMaterial::Sampler& cs = cm.samplers[j];
+			SamplerBinding& binding = m.samplers[m.num_samplers++];
+			binding.uniform = Uniforms::all[cs.uniform];
+			switch (cs.texture) {
+				case IrisModelNone: break;
+				case IrisModelTextureWhite: binding.texture = &Textures::White_1x1; break;
+				case IrisModelTextureBlack: binding.texture = &Textures::Black_1x1; break;
+				default: binding.texture = textures[cs.texture]; break;
+			}
+			switch (cs.sampler) {
+				case IrisModelNone: break;
+				case IrisModelSamplerNearestRepeat: binding.sampler = &Samplers::NearestRepeat; break;
+				default: binding.sampler = samplers[cs.sampler]; break;
+			}
+		}
+	}
+
+	auto resolve_view = [&](const IrisModelView& view) {
+		BufferView bv = {};
+		if (view.buffer != IrisModelNone) {
+			bv.buffer = buffers[view.buffer];
+			bv.etype = ElementType(view.etype);
+			bv.ctype = ComponentType(view.ctype);
+			bv.elements = view.elements;
+			bv.offset = view.offset;
+		}
+		return bv;
+	};
+	auto meshes = std::vector<Mesh*>(cooked.num_meshes);
+	for (uint32_t i = 0; i < cooked.num_meshes; i++) {
+		const IrisModelMesh& cm = cooked.meshes[i];
+		meshes[i] = new Mesh();
+		Mesh& mesh = *meshes[i];
+		mesh.ptype = PrimitiveType(cm.ptype);
+		mesh.index_buffer = resolve_view(cm.index_buffer);
+		for (uint32_t j = 0; j < Mesh::MaxVertexAttribs; j++) {
+			mesh.vertex_attribs[j] = resolve_view(cm.vertex_attribs[j]);
+		}
+		mesh.aabb_half_extents = cm.aabb_half_extents;
+		mesh.aabb_center = cm.aabb_center;
+		mesh.uv_density = cm.uv_density;
+	}
+
+	// Same structure as the glTF path builds: every node is a child of the root object, with its
+	// parent pointer set to its glTF parent
+	model.root_object = new GameObject(String::frame_format("Model %s", model.display_name.cstr));
+	auto objects = std::vector<GameObject*>(cooked.num_nodes);
+	for (uint32_t i = 0; i < cooked.num_nodes; i++) {
+		String name = String::frame_format("Node %s #%u", model.display_name.cstr, i);
+		objects[i] = model.root_object->AddNew<GameObject>(name);
+	}
+	for (uint32_t i = 0; i < cooked.num_nodes; i++) {
+		const IrisModelNode& node = cooked.nodes[i];
+		GameObject& obj = *objects[i];
+		if (node.parent != IrisModelNone) { obj.parent = objects[node.parent]; }
+		obj.position = node.position;
+		obj.scale = node.scale;
+		obj.rotation = node.rotation;
+		for (uint32_t j = node.first_mesh; j < node.first_mesh + node.num_meshes; j++) {
+			obj.AddNew<MeshInstance>(meshes[j], materials[cooked.meshes[j].material]);
+		}
+	}
+	uint64_t time_scene = SDL_GetPerformanceCounter();
+
+	BeginProfileZone("Upload Cooked Model Buffers");
+	uint32_t buffer_bytes_used = 0;
+	for (Buffer* buffer : buffers) {
+		buffer->upload();
+		buffer_bytes_used += buffer->size;
+	}
+	for (Mesh* mesh : meshes) { mesh->upload(); }
+	EndProfileZone();
+
+	LOG_F(INFO, "-> %u buffers (%.03f MiB), %u textures, %u materials, %u meshes, %u nodes; scene graph "
+		"ready in %.03f ms, uploaded in %.03f ms", cooked.num_buffers, float(buffer_bytes_used) / 1048576.0f,
+		cooked.num_textures, cooked.num_materials, cooked.num_meshes, cooked.num_nodes,
+		float(time_scene - time_start) / ticks_per_msec,
+		float(SDL_GetPerformanceCounter() - time_scene) / ticks_per_msec);
+
+	model.buffers = std::move(buffers);
+	model.textures = std::move(textures);
+	model.samplers = std::move(samplers);
+	model.materials = std::move(materials);
+	model.meshes = std::move(meshes);
+	model.objects = std::move(objects);
+	return true;
+}
+
+// Fills in the parts of the cooked model that can be read back from the loaded Model, and writes it.
+// Models that the format can't represent aren't cooked.
+static void CookModel(const Model& model, IrisModelData& cook, const String& cooked_path) {
+	ProfileZone("Cook Model");
+	auto index_of = [](const auto& vector, const auto* item) {
+		auto it = std::find(vector.begin(), vector.end(), item);
+		return (it == vector.end()) ? IrisModelNone : uint32_t(it - vector.begin());
+	};
+	HashMap<const Buffer*, uint32_t> buffer_indices;
+	for (uint32_t i = 0; i < model.buffers.size(); i++) { buffer_indices[model.buffers[i]] = i; }
+	auto cook_view = [&](const BufferView& view) {
+		IrisModelView cv = {.buffer = IrisModelNone};
+		if (view.buffer) {
+			const uint32_t* index = buffer_indices.find(view.buffer);
+			cv.buffer = index ? *index : IrisModelNone;
+			cv.elements = view.elements;
+			cv.offset = view.offset;
+			cv.etype = view.etype.v;
+			cv.ctype = view.ctype.v;
+		}
+		return cv;
+	};
+
+	for (uint32_t i = 0; i < model.buffers.size(); i++) { cook.buffers[i].usage = model.buffers[i]->usage.v; }
+	for (const Sampler* sampler : model.samplers) {
+		const SamplerParams& p = sampler->params;
+		cook.samplers.push_back({p.min_filter, p.mag_filter, p.wrap_s, p.wrap_t});
+	}
+
+	for (const Material* material : model.materials) {
+		const Material& m = *material;
+		if (m.num_uniforms > IrisModelMaterial::MaxUniforms || m.num_samplers > IrisModelMaterial::MaxSamplers) {
+			LOG_F(WARNING, "Not cooking %s: material has too many uniforms or samplers", model.source_path.cstr);
+			return;
+		}
+		IrisModelMaterial& cm = cook.materials.emplace_back();
+		cm = {};
+		cm.blend_mode = uint8_t(m.blend_mode);
+		cm.num_uniforms = uint8_t(m.num_uniforms);
+		cm.num_samplers = uint8_t(m.num_samplers);
+		cm.face_culling_mode = m.face_culling_mode;
+		cm.stipple_hard_cutoff = m.stipple_hard_cutoff;
+		cm.stipple_soft_cutoff = m.stipple_soft_cutoff;
+		for (uint32_t j = 0; j < m.num_uniforms; j++) {
+			const UniformValue& u = m.uniforms[j];
+			IrisModelMaterial::Uniform& cu = cm.uniforms[j];
+			if (u.etype.components() * u.ctype.bytes() > sizeof(cu.value)) {
+				LOG_F(WARNING, "Not cooking %s: material uniform %s is too large", model.source_path.cstr, u.uniform.name);
+				return;
+			}
+			cu.index = u.uniform.index;
+			cu.etype = u.etype.v;
+			cu.ctype = u.ctype.v;
+			memcpy(cu.value, &u.mat4x4, sizeof(cu.value));
+		}
+		for (uint32_t j = 0; j < m.num_samplers; j++) {
+			const SamplerBinding& binding = m.samplers[j];
+			IrisModelMaterial::Sampler& cs = cm.samplers[j];
+			cs.uniform = binding.uniform.index;
+			if (binding.texture == &Textures::White_1x1) {
+				cs.texture = IrisModelTextureWhite;
+			} else if (binding.texture == &Textures::Black_1x1) {
+				cs.texture = IrisModelTextureBlack;
+			} else {
+				cs.texture = binding.texture ? index_of(model.textures, binding.texture) : IrisModelNone;
+			}
+			if (binding.sampler == &Samplers::NearestRepeat) {
+				cs.sampler = IrisModelSamplerNearestRepeat;
+			} else {
+				cs.sampler = binding.sampler ? index_of(model.samplers, binding.sampler) : IrisModelNone;
+			}
+		}
+	}
+
+	// Meshes are stored in the order the nodes use them, one per MeshInstance
+	HashMap<const GameObject*, uint32_t> node_indices;
+	for (uint32_t i = 0; i < model.objects.size(); i++) { node_indices[model.objects[i]] = i; }
+	for (GameObject* obj : model.objects) {
+		const uint32_t* parent = node_indices.find(obj->parent);
+		IrisModelNode& node = cook.nodes.emplace_back();
+		node = {
+			.parent = parent ? *parent : IrisModelNone,
+			.first_mesh = uint32_t(cook.meshes.size()),
+			.num_meshes = 0,
+			.position = obj->position,
+			.scale = obj->scale,
+			.rotation = obj->rotation,
+		};
+		for (GameObject& child : *obj) {
+			MeshInstance* instance = dynamic_cast<MeshInstance*>(&child);
+			if (!instance) { continue; }
+			const Mesh& mesh = *instance->mesh;
+			IrisModelMesh& cm = cook.meshes.emplace_back();
+			cm = {};
+			for (uint32_t i = 0; i < Mesh::MaxVertexAttribs; i++) { cm.vertex_attribs[i] = cook_view(mesh.vertex_attribs[i]); }
+			cm.index_buffer = cook_view(mesh.index_buffer);
+			cm.material = index_of(model.materials, instance->material);
+			if (cm.material == IrisModelNone) {
+				LOG_F(WARNING, "Not cooking %s: mesh uses a material from elsewhere", model.source_path.cstr);
+				return;
+			}
+			cm.ptype = uint8_t(mesh.ptype.v);
+			cm.aabb_half_extents = mesh.aabb_half_extents;
+			cm.aabb_center = mesh.aabb_center;
+			cm.uv_density = mesh.uv_density;
+			node.num_meshes++;
+		}
+	}
+
+	if (WriteIrisModel(cooked_path, cook)) {
+		LOG_F(INFO, "-> cooked into %s", cooked_path.cstr);
+	}
+}
+
+Model* GetModelFromGLTF(StringId source_path_id) {
+	Model*& cached = ModelLoader_Cache[source_path_id];
+	if (!cached) { cached = new Model(); }
+	Model& model = *cached;
 	if (model.source_path != nullptr) { return &model; }
+	ProfileZone("Load glTF Model");
 
 	float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
 	uint64_t time_get_start = SDL_GetPerformanceCounter();
 
-	model.source_path = String::copy(source_path);
+	const char* source_path = source_path_id.cstr();
+	model.source_path = String::view(source_path);
 
 	char* last_slash = nullptr;
 	for (char& chr : model.source_path) {
@@ -43,7 +319,25 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 	LOG_F(INFO, "Loading model from path %s", model.source_path.cstr);
 	LOG_F(INFO, "-> directory [%s] name [%s]", gltf_directory.cstr, model.display_name.cstr);
 
+	String cooked_path = GetIrisModelPath(model.source_path);
+	IrisModel cooked;
+	if (LoadIrisModel(cooked_path, model.source_path, gltf_directory, &cooked) &&
+		LoadCookedModel(model, cooked, gltf_directory))
+	{
+		uint64_t time_end = SDL_GetPerformanceCounter();
+		LOG_F(INFO, "-> model %s loaded from %s in %.03f ms", model.display_name.cstr, cooked_path.cstr,
+			float(time_end - time_get_start) / ticks_per_msec);
+		return &model;
+	}
+
+	// Everything the cooked file needs that the Model doesn't keep track of is collected on the way
+	IrisModelData cook;
+	bool cookable = ModelLoader_WriteCooked;
+	cook.source_mtime = GetFileModificationTime(model.source_path);
+
+	BeginProfileZone("Parse glTF");
 	JSON_Value* rootval = json_parse_file_with_comments(source_path);
+	EndProfileZone();
 	if (!rootval) {
 		LOG_F(ERROR, "Failed to parse GLTF JSON file: %s", source_path);
 		return &model;
@@ -59,23 +353,35 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 	// Note that GLTF buffers may contain both vertex and index data, so we can't directly upload
 	// them to OpenGL because of WebGL2 limitations. We'll have to extract bits of them manually.
 	JSON_Array* jbuffers = json_object_get_array(root, "buffers");
-	auto buffer_sizes = std::vector<size_t>(json_array_get_count(jbuffers));
-	auto buffer_datas = std::vector<uint8_t*>(json_array_get_count(jbuffers));
+	// The files stay mapped until the end of this function, by which point every Buffer has been
+	// uploaded to the GPU and no longer points into them.
+	BeginProfileZone("Map glTF Buffers");
+	auto buffer_files = std::vector<MappedFile>(json_array_get_count(jbuffers));
 	for (uint32_t igbuf = 0; igbuf < json_array_get_count(jbuffers); igbuf++) {
 		JSON_Object* jbuf = json_array_get_object(jbuffers, igbuf);
 		// TODO: This can be a data URI, maybe we should support that?
 		const char* uri = json_object_get_string(jbuf, "uri");
 		uint32_t size = (uint32_t) json_object_get_number(jbuf, "byteLength");
 		if (uri && size) {
-			String src = String::format("%s/%s", gltf_directory.cstr, uri);
-			buffer_sizes[igbuf] = size;
-			buffer_datas[igbuf] = reinterpret_cast<uint8_t*>(ReadFile(src).leak_mut());
+			String src = String::frame_format("%s/%s", gltf_directory.cstr, uri);
+			cook.files.push_back({.path = cook.add_string(uri), .mtime = GetFileModificationTime(src)});
+			buffer_files[igbuf] = MapFile(src, MappedFile::Random);
+			if (buffer_files[igbuf] && buffer_files[igbuf].size < size) {
+				// Views into it could read past the end of the mapping, so it's treated as missing
+				LOG_F(ERROR, "Buffer %u (%s) is %zu bytes, expected %u", igbuf, uri, buffer_files[igbuf].size, size);
+				buffer_files[igbuf] = MappedFile();
+				cookable = false;
+				continue;
+			}
 		}
-		if (!buffer_datas[igbuf]) {
+		if (!buffer_files[igbuf]) {
 			LOG_F(WARNING, "Failed to read buffer %u (%s) from model", igbuf, uri);
+			cookable = false;
 		}
 	}
 
+	EndProfileZone();
+
 	// Convert GLTF buffer-views to Buffer objects:
 	JSON_Array* jbufferviews = json_object_get_array(root, "bufferViews");
 	auto buffers = std::vector<Buffer*>(json_array_get_count(jbufferviews));
@@ -89,8 +395,14 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 		// always be inferred from the accessor properties?
 		buffers[ibuf] = new Buffer();
 		buffers[ibuf]->size = uint32_t(json_object_get_number(jbv, "byteLength"));
-		buffers[ibuf]->cpu_buffer = &buffer_datas[igbuf][offset];
 		buffers[ibuf]->gpu_handle = gl_buffers[ibuf];
+		// Buffers whose file couldn't be read are left without data, and meshes that use them skipped
+		const MappedFile& file = buffer_files[igbuf];
+		if (file && uint64_t(offset) + buffers[ibuf]->size <= file.size) {
+			buffers[ibuf]->cpu_buffer = &file.data[offset];
+		}
+		// Buffers with files that couldn't be read make the model uncookable, so igbuf is the file
+		cook.buffers.push_back({.file = igbuf, .offset = offset, .size = buffers[ibuf]->size});
 	}
 
 	// Convert GLTF accessors to BufferView objects:
@@ -172,27 +484,81 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 	// Create Texture objects from GLTF images:
 	JSON_Array* jimages = json_object_get_array(root, "images");
 	JSON_Array* jtextures = json_object_get_array(root, "textures");
+	BeginProfileZone("Request glTF Textures");
 	auto textures = std::vector<Texture*>(json_array_get_count(jimages));
 	uint32_t texture_bytes_used = 0;
-	for (uint32_t iimg = 0; iimg < json_array_get_count(jimages); iimg++) {
-		JSON_Object* jimg = json_array_get_object(jimages, iimg);
-
-		bool texture_needs_mips = false;
-		for (uint32_t itex = 0; itex < json_array_get_count(jtextures); itex++) {
-			JSON_Object* jtex = json_array_get_object(jtextures, itex);
-			if (json_object_has_value(jtex, "source") && json_object_has_value(jtex, "sampler") &&
-				uint32_t(json_object_get_number(jtex, "source")) == iimg)
-			{
-				uint32_t ismp = uint32_t(json_object_get_number(jtex, "sampler"));
-				if (sampler_needs_mips[ismp]) { texture_needs_mips = true; break; }
-			}
+	// Only counts textures whose files were already read, e.g. by an earlier model. Duplicates found
+	// later are logged by the texture loader.
+	uint32_t texture_bytes_deduplicated = 0;
+
+	// Albedo textures are sRGB, so their mips are filtered in linear space. Alpha-tested ones also
+	// keep their alpha test coverage. gbuffer.frag linearises alpha along with the colour, so the
+	// cutoff is converted to the stored encoding. Each texture is block-compressed according to the
+	// channels its uses read; images used in several ways get the format that keeps the most.
+	JSON_Array* jmaterials = json_object_get_array(root, "materials");
+	auto texture_mipgen = std::vector<MipgenOptions>(json_array_get_count(jimages));
+	auto texture_compression = std::vector<TextureCompression>(json_array_get_count(jimages));
+	auto image_index = [&](JSON_Object* jtexinfo) -> int32_t {
+		if (!jtexinfo) { return -1; }
+		JSON_Object* jtex = json_array_get_object(jtextures, (int) json_object_get_number(jtexinfo, "index"));
+		if (!jtex || !json_object_has_value(jtex, "source")) { return -1; }
+		uint32_t iimg = uint32_t(json_object_get_number(jtex, "source"));
+		return (iimg < texture_mipgen.size()) ? int32_t(iimg) : -1;
+	};
+	auto use_compression = [&](int32_t iimg, TextureCompression compression) {
+		if (iimg >= 0) { texture_compression[iimg] = Max(texture_compression[iimg], compression); }
+	};
+	for (uint32_t imat = 0; imat < json_array_get_count(jmaterials); imat++) {
+		JSON_Object* jmat = json_array_get_object(jmaterials, imat);
+		JSON_Object* jmr = json_object_get_object(jmat, "pbrMetallicRoughness");
+		bool opaque = !json_object_has_value(jmat, "alphaMode") ||
+			Hash64(json_object_get_string(jmat, "alphaMode")) == Hash64("OPAQUE");
+		use_compression(image_index(json_object_get_object(jmat, "normalTexture")), TextureCompression::BC5);
+		use_compression(image_index(json_object_get_object(jmat, "occlusionTexture")), TextureCompression::BC4);
+		use_compression(image_index(json_object_get_object(jmat, "emissiveTexture")), TextureCompression::BC1);
+		if (!jmr) { continue; }
+		use_compression(image_index(json_object_get_object(jmr, "metallicRoughnessTexture")), TextureCompression::BC1);
+
+		int32_t iimg = image_index(json_object_get_object(jmr, "baseColorTexture"));
+		if (iimg < 0) { continue; }
+		use_compression(iimg, opaque ? TextureCompression::BC1 : TextureCompression::BC3);
+		MipgenOptions& mipgen = texture_mipgen[iimg];
+		mipgen.srgb = true;
+		if (Hash64(json_object_get_string(jmat, "alphaMode")) == Hash64("MASK")) {
+			float cutoff = json_object_has_value(jmat, "alphaCutoff") ?
+				float(json_object_get_number(jmat, "alphaCutoff")) : 0.5f;
+			mipgen.alpha_cutoff = Max(mipgen.alpha_cutoff, LinearToSRGB(cutoff));
 		}
+	}
+
+	// Images sampled with a mipmapping sampler by any texture need mips
+	auto texture_needs_mips = std::vector<bool>(json_array_get_count(jimages));
+	for (uint32_t itex = 0; itex < json_array_get_count(jtextures); itex++) {
+		JSON_Object* jtex = json_array_get_object(jtextures, itex);
+		if (!json_object_has_value(jtex, "source") || !json_object_has_value(jtex, "sampler")) { continue; }
+		uint32_t iimg = uint32_t(json_object_get_number(jtex, "source"));
+		uint32_t ismp = uint32_t(json_object_get_number(jtex, "sampler"));
+		if (iimg < texture_needs_mips.size() && sampler_needs_mips[ismp]) { texture_needs_mips[iimg] = true; }
+	}
 
+	for (uint32_t iimg = 0; iimg < json_array_get_count(jimages); iimg++) {
+		JSON_Object* jimg = json_array_get_object(jimages, iimg);
 		const char* uri = json_object_get_string(jimg, "uri");
+		cook.textures.push_back({
+			.path = uri ? cook.add_string(uri) : IrisModelNone,
+			.generate_mips = texture_needs_mips[iimg],
+			.filter = uint8_t(texture_mipgen[iimg].filter),
+			.srgb = texture_mipgen[iimg].srgb,
+			.compression = uint8_t(texture_compression[iimg]),
+			.alpha_cutoff = texture_mipgen[iimg].alpha_cutoff,
+		});
 		if (uri) {
-			String src = String::format("%s/%s", gltf_directory.cstr, uri);
-			textures[iimg] = GetTexture(src, texture_needs_mips);
+			// GetTexture interns the path, so it only needs to live until the call returns
+			String src = String::frame_format("%s/%s", gltf_directory.cstr, uri);
+			textures[iimg] = GetTexture(src, texture_needs_mips[iimg], DeferPriority::Normal, texture_mipgen[iimg],
+				texture_compression[iimg]);
 			texture_bytes_used += textures[iimg]->size();
+			if (textures[iimg]->alias) { texture_bytes_deduplicated += textures[iimg]->alias->size(); }
 			LOG_F(INFO, "-> img=%u %ux%u levels=%u gl=%u %s", iimg, textures[iimg]->width, textures[iimg]->height,
 				textures[iimg]->num_levels, textures[iimg]->gl_texture, uri);
 		} else {
@@ -200,8 +566,9 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 		}
 	}
 
+	EndProfileZone();
+
 	// Extract materials:
-	JSON_Array* jmaterials = json_object_get_array(root, "materials");
 	auto materials = std::vector<Material*>(json_array_get_count(jmaterials));
 	for (uint32_t imat = 0; imat < json_array_get_count(jmaterials); imat++) {
 		materials[imat] = new Material();
@@ -406,6 +773,19 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 			JSON_Object* jattr = json_object_get_object(jprim, "attributes");
 			if (!jattr || !json_object_has_value(jprim, "material")) { continue; }
 
+			// Every accessor the primitive uses must have been loaded, with its buffer's data
+			auto has_data = [&](JSON_Object* obj, const char* name) {
+				if (!json_object_has_value(obj, name)) { return true; }
+				BufferView* view = buffer_views[uint32_t(json_object_get_number(obj, name))];
+				return view && view->buffer->cpu_buffer;
+			};
+			bool complete = has_data(jprim, "indices");
+			for (Attributes::Item attr : Attributes::all) { complete = complete && has_data(jattr, attr.gltf_name); }
+			if (!complete) {
+				LOG_F(ERROR, "Skipping mesh %u prim %u: some of its buffers couldn't be loaded", igltfmesh, iprim);
+				continue;
+			}
+
 			// Create a Mesh and a MeshInstance object for this primitive.
 			// TODO: Ideally we would detect when a primitive can use a pre-existing Mesh (if the
 			// parameters and accessors are the same).
@@ -446,6 +826,7 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 			}
 
 			mesh.compute_aabb();
+			mesh.compute_uv_density();
 
 			LOG_F(INFO, "-> mesh=%u prim=%u <%p> mat=%u %s %s", igltfmesh, iprim, &mesh, imat,
 				mesh.ptype.name(), debug_str.cstr);
@@ -467,16 +848,19 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 	}
 
 	// Upload buffers to the GPU now that we have usage info for them
+	BeginProfileZone("Upload glTF Buffers");
 	uint32_t buffer_bytes_used = 0;
 	for (uint32_t ibuf = 0; ibuf < buffers.size(); ibuf++) {
+		if (!buffers[ibuf]->cpu_buffer) { continue; }
 		buffers[ibuf]->upload();
 		buffer_bytes_used += buffers[ibuf]->size;
 	}
 
 	// Set up GL vertex array object for each mesh and enable vertex attribute arrays
 	for (uint32_t imesh = 0; imesh < meshes.size(); imesh++) {
-		meshes[imesh]->upload();
+		if (meshes[imesh]) { meshes[imesh]->upload(); }
 	}
+	EndProfileZone();
 
 	model.buffers = std::move(buffers);
 	model.textures = std::move(textures);
@@ -487,12 +871,15 @@ Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path) {
 
 	json_value_free(rootval);
 
+	if (cookable) { CookModel(model, cook, cooked_path); }
+
 	uint64_t time_end = SDL_GetPerformanceCounter();
-	LOG_F(INFO, "-> model %s loaded in %.03f ms, %.03f MiB buffers, %.03f MiB textures",
+	LOG_F(INFO, "-> model %s loaded in %.03f ms, %.03f MiB buffers, %.03f MiB textures (%.03f MiB deduplicated)",
 		model.display_name.cstr,
 		float(time_end - time_get_start) / ticks_per_msec,
 		float(buffer_bytes_used) / 1048576.0f,
-		float(texture_bytes_used) / 1048576.0f);
+		float(texture_bytes_used) / 1048576.0f,
+		float(texture_bytes_deduplicated) / 1048576.0f);
 
 	return &model;
 }
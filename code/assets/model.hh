@@ -5,6 +5,7 @@
 #include "base/base.hh"
 #include "base/string.hh"
 #include "base/hash.hh"
+#include "base/stringid.hh"
 #include "assets/texture.hh"
 #include "assets/mesh.hh"
 #include "assets/material.hh"
@@ -22,8 +23,8 @@ struct Model {
 	std::vector<GameObject*> objects;
 };
 
-Model* GetModelFromGLTF(uint64_t source_path_hash, const char* source_path);
+Model* GetModelFromGLTF(StringId source_path);
 
 static Model* GetModelFromGLTF(const char* source_path) {
-	return GetModelFromGLTF(Hash64(source_path), source_path);
+	return GetModelFromGLTF(StringId::intern(source_path));
 }
@@ -2,22 +2,32 @@
 #include "assets/asset_loader.hh"
 
 #include <stdarg.h>
-#include <unordered_map>
 #include <functional>
 
 #include <stb_sprintf.h>
 
 #include "base/debug.hh"
 #include "base/hash.hh"
+#include "base/hashmap.hh"
 #include "base/filesystem.hh"
+#include "base/filewatch.hh"
 #include "engine/engine.hh"
+#include "engine/profiler.hh"
 
 static bool ShaderLoader_Initialised = false;
 
 StaticAssert(sizeof(VertShader) == sizeof(Shader));
 StaticAssert(sizeof(FragShader) == sizeof(Shader));
-static std::unordered_map<uint64_t, Shader> ShaderCache = {};
-static std::unordered_map<uint64_t, Program> ProgramCache = {};
+struct ProgramKey {
+	VertShader* vsh;
+	FragShader* fsh;
+	constexpr bool operator==(const ProgramKey& rhs) const { return vsh == rhs.vsh && fsh == rhs.fsh; }
+	constexpr bool operator!=(const ProgramKey& rhs) const { return !(*this == rhs); }
+};
+
+// Values are heap-allocated, since programs and materials hold on to the returned pointers.
+static HashMap<StringId, Shader*> ShaderCache = {};
+static HashMap<ProgramKey, Program*> ProgramCache = {};
 
 void InitShaderLoader() {
 	if (ShaderLoader_Initialised) { return; }
@@ -116,11 +126,12 @@ static bool UpdateShaderDefines(const Engine& engine) {
 }
 
 static void LoadShaderFromDisk(Shader& shader) {
-	shader.mtime = GetFileModificationTime(shader.source_path);
-	shader.source_code = ReadFile(shader.source_path);
+	ProfileZone("Compile Shader");
+	MappedFile source = MapFile(shader.source_path);
 
 	const char* expected_version = "#version 300 es";
-	if (strstr(shader.source_code.cstr, expected_version) != shader.source_code.cstr) {
+	size_t expected_version_size = strlen(expected_version);
+	if (source.size < expected_version_size || memcmp(source.data, expected_version, expected_version_size) != 0) {
 		LOG_F(ERROR, "Failed to load shader %s", shader.source_path.cstr);
 		LOG_F(ERROR, "Expected shader to start with %s", expected_version);
 		return;
@@ -130,9 +141,10 @@ static void LoadShaderFromDisk(Shader& shader) {
 	shader.gl_shader = gl_shader;
 
 	const char* version = PLATFORM_DESKTOP ? "#version 330 core\n" : "#version 300 es\n";
-	const char* code = &shader.source_code.cstr[strlen(expected_version)];
+	// The mapped source isn't null-terminated, so pass its length explicitly
+	const char* code = &source.chars()[expected_version_size];
 	const GLchar* sources[] = { version, ShaderDefineBlock.cstr, code };
-	GLint lengths[] = { (GLint)strlen(version), (GLint)(ShaderDefineBlock.size()), (GLint)strlen(code) };
+	GLint lengths[] = { (GLint)strlen(version), (GLint)(ShaderDefineBlock.size()), (GLint)(source.size - expected_version_size) };
 	glShaderSource(gl_shader, CountOf(sources), sources, lengths);
 
 	glCompileShader(gl_shader);
@@ -160,8 +172,24 @@ static void LoadShaderFromDisk(Shader& shader) {
 	GLObjectLabel(GL_SHADER, gl_shader, shader.source_path.cstr);
 }
 
-VertShader* GetVertShader(const char* path) {
-	Shader& gen_shader = ShaderCache[Hash64(path)];
+static void OnShaderFileChanged(void* pv_shader, const String& path) {
+	Shader* shader = static_cast<Shader*>(pv_shader);
+	LOG_F(INFO, "Shader %s changed on disk, recompiling", path.cstr);
+	shader->invalidate();
+	for (auto& [key, program] : ProgramCache) {
+		if (program->vsh == shader || program->fsh == shader) {
+			program->invalidate();
+		}
+	}
+}
+
+VertShader* GetVertShader(StringId path) {
+	Shader*& cached = ShaderCache[path];
+	if (!cached) {
+		cached = new Shader();
+		WatchFile(path, OnShaderFileChanged, cached);
+	}
+	Shader& gen_shader = *cached;
 	auto& shader = static_cast<VertShader&>(gen_shader);
 
 	if (shader.gl_shader != 0) {
@@ -171,14 +199,19 @@ VertShader* GetVertShader(const char* path) {
 
 	shader.type = Shader::VERTEX;
 	shader.gl_type = GL_VERTEX_SHADER;
-	shader.source_path = String::copy(path);
+	shader.source_path = String::view(path.cstr());
 	LoadShaderFromDisk(shader);
 
 	return &shader;
 }
 
-FragShader* GetFragShader(const char* path) {
-	Shader& gen_shader = ShaderCache[Hash64(path)];
+FragShader* GetFragShader(StringId path) {
+	Shader*& cached = ShaderCache[path];
+	if (!cached) {
+		cached = new Shader();
+		WatchFile(path, OnShaderFileChanged, cached);
+	}
+	Shader& gen_shader = *cached;
 	auto& shader = static_cast<FragShader&>(gen_shader);
 
 	if (shader.gl_shader != 0) {
@@ -188,21 +221,22 @@ FragShader* GetFragShader(const char* path) {
 
 	shader.type = Shader::FRAGMENT;
 	shader.gl_type = GL_FRAGMENT_SHADER;
-	shader.source_path = String::copy(path);
+	shader.source_path = String::view(path.cstr());
 	LoadShaderFromDisk(shader);
 
 	return &shader;
 }
 
 Program* GetProgram(VertShader* vsh, FragShader* fsh) {
-	uint64_t key[2] = {uint64_t(vsh), uint64_t(fsh)};
-	uint64_t hash = Hash64(reinterpret_cast<char*>(key), sizeof(key));
-	Program& program = ProgramCache[hash];
+	Program*& cached = ProgramCache[ProgramKey{vsh, fsh}];
+	if (!cached) { cached = new Program(); }
+	Program& program = *cached;
 
 	if (program.gl_program != 0) {
 		return &program;
 	}
 
+	ProfileZone("Link Program");
 	program = Program(vsh, fsh);
 	DCHECK_NOTNULL_F(program.vsh);
 	DCHECK_NOTNULL_F(program.fsh);
@@ -258,38 +292,10 @@ Program* GetProgram(VertShader* vsh, FragShader* fsh) {
 void ProcessShaderUpdates(const Engine& engine) {
 	if (UpdateShaderDefines(engine)) {
 		for (auto& [key, shader] : ShaderCache) {
-			shader.invalidate();
+			shader->invalidate();
 		}
 		for (auto& [key, program] : ProgramCache) {
-			program.invalidate();
-		}
-	}
-	// Detect on-disk shader changes. Pointless for web/mobile builds since the "disk" is read-only.
-	if (PLATFORM_DESKTOP) {
-		static size_t bucket_idx = 0;
-		size_t bucket_count = ShaderCache.bucket_count();
-		Shader* invalidated_shader = nullptr;
-
-		for (size_t i = bucket_idx; i < bucket_idx + bucket_count; i++) {
-			size_t bucket = i % bucket_count;
-			for (auto it = ShaderCache.begin(bucket); it != ShaderCache.end(bucket); ++it) {
-				Shader& shader = it->second;
-				if (shader.mtime != 0 && shader.mtime != GetFileModificationTime(shader.source_path)) {
-					shader.invalidate();
-					invalidated_shader = &shader;
-					break;
-				}
-			}
-			if (invalidated_shader) { break; }
-		}
-		bucket_idx = (bucket_idx + 1) % bucket_count;
-
-		if (invalidated_shader) {
-			for (auto& [key, program] : ProgramCache) {
-				if (program.vsh == invalidated_shader || program.fsh == invalidated_shader) {
-					program.invalidate();
-				}
-			}
+			program->invalidate();
 		}
 	}
 }
@@ -305,10 +311,9 @@ void Program::invalidate() {
 }
 
 GLint Program::location(const Uniforms::Item& uniform) {
-	for (uint32_t i = 0; i < CountOf(Uniforms::all); i++) {
-		if (Uniforms::all[i].hash == uniform.hash) {
-			return uniform_locations[i];
-		}
+	if (ExpectTrue(uniform.index < CountOf(Uniforms::all))) {
+		DCHECK_EQ_F(Uniforms::all[uniform.index].hash, uniform.hash);
+		return uniform_locations[uniform.index];
 	}
 	return glGetUniformLocation(gl_program, uniform.name);
 }
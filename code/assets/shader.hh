@@ -1,5 +1,6 @@
 #pragma once
 #include "base/string.hh"
+#include "base/stringid.hh"
 #include "base/math.hh"
 #include "graphics/opengl.hh"
 #include "graphics/defaults.hh"
@@ -103,8 +104,6 @@ struct Shader {
 		FRAGMENT,
 	} type;
 	String source_path;
-	String source_code;
-	uint64_t mtime;
 	GLenum gl_type;
 	GLuint gl_shader;
 
@@ -131,8 +130,13 @@ struct Program {
 	bool set(const UniformValue& u);
 };
 
-VertShader* GetVertShader(const char* path);
-FragShader* GetFragShader(const char* path);
+// Loads and compiles shaders, or returns previously loaded ones. Prefer passing a StringIdLiteral
+// for fixed paths, so they don't need to be hashed and looked up on every call.
+VertShader* GetVertShader(StringId path);
+FragShader* GetFragShader(StringId path);
+
+static VertShader* GetVertShader(const char* path) { return GetVertShader(StringId::intern(path)); }
+static FragShader* GetFragShader(const char* path) { return GetFragShader(StringId::intern(path)); }
 
 Program* GetProgram(VertShader* vsh, FragShader* fsh);
 
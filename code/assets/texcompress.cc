@@ -0,0 +1,94 @@
+#include "assets/texcompress.hh"
+#include "base/debug.hh"
+#include "base/jobs.hh"
+#include "engine/profiler.hh"
+
+#include <stb_dxt.h>
+
+// Number of blocks each job compresses, roughly.
+static constexpr uint32_t TextureCompression_BatchBlocks = 2048;
+
+// Older versions of stb_dxt build their tables on first use, which isn't thread-safe. Compressing
+// a block from inside a static initialiser makes sure that happens exactly once.
+static void InitBlockCompressor() {
+	static const bool initialised = []() {
+		uint8_t rgba[16 * 4] = {}, block[16];
+		stb_compress_dxt_block(block, rgba, 1, STB_DXT_HIGHQUAL);
+		return true;
+	}();
+	(void)initialised;
+}
+
+// Gathers a 4x4 block of texels as RGBA, repeating the last row and column at the edges.
+static void GatherBlockRGBA(const uint8_t* src, uint32_t width, uint32_t height, uint8_t channels,
+	uint32_t bx, uint32_t by, uint8_t* rgba)
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		const uint8_t* row = src + size_t(Min(by * 4 + y, height - 1)) * width * channels;
+		for (uint32_t x = 0; x < 4; x++) {
+			const uint8_t* t = row + Min(bx * 4 + x, width - 1) * channels;
+			uint8_t* out = &rgba[(y * 4 + x) * 4];
+			switch (channels) {
+				case 1:  out[0] = out[1] = out[2] = t[0]; out[3] = 255;  break;
+				case 2:  out[0] = out[1] = out[2] = t[0]; out[3] = t[1]; break;
+				case 3:  out[0] = t[0]; out[1] = t[1]; out[2] = t[2]; out[3] = 255; break;
+				default: out[0] = t[0]; out[1] = t[1]; out[2] = t[2]; out[3] = t[3]; break;
+			}
+		}
+	}
+}
+
+// Gathers the first count channels of a 4x4 block, repeating the last row and column at the edges.
+static void GatherBlockChannels(const uint8_t* src, uint32_t width, uint32_t height, uint8_t channels,
+	uint32_t bx, uint32_t by, uint32_t count, uint8_t* out)
+{
+	for (uint32_t y = 0; y < 4; y++) {
+		const uint8_t* row = src + size_t(Min(by * 4 + y, height - 1)) * width * channels;
+		for (uint32_t x = 0; x < 4; x++) {
+			const uint8_t* t = row + Min(bx * 4 + x, width - 1) * channels;
+			for (uint32_t ch = 0; ch < count; ch++) {
+				out[(y * 4 + x) * count + ch] = t[Min(ch, uint32_t(channels) - 1)];
+			}
+		}
+	}
+}
+
+void CompressTextureLevel(TextureCompression compression, const uint8_t* src, uint32_t width,
+	uint32_t height, uint8_t channels, uint8_t* dst)
+{
+	CHECK_F(compression != TextureCompression::None);
+	CHECK_F(channels >= 1 && channels <= 4);
+	ProfileZone("Compress Texture Level");
+	InitBlockCompressor();
+
+	uint32_t blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	uint32_t block_bytes = CompressedBlockBytes(compression);
+	uint32_t batch_rows = Max(1U, TextureCompression_BatchBlocks / blocks_x);
+	ParallelFor(blocks_y, batch_rows, [&](uint32_t begin, uint32_t end) {
+		uint8_t texels[16 * 4];
+		for (uint32_t by = begin; by < end; by++) {
+			uint8_t* out = dst + size_t(by) * blocks_x * block_bytes;
+			for (uint32_t bx = 0; bx < blocks_x; bx++, out += block_bytes) {
+				switch (compression) {
+					case TextureCompression::BC1:
+						GatherBlockRGBA(src, width, height, channels, bx, by, texels);
+						stb_compress_dxt_block(out, texels, 0, STB_DXT_HIGHQUAL);
+						break;
+					case TextureCompression::BC3:
+						GatherBlockRGBA(src, width, height, channels, bx, by, texels);
+						stb_compress_dxt_block(out, texels, 1, STB_DXT_HIGHQUAL);
+						break;
+					case TextureCompression::BC4:
+						GatherBlockChannels(src, width, height, channels, bx, by, 1, texels);
+						stb_compress_bc4_block(out, texels);
+						break;
+					case TextureCompression::BC5:
+						GatherBlockChannels(src, width, height, channels, bx, by, 2, texels);
+						stb_compress_bc5_block(out, texels);
+						break;
+					default: break;
+				}
+			}
+		}
+	});
+}
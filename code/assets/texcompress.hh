@@ -0,0 +1,33 @@
+#pragma once
+#include "base/base.hh"
+
+/* Block compression of 8-bit UNORM texture levels.
+ *
+ * Levels are compressed on the CPU with stb_dxt, in rows of 4x4 blocks that are split across the
+ * job system's threads. Texels past the edge of levels that aren't a multiple of 4 in size are
+ * filled in by repeating the last row and column.
+ */
+
+// Ordered by how many of the source channels are kept, so that a texture used in several ways can
+// take the maximum of what each use asks for.
+enum class TextureCompression : uint8_t {
+	None,
+	BC4, // R, 8 bytes per block (RGTC1)
+	BC5, // RG, 16 bytes per block (RGTC2)
+	BC1, // RGB, 8 bytes per block (DXT1), alpha is dropped
+	BC3, // RGBA, 16 bytes per block (DXT5)
+};
+
+static constexpr uint32_t CompressedBlockBytes(TextureCompression compression) {
+	return (compression == TextureCompression::BC1 || compression == TextureCompression::BC4) ? 8 : 16;
+}
+
+static constexpr size_t CompressedLevelSize(TextureCompression compression, uint32_t width, uint32_t height) {
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * CompressedBlockBytes(compression);
+}
+
+// Compresses a tightly packed level with the given number of channels. Single-channel images are
+// treated as grey, and two-channel ones as grey and alpha, except by BC4 and BC5, which take the
+// first one or two channels as they are. dst must hold CompressedLevelSize() bytes.
+void CompressTextureLevel(TextureCompression compression, const uint8_t* src, uint32_t width,
+	uint32_t height, uint8_t channels, uint8_t* dst);
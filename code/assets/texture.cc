@@ -1,14 +1,23 @@
 #include "assets/texture.hh"
 #include "assets/asset_loader.hh"
-
-#include <unordered_map>
+#include "assets/iristex.hh"
 
 #include <stb_image.h>
-#include <stb_image_resize.h>
 #include <SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 #include "base/debug.hh"
+#include "base/hashmap.hh"
+#include "base/filesystem.hh"
+#include "base/filewatch.hh"
+#include "base/jobs.hh"
+#include "engine/engine.hh"
 #include "engine/deferred.hh"
+#include "engine/profiler.hh"
+#include "graphics/upload.hh"
 
 static bool TextureLoader_Initialised = false;
 
@@ -25,42 +34,90 @@ namespace Samplers {
 	Sampler MipmappedLinearRepeat = {};
 }
 
-std::unordered_map<uint64_t, Texture> TextureLoader_Cache = {};
-std::unordered_map<uint64_t, Sampler> SamplerLoader_Cache = {};
+// Values are heap-allocated, since callers hold on to the returned pointers.
+HashMap<StringId, Texture*> TextureLoader_Cache = {};
+HashMap<uint64_t, Sampler*> SamplerLoader_Cache = {};
+
+// Texture that each content key was first decoded for, which textures with the same content alias.
+// Looked up and filled in by the decode jobs, so it's guarded by a mutex.
+static HashMap<TextureContentKey, Texture*> TextureLoader_ContentCache = {};
+static std::mutex TextureLoader_ContentMutex;
+
+static void GetTextureFormat(uint8_t channels, GLenum* internalformat, GLenum* format) {
+	switch (channels) {
+		case 1:  *internalformat = GL_R8;    *format = GL_RED;  break;
+		case 2:  *internalformat = GL_RG8;   *format = GL_RG;   break;
+		case 3:  *internalformat = GL_RGB8;  *format = GL_RGB;  break;
+		default: *internalformat = GL_RGBA8; *format = GL_RGBA; break;
+	}
+}
 
-static void UploadStagedLevels(Texture& texture) {
-	// TODO: Support more image formats than just the 8-bit UNORM ones
-	GLenum internalformat = GL_RGBA8, format = GL_RGBA, type = GL_UNSIGNED_BYTE;
-	switch (texture.channels) {
-		case 1: internalformat = GL_R8;    format = GL_RED;  break;
-		case 2: internalformat = GL_RG8;   format = GL_RG;   break;
-		case 3: internalformat = GL_RGB8;  format = GL_RGB;  break;
-		case 4: internalformat = GL_RGBA8; format = GL_RGBA; break;
+static GLenum GetCompressedTextureFormat(TextureCompression compression) {
+	switch (compression) {
+		case TextureCompression::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case TextureCompression::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case TextureCompression::BC4: return GL_COMPRESSED_RED_RGTC1;
+		case TextureCompression::BC5: return GL_COMPRESSED_RG_RGTC2;
+		default: return GL_NONE;
 	}
+}
 
-	if (texture.gl_texture == 0) {
-		glGenTextures(1, &texture.gl_texture);
-		glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
-		// The default min-filter is NEAREST_MIPMAP_LINEAR, which requires the texture to be mipmap
-		// complete. LINEAR is a more sensible default.
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		// REPEAT is the default, but we might as well be explicit about it.
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexStorage2D(GL_TEXTURE_2D, texture.num_levels, internalformat, texture.width, texture.height);
-	} else {
-		glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
+static bool IsCompressionSupported(TextureCompression compression) {
+	switch (compression) {
+		case TextureCompression::BC1:
+		case TextureCompression::BC3: return GLSupport_S3TC;
+		case TextureCompression::BC4:
+		case TextureCompression::BC5: return GLSupport_RGTC;
+		default: return true;
+	}
+}
+
+// Number of channels sampled from a texture stored with the given compression.
+static uint8_t CompressedChannelCount(TextureCompression compression) {
+	switch (compression) {
+		case TextureCompression::BC4: return 1;
+		case TextureCompression::BC5: return 2;
+		case TextureCompression::BC1: return 3;
+		default: return 4;
 	}
+}
+
+// Creates a texture object without any storage. Levels past num_levels are never sampled.
+static GLuint CreateTexture(uint8_t num_levels) {
+	GLuint gl_texture = 0;
+	glGenTextures(1, &gl_texture);
+	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	// The default min-filter is NEAREST_MIPMAP_LINEAR, which requires the texture to be mipmap
+	// complete. LINEAR is a more sensible default.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// REPEAT is the default, but we might as well be explicit about it.
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, num_levels - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return gl_texture;
+}
 
+// Uploads the staged levels directly, rather than through graphics/upload.hh. Only used for the
+// built-in textures, which have to be usable right away.
+static void UploadStagedLevels(Texture& texture) {
+	GLenum internalformat, format;
+	GetTextureFormat(texture.channels, &internalformat, &format);
+	bool allocate = (texture.gl_texture == 0);
+	if (allocate) { texture.gl_texture = CreateTexture(texture.num_levels); }
+
+	glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
+	if (allocate) {
+		glTexStorage2D(GL_TEXTURE_2D, texture.num_levels, internalformat, texture.width, texture.height);
+	}
 	for (uint32_t i = 0; i < texture.num_levels; i++) {
 		Texture::Level& l = texture.levels[i];
 		if (l.staging_buffer) {
-			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, l.width, l.height, format, type, l.staging_buffer);
+			glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, l.width, l.height, format, GL_UNSIGNED_BYTE, l.staging_buffer);
 			l.staging_buffer = nullptr;
 		}
 	}
-
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
@@ -129,125 +186,772 @@ static uint8_t MipchainLevelCount(uint32_t w, uint32_t h) {
 	return 1 + static_cast<uint8_t>(floorf(log2f(float(Max(Max(w, h), 2U)))));
 }
 
-static void UploadTexture(Engine& engine, void* pv_texture) {
-	Texture& texture = *(static_cast<Texture*>(pv_texture));
+// Mipmapped textures are first uploaded down to the first level that fits into this size. Finer
+// levels are streamed in on request.
+static constexpr uint32_t TextureLoader_InitialLevelSize = 64;
+
+// Number of textures with a decode started but not yet uploaded. Only touched on the main thread.
+static uint32_t TextureLoader_PendingLoads = 0;
+// Number of textures with level_upload_pending set.
+static uint32_t TextureLoader_PendingLevels = 0;
+
+// Textures that aren't fully resident, i.e. that are still being streamed in, have had levels
+// dropped, or have been evicted. Only touched on the main thread.
+static std::vector<Texture*> TextureLoader_Streaming;
+
+// Approximate GPU memory used by resident levels, including levels that are being streamed in.
+// Only touched on the main thread.
+static uint64_t TextureLoader_ResidentBytes = 0;
+
+// When over the memory budget, textures that haven't been used for this many frames are evicted
+// entirely, rather than just losing their finest levels.
+static constexpr uint64_t TextureLoader_IdleFrames = 600;
+
+// Approximate size of a level in GPU memory. Drivers generally store RGB8 textures as RGBA8.
+static uint64_t LevelBytes(const Texture& texture, uint32_t level) {
+	if (texture.stored_compression != TextureCompression::None) {
+		return CompressedLevelSize(texture.stored_compression, texture.levels[level].width, texture.levels[level].height);
+	}
+	uint32_t bytes_per_texel = (texture.channels == 3) ? 4 : texture.channels;
+	return uint64_t(texture.levels[level].width) * texture.levels[level].height * bytes_per_texel;
+}
+
+static uint64_t ResidentBytes(const Texture& texture) {
+	// Textures that failed to load share the fallback texture
+	if (texture.gl_texture == 0 || texture.gl_texture == Textures::Red_1x1.gl_texture) { return 0; }
+	uint64_t bytes = 0;
+	for (uint32_t i = texture.base_level; i < texture.num_levels; i++) { bytes += LevelBytes(texture, i); }
+	return bytes;
+}
+
+static void AddStreamingTexture(Texture& texture) {
+	auto it = std::find(TextureLoader_Streaming.begin(), TextureLoader_Streaming.end(), &texture);
+	if (it == TextureLoader_Streaming.end()) { TextureLoader_Streaming.push_back(&texture); }
+}
+
+// Cooked textures are written next to their source the first time it's decoded. Not on the web,
+// where the data directory is an in-memory copy that doesn't outlive the page.
+static constexpr bool TextureLoader_WriteCooked = !PLATFORM_WEB;
+
+// Image data decoded by a worker thread, waiting to be uploaded on the main thread. Owns the
+// staging buffers the levels point into. Kept around as the texture's stream until every level
+// is resident.
+struct TextureDecode {
+	Texture* texture = nullptr;
+	String source_path; // copied from the texture, so that the worker never reads it
+	MappedFile file; // contents read ahead by GetTexture, if any
+	DeferPriority priority;
+	bool generate_mips;
+	MipgenOptions mipgen;
+	TextureCompression compression = TextureCompression::None; // requested, then actual
+	TextureContentKey content_key;
+	Texture* duplicate_of = nullptr; // texture already loaded with the same content key, if any
+	size_t source_size = 0;
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	uint8_t channels = 0;
+	uint8_t num_levels = 0;
+	Texture::Level levels[Texture::MaxLevels];
+	uint8_t* image = nullptr; // level 0, decoded in place by stb_image
+	uint8_t* mips = nullptr;  // levels 1 and up, if generated
+	uint8_t* compressed = nullptr; // all levels, if block-compressed after decoding
+	MappedFile cooked;        // all levels, if loaded from a cooked file
+	const char* error = nullptr;
+
+	float time_decode = 0.0f;
+	float time_mipgen = 0.0f;
+	float time_compress = 0.0f;
+
+	// New GL texture the levels are streamed into. Replaces the texture's old one once the levels
+	// from initial_level down are resident.
+	GLuint gl_texture = 0;
+	uint8_t initial_level = 0;
+	uint64_t upload_start = 0; // performance counter
+	uint64_t upload_frame = 0;
+
+	~TextureDecode() {
+		stbi_image_free(image);
+		free(mips);
+		free(compressed);
+	}
+};
+
+static void UploadTexture(Engine& engine, void* pv_decode);
+static void FinishTextureUpload(Engine& engine, void* pv_decode);
+
+// Points the decode's levels into an up-to-date cooked file for its source, if there is one. Files
+// cooked without mips are only used for textures that don't need them.
+static bool LoadCookedTexture(TextureDecode& decode, const String& cooked_path, uint64_t source_hash) {
+	IrisTex cooked;
+	if (!LoadIrisTex(cooked_path, source_hash, &cooked)) { return false; }
+	uint8_t mipchain_levels = MipchainLevelCount(cooked.width, cooked.height);
+	if (decode.generate_mips && cooked.num_levels < mipchain_levels) { return false; }
+
+	switch (cooked.format) {
+		case IrisTexFormat::BC1: decode.compression = TextureCompression::BC1; break;
+		case IrisTexFormat::BC3: decode.compression = TextureCompression::BC3; break;
+		case IrisTexFormat::BC4: decode.compression = TextureCompression::BC4; break;
+		case IrisTexFormat::BC5: decode.compression = TextureCompression::BC5; break;
+		default: decode.compression = TextureCompression::None; break;
+	}
+	decode.width = cooked.width;
+	decode.height = cooked.height;
+	decode.channels = (decode.compression != TextureCompression::None) ?
+		CompressedChannelCount(decode.compression) : uint8_t(cooked.format);
+	decode.num_levels = decode.generate_mips ? mipchain_levels : 1;
+	for (uint32_t i = 0; i < decode.num_levels; i++) {
+		decode.levels[i].width  = Max(1U, cooked.width >> i);
+		decode.levels[i].height = Max(1U, cooked.height >> i);
+		decode.levels[i].staging_buffer = cooked.levels[i];
+	}
+	decode.cooked = std::move(cooked.file);
+	return true;
+}
+
+// Decodes the image in decode.file with stb_image. Mips are generated with decode.mipgen if the
+// texture needs them or full_mipchain is set, e.g. because the result is going to be cooked.
+// Returns false and sets decode.error if the image can't be decoded.
+static bool DecodeImage(TextureDecode& decode, bool full_mipchain) {
+	float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
+	uint64_t timestamp = SDL_GetPerformanceCounter();
+
+	int w, h, c;
+	decode.image = stbi_load_from_memory(decode.file.data, int(decode.file.size), &w, &h, &c, 0);
+	if (!decode.image) {
+		decode.error = stbi_failure_reason();
+		return false;
+	}
+
+	uint64_t time_decode_end = SDL_GetPerformanceCounter();
+	decode.time_decode = float(time_decode_end - timestamp) / ticks_per_msec;
+	timestamp = time_decode_end;
+
+	// Level 0 is uploaded straight from the buffer stb_image decoded into
+	decode.width  = decode.levels[0].width  = static_cast<uint32_t>(w);
+	decode.height = decode.levels[0].height = static_cast<uint32_t>(h);
+	decode.channels = static_cast<uint8_t>(c);
+	decode.num_levels = (decode.generate_mips || full_mipchain) ? MipchainLevelCount(w, h) : 1;
+	decode.levels[0].staging_buffer = decode.image;
+	if (decode.num_levels == 1) { return true; }
+
+	// Mips are generated here rather than with glGenerateMipmap, since the smallest levels have to
+	// be uploaded first, and so that sRGB textures are filtered in linear space.
+	size_t mips_size = 0;
+	for (uint32_t i = 1; i < decode.num_levels; i++) {
+		mips_size += size_t(Max(1U, decode.width >> i)) * Max(1U, decode.height >> i) * c;
+	}
+	decode.mips = static_cast<uint8_t*>(malloc(mips_size));
+	CHECK_NOTNULL_F(decode.mips);
+
+	uint8_t* level_data[Texture::MaxLevels] = {decode.image};
+	size_t mip_offset = 0;
+	for (uint32_t i = 1; i < decode.num_levels; i++) {
+		Texture::Level& l = decode.levels[i];
+		l.width  = Max(1U, decode.width >> i);
+		l.height = Max(1U, decode.height >> i);
+		level_data[i] = &decode.mips[mip_offset];
+		l.staging_buffer = level_data[i];
+		mip_offset += size_t(l.width) * l.height * c;
+	}
+	GenerateMipChain(level_data, decode.width, decode.height, decode.channels, decode.num_levels, decode.mipgen);
+	decode.time_mipgen = float(SDL_GetPerformanceCounter() - timestamp) / ticks_per_msec;
+	return true;
+}
+
+// Block-compresses the decoded levels, if the decode asks for it, and points the levels at the
+// compressed data. The uncompressed levels are freed. The compression is first narrowed down to
+// the channels the image has: BC3 is only worth it with alpha, and BC5 needs two channels.
+static void CompressDecodedLevels(TextureDecode& decode) {
+	if (decode.compression == TextureCompression::BC3 && (decode.channels == 1 || decode.channels == 3)) {
+		decode.compression = TextureCompression::BC1;
+	}
+	if (decode.compression == TextureCompression::BC5 && decode.channels == 1) {
+		decode.compression = TextureCompression::BC4;
+	}
+	if (decode.compression == TextureCompression::None) { return; }
+	if (PLATFORM_WEB) {
+		// WebGL only accepts compressed levels that are 1, 2 or a multiple of 4 texels in each dimension
+		for (uint32_t i = 0; i < decode.num_levels; i++) {
+			for (uint32_t size : {decode.levels[i].width, decode.levels[i].height}) {
+				if (size > 2 && size % 4 != 0) {
+					decode.compression = TextureCompression::None;
+					return;
+				}
+			}
+		}
+	}
+	uint64_t timestamp = SDL_GetPerformanceCounter();
+
+	size_t compressed_size = 0;
+	for (uint32_t i = 0; i < decode.num_levels; i++) {
+		compressed_size += CompressedLevelSize(decode.compression, decode.levels[i].width, decode.levels[i].height);
+	}
+	decode.compressed = static_cast<uint8_t*>(malloc(compressed_size));
+	CHECK_NOTNULL_F(decode.compressed);
+
+	size_t offset = 0;
+	for (uint32_t i = 0; i < decode.num_levels; i++) {
+		Texture::Level& l = decode.levels[i];
+		CompressTextureLevel(decode.compression, l.staging_buffer, l.width, l.height, decode.channels,
+			&decode.compressed[offset]);
+		l.staging_buffer = &decode.compressed[offset];
+		offset += CompressedLevelSize(decode.compression, l.width, l.height);
+	}
+	decode.channels = CompressedChannelCount(decode.compression);
+	stbi_image_free(decode.image);
+	free(decode.mips);
+	decode.image = nullptr;
+	decode.mips = nullptr;
+
+	float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
+	decode.time_compress = float(SDL_GetPerformanceCounter() - timestamp) / ticks_per_msec;
+}
+
+// Keys the texture by the source file's contents. Covers the mipgen options and requested
+// compression as well, since the same image is loaded differently depending on how it's used.
+static TextureContentKey GetTextureContentKey(const MappedFile& file, const MipgenOptions& mipgen,
+	TextureCompression compression)
+{
+	uint32_t cutoff_bits;
+	memcpy(&cutoff_bits, &mipgen.alpha_cutoff, sizeof(cutoff_bits));
+	uint64_t options = uint64_t(mipgen.filter) | (uint64_t(mipgen.srgb) << 8) | (uint64_t(compression) << 16) |
+		(uint64_t(cutoff_bits) << 32);
+	return {.source = HashBuffer128(file.data, file.size), .options = options};
+}
+
+// Hash that cooked files are keyed by.
+static uint64_t CookedSourceHash(const TextureContentKey& key) {
+	return Hash64(&key, sizeof(key));
+}
+
+// Looks for a texture that has already been loaded from the same content. If there isn't one, the
+// decode's texture is registered as the one to share for its content, and false is returned.
+static bool FindDuplicateTexture(TextureDecode& decode) {
+	std::lock_guard<std::mutex> lock(TextureLoader_ContentMutex);
+	Texture*& owner = TextureLoader_ContentCache[decode.content_key];
+	if (owner && owner != decode.texture) {
+		decode.duplicate_of = owner;
+		return true;
+	}
+	owner = decode.texture;
+	return false;
+}
+
+// Writes the decoded levels to a cooked file.
+static bool CookDecodedTexture(const TextureDecode& decode, const String& cooked_path, uint64_t source_hash) {
+	ProfileZone("Cook Texture");
+	const uint8_t* level_data[Texture::MaxLevels];
+	for (uint32_t i = 0; i < decode.num_levels; i++) { level_data[i] = decode.levels[i].staging_buffer; }
+	IrisTexFormat format = IrisTexFormat(decode.channels);
+	switch (decode.compression) {
+		case TextureCompression::BC1: format = IrisTexFormat::BC1; break;
+		case TextureCompression::BC3: format = IrisTexFormat::BC3; break;
+		case TextureCompression::BC4: format = IrisTexFormat::BC4; break;
+		case TextureCompression::BC5: format = IrisTexFormat::BC5; break;
+		default: break;
+	}
+	return WriteIrisTex(cooked_path, source_hash, decode.width, decode.height, format, decode.num_levels, level_data);
+}
+
+// Runs on a worker thread. Reads nothing from the Texture, since everything the decode needs is
+// copied into it when it's queued, so the texture can keep being used in the meantime.
+static void DecodeTexture(void* pv_decode) {
+	TextureDecode& decode = *(static_cast<TextureDecode*>(pv_decode));
+	ProfileZone("Decode Texture");
+	const String& path = decode.source_path;
+
+	// Reuploads (e.g. to add mips) read the file again, rather than holding on to the contents
+	if (!decode.file) { decode.file = MapFile(path); }
+	if (decode.file) {
+		float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
+		uint64_t timestamp = SDL_GetPerformanceCounter();
+		// Formats the GPU can't sample are never cooked, so that the hash stays the same on GPUs
+		// that can
+		if (!IsCompressionSupported(decode.compression)) { decode.compression = TextureCompression::None; }
+		decode.content_key = GetTextureContentKey(decode.file, decode.mipgen, decode.compression);
+		decode.source_size = decode.file.size;
+		uint64_t source_hash = CookedSourceHash(decode.content_key);
+		String cooked_path = GetIrisTexPath(path);
+		if (FindDuplicateTexture(decode)) {
+			// Nothing to decode, the texture is pointed at its duplicate on the main thread
+		} else if (LoadCookedTexture(decode, cooked_path, source_hash)) {
+			decode.time_decode = float(SDL_GetPerformanceCounter() - timestamp) / ticks_per_msec;
+		} else if (DecodeImage(decode, TextureLoader_WriteCooked)) {
+			CompressDecodedLevels(decode);
+			if (TextureLoader_WriteCooked) { CookDecodedTexture(decode, cooked_path, source_hash); }
+			// Mips generated only for the cooked file stay allocated until the decode is freed
+			if (!decode.generate_mips) { decode.num_levels = 1; }
+		}
+	} else {
+		decode.error = "can't open file";
+	}
+	decode.file = MappedFile();
+
+	Defer(UploadTexture, &decode, decode.priority);
+}
+
+// Starts decoding the texture on a worker thread, using the given file contents if there are any.
+// The upload is deferred once the image is decoded. Must be called from the main thread.
+static void StartTextureDecode(Texture& texture, MappedFile&& file, DeferPriority priority) {
+	if (texture.decode_pending) {
+		texture.redecode_pending = true;
+		return;
+	}
+	texture.decode_pending = true;
+	TextureLoader_PendingLoads++;
+
+	TextureDecode* decode = new TextureDecode();
+	decode->texture = &texture;
+	decode->source_path = String::copy(texture.source_path);
+	decode->file = std::move(file);
+	decode->priority = priority;
+	decode->generate_mips = texture.generate_mips;
+	decode->mipgen = texture.mipgen;
+	decode->compression = texture.compression;
+	StartJob(nullptr, DecodeTexture, decode);
+}
+
+static void FreeTextureDecode(TextureDecode* decode) {
+	delete decode;
+}
+
+// Allocates storage for one level of a texture created with CreateTexture and queues its upload.
+static void QueueLevelUpload(GLuint gl_texture, const TextureDecode& decode, uint8_t level) {
+	const Texture::Level& l = decode.levels[level];
+	if (decode.compression != TextureCompression::None) {
+		GLenum internalformat = GetCompressedTextureFormat(decode.compression);
+		GLsizei size = GLsizei(CompressedLevelSize(decode.compression, l.width, l.height));
+		glBindTexture(GL_TEXTURE_2D, gl_texture);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internalformat, l.width, l.height, 0, size, nullptr);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		QueueCompressedTextureUpload(gl_texture, level, l.width, l.height, internalformat,
+			CompressedBlockBytes(decode.compression), l.staging_buffer);
+		return;
+	}
+	GLenum internalformat, format;
+	GetTextureFormat(decode.channels, &internalformat, &format);
+	glBindTexture(GL_TEXTURE_2D, gl_texture);
+	glTexImage2D(GL_TEXTURE_2D, level, internalformat, l.width, l.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	QueueTextureUpload(gl_texture, level, l.width, l.height, format, GL_UNSIGNED_BYTE, decode.channels,
+		l.staging_buffer);
+}
+
+// Runs on the main thread once the texture has been decoded. Creates the new GL texture and queues
+// the levels from the smallest one up to the initial level for streaming. The texture keeps its old
+// contents until they've all been uploaded, so a reload never shows a half-uploaded image.
+static void UploadTexture(Engine& engine, void* pv_decode) {
+	TextureDecode* decode = static_cast<TextureDecode*>(pv_decode);
+	if (decode->error || decode->duplicate_of) {
+		FinishTextureUpload(engine, decode);
+		return;
+	}
+	ProfileZone("Upload Texture");
+
+	// Only levels that are resident get storage, so GPU memory use grows with base_level
+	decode->initial_level = decode->num_levels - 1;
+	while (decode->initial_level > 0 &&
+		Max(decode->levels[decode->initial_level - 1].width, decode->levels[decode->initial_level - 1].height)
+			<= TextureLoader_InitialLevelSize)
+	{
+		decode->initial_level--;
+	}
+	// Reloads keep at least the levels that are resident now, so they don't lose detail
+	const Texture& texture = *decode->texture;
+	if (ResidentBytes(texture) > 0 && texture.num_levels == decode->num_levels) {
+		decode->initial_level = Min(decode->initial_level, texture.base_level);
+	}
+	decode->gl_texture = CreateTexture(decode->num_levels);
+	for (int32_t i = decode->num_levels - 1; i >= int32_t(decode->initial_level); i--) {
+		QueueLevelUpload(decode->gl_texture, *decode, uint8_t(i));
+	}
+	decode->upload_start = SDL_GetPerformanceCounter();
+	decode->upload_frame = engine.this_frame.n;
+	QueueUploadCallback(FinishTextureUpload, decode);
+}
+
+// Called when a texture's contents change. Textures that were sharing the old contents are loaded
+// again on their own.
+static void DetachTextureAliases(Texture& texture) {
+	{
+		std::lock_guard<std::mutex> lock(TextureLoader_ContentMutex);
+		Texture** owner = TextureLoader_ContentCache.find(texture.content_key);
+		if (owner && *owner == &texture) { TextureLoader_ContentCache.erase(texture.content_key); }
+	}
+	for (auto& [path, other] : TextureLoader_Cache) {
+		if (other->alias == &texture) {
+			other->alias = nullptr;
+			if (!other->read_pending) { StartTextureDecode(*other, MappedFile(), other->priority); }
+		}
+	}
+}
+
+// Points a texture at another one with the same contents. The other texture is reloaded with mips
+// if this one needs them.
+static void AliasTexture(Texture& texture, Texture& owner, size_t source_size) {
+	texture.alias = &owner;
+	texture.width = 0;
+	texture.height = 0;
+	texture.channels = 0;
+	texture.num_levels = 0;
+	texture.base_level = 0;
+	texture.stored_compression = TextureCompression::None;
+	memset(&texture.levels, 0, sizeof(texture.levels));
+	if (texture.generate_mips && !owner.generate_mips) {
+		owner.generate_mips = true;
+		if (!owner.read_pending) { StartTextureDecode(owner, MappedFile(), owner.priority); }
+	}
+	LOG_F(INFO, "Texture %s: same contents as %s, sharing its texture (%.2f MB file not decoded again)",
+		texture.source_path.cstr, owner.source_path.cstr, float(source_size) / (1024.0f * 1024.0f));
+}
+
+// Runs on the main thread once the initial levels have been uploaded, or right away if the decode
+// failed or found a duplicate. Replaces the texture's old GL texture and contents.
+static void FinishTextureUpload(Engine& engine, void* pv_decode) {
+	TextureDecode* decode = static_cast<TextureDecode*>(pv_decode);
+	Texture& texture = *decode->texture;
 
 	float ticks_per_msec = float(SDL_GetPerformanceFrequency()) * 0.001f;
 	uint64_t timestamp = SDL_GetPerformanceCounter();
 
-	if (texture.gl_texture != 0) {
+	// Textures that failed to load share the fallback texture, which mustn't be deleted
+	TextureLoader_ResidentBytes -= ResidentBytes(texture);
+	if (texture.gl_texture != 0 && texture.gl_texture != Textures::Red_1x1.gl_texture) {
 		glDeleteTextures(1, &texture.gl_texture);
-		memset(&texture.levels, 0, sizeof(texture.levels));
+	}
+	texture.gl_texture = 0;
+	// Level uploads are queued before the callbacks of any later reload, so the old stream's level
+	// upload, if any, has finished by now.
+	if (texture.stream) {
+		FreeTextureDecode(texture.stream);
+		texture.stream = nullptr;
 	}
 
-	int w, h, c;
-	uint8_t* image = stbi_load(texture.source_path, &w, &h, &c, 0);
-	if (!image) {
-		LOG_F(ERROR, "Failed to load %s: %s", texture.source_path.cstr, stbi_failure_reason());
+	// Textures sharing this one's old contents can't keep doing so
+	bool had_contents = (texture.content_key.source.lo | texture.content_key.source.hi) != 0;
+	if (had_contents && !decode->error && decode->content_key != texture.content_key) {
+		DetachTextureAliases(texture);
+	}
+
+	bool keep_decode = false;
+	if (decode->duplicate_of) {
+		AliasTexture(texture, *decode->duplicate_of, decode->source_size);
+		texture.content_key = decode->content_key;
+	} else if (decode->error) {
+		LOG_F(ERROR, "Failed to load %s: %s", texture.source_path.cstr, decode->error);
 		texture.width = 1;
 		texture.height = 1;
 		texture.channels = 4;
 		texture.num_levels = 1;
+		texture.base_level = 0;
+		texture.stored_compression = TextureCompression::None;
+		memset(&texture.levels, 0, sizeof(texture.levels));
 		texture.gl_texture = Textures::Red_1x1.gl_texture;
-		return;
+	} else {
+		texture.width = decode->width;
+		texture.height = decode->height;
+		texture.channels = decode->channels;
+		texture.num_levels = decode->num_levels;
+		texture.base_level = decode->initial_level;
+		texture.stored_compression = decode->compression;
+		texture.alias = nullptr;
+		texture.content_key = decode->content_key;
+		memcpy(&texture.levels, &decode->levels, sizeof(texture.levels));
+		for (Texture::Level& l : texture.levels) { l.staging_buffer = nullptr; }
+		texture.gl_texture = decode->gl_texture;
+
+		glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base_level);
+		if (decode->generate_mips) {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		TextureLoader_ResidentBytes += ResidentBytes(texture);
+
+		// The finer levels are kept around until the render list asks for them
+		if (texture.base_level > 0) {
+			texture.stream = decode;
+			keep_decode = true;
+			AddStreamingTexture(texture);
+		}
+
+		float time_upload = float(timestamp - decode->upload_start) / ticks_per_msec;
+		static const char* compression_names[] = {"none", "BC4", "BC5", "BC1", "BC3"};
+		LOG_F(INFO, "Texture %s: %s %.03fms mipgen %.03fms compress (%s) %.03fms upload %.03fms (%llu frames) "
+			"levels %u-%u/%u gltex=%u", texture.source_path.cstr, decode->cooked ? "load cooked" : "decode",
+			decode->time_decode, decode->time_mipgen, compression_names[uint8_t(texture.stored_compression)],
+			decode->time_compress, time_upload, (unsigned long long)(engine.this_frame.n - decode->upload_frame), texture.base_level,
+			texture.num_levels - 1, texture.num_levels, texture.gl_texture);
 	}
-	texture.width  = texture.levels[0].width  = static_cast<uint32_t>(w);
-	texture.height = texture.levels[0].height = static_cast<uint32_t>(h);
-	texture.channels = static_cast<uint32_t>(c);
 
-	uint64_t time_disk_load_end = SDL_GetPerformanceCounter();
-	float time_disk_load = float(time_disk_load_end - timestamp) / ticks_per_msec;
-	timestamp = time_disk_load_end;
+	if (!keep_decode) { FreeTextureDecode(decode); }
 
-	// Software mipgen is significantly slower than glGenerateMipmap in my testing so far, but I'm
-	// not yet sure how general this rule is.
-	static constexpr bool SOFTWARE_MIPGEN = false;
+	texture.decode_pending = false;
+	TextureLoader_PendingLoads--;
+	if (texture.redecode_pending) {
+		texture.redecode_pending = false;
+		StartTextureDecode(texture, MappedFile(), texture.priority);
+	}
+}
 
-	float time_mipgen = 0.0f;
-	texture.num_levels = texture.generate_mips ? MipchainLevelCount(w, h) : 1;
-	uint32_t texture_size = 0;
-	uint32_t mip_w = texture.width, mip_h = texture.height;
-	for (uint32_t i = 0; i < texture.num_levels; i++) {
-		texture_size += mip_w * mip_h * c;
-		mip_w = Max(1U, mip_w / 2U);
-		mip_h = Max(1U, mip_h / 2U);
-	}
-
-	// Allocate staging mipchain and copy level 0 into it
-	size_t level0_size = w * h * c;
-	size_t staging_size = SOFTWARE_MIPGEN ? texture_size : level0_size;
-	uint8_t* staging = static_cast<uint8_t*>(calloc(staging_size, 1));
-	CHECK_NOTNULL_F(staging);
-	texture.levels[0].staging_buffer = staging;
-	memcpy(staging, image, level0_size);
-
-	if (SOFTWARE_MIPGEN && texture.generate_mips) {
-		uint32_t mip_w = texture.width, mip_h = texture.height;
-		uint32_t mip_offset = mip_w * mip_h * c;
-		for (uint32_t i = 1; i < texture.num_levels; i++) {
-			mip_w = Max(1U, mip_w / 2U);
-			mip_h = Max(1U, mip_h / 2U);
-			texture.levels[i].width  = mip_w;
-			texture.levels[i].height = mip_h;
-			uint8_t* staging_buffer = &staging[mip_offset];
-			mip_offset += mip_w * mip_h * c;
-			texture.levels[i].staging_buffer = staging_buffer;
-			// Downscale from previous level to current level
-			Texture::Level& last = texture.levels[i-1];
-			if (!stbir_resize_uint8(last.staging_buffer, last.width, last.height, last.width * c,
-				staging_buffer, mip_w, mip_h, mip_w * c, c))
-			{
-				// If downscale fails, fill level with red so this is visible
-				for (size_t i = 0; i < mip_w * mip_h * c; i++) { staging_buffer[i] = (i % c) ? 0 : 255; }
-				LOG_F(ERROR, "Downscale failed for texture %s level %u (%ux%u)", texture.source_path.cstr,
-					i, mip_w, mip_h);
+// Runs on the main thread once the next finer level of a streaming texture has been uploaded. The
+// level was counted as resident when it was queued, since its storage was allocated then.
+static void OnTextureLevelUploaded(Engine& engine, void* pv_texture) {
+	Texture& texture = *(static_cast<Texture*>(pv_texture));
+	texture.level_upload_pending = false;
+	TextureLoader_PendingLevels--;
+	texture.base_level--;
+	glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.base_level);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (texture.base_level == 0) {
+		FreeTextureDecode(texture.stream);
+		texture.stream = nullptr;
+	}
+}
+
+// Frees the finest resident level of a texture. The level is redefined as empty, which is allowed
+// since levels below GL_TEXTURE_BASE_LEVEL don't count towards completeness. The decoded level is
+// kept if the texture still has a stream, otherwise the texture is decoded again when needed.
+static uint64_t DropTextureLevel(Texture& texture) {
+	uint8_t level = texture.base_level;
+	uint64_t bytes = LevelBytes(texture, level);
+	glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+	if (texture.stored_compression != TextureCompression::None) {
+		GLenum internalformat = GetCompressedTextureFormat(texture.stored_compression);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internalformat, 0, 0, 0, 0, nullptr);
+	} else {
+		GLenum internalformat, format;
+		GetTextureFormat(texture.channels, &internalformat, &format);
+		glTexImage2D(GL_TEXTURE_2D, level, internalformat, 0, 0, 0, format, GL_UNSIGNED_BYTE, nullptr);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	texture.base_level++;
+	TextureLoader_ResidentBytes -= bytes;
+	AddStreamingTexture(texture);
+	return bytes;
+}
+
+// Deletes a texture's GL texture and decoded levels. It's loaded again once it's used.
+static uint64_t EvictTexture(Texture& texture) {
+	uint64_t bytes = ResidentBytes(texture);
+	glDeleteTextures(1, &texture.gl_texture);
+	texture.gl_texture = 0;
+	texture.base_level = texture.num_levels;
+	if (texture.stream) {
+		FreeTextureDecode(texture.stream);
+		texture.stream = nullptr;
+	}
+	TextureLoader_ResidentBytes -= bytes;
+	AddStreamingTexture(texture);
+	LOG_F(INFO, "Evicted texture %s (%.2f MB)", texture.source_path.cstr, float(bytes) / (1024.0f * 1024.0f));
+	return bytes;
+}
+
+// Tries to free bytes_needed of texture memory, least recently used textures first. Textures that
+// have been idle for TextureLoader_IdleFrames are evicted entirely, others lose their finest levels
+// one at a time. Textures used in the last frame, or with loads in flight, are left alone. Returns
+// the number of bytes freed.
+static uint64_t EvictTextureMemory(Engine& engine, uint64_t bytes_needed) {
+	ProfileZone("Evict Textures");
+	static std::vector<Texture*> candidates;
+	candidates.clear();
+	for (auto& [path, texture] : TextureLoader_Cache) {
+		bool used_recently = (texture->last_used_frame + 1 >= engine.this_frame.n);
+		bool busy = texture->read_pending || texture->decode_pending || texture->level_upload_pending;
+		if (!used_recently && !busy && ResidentBytes(*texture) > 0) { candidates.push_back(texture); }
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const Texture* a, const Texture* b) {
+		return a->last_used_frame < b->last_used_frame;
+	});
+
+	uint64_t freed = 0;
+	for (Texture* texture : candidates) {
+		if (freed >= bytes_needed) { break; }
+		if (texture->last_used_frame + TextureLoader_IdleFrames < engine.this_frame.n) {
+			freed += EvictTexture(*texture);
+		} else {
+			while (freed < bytes_needed && texture->base_level + 1 < texture->num_levels) {
+				freed += DropTextureLevel(*texture);
 			}
 		}
-		uint64_t time_mipgen_end = SDL_GetPerformanceCounter();
-		time_mipgen = float(time_mipgen_end - timestamp) / ticks_per_msec;
-		timestamp = time_mipgen_end;
+	}
+	return freed;
+}
+
+void UpdateTextureStreaming(Engine& engine) {
+	ProfileZone("Update Texture Streaming");
+	uint64_t budget = uint64_t(engine.texture_budget_mb * 1024.0f * 1024.0f);
+	if (TextureLoader_ResidentBytes > budget) {
+		EvictTextureMemory(engine, TextureLoader_ResidentBytes - budget);
 	}
 
-	UploadStagedLevels(texture);
+	for (size_t i = 0; i < TextureLoader_Streaming.size();) {
+		Texture& texture = *TextureLoader_Streaming[i];
+		uint8_t requested_level = texture.requested_level;
+		texture.requested_level = UINT8_MAX;
+		bool evicted = (texture.gl_texture == 0);
+		if (texture.alias || (!evicted && texture.base_level == 0)) {
+			TextureLoader_Streaming[i] = TextureLoader_Streaming.back();
+			TextureLoader_Streaming.pop_back();
+			continue;
+		}
+		i++;
 
-	uint64_t time_upload_end = SDL_GetPerformanceCounter();
-	float time_upload = float(time_upload_end - timestamp) / ticks_per_msec;
-	timestamp = time_upload_end;
+		// While a reload is pending, the old stream's levels would only be thrown away
+		if (texture.read_pending || texture.decode_pending || texture.level_upload_pending) { continue; }
 
-	if (!SOFTWARE_MIPGEN && texture.generate_mips) {
-		glBindTexture(GL_TEXTURE_2D, texture.gl_texture);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		uint64_t time_mipgen_end = SDL_GetPerformanceCounter();
-		time_mipgen = float(time_mipgen_end - timestamp) / ticks_per_msec;
-		timestamp = time_mipgen_end;
+		if (evicted) {
+			// Render() binds the texture (as 0) for as long as it's in use
+			if (texture.last_used_frame == engine.this_frame.n) {
+				StartTextureDecode(texture, MappedFile(), texture.priority);
+			}
+			continue;
+		}
+
+		if (requested_level >= texture.base_level) { continue; }
+		uint64_t bytes = LevelBytes(texture, texture.base_level - 1);
+		if (TextureLoader_ResidentBytes + bytes > budget) {
+			EvictTextureMemory(engine, TextureLoader_ResidentBytes + bytes - budget);
+			if (TextureLoader_ResidentBytes + bytes > budget) { continue; }
+		}
+		if (texture.stream) {
+			QueueLevelUpload(texture.gl_texture, *texture.stream, texture.base_level - 1);
+			QueueUploadCallback(OnTextureLevelUploaded, &texture);
+			texture.level_upload_pending = true;
+			TextureLoader_PendingLevels++;
+			TextureLoader_ResidentBytes += bytes;
+		} else {
+			// The decoded levels were freed when the texture was fully resident. The reload keeps
+			// the resident levels and streams in finer ones from the new stream.
+			StartTextureDecode(texture, MappedFile(), texture.priority);
+		}
 	}
+}
+
+uint64_t GetTextureMemoryUsage() {
+	return TextureLoader_ResidentBytes;
+}
 
-	LOG_F(INFO, "Texture %s: load %.03fms mipgen %.03f ms upload %.03fms gltex=%u", texture.source_path.cstr,
-		time_disk_load, time_mipgen, time_upload, texture.gl_texture);
+static void OnTextureRead(void* pv_texture, const String& path, MappedFile& contents) {
+	Texture& texture = *(static_cast<Texture*>(pv_texture));
+	texture.read_pending = false;
+	StartTextureDecode(texture, std::move(contents), texture.priority);
+}
 
-	stbi_image_free(image);
-	free(staging);
+static void OnTextureFileChanged(void* pv_texture, const String& path) {
+	Texture& texture = *(static_cast<Texture*>(pv_texture));
+	LOG_F(INFO, "Texture %s changed on disk, reloading", path.cstr);
+	// If the initial read is still in flight, it'll pick up the new contents anyway. Otherwise the
+	// reload jumps the queue, since whoever saved the file is looking at the result.
+	if (!texture.read_pending) { StartTextureDecode(texture, MappedFile(), DeferPriority::High); }
 }
 
-Texture* GetTexture(uint64_t source_path_hash, const char* source_path, bool generate_mips) {
-	Texture& texture = TextureLoader_Cache[source_path_hash];
+Texture* GetTexture(StringId source_path, bool generate_mips, DeferPriority priority,
+	const MipgenOptions& mipgen, TextureCompression compression)
+{
+	Texture*& cached = TextureLoader_Cache[source_path];
+	if (!cached) {
+		cached = new Texture();
+		WatchFile(source_path, OnTextureFileChanged, cached);
+	}
+	Texture& texture = *cached;
+	if (priority < texture.priority) { texture.priority = priority; }
 
 	bool uninitialised = (texture.source_path == nullptr);
 	bool needs_reupload = (!uninitialised && (generate_mips && !texture.generate_mips));
 	if (uninitialised || needs_reupload) {
-		texture.source_path = String::copy(source_path);
 		texture.generate_mips = generate_mips;
-		Defer(UploadTexture, &texture);
+		if (uninitialised) {
+			texture.source_path = String::view(source_path.cstr());
+			texture.mipgen = mipgen;
+			texture.compression = compression;
+			// Read the file in the background, so that many textures can be read at once. The
+			// decode is started once the contents are available.
+			texture.read_pending = true;
+			SubmitAsyncRead(texture.source_path, OnTextureRead, &texture);
+		} else if (!texture.read_pending) {
+			StartTextureDecode(texture, MappedFile(), texture.priority);
+		}
 	}
 
 	return &texture;
 }
 
+uint32_t GetPendingTextureLoadCount() {
+	return TextureLoader_PendingLoads;
+}
+
+uint32_t GetPendingTextureLevelCount() {
+	return TextureLoader_PendingLevels;
+}
+
+static bool IsCookableImage(const String& path) {
+	const char* extension = strrchr(path.cstr, '.');
+	if (!extension) { return false; }
+	for (const char* e : {".png", ".jpg", ".jpeg", ".tga", ".bmp"}) {
+		if (SDL_strcasecmp(extension, e) == 0) { return true; }
+	}
+	return false;
+}
+
+static void FindCookableImages(const String& directory, std::vector<String>& paths) {
+	for (String name : DirectoryIterator(directory)) {
+		String path = PathJoin(directory, name);
+		if (PathIsDirectory(path)) {
+			FindCookableImages(path, paths);
+		} else if (IsCookableImage(path)) {
+			paths.push_back(path);
+		}
+	}
+}
+
+bool CookTextures(const String& directory) {
+	std::vector<String> paths;
+	FindCookableImages(directory, paths);
+
+	// Always cooked with mips, so that the files can be used whether the texture needs them or not
+	std::atomic<uint32_t> cooked = 0, failed = 0;
+	ParallelFor(uint32_t(paths.size()), 1, [&](uint32_t begin, uint32_t end) {
+		for (uint32_t i = begin; i < end; i++) {
+			const String& path = paths[i];
+			TextureDecode decode;
+			decode.generate_mips = true;
+			decode.file = MapFile(path);
+			if (!decode.file) {
+				LOG_F(ERROR, "Failed to cook %s: can't open file", path.cstr);
+				failed++;
+				continue;
+			}
+			decode.content_key = GetTextureContentKey(decode.file, decode.mipgen, decode.compression);
+			uint64_t source_hash = CookedSourceHash(decode.content_key);
+			String cooked_path = GetIrisTexPath(path);
+			if (LoadCookedTexture(decode, cooked_path, source_hash)) { continue; }
+			if (!DecodeImage(decode, true)) {
+				LOG_F(ERROR, "Failed to cook %s: %s", path.cstr, decode.error);
+				failed++;
+			} else if (!CookDecodedTexture(decode, cooked_path, source_hash)) {
+				failed++;
+			} else {
+				LOG_F(INFO, "Cooked %s (%ux%u, %u levels)", path.cstr, decode.width, decode.height, decode.num_levels);
+				cooked++;
+			}
+		}
+	});
+
+	LOG_F(INFO, "Cooked %u of %u textures under %s (%u up to date, %u failed)", cooked.load(),
+		uint32_t(paths.size()), directory.cstr, uint32_t(paths.size()) - cooked.load() - failed.load(), failed.load());
+	return failed == 0;
+}
+
 Sampler* GetSampler(const SamplerParams& params) {
 	uint64_t hash = Hash64(&params, sizeof(params));
-	Sampler& sampler = SamplerLoader_Cache[hash];
+	Sampler*& cached = SamplerLoader_Cache[hash];
+	if (!cached) { cached = new Sampler(); }
+	Sampler& sampler = *cached;
 	if (sampler.gl_sampler) { return &sampler; }
 
 	sampler.params = params;
@@ -1,15 +1,38 @@
 #pragma once
 #include "base/string.hh"
 #include "base/hash.hh"
+#include "base/stringid.hh"
+#include "base/filesystem.hh"
 #include "graphics/opengl.hh"
+#include "assets/mipgen.hh"
+#include "assets/texcompress.hh"
+#include "engine/deferred.hh"
+
+struct Engine;
+struct TextureDecode;
+
+// Identifies what a texture is loaded from: a hash of its source file's contents, and of the options
+// it's decoded with.
+struct TextureContentKey {
+	Hash128 source = {};
+	uint64_t options = 0;
+	bool operator==(const TextureContentKey& rhs) const = default;
+};
 
 // Represents a 2D texture that may be fully, partially or not at all loaded into GPU memory.
 // To retrieve a texture object usable for rendering, use GetTexture().
-// TODO: We only support 8-bit UNORM textures at the moment. We probably want to support more
-// formats, including compressed ones.
+// Textures are stored as 8-bit UNORM, or block-compressed if requested and supported by the GPU.
 struct Texture {
 	String source_path;
 	bool generate_mips;
+	// How the mips are generated. Set by the first request for the texture.
+	MipgenOptions mipgen;
+	// Block compression to store the texture with. Set by the first request for the texture. Falls
+	// back to a format with fewer channels if the image doesn't have them, or to no compression if
+	// the GPU doesn't support the format.
+	TextureCompression compression = TextureCompression::None;
+	// Block compression of the resident levels, once loaded.
+	TextureCompression stored_compression = TextureCompression::None;
 
 	bool loaded = false;
 	uint32_t width = 0;
@@ -20,24 +43,65 @@ struct Texture {
 	struct Level {
 		uint32_t width = 0;
 		uint32_t height = 0;
-		// CPU-side staging buffer containing RGBA8 image data for this level.
-		// Will be deallocated using free() once the level is uploaded.
-		uint8_t* staging_buffer = nullptr;
+		// CPU-side staging buffer containing 8-bit UNORM texels or compressed blocks for this level.
+		// Only set while the level is waiting to be uploaded; the buffer belongs to whoever filled it
+		// in, and may be a read-only mapping of a cooked file.
+		const uint8_t* staging_buffer = nullptr;
 	};
 	uint8_t num_levels = 0;
 	Level levels[MaxLevels];
 
 	GLuint gl_texture = 0;
 
+	// Mipmapped textures are streamed in progressively, smallest levels first. Only levels from
+	// base_level down to the smallest one are resident on the GPU, and the texture's
+	// GL_TEXTURE_BASE_LEVEL is clamped to base_level. Finer levels are uploaded when the render list
+	// asks for them with RequestTextureLevel(), and dropped again when over the memory budget.
+	// Textures evicted entirely have a gl_texture of 0 and are reloaded once they're used again.
+	uint8_t base_level = 0;
+	// Finest level requested since the last call to UpdateTextureStreaming().
+	uint8_t requested_level = UINT8_MAX;
+	// Set while a finer level is being streamed in.
+	bool level_upload_pending = false;
+	// Last frame in which the texture was bound for rendering. Textures that haven't been used for
+	// a while are the first to lose levels when over the texture memory budget.
+	uint64_t last_used_frame = 0;
+	// Decoded levels that aren't resident yet. Owned by the texture loader.
+	TextureDecode* stream = nullptr;
+
+	// Textures are deduplicated by content. If another texture was loaded from a byte-identical file
+	// with the same options, this one doesn't get levels or a GL texture of its own, and points to
+	// the other one instead. Set once the file has been read; use resolve() to get the texture to
+	// bind.
+	Texture* alias = nullptr;
+	// Content of the texture's levels, once loaded.
+	TextureContentKey content_key;
+
+	// Set while the file is being read in the background by GetTexture.
+	bool read_pending = false;
+	// Set while the image is being decoded on a worker thread, or waiting to be streamed to the GPU.
+	bool decode_pending = false;
+	// Set if the texture needs to be decoded again once the pending decode is done, e.g. because
+	// the file changed in the meantime.
+	bool redecode_pending = false;
+	// Priority of the deferred upload. Raised if the texture is requested again with a higher one.
+	DeferPriority priority = DeferPriority::Normal;
+
 	Texture(): source_path{nullptr}, generate_mips{false} {}
 
 	Texture(const String& source_path, bool generate_mips = false):
 		source_path{String::copy(source_path)}, generate_mips{generate_mips} {}
 
+	Texture* resolve() { return alias ? alias : this; }
+
 	uint32_t size() const {
 		uint32_t accum = 0;
 		for (uint32_t i = 0; i < num_levels; i++) {
-			accum += levels[i].width * levels[i].height * channels;
+			if (stored_compression != TextureCompression::None) {
+				accum += uint32_t(CompressedLevelSize(stored_compression, levels[i].width, levels[i].height));
+			} else {
+				accum += levels[i].width * levels[i].height * channels;
+			}
 		}
 		return accum;
 	}
@@ -50,13 +114,55 @@ namespace Textures {
 }
 
 // Allocates or returns a previously allocated Texture object for the given path and parameters.
-// Once requested, the texture will be uploaded to the GPU when possible.
-Texture* GetTexture(uint64_t source_path_hash, const char* source_path, bool generate_mips = false);
+// Once requested, the texture's file is read in the background and decoded on a worker thread,
+// then uploaded to the GPU on the main thread when possible. Uploads of textures with a higher
+// priority are done first. Decoded textures are cooked into an .iristex file next to the source
+// (see assets/iristex.hh), which later loads use instead. The mipgen options and compression only
+// apply to the first request for a path. Paths whose contents turn out to be identical to an already
+// loaded texture's become aliases of it, see Texture::alias.
+Texture* GetTexture(StringId source_path, bool generate_mips = false,
+	DeferPriority priority = DeferPriority::Normal, const MipgenOptions& mipgen = {},
+	TextureCompression compression = TextureCompression::None);
 
-static Texture* GetTexture(const char* source_path, bool generate_mips = false) {
-	return GetTexture(Hash64(source_path), source_path, generate_mips);
+static Texture* GetTexture(const char* source_path, bool generate_mips = false,
+	DeferPriority priority = DeferPriority::Normal, const MipgenOptions& mipgen = {},
+	TextureCompression compression = TextureCompression::None)
+{
+	return GetTexture(StringId::intern(source_path), generate_mips, priority, mipgen, compression);
 }
 
+// Number of textures that have been requested but aren't uploaded yet. Must be called from the
+// main thread.
+uint32_t GetPendingTextureLoadCount();
+
+// Number of textures that have a finer level queued for upload by UpdateTextureStreaming() but
+// not uploaded yet. Must be called from the main thread.
+uint32_t GetPendingTextureLevelCount();
+
+// Asks for the texture to be streamed in down to at least the given level. Requests are collected
+// over a frame, and the finest one is acted on by UpdateTextureStreaming().
+static void RequestTextureLevel(Texture* texture, uint8_t level) {
+	texture->requested_level = Min(texture->requested_level, level);
+}
+
+// Queues the next finer level of every partially resident texture that has been asked for one since
+// the last call, and reloads evicted textures that have been used again. One level per texture is
+// streamed at a time. Keeps the GPU memory used by textures under engine.texture_budget_mb by
+// evicting least recently used levels and textures, and doesn't stream in finer levels that would
+// go over it. Must be called once per frame on the main thread, after rendering and before
+// ProcessUploads().
+void UpdateTextureStreaming(Engine& engine);
+
+// Cooks every image under the given directory that doesn't have an up-to-date .iristex file yet,
+// so that the first run doesn't have to. Images are cooked uncompressed with the default mipgen
+// options; ones that the engine loads with other options (e.g. sRGB albedo, or block compression)
+// are cooked again on first use. Runs on the calling thread and the job system's workers.
+// Returns false if any image couldn't be cooked.
+bool CookTextures(const String& directory);
+
+// Approximate GPU memory used by the levels of all textures that are resident, in bytes.
+uint64_t GetTextureMemoryUsage();
+
 // Represents a set of texture sampling parameters.
 struct SamplerParams {
 	GLenum min_filter = GL_LINEAR;
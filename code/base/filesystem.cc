@@ -1,5 +1,59 @@
 #include "base/filesystem.hh"
 #include "base/debug.hh"
+#include "base/memory.hh"
+
+#include <atomic>
+#include <new>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+struct MappedFileShared {
+	std::atomic<uint32_t> refs;
+	// Base address and size of the mapping, or of the heap buffer if mapped is false
+	void* base;
+	size_t size;
+	bool mapped;
+};
+
+// Files smaller than this are read into a heap buffer instead of being mapped. A mapping costs at
+// least a page plus a few syscalls to set up and tear down, which outweighs copying a small file.
+static constexpr size_t MapFile_MinMappedSize = 64 * 1024;
+
+// Implemented by the platform-specific filesystem code. PlatformMapFile fills in base, size
+// and mapped. It returns false only if the file can't be opened; if mapping fails, or the
+// file is smaller than MapFile_MinMappedSize, it reads the file into a malloc'd buffer instead.
+static bool PlatformMapFile(const String& path, MappedFile::Access access, MappedFileShared& shared);
+static void PlatformUnmapFile(MappedFileShared& shared);
+
+// Reads a whole file into a malloc'd buffer with blocking calls. Returns false if the file can't
+// be opened.
+static bool PlatformReadFile(const String& path, MappedFileShared& shared);
+
+struct AsyncReadOp {
+	String path;
+	AsyncReadCallback callback;
+	void* userdata;
+	MappedFileShared* shared;
+	bool ok;
+	// State for the native backend
+	int fd;
+	size_t offset;
+};
+
+// Native asynchronous I/O backend, if the platform has one. All of these except PlatformAsyncWait
+// are called with AsyncIO_Mutex held. PlatformAsyncStart either issues the read, keeps the op in
+// its own backlog if it's at capacity, or fails it straight away by putting it on
+// AsyncIO_Completed. PlatformAsyncReap moves finished ops to AsyncIO_Completed and starts ones from
+// the backlog. PlatformAsyncWait blocks until at least one op might have finished, and returns
+// false without blocking if the backend has nothing in flight. If PlatformAsyncInit returns false,
+// every read goes to the thread pool instead.
+static bool PlatformAsyncInit();
+static void PlatformAsyncStart(AsyncReadOp* op);
+static void PlatformAsyncReap();
+static bool PlatformAsyncWait();
 
 String PathJoin(const String& a, const String& b) {
 	const char native_sep  = PLATFORM_WINDOWS ? '\\' : '/';
@@ -38,6 +92,216 @@ String ReadFile(const String& path) {
 	return str;
 }
 
+// Returned for empty files, so that they can be told apart from files that couldn't be opened.
+static const uint8_t MapFile_EmptyData[1] = {};
+
+MappedFile MapFile(const String& path, MappedFile::Access access) {
+	auto shared = new MappedFileShared{.refs = 1, .base = nullptr, .size = 0, .mapped = false};
+	if (!PlatformMapFile(path, access, *shared)) {
+		delete shared;
+		return MappedFile();
+	}
+
+	MappedFile result;
+	result.shared = shared;
+	result.data = shared->base ? static_cast<const uint8_t*>(shared->base) : MapFile_EmptyData;
+	result.size = shared->size;
+	return result;
+}
+
+MappedFile::MappedFile(const MappedFile& other): data{other.data}, size{other.size}, shared{other.shared} {
+	if (shared) { shared->refs.fetch_add(1, std::memory_order_relaxed); }
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept: data{other.data}, size{other.size}, shared{other.shared} {
+	other.data = nullptr;
+	other.size = 0;
+	other.shared = nullptr;
+}
+
+MappedFile& MappedFile::operator=(const MappedFile& other) {
+	if (this != &other) {
+		this->~MappedFile();
+		new (this) MappedFile(other);
+	}
+	return *this;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		this->~MappedFile();
+		new (this) MappedFile(std::move(other));
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	if (shared && shared->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		if (shared->mapped) {
+			PlatformUnmapFile(*shared);
+		} else {
+			free(shared->base);
+		}
+		delete shared;
+	}
+	data = nullptr;
+	size = 0;
+	shared = nullptr;
+}
+
+static constexpr uint32_t AsyncIO_MaxThreads = 4;
+
+static std::mutex AsyncIO_Mutex;
+static std::condition_variable AsyncIO_Wakeup;    // signalled when ops are queued
+static std::condition_variable AsyncIO_Finished;  // signalled when ops are completed
+static std::deque<AsyncReadOp*> AsyncIO_Queued;
+static std::vector<AsyncReadOp*> AsyncIO_Completed;
+static std::atomic<uint32_t> AsyncIO_Pending = 0;
+static bool AsyncIO_Initialised = false;
+static bool AsyncIO_Native = false;
+static bool AsyncIO_Quit = false;
+static uint32_t AsyncIO_NumThreads = 0;
+static std::thread AsyncIO_Threads[AsyncIO_MaxThreads];
+
+static void AsyncIOThread() {
+	for (;;) {
+		AsyncReadOp* op;
+		{
+			std::unique_lock<std::mutex> lock(AsyncIO_Mutex);
+			AsyncIO_Wakeup.wait(lock, []() { return AsyncIO_Quit || !AsyncIO_Queued.empty(); });
+			if (AsyncIO_Quit) { return; }
+			op = AsyncIO_Queued.front();
+			AsyncIO_Queued.pop_front();
+		}
+		op->ok = PlatformReadFile(op->path, *op->shared);
+		{
+			std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+			AsyncIO_Completed.push_back(op);
+		}
+		AsyncIO_Finished.notify_all();
+	}
+}
+
+static void ShutdownAsyncIO() {
+	{
+		std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+		AsyncIO_Quit = true;
+	}
+	AsyncIO_Wakeup.notify_all();
+	for (uint32_t i = 0; i < AsyncIO_NumThreads; i++) {
+		AsyncIO_Threads[i].join();
+	}
+	AsyncIO_NumThreads = 0;
+}
+
+// Starts the I/O thread pool. Called with AsyncIO_Mutex held, either on first use or when the
+// native backend turns out not to work.
+static void StartAsyncIOThreads() {
+	if (PLATFORM_WEB || AsyncIO_NumThreads > 0) { return; }
+	AsyncIO_NumThreads = AsyncIO_MaxThreads;
+	for (uint32_t i = 0; i < AsyncIO_NumThreads; i++) {
+		AsyncIO_Threads[i] = std::thread(AsyncIOThread);
+	}
+	LOG_F(INFO, "Started %u threads for asynchronous file reads", AsyncIO_NumThreads);
+}
+
+// Hands an op over to the thread pool. Used by the native backend if it can't handle the op.
+// Called with AsyncIO_Mutex held.
+static void FallBackToAsyncIOThreads(AsyncReadOp* op) {
+	StartAsyncIOThreads();
+	AsyncIO_Queued.push_back(op);
+	AsyncIO_Wakeup.notify_one();
+}
+
+void SubmitAsyncReads(const AsyncReadRequest* requests, uint32_t count) {
+	std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+	if (!AsyncIO_Initialised) {
+		AsyncIO_Native = PlatformAsyncInit();
+		if (!AsyncIO_Native) { StartAsyncIOThreads(); }
+		// Threads have to be joined before the mutex and condition variables are destroyed
+		atexit(ShutdownAsyncIO);
+		AsyncIO_Initialised = true;
+	}
+
+	AsyncIO_Pending.fetch_add(count, std::memory_order_relaxed);
+	for (uint32_t i = 0; i < count; i++) {
+		auto op = new AsyncReadOp{
+			.path = String::copy(requests[i].path),
+			.callback = requests[i].callback,
+			.userdata = requests[i].userdata,
+			.shared = new MappedFileShared{.refs = 1, .base = nullptr, .size = 0, .mapped = false},
+			.ok = false,
+			.fd = -1,
+			.offset = 0,
+		};
+		if (AsyncIO_Native) {
+			PlatformAsyncStart(op);
+		} else {
+			AsyncIO_Queued.push_back(op);
+		}
+	}
+	if (AsyncIO_Native) {
+		PlatformAsyncReap();
+	} else {
+		AsyncIO_Wakeup.notify_all();
+	}
+}
+
+uint32_t PollAsyncReads() {
+	std::vector<AsyncReadOp*> completed;
+	{
+		std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+		if (AsyncIO_Native) { PlatformAsyncReap(); }
+		// Without native I/O or threads, reads are done here, one batch per poll
+		if (AsyncIO_NumThreads == 0 && !AsyncIO_Native) {
+			while (!AsyncIO_Queued.empty()) {
+				AsyncReadOp* op = AsyncIO_Queued.front();
+				AsyncIO_Queued.pop_front();
+				op->ok = PlatformReadFile(op->path, *op->shared);
+				AsyncIO_Completed.push_back(op);
+			}
+		}
+		completed.swap(AsyncIO_Completed);
+	}
+
+	for (AsyncReadOp* op : completed) {
+		MappedFile contents;
+		if (op->ok) {
+			contents.shared = op->shared;
+			contents.data = op->shared->base ? static_cast<const uint8_t*>(op->shared->base) : MapFile_EmptyData;
+			contents.size = op->shared->size;
+		} else {
+			free(op->shared->base);
+			delete op->shared;
+		}
+		op->callback(op->userdata, op->path, contents);
+		delete op;
+		AsyncIO_Pending.fetch_sub(1, std::memory_order_release);
+	}
+	return uint32_t(completed.size());
+}
+
+uint32_t GetPendingAsyncReadCount() {
+	return AsyncIO_Pending.load(std::memory_order_acquire);
+}
+
+void WaitForAsyncReads() {
+	while (GetPendingAsyncReadCount() > 0) {
+		if (PollAsyncReads() > 0) { continue; }
+		bool native;
+		{
+			std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+			native = AsyncIO_Native;
+		}
+		if (native && PlatformAsyncWait()) { continue; }
+		// Ops that the native backend couldn't handle may still be with the thread pool
+		std::unique_lock<std::mutex> lock(AsyncIO_Mutex);
+		if (AsyncIO_NumThreads > 0) {
+			AsyncIO_Finished.wait(lock, []() { return !AsyncIO_Completed.empty(); });
+		}
+	}
+}
+
 bool WriteFile(const String& path, const void* data, size_t size) {
 	FILE* file = fopen(path, "wb");
 	if (!file) { return false; }
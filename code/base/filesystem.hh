@@ -24,6 +24,76 @@ uint64_t GetFileModificationTime(const String& path);
 // Assumes the file is binary data. Doesn't perform any newline conversion.
 String ReadFile(const String& path);
 
+// Read-only view of a file's contents, mapped into memory so that pages are read from the OS page
+// cache on demand instead of being copied into a heap buffer. Copies of a MappedFile share the
+// same mapping, which is released once the last copy is destroyed. Mapped memory may be read from
+// any thread. The data is NOT null-terminated.
+struct MappedFile {
+	// How the caller intends to read the file. Passed on to the OS as a readahead hint.
+	enum Access : uint8_t {
+		// The whole file will be read from front to back, e.g. when decoding an image.
+		Sequential,
+		// Parts of the file will be read in no particular order.
+		Random,
+	};
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+	struct MappedFileShared* shared = nullptr;
+
+	MappedFile() = default;
+	MappedFile(const MappedFile& other);
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(const MappedFile& other);
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	const char* chars() const { return reinterpret_cast<const char*>(data); }
+	explicit operator bool() const { return data != nullptr; }
+};
+
+// Map a file into memory. Returns an empty MappedFile if the file can't be opened. If mapping
+// fails, or on platforms without mmap support, the file is read into a heap buffer instead.
+MappedFile MapFile(const String& path, MappedFile::Access access = MappedFile::Sequential);
+
+/* Asynchronous file reads.
+ *
+ * SubmitAsyncReads() queues any number of whole-file reads and returns immediately. On Linux the
+ * reads are issued through io_uring, so the kernel can work on all of them at once. Elsewhere, or
+ * if io_uring isn't available, a small pool of I/O threads reads the files with blocking calls.
+ * On the web there are no threads, and files are read inside PollAsyncReads().
+ *
+ * Finished reads are handed back by PollAsyncReads(), which calls each request's callback on the
+ * calling thread. The contents are passed as a heap-backed MappedFile that the callback can move
+ * out and hold on to; it's empty if the file couldn't be read.
+ */
+typedef void (*AsyncReadCallback)(void* userdata, const String& path, MappedFile& contents);
+
+struct AsyncReadRequest {
+	// Path to read. Copied, so it doesn't need to outlive the call to SubmitAsyncReads.
+	const char* path;
+	AsyncReadCallback callback;
+	void* userdata;
+};
+
+// Queues a batch of reads. May be called from any thread.
+void SubmitAsyncReads(const AsyncReadRequest* requests, uint32_t count);
+
+static void SubmitAsyncRead(const char* path, AsyncReadCallback callback, void* userdata) {
+	AsyncReadRequest request = {.path = path, .callback = callback, .userdata = userdata};
+	SubmitAsyncReads(&request, 1);
+}
+
+// Calls the callbacks of reads that have finished since the last call. Returns the number of
+// callbacks that were run. Should only be called from one thread, usually the main thread.
+uint32_t PollAsyncReads();
+
+// Number of reads that have been submitted but whose callbacks haven't run yet.
+uint32_t GetPendingAsyncReadCount();
+
+// Blocks until every submitted read has finished and its callback has run.
+void WaitForAsyncReads();
+
 // Write the given buffer to a file, overwriting its previous contents.
 // Assumes the buffer is binary data and writes it to disk verbatim.
 bool WriteFile(const String& path, const void* data, size_t size);
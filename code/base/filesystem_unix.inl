@@ -4,7 +4,20 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+
+// io_uring is used for asynchronous reads on Linux. Android is excluded since its seccomp policy
+// may kill processes that use it.
+#if defined(__linux__) && !defined(__ANDROID__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define FILESYSTEM_IO_URING 1
+#else
+#define FILESYSTEM_IO_URING 0
+#endif
 
 String GetCurrentDir() {
 	// FIXME: getcwd(NULL, 0) is an extension, probably doesn't work on Android
@@ -86,3 +99,280 @@ DirectoryIterator& DirectoryIterator::operator++() {
 
 	return *this;
 }
+
+// Reads a file into a malloc'd buffer. Used for small files and when mmap fails.
+static bool ReadFileToHeap(int fd, size_t size, MappedFileShared& shared) {
+	if (size == 0) { return true; }
+	uint8_t* buffer = static_cast<uint8_t*>(malloc(size));
+	CHECK_NOTNULL_F(buffer, "Failed to allocate %zu bytes for file contents", size);
+	CountHeapAllocation();
+	size_t total = 0;
+	while (total < size) {
+		ssize_t bytes = read(fd, &buffer[total], size - total);
+		if (bytes < 0 && errno == EINTR) { continue; }
+		if (bytes <= 0) { break; }
+		total += size_t(bytes);
+	}
+	shared.base = buffer;
+	shared.size = total;
+	shared.mapped = false;
+	return true;
+}
+
+static bool PlatformMapFile(const String& path, MappedFile::Access access, MappedFileShared& shared) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { return false; }
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+		close(fd);
+		return false;
+	}
+	size_t size = size_t(statbuf.st_size);
+
+	// Emscripten's mmap allocates a buffer and copies the file into it, so there's nothing to gain
+	if (!PLATFORM_WEB && size >= MapFile_MinMappedSize) {
+		void* base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (base != MAP_FAILED) {
+			if (access == MappedFile::Sequential) {
+				madvise(base, size, MADV_SEQUENTIAL);
+				madvise(base, size, MADV_WILLNEED);
+			} else {
+				madvise(base, size, MADV_RANDOM);
+			}
+			#ifdef MADV_HUGEPAGE
+			// Allows the kernel to back large mappings with transparent huge pages, if the filesystem
+			// supports that. Fewer TLB misses when walking through multi-megabyte buffers.
+			if (size >= 2 * 1024 * 1024) { madvise(base, size, MADV_HUGEPAGE); }
+			#endif
+			// The mapping keeps its own reference to the file
+			close(fd);
+			shared.base = base;
+			shared.size = size;
+			shared.mapped = true;
+			return true;
+		}
+		LOG_F(WARNING, "Failed to map %s (%s), reading it instead", path.cstr, strerror(errno));
+	}
+
+	bool ok = ReadFileToHeap(fd, size, shared);
+	close(fd);
+	return ok;
+}
+
+static void PlatformUnmapFile(MappedFileShared& shared) {
+	munmap(shared.base, shared.size);
+}
+
+static bool PlatformReadFile(const String& path, MappedFileShared& shared) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) { return false; }
+	struct stat statbuf;
+	if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+		close(fd);
+		return false;
+	}
+	bool ok = ReadFileToHeap(fd, size_t(statbuf.st_size), shared);
+	close(fd);
+	return ok;
+}
+
+#if FILESYSTEM_IO_URING
+
+// Minimal io_uring setup using raw syscalls, so we don't need liburing. The ring is only touched
+// with AsyncIO_Mutex held, so the only synchronisation needed is with the kernel.
+struct IoUring {
+	int fd = -1;
+	uint32_t entries = 0;
+	uint32_t in_flight = 0;   // ops whose completions haven't been reaped yet
+	uint32_t unsubmitted = 0; // SQEs written but not yet passed to io_uring_enter
+	uint32_t* sq_tail;
+	uint32_t* sq_mask;
+	uint32_t* sq_array;
+	io_uring_sqe* sqes;
+	uint32_t* cq_head;
+	uint32_t* cq_tail;
+	uint32_t* cq_mask;
+	io_uring_cqe* cqes;
+};
+static IoUring AsyncIO_Ring;
+// Ops waiting for space in the ring, or for the rest of a short read to be issued
+static std::deque<AsyncReadOp*> AsyncIO_RingBacklog;
+
+// Reads larger than this are split up, since the length field is 32 bits
+static constexpr size_t IoUring_MaxReadSize = 1 << 30;
+
+static bool PlatformAsyncInit() {
+	IoUring& ring = AsyncIO_Ring;
+	io_uring_params params = {};
+	int fd = int(syscall(__NR_io_uring_setup, 64, &params));
+	if (fd < 0) {
+		LOG_F(INFO, "io_uring is not available (%s), using threads for asynchronous reads", strerror(errno));
+		return false;
+	}
+
+	size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+	if (single_mmap) { sq_size = cq_size = Max(sq_size, cq_size); }
+
+	int prot = PROT_READ | PROT_WRITE, flags = MAP_SHARED | MAP_POPULATE;
+	void* sq = mmap(nullptr, sq_size, prot, flags, fd, IORING_OFF_SQ_RING);
+	void* cq = single_mmap ? sq : mmap(nullptr, cq_size, prot, flags, fd, IORING_OFF_CQ_RING);
+	void* sqes = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), prot, flags, fd, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+		LOG_F(WARNING, "Failed to map io_uring queues, using threads for asynchronous reads");
+		close(fd);
+		return false;
+	}
+
+	uint8_t* sq_base = static_cast<uint8_t*>(sq);
+	uint8_t* cq_base = static_cast<uint8_t*>(cq);
+	ring.fd = fd;
+	ring.entries = params.sq_entries;
+	ring.sq_tail  = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.tail);
+	ring.sq_mask  = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.ring_mask);
+	ring.sq_array = reinterpret_cast<uint32_t*>(sq_base + params.sq_off.array);
+	ring.sqes     = static_cast<io_uring_sqe*>(sqes);
+	ring.cq_head  = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.head);
+	ring.cq_tail  = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.tail);
+	ring.cq_mask  = reinterpret_cast<uint32_t*>(cq_base + params.cq_off.ring_mask);
+	ring.cqes     = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+	LOG_F(INFO, "Using io_uring with %u entries for asynchronous reads", ring.entries);
+	return true;
+}
+
+static void IoUringQueueRead(AsyncReadOp* op) {
+	IoUring& ring = AsyncIO_Ring;
+	uint32_t tail = *ring.sq_tail;
+	uint32_t index = tail & *ring.sq_mask;
+	io_uring_sqe& sqe = ring.sqes[index];
+	memset(&sqe, 0, sizeof(sqe));
+	sqe.opcode = IORING_OP_READ;
+	sqe.fd = op->fd;
+	sqe.addr = uint64_t(static_cast<uint8_t*>(op->shared->base) + op->offset);
+	sqe.len = uint32_t(Min(op->shared->size - op->offset, IoUring_MaxReadSize));
+	sqe.off = op->offset;
+	sqe.user_data = uint64_t(op);
+	ring.sq_array[index] = index;
+	std::atomic_ref<uint32_t>(*ring.sq_tail).store(tail + 1, std::memory_order_release);
+	ring.in_flight++;
+	ring.unsubmitted++;
+}
+
+static void IoUringSubmit() {
+	IoUring& ring = AsyncIO_Ring;
+	while (ring.unsubmitted > 0) {
+		int submitted = int(syscall(__NR_io_uring_enter, ring.fd, ring.unsubmitted, 0, 0, nullptr, 0));
+		if (submitted < 0 && errno == EINTR) { continue; }
+		if (submitted <= 0) {
+			// Leave the rest in the queue. The next call to io_uring_enter will pick them up.
+			LOG_F(WARNING, "io_uring_enter failed: %s", strerror(errno));
+			break;
+		}
+		ring.unsubmitted -= uint32_t(submitted);
+	}
+}
+
+static void FinishAsyncOp(AsyncReadOp* op, bool ok) {
+	if (op->fd >= 0) { close(op->fd); }
+	op->fd = -1;
+	op->ok = ok;
+	AsyncIO_Completed.push_back(op);
+}
+
+static void PlatformAsyncStart(AsyncReadOp* op) {
+	if (AsyncIO_Ring.in_flight >= AsyncIO_Ring.entries) {
+		AsyncIO_RingBacklog.push_back(op);
+		return;
+	}
+
+	if (op->fd < 0) {
+		// Opening and sizing the file happen here rather than through the ring. Doing them there
+		// would take two more round trips (openat, then statx) before the buffer could be
+		// allocated and the read queued, and on local disks open and fstat rarely block for long.
+		op->fd = open(op->path, O_RDONLY | O_CLOEXEC);
+		struct stat statbuf;
+		if (op->fd < 0 || fstat(op->fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+			FinishAsyncOp(op, false);
+			return;
+		}
+		size_t size = size_t(statbuf.st_size);
+		if (size == 0) {
+			FinishAsyncOp(op, true);
+			return;
+		}
+		op->shared->base = malloc(size);
+		CHECK_NOTNULL_F(op->shared->base, "Failed to allocate %zu bytes for %s", size, op->path.cstr);
+		CountHeapAllocation();
+		op->shared->size = size;
+		op->offset = 0;
+	}
+
+	IoUringQueueRead(op);
+}
+
+static void PlatformAsyncReap() {
+	IoUring& ring = AsyncIO_Ring;
+	uint32_t head = *ring.cq_head;
+	uint32_t tail = std::atomic_ref<uint32_t>(*ring.cq_tail).load(std::memory_order_acquire);
+	for (; head != tail; head++) {
+		const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+		AsyncReadOp* op = reinterpret_cast<AsyncReadOp*>(cqe.user_data);
+		int32_t result = cqe.res;
+		ring.in_flight--;
+
+		if (result > 0) {
+			op->offset += size_t(result);
+			if (op->offset < op->shared->size) {
+				// Short read, queue up the rest
+				AsyncIO_RingBacklog.push_front(op);
+			} else {
+				FinishAsyncOp(op, true);
+			}
+		} else if (result == 0) {
+			// The file got shorter since we looked at it
+			op->shared->size = op->offset;
+			FinishAsyncOp(op, true);
+		} else if (result == -EINTR || result == -EAGAIN) {
+			AsyncIO_RingBacklog.push_front(op);
+		} else if (result == -EINVAL || result == -EOPNOTSUPP) {
+			// Kernels older than 5.6 have io_uring but not IORING_OP_READ
+			LOG_F(WARNING, "io_uring read of %s failed (%s), retrying on a thread", op->path.cstr, strerror(-result));
+			close(op->fd);
+			op->fd = -1;
+			free(op->shared->base);
+			op->shared->base = nullptr;
+			op->shared->size = 0;
+			FallBackToAsyncIOThreads(op);
+		} else {
+			LOG_F(WARNING, "io_uring read of %s failed: %s", op->path.cstr, strerror(-result));
+			FinishAsyncOp(op, false);
+		}
+	}
+	std::atomic_ref<uint32_t>(*ring.cq_head).store(head, std::memory_order_release);
+
+	while (!AsyncIO_RingBacklog.empty() && ring.in_flight < ring.entries) {
+		AsyncReadOp* op = AsyncIO_RingBacklog.front();
+		AsyncIO_RingBacklog.pop_front();
+		PlatformAsyncStart(op);
+	}
+	IoUringSubmit();
+}
+
+static bool PlatformAsyncWait() {
+	{
+		std::lock_guard<std::mutex> lock(AsyncIO_Mutex);
+		if (AsyncIO_Ring.in_flight == 0) { return false; }
+	}
+	syscall(__NR_io_uring_enter, AsyncIO_Ring.fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+	return true;
+}
+
+#else
+
+static bool PlatformAsyncInit() { return false; }
+static void PlatformAsyncStart(AsyncReadOp*) {}
+static void PlatformAsyncReap() {}
+static bool PlatformAsyncWait() { return false; }
+
+#endif // FILESYSTEM_IO_URING
@@ -136,3 +136,80 @@ DirectoryIterator& DirectoryIterator::operator++() {
 
 	return *this;
 }
+
+// Reads a file into a malloc'd buffer. Used for small files and when mapping fails.
+static bool ReadFileToHeap(HANDLE file, size_t size, MappedFileShared& shared) {
+	if (size == 0) { return true; }
+	uint8_t* buffer = static_cast<uint8_t*>(malloc(size));
+	CHECK_NOTNULL_F(buffer, "Failed to allocate %zu bytes for file contents", size);
+	CountHeapAllocation();
+	size_t total = 0;
+	while (total < size) {
+		DWORD chunk = DWORD(Min(size - total, size_t(1) << 30));
+		DWORD bytes = 0;
+		if (!ReadFile(file, &buffer[total], chunk, &bytes, NULL) || bytes == 0) { break; }
+		total += bytes;
+	}
+	shared.base = buffer;
+	shared.size = total;
+	shared.mapped = false;
+	return true;
+}
+
+static bool PlatformMapFile(const String& path, MappedFile::Access access, MappedFileShared& shared) {
+	// FIXME: Win32: should use UTF-16 functions and do UTF-8 conversion internally
+	DWORD flags = FILE_ATTRIBUTE_NORMAL;
+	flags |= (access == MappedFile::Sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, flags, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		return false;
+	}
+	size_t size = size_t(file_size.QuadPart);
+
+	if (size >= MapFile_MinMappedSize) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		// The view keeps its own references to the mapping and the file
+		if (mapping) { CloseHandle(mapping); }
+		if (base) {
+			CloseHandle(file);
+			shared.base = base;
+			shared.size = size;
+			shared.mapped = true;
+			return true;
+		}
+		LOG_F(WARNING, "Failed to map %s (error %lu), reading it instead", path.cstr, GetLastError());
+	}
+
+	bool ok = ReadFileToHeap(file, size, shared);
+	CloseHandle(file);
+	return ok;
+}
+
+static void PlatformUnmapFile(MappedFileShared& shared) {
+	UnmapViewOfFile(shared.base);
+}
+
+static bool PlatformReadFile(const String& path, MappedFileShared& shared) {
+	// FIXME: Win32: should use UTF-16 functions and do UTF-8 conversion internally
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return false; }
+	LARGE_INTEGER file_size;
+	bool ok = GetFileSizeEx(file, &file_size) && ReadFileToHeap(file, size_t(file_size.QuadPart), shared);
+	CloseHandle(file);
+	return ok;
+}
+
+// There's no native backend on Windows, so all asynchronous reads go to the thread pool. Overlapped
+// reads still need CreateFile, which blocks, to be called from a worker thread, and the pool already
+// keeps several ReadFile calls in flight. IoRing would only help on Windows 11, and would need a
+// second code path for older versions anyway.
+static bool PlatformAsyncInit() { return false; }
+static void PlatformAsyncStart(AsyncReadOp*) {}
+static void PlatformAsyncReap() {}
+static bool PlatformAsyncWait() { return false; }
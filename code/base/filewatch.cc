@@ -0,0 +1,164 @@
+#include "base/filewatch.hh"
+#include "base/filesystem.hh"
+#include "base/debug.hh"
+
+#include <vector>
+
+// PLATFORM_LINUX shares the UNIX bit with Apple platforms, so check the compiler macros instead
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#define FILEWATCH_INOTIFY 1
+#else
+#define FILEWATCH_INOTIFY 0
+#endif
+
+struct FileWatch {
+	StringId path;
+	// File name without the directory. Points into the interned path.
+	const char* name;
+	FileChangeCallback callback;
+	void* userdata;
+	// inotify watch descriptor for the file's directory, or -1 if the file is polled instead
+	int wd;
+	// Last seen modification time, for polling
+	uint64_t mtime;
+	bool changed;
+};
+
+static bool FileWatch_Initialised = false;
+static std::vector<FileWatch> FileWatch_Watches;
+static int FileWatch_INotify = -1;
+
+// Files checked per call to ProcessFileChanges, for files that aren't covered by inotify
+static constexpr uint32_t FileWatch_PollsPerCall = 4;
+static uint32_t FileWatch_NextPoll = 0;
+
+static void InitFileWatch() {
+	FileWatch_Initialised = true;
+	#if FILEWATCH_INOTIFY
+	FileWatch_INotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (FileWatch_INotify < 0) {
+		LOG_F(WARNING, "inotify_init1 failed (%s), watched files will be polled", strerror(errno));
+	}
+	#endif
+}
+
+void WatchFile(StringId path, FileChangeCallback callback, void* userdata) {
+	if (PLATFORM_WEB || !path) { return; }
+	if (!FileWatch_Initialised) { InitFileWatch(); }
+
+	const char* cstr = path.cstr();
+	const char* last_sep = nullptr;
+	for (const char* p = cstr; *p; p++) {
+		if (*p == '/' || *p == '\\') { last_sep = p; }
+	}
+
+	FileWatch watch = {
+		.path = path,
+		.name = last_sep ? &last_sep[1] : cstr,
+		.callback = callback,
+		.userdata = userdata,
+		.wd = -1,
+		.mtime = GetFileModificationTime(cstr),
+		.changed = false,
+	};
+
+	#if FILEWATCH_INOTIFY
+	if (FileWatch_INotify >= 0) {
+		// Watching the same directory twice returns the same descriptor, so there's no need to
+		// keep track of which directories are already watched.
+		String dir = last_sep ? String::frame_format("%.*s", int(last_sep - cstr), cstr) : String::view(".");
+		watch.wd = inotify_add_watch(FileWatch_INotify, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch.wd < 0) {
+			LOG_F(WARNING, "Can't watch directory %s (%s), polling %s instead", dir.cstr, strerror(errno), cstr);
+		}
+	}
+	#endif
+
+	FileWatch_Watches.push_back(watch);
+}
+
+void UnwatchFile(StringId path, FileChangeCallback callback, void* userdata) {
+	// The directory's inotify watch is left in place, since other files may share it
+	for (size_t i = 0; i < FileWatch_Watches.size(); i++) {
+		const FileWatch& watch = FileWatch_Watches[i];
+		if (watch.path == path && watch.callback == callback && watch.userdata == userdata) {
+			FileWatch_Watches.erase(FileWatch_Watches.begin() + i);
+			return;
+		}
+	}
+}
+
+#if FILEWATCH_INOTIFY
+static void ReadINotifyEvents() {
+	alignas(inotify_event) char buffer[4096];
+	for (;;) {
+		ssize_t bytes = read(FileWatch_INotify, buffer, sizeof(buffer));
+		if (bytes <= 0) { break; } // EAGAIN once the queue is empty
+
+		for (char* p = buffer; p < &buffer[bytes]; ) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+			p += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				// Events were dropped, so we don't know what changed
+				for (FileWatch& watch : FileWatch_Watches) { watch.changed |= (watch.wd >= 0); }
+				continue;
+			}
+			if (event->len == 0) { continue; }
+
+			for (FileWatch& watch : FileWatch_Watches) {
+				if (watch.wd == event->wd && strcmp(watch.name, event->name) == 0) {
+					watch.changed = true;
+				}
+			}
+		}
+	}
+}
+#endif
+
+static void PollWatchedFiles() {
+	uint32_t count = uint32_t(FileWatch_Watches.size());
+	uint32_t polled = 0;
+	for (uint32_t i = 0; i < count && polled < FileWatch_PollsPerCall; i++) {
+		FileWatch& watch = FileWatch_Watches[FileWatch_NextPoll++ % count];
+		if (watch.wd >= 0) { continue; }
+		uint64_t mtime = GetFileModificationTime(watch.path.cstr());
+		// A failed stat() returns 0, which usually means the file is being replaced right now.
+		// Wait until it's back before reporting the change.
+		if (mtime != 0 && mtime != watch.mtime) {
+			watch.mtime = mtime;
+			watch.changed = true;
+		}
+		polled++;
+	}
+}
+
+uint32_t ProcessFileChanges() {
+	if (FileWatch_Watches.empty()) { return 0; }
+
+	#if FILEWATCH_INOTIFY
+	if (FileWatch_INotify >= 0) { ReadINotifyEvents(); }
+	#endif
+	PollWatchedFiles();
+
+	// Collect the changes first, since callbacks are allowed to add or remove watches
+	struct Change {
+		StringId path;
+		FileChangeCallback callback;
+		void* userdata;
+	};
+	std::vector<Change> changes;
+	for (FileWatch& watch : FileWatch_Watches) {
+		if (!watch.changed) { continue; }
+		watch.changed = false;
+		changes.push_back({watch.path, watch.callback, watch.userdata});
+	}
+
+	for (const Change& change : changes) {
+		change.callback(change.userdata, String::view(change.path.cstr()));
+	}
+	return uint32_t(changes.size());
+}
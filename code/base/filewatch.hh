@@ -0,0 +1,32 @@
+#pragma once
+#include "base/base.hh"
+#include "base/string.hh"
+#include "base/stringid.hh"
+
+/* File change notifications.
+ *
+ * WatchFile() registers a callback that runs whenever the given file is written to or replaced.
+ * On Linux, changes are picked up with inotify, which watches the file's directory so that
+ * editors which save by writing a new file and renaming it over the old one are handled. Changes
+ * are queued by the kernel, so checking for them costs a single non-blocking read when nothing
+ * has changed. Elsewhere, or if inotify can't be used, a few watched files are stat()'ed on each
+ * call to ProcessFileChanges().
+ *
+ * Watching does nothing on the web, where files can't change.
+ */
+typedef void (*FileChangeCallback)(void* userdata, const String& path);
+
+// Calls callback(userdata, path) from ProcessFileChanges() whenever the file changes on disk.
+void WatchFile(StringId path, FileChangeCallback callback, void* userdata);
+
+static void WatchFile(const char* path, FileChangeCallback callback, void* userdata) {
+	WatchFile(StringId::intern(path), callback, userdata);
+}
+
+// Removes a watch that was added with the same path, callback and userdata.
+void UnwatchFile(StringId path, FileChangeCallback callback, void* userdata);
+
+// Runs the callbacks of every watched file that has changed since the last call. Several changes
+// to a file in quick succession will only be reported once. Returns the number of callbacks run.
+// Must be called from the main thread, usually once per frame.
+uint32_t ProcessFileChanges();
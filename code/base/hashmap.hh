@@ -0,0 +1,293 @@
+#pragma once
+#include "base/base.hh"
+#include "base/hash.hh"
+
+#include <new>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define HASHMAP_SSE2 1
+#else
+	#define HASHMAP_SSE2 0
+#endif
+
+/* Flat open-addressing hash map, modelled on Abseil's Swiss tables.
+ *
+ * Keys and values are stored inline in a single slot array, alongside a separate array of one-byte
+ * control words. Each control word is either Empty, Deleted, or the top 7 bits of the hash of the
+ * key stored in the corresponding slot. Lookups probe the control words 16 at a time (one SSE2
+ * compare per group) and only touch the slot array for likely matches.
+ *
+ * Differences from std::unordered_map that callers need to be aware of:
+ * - Inserting can move every element, so references and pointers to values are invalidated by any
+ *   operation that might insert. Caches that hand out pointers should store pointers as values.
+ * - Iteration order is unspecified and changes when the map grows.
+ * - clear() keeps the allocated memory, so a map that's refilled every frame doesn't reallocate.
+ *
+ * Iterating yields Slot references, which have a key and a value, so structured bindings work:
+ *   for (auto& [key, value] : map) { ... }
+ */
+template <typename K, typename V, typename H = Hash64T>
+struct HashMap {
+	struct Slot {
+		K key;
+		V value;
+	};
+
+	static constexpr uint32_t GroupSize = 16;
+
+	// Control words. Full slots store a 7-bit hash fragment, so the high bit means "not full".
+	static constexpr int8_t Empty = -128; // 0b10000000
+	static constexpr int8_t Deleted = -2; // 0b11111110
+
+	int8_t* ctrl = nullptr;
+	Slot* slots = nullptr;
+	uint32_t capacity = 0;
+	uint32_t count = 0;
+	// Number of Empty slots that can still be filled before the map has to grow. Deleted slots
+	// don't count towards this, which keeps probe sequences short after lots of erasing.
+	uint32_t growth_left = 0;
+
+	HashMap() = default;
+	HashMap(uint32_t expected_count) { reserve(expected_count); }
+	~HashMap() { release(); }
+
+	HashMap(const HashMap&) = delete;
+	HashMap& operator=(const HashMap&) = delete;
+
+	HashMap(HashMap&& rhs) noexcept { take(rhs); }
+	HashMap& operator=(HashMap&& rhs) noexcept {
+		if (this != &rhs) { release(); take(rhs); }
+		return *this;
+	}
+
+	uint32_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	// Returns a pointer to the value stored for the given key, or nullptr if there isn't one.
+	V* find(const K& key) {
+		if (count == 0) { return nullptr; }
+		uint32_t index = find_index(key, hash(key));
+		return index != UINT32_MAX ? &slots[index].value : nullptr;
+	}
+	const V* find(const K& key) const { return const_cast<HashMap*>(this)->find(key); }
+
+	bool contains(const K& key) const { return find(key) != nullptr; }
+
+	// Returns a reference to the value stored for the given key, inserting a value-initialised one
+	// if the key isn't present yet.
+	V& operator[](const K& key) {
+		uint64_t h = hash(key);
+		if (count > 0) {
+			uint32_t index = find_index(key, h);
+			if (index != UINT32_MAX) { return slots[index].value; }
+		}
+		if (growth_left == 0) { grow(); }
+		uint32_t index = find_insert_index(h);
+		if (ctrl[index] == Empty) { growth_left--; }
+		ctrl[index] = fragment(h);
+		count++;
+		new (&slots[index]) Slot{key, V()};
+		return slots[index].value;
+	}
+
+	// Removes the given key. Returns false if it wasn't present.
+	bool erase(const K& key) {
+		if (count == 0) { return false; }
+		uint32_t index = find_index(key, hash(key));
+		if (index == UINT32_MAX) { return false; }
+		slots[index].~Slot();
+		count--;
+		// Probing only stops at groups with an Empty slot. If this slot's group already has one,
+		// no probe sequence can have passed through this group, so the slot can become Empty again.
+		uint32_t group = index & ~(GroupSize - 1);
+		if (match_empty(&ctrl[group]) != 0) {
+			ctrl[index] = Empty;
+			growth_left++;
+		} else {
+			ctrl[index] = Deleted;
+		}
+		return true;
+	}
+
+	// Makes sure that the map can hold at least the given number of elements without growing.
+	void reserve(uint32_t expected_count) {
+		uint32_t required = capacity_for(expected_count);
+		if (required > capacity) { rehash(required); }
+	}
+
+	// Removes all elements but keeps the allocated memory.
+	void clear() {
+		if (capacity == 0) { return; }
+		destroy_all();
+		memset(ctrl, Empty, capacity);
+		count = 0;
+		growth_left = max_load(capacity);
+	}
+
+	template <bool Const> struct Iterator {
+		using MapT = std::conditional_t<Const, const HashMap, HashMap>;
+		using SlotT = std::conditional_t<Const, const Slot, Slot>;
+		MapT* map;
+		uint32_t index;
+
+		SlotT& operator*() const { return map->slots[index]; }
+		SlotT* operator->() const { return &map->slots[index]; }
+		bool operator==(const Iterator& rhs) const { return index == rhs.index; }
+		bool operator!=(const Iterator& rhs) const { return index != rhs.index; }
+		Iterator& operator++() { index = map->next_full(index + 1); return *this; }
+	};
+	using iterator = Iterator<false>;
+	using const_iterator = Iterator<true>;
+
+	iterator begin() { return {this, next_full(0)}; }
+	iterator end() { return {this, capacity}; }
+	const_iterator begin() const { return {this, next_full(0)}; }
+	const_iterator end() const { return {this, capacity}; }
+
+private:
+	static FORCEINLINE uint64_t hash(const K& key) {
+		// Fold the high bits into the low ones, which pick the group, in case the hasher is weak.
+		uint64_t h = static_cast<uint64_t>(H()(key));
+		h *= 0x9E3779B97F4A7C15ULL;
+		return h ^ (h >> 32);
+	}
+
+	static FORCEINLINE int8_t fragment(uint64_t h) { return static_cast<int8_t>(h >> 57); }
+
+	static constexpr uint32_t max_load(uint32_t capacity) { return capacity - capacity / 8; }
+
+	static uint32_t capacity_for(uint32_t expected_count) {
+		if (expected_count == 0) { return 0; }
+		uint32_t capacity = GroupSize;
+		while (max_load(capacity) < expected_count) { capacity *= 2; }
+		return capacity;
+	}
+
+	// Bitmasks with bit i set if control word i of the group matches.
+	#if HASHMAP_SSE2
+	static FORCEINLINE uint32_t match(const int8_t* group, int8_t value) {
+		__m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(value))));
+	}
+	static FORCEINLINE uint32_t match_empty_or_deleted(const int8_t* group) {
+		__m128i g = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(g));
+	}
+	#else
+	static FORCEINLINE uint32_t match(const int8_t* group, int8_t value) {
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < GroupSize; i++) { mask |= uint32_t(group[i] == value) << i; }
+		return mask;
+	}
+	static FORCEINLINE uint32_t match_empty_or_deleted(const int8_t* group) {
+		uint32_t mask = 0;
+		for (uint32_t i = 0; i < GroupSize; i++) { mask |= uint32_t(group[i] < 0) << i; }
+		return mask;
+	}
+	#endif
+	static FORCEINLINE uint32_t match_empty(const int8_t* group) { return match(group, Empty); }
+
+	static FORCEINLINE uint32_t lowest_bit(uint32_t mask) {
+		#if defined(_MSC_VER) && !defined(__clang__)
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return index;
+		#else
+			return static_cast<uint32_t>(__builtin_ctz(mask));
+		#endif
+	}
+
+	// Groups are probed in triangular order (+1, +2, +3...), which visits every group exactly once
+	// when the number of groups is a power of two.
+	uint32_t find_index(const K& key, uint64_t h) const {
+		uint32_t group_mask = (capacity / GroupSize) - 1;
+		uint32_t group = static_cast<uint32_t>(h) & group_mask;
+		int8_t frag = fragment(h);
+		for (uint32_t step = 1; ; step++) {
+			const int8_t* g = &ctrl[group * GroupSize];
+			for (uint32_t mask = match(g, frag); mask != 0; mask &= mask - 1) {
+				uint32_t index = group * GroupSize + lowest_bit(mask);
+				if (ExpectTrue(slots[index].key == key)) { return index; }
+			}
+			if (match_empty(g) != 0 || step > group_mask) { return UINT32_MAX; }
+			group = (group + step) & group_mask;
+		}
+	}
+
+	uint32_t find_insert_index(uint64_t h) const {
+		uint32_t group_mask = (capacity / GroupSize) - 1;
+		uint32_t group = static_cast<uint32_t>(h) & group_mask;
+		for (uint32_t step = 1; ; step++) {
+			uint32_t mask = match_empty_or_deleted(&ctrl[group * GroupSize]);
+			if (mask != 0) { return group * GroupSize + lowest_bit(mask); }
+			group = (group + step) & group_mask;
+		}
+	}
+
+	uint32_t next_full(uint32_t index) const {
+		while (index < capacity && ctrl[index] < 0) { index++; }
+		return index;
+	}
+
+	void grow() {
+		// If most of the non-empty slots are tombstones, rehashing in place is enough.
+		if (capacity > 0 && count <= max_load(capacity) / 2) {
+			rehash(capacity);
+		} else {
+			rehash(capacity ? capacity * 2 : GroupSize);
+		}
+	}
+
+	void rehash(uint32_t new_capacity) {
+		StaticAssert(alignof(Slot) <= alignof(max_align_t));
+		int8_t* old_ctrl = ctrl;
+		Slot* old_slots = slots;
+		uint32_t old_capacity = capacity;
+
+		ctrl = static_cast<int8_t*>(malloc(new_capacity));
+		slots = static_cast<Slot*>(malloc(size_t(new_capacity) * sizeof(Slot)));
+		if (!ctrl || !slots) { abort(); }
+		memset(ctrl, Empty, new_capacity);
+		capacity = new_capacity;
+		growth_left = max_load(new_capacity) - count;
+
+		for (uint32_t i = 0; i < old_capacity; i++) {
+			if (old_ctrl[i] < 0) { continue; }
+			Slot& old = old_slots[i];
+			uint64_t h = hash(old.key);
+			uint32_t index = find_insert_index(h);
+			ctrl[index] = fragment(h);
+			new (&slots[index]) Slot(std::move(old));
+			old.~Slot();
+		}
+		free(old_ctrl);
+		free(old_slots);
+	}
+
+	void destroy_all() {
+		if constexpr (!std::is_trivially_destructible_v<Slot>) {
+			for (uint32_t i = 0; i < capacity; i++) {
+				if (ctrl[i] >= 0) { slots[i].~Slot(); }
+			}
+		}
+	}
+
+	void release() {
+		if (capacity == 0) { return; }
+		destroy_all();
+		free(ctrl);
+		free(slots);
+		ctrl = nullptr;
+		slots = nullptr;
+		capacity = count = growth_left = 0;
+	}
+
+	void take(HashMap& rhs) {
+		ctrl = rhs.ctrl; slots = rhs.slots;
+		capacity = rhs.capacity; count = rhs.count; growth_left = rhs.growth_left;
+		rhs.ctrl = nullptr; rhs.slots = nullptr;
+		rhs.capacity = rhs.count = rhs.growth_left = 0;
+	}
+};
@@ -0,0 +1,391 @@
+#include "base/jobs.hh"
+#include "base/debug.hh"
+#include "base/mpsc_queue.hh"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct Job {
+	JobCallback callback;
+	void* data;
+	JobGroup* group;
+};
+
+// Fixed-size Chase-Lev work-stealing deque. Only the owning thread may push() and pop(); any
+// thread may steal(). Reference: "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Lê, Pop, Cohen, Zappa Nardelli, 2013). The slots are atomics so that a thief reading a slot
+// that's concurrently being overwritten is merely wasted work (its CAS on top will fail) rather
+// than a data race.
+struct JobDeque {
+	static constexpr int64_t Capacity = 4096;
+	StaticAssert((Capacity & (Capacity - 1)) == 0);
+
+	struct Slot {
+		std::atomic<JobCallback> callback;
+		std::atomic<void*> data;
+		std::atomic<JobGroup*> group;
+	};
+
+	alignas(64) std::atomic<int64_t> top = 0;
+	alignas(64) std::atomic<int64_t> bottom = 0;
+	alignas(64) Slot slots[Capacity];
+
+	bool push(const Job& job) {
+		int64_t b = bottom.load(std::memory_order_relaxed);
+		int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= Capacity) { return false; }
+		Slot& slot = slots[b & (Capacity - 1)];
+		slot.callback.store(job.callback, std::memory_order_relaxed);
+		slot.data.store(job.data, std::memory_order_relaxed);
+		slot.group.store(job.group, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(Job* job) {
+		int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_relaxed);
+		if (t > b) {
+			// Deque was empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return false;
+		}
+		read(b, job);
+		if (t == b) {
+			// Last job in the deque: race any thieves for it
+			bool won = top.compare_exchange_strong(t, t + 1,
+				std::memory_order_seq_cst, std::memory_order_relaxed);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return won;
+		}
+		return true;
+	}
+
+	bool steal(Job* job) {
+		int64_t t = top.load(std::memory_order_acquire);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int64_t b = bottom.load(std::memory_order_acquire);
+		if (t >= b) { return false; }
+		read(t, job);
+		return top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+
+	bool empty() const {
+		return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+	}
+
+	void read(int64_t index, Job* job) {
+		Slot& slot = slots[index & (Capacity - 1)];
+		job->callback = slot.callback.load(std::memory_order_relaxed);
+		job->data = slot.data.load(std::memory_order_relaxed);
+		job->group = slot.group.load(std::memory_order_relaxed);
+	}
+};
+
+// Thread index 0 is the main thread; workers are numbered from 1. Any other thread has no index.
+static constexpr uint32_t JobSystem_NoThread = UINT32_MAX;
+static thread_local uint32_t JobSystem_ThreadIndex = JobSystem_NoThread;
+static thread_local uint32_t JobSystem_StealSeed = 0;
+
+static bool JobSystem_Running = false;
+static uint32_t JobSystem_ThreadCount = 1;
+static JobDeque* JobSystem_Deques = nullptr;
+static std::thread* JobSystem_Workers = nullptr;
+
+// Jobs started from threads that don't have a deque, and jobs that have to run on the main thread.
+// Main-thread jobs go into a lock-free queue, and only end up in JobSystem_MainThreadQueue if that
+// is full.
+static std::mutex JobSystem_QueueMutex;
+static std::deque<Job> JobSystem_InjectQueue;
+static std::deque<Job> JobSystem_MainThreadQueue;
+static std::atomic<uint32_t> JobSystem_InjectQueueSize = 0;
+static std::atomic<uint32_t> JobSystem_MainThreadQueueSize = 0;
+static MPSCQueue<Job, 1024> JobSystem_MainThreadRing;
+
+// Idle workers sleep on this condition variable. JobSystem_Epoch is incremented whenever work is
+// queued, so that a worker can tell if anything was added between its last look and going to sleep.
+static std::mutex JobSystem_SleepMutex;
+static std::condition_variable JobSystem_SleepCondition;
+static std::atomic<uint64_t> JobSystem_Epoch = 0;
+static std::atomic<uint32_t> JobSystem_Sleeping = 0;
+static std::atomic<bool> JobSystem_Quit = false;
+
+static void WakeWorkers(bool all = false) {
+	JobSystem_Epoch.fetch_add(1, std::memory_order_seq_cst);
+	if (JobSystem_Sleeping.load(std::memory_order_seq_cst) > 0) {
+		// Taking the lock guarantees that any worker which saw the old epoch is now waiting
+		{ std::lock_guard<std::mutex> lock(JobSystem_SleepMutex); }
+		if (all) {
+			JobSystem_SleepCondition.notify_all();
+		} else {
+			JobSystem_SleepCondition.notify_one();
+		}
+	}
+}
+
+static void FinishJob(JobGroup* group) {
+	if (!group) { return; }
+	// Read the continuation first: once the counter hits 0, a waiting thread is free to destroy
+	// the group.
+	JobCallback continuation = group->continuation;
+	void* continuation_data = group->continuation_data;
+	JobAffinity continuation_affinity = group->continuation_affinity;
+	if (group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1 && continuation) {
+		StartJob(nullptr, continuation, continuation_data, continuation_affinity);
+	}
+}
+
+static FORCEINLINE void RunJob(const Job& job) {
+	job.callback(job.data);
+	FinishJob(job.group);
+}
+
+static bool PopQueue(std::deque<Job>& queue, std::atomic<uint32_t>& size, Job* job) {
+	if (size.load(std::memory_order_relaxed) == 0) { return false; }
+	std::lock_guard<std::mutex> lock(JobSystem_QueueMutex);
+	if (queue.empty()) { return false; }
+	*job = queue.front();
+	queue.pop_front();
+	size.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+static void PushQueue(std::deque<Job>& queue, std::atomic<uint32_t>& size, const Job& job) {
+	std::lock_guard<std::mutex> lock(JobSystem_QueueMutex);
+	queue.push_back(job);
+	size.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void PushMainThreadJob(const Job& job) {
+	if (ExpectTrue(JobSystem_MainThreadRing.try_push(job))) { return; }
+	PushQueue(JobSystem_MainThreadQueue, JobSystem_MainThreadQueueSize, job);
+}
+
+static bool PopMainThreadJob(Job* job) {
+	if (JobSystem_MainThreadRing.try_pop(job)) { return true; }
+	return PopQueue(JobSystem_MainThreadQueue, JobSystem_MainThreadQueueSize, job);
+}
+
+// Looks for a job for the current thread to run: first in its own deque, then in the shared
+// injection queue, then in other threads' deques, starting at a random victim.
+static bool FindJob(Job* job) {
+	uint32_t self = JobSystem_ThreadIndex;
+	if (self != JobSystem_NoThread && JobSystem_Deques[self].pop(job)) { return true; }
+	if (PopQueue(JobSystem_InjectQueue, JobSystem_InjectQueueSize, job)) { return true; }
+
+	// xorshift32, seeded per thread
+	uint32_t x = JobSystem_StealSeed;
+	x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+	JobSystem_StealSeed = x;
+
+	uint32_t count = JobSystem_ThreadCount;
+	uint32_t start = x % count;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t victim = (start + i) % count;
+		if (victim != self && JobSystem_Deques[victim].steal(job)) { return true; }
+	}
+	return false;
+}
+
+static void WorkerThread(uint32_t index) {
+	JobSystem_ThreadIndex = index;
+	JobSystem_StealSeed = 0x9E3779B9u * (index + 1);
+	char name[32];
+	snprintf(name, sizeof(name), "Worker %u", index);
+	loguru::set_thread_name(name);
+
+	Job job;
+	while (!JobSystem_Quit.load(std::memory_order_relaxed)) {
+		uint64_t epoch = JobSystem_Epoch.load(std::memory_order_seq_cst);
+
+		// Spin for a little while before going to sleep, since jobs tend to come in bursts
+		bool found = false;
+		for (uint32_t spin = 0; spin < 64 && !found; spin++) {
+			found = FindJob(&job);
+			if (!found) { std::this_thread::yield(); }
+		}
+		if (found) {
+			RunJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(JobSystem_SleepMutex);
+		JobSystem_Sleeping.fetch_add(1, std::memory_order_seq_cst);
+		JobSystem_SleepCondition.wait(lock, [epoch]{
+			return JobSystem_Epoch.load(std::memory_order_seq_cst) != epoch ||
+				JobSystem_Quit.load(std::memory_order_relaxed);
+		});
+		JobSystem_Sleeping.fetch_sub(1, std::memory_order_seq_cst);
+	}
+}
+
+void InitJobSystem(uint32_t worker_threads) {
+	CHECK_F(!JobSystem_Running, "InitJobSystem called twice");
+	JobSystem_ThreadIndex = 0;
+	JobSystem_StealSeed = 0x9E3779B9u;
+
+	if (worker_threads == UINT32_MAX) {
+		uint32_t hardware_threads = std::thread::hardware_concurrency();
+		worker_threads = hardware_threads > 1 ? hardware_threads - 1 : 0;
+	}
+	#if PLATFORM_WEB
+	worker_threads = 0;
+	#endif
+
+	JobSystem_ThreadCount = 1 + worker_threads;
+	JobSystem_Deques = new JobDeque[JobSystem_ThreadCount];
+	JobSystem_Quit.store(false);
+	JobSystem_Running = true;
+
+	if (worker_threads > 0) {
+		JobSystem_Workers = new std::thread[worker_threads];
+		for (uint32_t i = 0; i < worker_threads; i++) {
+			JobSystem_Workers[i] = std::thread(WorkerThread, i + 1);
+		}
+	}
+	// The main loop ends with exit(), so make sure workers are joined before the mutexes and
+	// condition variables they might be waiting on are destroyed. Registered once, since the job
+	// system can be restarted (e.g. by benchmarks that vary the thread count).
+	static bool registered_atexit = false;
+	if (!registered_atexit) {
+		atexit(ShutdownJobSystem);
+		registered_atexit = true;
+	}
+	LOG_F(INFO, "Job system started with %u worker threads", worker_threads);
+}
+
+void ShutdownJobSystem() {
+	if (!JobSystem_Running) { return; }
+	CHECK_F(IsMainThread(), "ShutdownJobSystem must be called from the main thread");
+	JobSystem_Quit.store(true);
+	WakeWorkers(true);
+	for (uint32_t i = 0; i < JobSystem_ThreadCount - 1; i++) {
+		JobSystem_Workers[i].join();
+	}
+	delete[] JobSystem_Workers;
+	delete[] JobSystem_Deques;
+	JobSystem_Workers = nullptr;
+	JobSystem_Deques = nullptr;
+	JobSystem_ThreadCount = 1;
+	JobSystem_Running = false;
+}
+
+uint32_t GetJobThreadCount() {
+	return JobSystem_ThreadCount;
+}
+
+bool IsMainThread() {
+	return JobSystem_ThreadIndex == 0;
+}
+
+void StartJob(JobGroup* group, JobCallback callback, void* data, JobAffinity affinity) {
+	Job job = {.callback = callback, .data = data, .group = group};
+	if (group) { group->pending.fetch_add(1, std::memory_order_relaxed); }
+
+	if (affinity == JobAffinity::MainThread) {
+		// Queued even when started from the main thread, so that these jobs always run at a
+		// predictable point in the frame rather than in the middle of whatever started them.
+		PushMainThreadJob(job);
+		return;
+	}
+
+	if (!JobSystem_Running || JobSystem_ThreadCount == 1) {
+		RunJob(job);
+		return;
+	}
+
+	uint32_t self = JobSystem_ThreadIndex;
+	if (self == JobSystem_NoThread) {
+		PushQueue(JobSystem_InjectQueue, JobSystem_InjectQueueSize, job);
+	} else if (!JobSystem_Deques[self].push(job)) {
+		// Deque is full; running the job now also applies some back-pressure to the producer
+		RunJob(job);
+		return;
+	}
+	WakeWorkers();
+}
+
+void CloseJobGroup(JobGroup* group) {
+	DCHECK_F(group->continuation != nullptr, "CloseJobGroup called on a group without a continuation");
+	FinishJob(group);
+}
+
+void WaitForJobs(JobGroup* group) {
+	bool main_thread = IsMainThread();
+	Job job;
+	while (!group->done()) {
+		if (main_thread && PopMainThreadJob(&job)) {
+			RunJob(job);
+		} else if (JobSystem_Running && FindJob(&job)) {
+			RunJob(job);
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+uint32_t RunMainThreadJobs(uint32_t max_jobs) {
+	DCHECK_F(IsMainThread() || !JobSystem_Running, "RunMainThreadJobs called from a worker thread");
+	uint32_t count = 0;
+	Job job;
+	while (count < max_jobs && PopMainThreadJob(&job)) {
+		RunJob(job);
+		count++;
+	}
+	return count;
+}
+
+struct ParallelForContext {
+	void (*function)(void* context, uint32_t begin, uint32_t end);
+	void* context;
+	uint32_t count;
+	uint32_t batch_size;
+	std::atomic<uint32_t> next_batch;
+};
+
+// Each ParallelFor job keeps claiming batches until there are none left, which balances the load
+// when some batches take longer than others.
+static void ParallelForJob(void* data) {
+	ParallelForContext* pf = static_cast<ParallelForContext*>(data);
+	uint32_t batch_count = (pf->count + pf->batch_size - 1) / pf->batch_size;
+	for (;;) {
+		uint32_t batch = pf->next_batch.fetch_add(1, std::memory_order_relaxed);
+		if (batch >= batch_count) { break; }
+		uint32_t begin = batch * pf->batch_size;
+		uint32_t end = Min(begin + pf->batch_size, pf->count);
+		pf->function(pf->context, begin, end);
+	}
+}
+
+void ParallelFor(uint32_t count, uint32_t batch_size,
+	void (*function)(void* context, uint32_t begin, uint32_t end), void* context)
+{
+	if (count == 0) { return; }
+	if (batch_size == 0) { batch_size = 1; }
+	uint32_t batch_count = (count + batch_size - 1) / batch_size;
+	if (batch_count == 1 || !JobSystem_Running || JobSystem_ThreadCount == 1) {
+		function(context, 0, count);
+		return;
+	}
+
+	ParallelForContext pf = {
+		.function = function,
+		.context = context,
+		.count = count,
+		.batch_size = batch_size,
+		.next_batch = 0,
+	};
+	JobGroup group;
+	uint32_t helpers = Min(batch_count, JobSystem_ThreadCount) - 1;
+	for (uint32_t i = 0; i < helpers; i++) {
+		StartJob(&group, ParallelForJob, &pf);
+	}
+	// The calling thread takes part too, and then helps with whatever else is queued
+	ParallelForJob(&pf);
+	WaitForJobs(&group);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "base/base.hh"
+
+/***************************************************************************************************
+ * Work-stealing job system
+ *
+ * Each worker thread, plus the main thread, owns a fixed-size deque of jobs. Threads push and pop
+ * jobs at the bottom of their own deque and steal from the top of other threads' deques when they
+ * run out of work. Jobs started from threads that aren't part of the system go into a shared
+ * injection queue. Jobs with JobAffinity::MainThread are only ever run on the main thread, either
+ * by RunMainThreadJobs() or while the main thread is waiting for a JobGroup. Use this for work
+ * that needs the OpenGL context.
+ *
+ * On platforms without thread support (i.e. the web), there are no worker threads and every job
+ * runs immediately on the thread that starts it. Code using the job system should still work.
+ **************************************************************************************************/
+
+typedef void (*JobCallback)(void* data);
+
+enum class JobAffinity : uint8_t {
+	// The job can run on any thread, including the main thread.
+	Any,
+	// The job must run on the main thread.
+	MainThread,
+};
+
+// Counter for a set of jobs that can be waited on. A JobGroup must outlive all the jobs started
+// with it. It can optionally have a continuation: a job that gets started, with the given affinity,
+// once the group has been closed with CloseJobGroup() and every job in it has finished. A group
+// with a continuation holds one extra count until it's closed, so that the continuation can't fire
+// while jobs are still being added. WaitForJobs() does not wait for the continuation.
+struct JobGroup {
+	std::atomic<uint32_t> pending = 0;
+	JobCallback continuation = nullptr;
+	void* continuation_data = nullptr;
+	JobAffinity continuation_affinity = JobAffinity::Any;
+
+	JobGroup() = default;
+	JobGroup(JobCallback continuation, void* data, JobAffinity affinity = JobAffinity::Any):
+		pending{1}, continuation{continuation}, continuation_data{data}, continuation_affinity{affinity} {}
+
+	bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Starts the job system's worker threads. Must be called from the main thread. By default, one
+// worker is started for each hardware thread except the one the main thread is expected to use.
+void InitJobSystem(uint32_t worker_threads = UINT32_MAX);
+
+// Stops and joins all worker threads. Any jobs still queued must have been waited on beforehand.
+void ShutdownJobSystem();
+
+// Number of threads that can run jobs, including the main thread. Always at least 1.
+uint32_t GetJobThreadCount();
+
+// Returns true if called from the thread that called InitJobSystem().
+bool IsMainThread();
+
+// Queues a job. Increments the group's counter if a group is given. Jobs with Any affinity will
+// run inline if the job system isn't running or the current thread's deque is full.
+void StartJob(JobGroup* group, JobCallback callback, void* data, JobAffinity affinity = JobAffinity::Any);
+
+// Releases the extra count held by a group with a continuation. No more jobs may be started with
+// the group afterwards. The continuation may run before this function returns.
+void CloseJobGroup(JobGroup* group);
+
+// Waits for all jobs in the group to finish, running queued jobs on this thread in the meantime.
+void WaitForJobs(JobGroup* group);
+
+// Runs queued main-thread jobs. Returns the number of jobs that were run. Must be called from the
+// main thread, usually once per frame.
+uint32_t RunMainThreadJobs(uint32_t max_jobs = UINT32_MAX);
+
+// Calls function(context, begin, end) for every batch of up to batch_size items in [0, count),
+// spreading the batches out across all job threads. Returns once every batch is done.
+void ParallelFor(uint32_t count, uint32_t batch_size,
+	void (*function)(void* context, uint32_t begin, uint32_t end), void* context);
+
+// Templated version of ParallelFor that accepts lambdas: function(uint32_t begin, uint32_t end).
+template <typename F> static void ParallelFor(uint32_t count, uint32_t batch_size, F&& function) {
+	auto trampoline = [](void* context, uint32_t begin, uint32_t end) {
+		(*static_cast<std::remove_reference_t<F>*>(context))(begin, end);
+	};
+	ParallelFor(count, batch_size, trampoline, static_cast<void*>(&function));
+}
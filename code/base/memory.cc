@@ -0,0 +1,175 @@
+#include "base/memory.hh"
+#include "base/debug.hh"
+
+#include <new>
+
+#if PLATFORM_WINDOWS
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <Windows.h>
+	#include <Psapi.h>
+	#include <malloc.h>
+#elif PLATFORM_UNIX
+	#include <sys/resource.h>
+#endif
+
+static std::atomic<uint64_t> Memory_HeapAllocations = 0;
+
+void CountHeapAllocation() {
+	Memory_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t GetHeapAllocationCount() {
+	return Memory_HeapAllocations.load(std::memory_order_relaxed);
+}
+
+uint64_t GetPeakResidentMemory() {
+	#if PLATFORM_WINDOWS
+		PROCESS_MEMORY_COUNTERS counters;
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+		return uint64_t(counters.PeakWorkingSetSize);
+	#elif PLATFORM_UNIX
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+		// ru_maxrss is in bytes on Apple platforms and in kilobytes everywhere else. PLATFORM_APPLE
+		// can't be used here, since it shares the UNIX bit and is nonzero on Linux too.
+		#if defined(__APPLE__)
+			return uint64_t(usage.ru_maxrss);
+		#else
+			return uint64_t(usage.ru_maxrss) * 1024;
+		#endif
+	#else
+		return 0;
+	#endif
+}
+
+// Replacement global allocation functions, so that allocations made with new are counted. The
+// aligned overloads are used for over-aligned types, like the job system's cache-line-aligned
+// queues, and have to go through the platform's aligned allocator.
+void* operator new(size_t size) {
+	CountHeapAllocation();
+	void* p = malloc(size ? size : 1);
+	if (ExpectFalse(!p)) { Panic("Out of memory (operator new, %zu bytes)", size); }
+	return p;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	CountHeapAllocation();
+	return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+	return operator new(size, std::nothrow);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+static void* AlignedMalloc(size_t size, size_t align) {
+	CountHeapAllocation();
+	size = size ? size : 1;
+	#if PLATFORM_WINDOWS
+		return _aligned_malloc(size, align);
+	#else
+		// posix_memalign needs at least pointer alignment, which can be more than was asked for
+		void* p = nullptr;
+		return (posix_memalign(&p, Max(align, sizeof(void*)), size) == 0) ? p : nullptr;
+	#endif
+}
+
+static void AlignedFree(void* p) {
+	#if PLATFORM_WINDOWS
+		_aligned_free(p);
+	#else
+		free(p);
+	#endif
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+	void* p = AlignedMalloc(size, size_t(align));
+	if (ExpectFalse(!p)) { Panic("Out of memory (operator new, %zu bytes aligned to %zu)", size, size_t(align)); }
+	return p;
+}
+void* operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+	return AlignedMalloc(size, size_t(align));
+}
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+	return AlignedMalloc(size, size_t(align));
+}
+void operator delete(void* p, std::align_val_t) noexcept { AlignedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { AlignedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { AlignedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { AlignedFree(p); }
+
+static FORCEINLINE size_t AlignUp(size_t x, size_t align) {
+	return (x + (align - 1)) & ~(align - 1);
+}
+
+Arena::Arena(size_t capacity): capacity{capacity} {
+	base = static_cast<uint8_t*>(malloc(capacity));
+	CHECK_NOTNULL_F(base, "Failed to allocate %zu-byte arena", capacity);
+	CountHeapAllocation();
+}
+
+Arena::~Arena() {
+	reset();
+	free(base);
+}
+
+void* Arena::alloc(size_t size, size_t align) {
+	DCHECK_F((align & (align - 1)) == 0, "Alignment must be a power of two");
+	// Align the actual address rather than the offset, since malloc only guarantees max_align_t
+	uintptr_t start = AlignUp(uintptr_t(base) + used, align);
+	size_t end = size_t(start - uintptr_t(base)) + size;
+	if (ExpectTrue(base && end <= capacity)) {
+		requested += end - used;
+		used = end;
+		return reinterpret_cast<void*>(start);
+	}
+	requested += size + align;
+	return alloc_overflow(size, align);
+}
+
+void* Arena::alloc_overflow(size_t size, size_t align) {
+	Overflow* block = static_cast<Overflow*>(malloc(sizeof(Overflow) + align + size));
+	CHECK_NOTNULL_F(block, "Failed to allocate %zu-byte arena overflow block", size);
+	CountHeapAllocation();
+	block->next = overflow;
+	overflow = block;
+	uintptr_t start = AlignUp(uintptr_t(block) + sizeof(Overflow), align);
+	return reinterpret_cast<void*>(start);
+}
+
+void Arena::reset() {
+	high_water = Max(high_water, requested);
+	bool overflowed = (overflow != nullptr);
+	while (overflow) {
+		Overflow* next = overflow->next;
+		free(overflow);
+		overflow = next;
+	}
+	if (overflowed) {
+		size_t new_capacity = Max(capacity * 2, high_water);
+		free(base);
+		base = static_cast<uint8_t*>(malloc(new_capacity));
+		CHECK_NOTNULL_F(base, "Failed to allocate %zu-byte arena", new_capacity);
+		CountHeapAllocation();
+		capacity = new_capacity;
+	}
+	used = 0;
+	requested = 0;
+}
+
+// Sized for a typical frame. They grow to fit if a frame turns out to need more.
+static Arena FrameArenas[2] = {Arena(1 << 20), Arena(1 << 20)};
+static uint32_t FrameArena_Current = 0;
+
+void BeginFrameArena() {
+	FrameArena_Current ^= 1;
+	FrameArenas[FrameArena_Current].reset();
+}
+
+void* FrameAlloc(size_t size, size_t align) {
+	return FrameArenas[FrameArena_Current].alloc(size, align);
+}
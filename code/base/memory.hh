@@ -0,0 +1,73 @@
+#pragma once
+#include "base/base.hh"
+
+/* Linear (bump) allocator. Allocations are made by bumping an offset into one large block and are
+ * all freed together by reset(). There's no per-allocation overhead and no way to free individual
+ * allocations.
+ *
+ * If the block runs out, further allocations come from overflow blocks allocated with malloc().
+ * These are freed by the next reset(), which also grows the main block to the high-water mark, so
+ * an arena that's reset every frame stops touching malloc() once it's seen its largest frame.
+ */
+struct Arena {
+	struct Overflow {
+		Overflow* next;
+	};
+
+	uint8_t* base = nullptr;
+	size_t capacity = 0;
+	size_t used = 0;
+	// Bytes used since the last reset, including alignment padding and overflow blocks.
+	size_t requested = 0;
+	// Largest value of requested seen at a reset.
+	size_t high_water = 0;
+	Overflow* overflow = nullptr;
+
+	Arena() = default;
+	Arena(size_t capacity);
+	~Arena();
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Allocates a block of uninitialised memory. Never returns nullptr.
+	void* alloc(size_t size, size_t align = alignof(max_align_t));
+
+	// Allocates uninitialised memory for an array of count objects of type T.
+	template <typename T> T* alloc_array(size_t count) {
+		return static_cast<T*>(alloc(count * sizeof(T), alignof(T)));
+	}
+
+	// Frees all allocations made from this arena.
+	void reset();
+
+private:
+	void* alloc_overflow(size_t size, size_t align);
+};
+
+/* Frame arenas: a pair of arenas that are swapped at the start of every frame. Memory allocated
+ * with FrameAlloc() stays valid until the end of the following frame, so data from the last frame
+ * can still be read while building the current one. Only the main thread may use these.
+ */
+
+// Swaps the frame arenas and resets the one that's about to be reused. Call once at frame start.
+void BeginFrameArena();
+
+// Allocates uninitialised memory that's freed automatically at the end of the next frame.
+void* FrameAlloc(size_t size, size_t align = alignof(max_align_t));
+
+// Allocates an uninitialised array that's freed automatically at the end of the next frame.
+template <typename T> static T* FrameAllocArray(size_t count) {
+	return static_cast<T*>(FrameAlloc(count * sizeof(T), alignof(T)));
+}
+
+// Counts a heap allocation made outside of operator new, which is counted automatically. Used by
+// code that calls malloc() directly, like String, so that allocation counts are meaningful.
+void CountHeapAllocation();
+
+// Returns the number of heap allocations made since startup.
+uint64_t GetHeapAllocationCount();
+
+// Returns the largest amount of physical memory the process has used so far, in bytes, or 0 if
+// this isn't available on the current platform.
+uint64_t GetPeakResidentMemory();
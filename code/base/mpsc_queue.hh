@@ -0,0 +1,92 @@
+#pragma once
+#include "base/base.hh"
+
+#include <type_traits>
+
+/* Bounded lock-free multi-producer, single-consumer queue.
+ *
+ * Based on Dmitry Vyukov's bounded MPMC queue: each slot carries a sequence number that tells
+ * producers and the consumer whose turn it is to use the slot, so pushing costs one CAS on the
+ * tail and popping needs no atomic read-modify-write at all. Slots are stored inline and the
+ * queue never allocates. try_push() fails when the queue is full; callers decide what to do then.
+ *
+ * Any thread may push. Only one thread at a time may pop.
+ */
+template <typename T, uint32_t Capacity>
+struct MPSCQueue {
+	StaticAssert((Capacity & (Capacity - 1)) == 0);
+	static_assert(std::is_trivially_copyable_v<T>, "MPSCQueue values must be trivially copyable");
+
+	struct Slot {
+		std::atomic<uint32_t> sequence;
+		T value;
+	};
+
+	alignas(64) std::atomic<uint32_t> tail = 0;
+	alignas(64) std::atomic<uint32_t> head = 0;
+	alignas(64) Slot slots[Capacity];
+
+	MPSCQueue() {
+		for (uint32_t i = 0; i < Capacity; i++) {
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	// Returns false if the queue is full.
+	bool try_push(const T& value) {
+		uint32_t pos = tail.load(std::memory_order_relaxed);
+		for (;;) {
+			Slot& slot = slots[pos & (Capacity - 1)];
+			uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+			int32_t diff = int32_t(sequence - pos);
+			if (diff == 0) {
+				// The slot is free. Claim it by moving the tail past it.
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					slot.value = value;
+					slot.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// The slot still holds a value from one lap ago that hasn't been popped
+				return false;
+			} else {
+				// Another producer claimed this slot first
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns false if the queue is empty, or if the producer of the next value hasn't finished
+	// writing it yet. Consumer only.
+	bool try_pop(T* value) {
+		uint32_t pos = head.load(std::memory_order_relaxed);
+		Slot& slot = slots[pos & (Capacity - 1)];
+		uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+		if (int32_t(sequence - (pos + 1)) < 0) { return false; }
+		*value = slot.value;
+		// Hand the slot back to producers for the next lap
+		slot.sequence.store(pos + Capacity, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Pops up to max_count values into the given array. Returns the number of values popped.
+	// Consumer only.
+	uint32_t pop_batch(T* values, uint32_t max_count) {
+		uint32_t count = 0;
+		while (count < max_count && try_pop(&values[count])) { count++; }
+		return count;
+	}
+
+	// Number of values in the queue. Only a snapshot when producers are active.
+	uint32_t size() const {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t h = head.load(std::memory_order_relaxed);
+		return int32_t(t - h) > 0 ? t - h : 0;
+	}
+
+	bool empty() const { return size() == 0; }
+};
@@ -1,4 +1,5 @@
 #include "base/string.hh"
+#include "base/memory.hh"
 
 #include <stdlib.h>
 #include <string.h>
@@ -7,12 +8,14 @@
 String::String(uint32_t size): cstr{nullptr}, capacity{size ? size + 1 : 0}, _size{0} {
 	if (ExpectTrue(size != 0)) {
 		const_cast<char*&>(cstr) = static_cast<char*>(calloc(capacity, 1));
+		CountHeapAllocation();
 	}
 }
 
 String String::copy(const char* cstr, uint32_t size) {
 	if (ExpectFalse(!cstr)) { return String(); }
 	char* new_cstr = static_cast<char*>(malloc(size + 1));
+	CountHeapAllocation();
 	memcpy(new_cstr, cstr, size);
 	new_cstr[size] = '\0';
 	return String(new_cstr, size + 1, static_cast<uint32_t>(strlen(new_cstr)));
@@ -32,6 +35,7 @@ String String::move(const char* cstr) {
 String String::join(String a, String b) {
 	uint32_t asize = a.size(), bsize = b.size(), size = asize + bsize;
 	char* new_cstr = static_cast<char*>(malloc(size + 1));
+	CountHeapAllocation();
 	memcpy(&new_cstr[0], a.cstr, asize);
 	memcpy(&new_cstr[asize], b.cstr, bsize);
 	new_cstr[size] = '\0';
@@ -41,8 +45,12 @@ String String::join(String a, String b) {
 String String::vformat(const char* fmt, va_list ap) {
 	// snprintf returns the number of characters that would have been written if the buffer was
 	// large enough. This count doesn't include the null terminator.
-	uint32_t size = stbsp_vsnprintf(nullptr, 0, fmt, ap);
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+	uint32_t size = stbsp_vsnprintf(nullptr, 0, fmt, ap_copy);
+	va_end(ap_copy);
 	char* buffer = static_cast<char*>(malloc(size + 1));
+	CountHeapAllocation();
 	stbsp_vsnprintf(buffer, size + 1, fmt, ap);
 	return String(buffer, size + 1, size);
 }
@@ -54,3 +62,22 @@ String String::format(const char* fmt, ...) {
 	va_end(ap);
 	return str;
 }
+
+String String::frame_vformat(const char* fmt, va_list ap) {
+	va_list ap_copy;
+	va_copy(ap_copy, ap);
+	uint32_t size = stbsp_vsnprintf(nullptr, 0, fmt, ap_copy);
+	va_end(ap_copy);
+	char* buffer = FrameAllocArray<char>(size + 1);
+	stbsp_vsnprintf(buffer, size + 1, fmt, ap);
+	// Capacity 0: the frame arena owns the buffer, so the String must never free it
+	return String(buffer, 0, size);
+}
+
+String String::frame_format(const char* fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	String str = String::frame_vformat(fmt, ap);
+	va_end(ap);
+	return str;
+}
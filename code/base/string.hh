@@ -14,6 +14,7 @@
  * Use `String::view()` to create a view into another String or null-terminated buffer.
  * Use `String::copy()` to create a copy of a given String or null-terminated buffer.
  * Use `String::move()` to create a String that manages the given buffer's ownership.
+ * Use `String::frame_format()` for transient strings that only need to live until the next frame.
  *
  * There's an implicit conversion from char* that acts like String::view(), so passing a char*
  * argument to a function that accepts a String will "just work" without any performance penalty.
@@ -160,6 +161,12 @@ struct String {
 	static String format(const char* fmt, ...);
 	static String vformat(const char* fmt, va_list ap);
 
+	// Generates a string from a format string and arguments, allocating it from the frame arena
+	// instead of the heap. The result is a view that's valid until the end of the next frame.
+	// Main thread only. Use mut() or String::copy() if the string needs to live longer.
+	static String frame_format(const char* fmt, ...);
+	static String frame_vformat(const char* fmt, va_list ap);
+
 	// Destructor. Deallocates the backing buffer if its lifetime is managed by this UString.
 	~String() {
 		if (capacity != 0) { free((void*)(cstr)); }
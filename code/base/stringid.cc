@@ -0,0 +1,115 @@
+#include "base/stringid.hh"
+#include "base/hashmap.hh"
+#include "base/memory.hh"
+#include "base/debug.hh"
+
+#include <mutex>
+
+struct StringIdEntry {
+	const char* cstr;
+	uint32_t size;
+	uint64_t hash;
+};
+
+// Entries are stored in fixed-size chunks that are never moved or freed, so lookups don't need to
+// take the lock. Chunk pointers are published with release semantics once the chunk is allocated.
+static constexpr uint32_t StringId_ChunkBits = 12;
+static constexpr uint32_t StringId_ChunkSize = 1 << StringId_ChunkBits;
+static constexpr uint32_t StringId_MaxChunks = 1024;
+static std::atomic<StringIdEntry*> StringId_Chunks[StringId_MaxChunks] = {};
+static uint32_t StringId_Count = 1; // ID 0 is reserved for the null string
+
+// Character storage. Strings are bump-allocated from large blocks that are never freed.
+static constexpr uint32_t StringId_BlockSize = 64 * 1024;
+static char* StringId_Block = nullptr;
+static uint32_t StringId_BlockUsed = StringId_BlockSize;
+
+// Maps string hashes to IDs. If two different strings have the same hash, the second one is stored
+// under hash+1 (or the next free value after that), so lookups have to compare the actual strings.
+static HashMap<uint64_t, uint32_t> StringId_Lookup;
+static std::mutex StringId_Mutex;
+
+static FORCEINLINE const StringIdEntry& GetEntry(uint32_t index) {
+	const StringIdEntry* chunk = StringId_Chunks[index >> StringId_ChunkBits].load(std::memory_order_acquire);
+	return chunk[index & (StringId_ChunkSize - 1)];
+}
+
+static char* StoreString(const char* str, uint32_t size) {
+	char* storage;
+	if (size + 1 > StringId_BlockSize / 4) {
+		// Large strings get their own allocation rather than wasting the rest of a block
+		storage = static_cast<char*>(malloc(size + 1));
+		CountHeapAllocation();
+	} else {
+		if (StringId_BlockUsed + size + 1 > StringId_BlockSize) {
+			StringId_Block = static_cast<char*>(malloc(StringId_BlockSize));
+			CountHeapAllocation();
+			StringId_BlockUsed = 0;
+		}
+		storage = &StringId_Block[StringId_BlockUsed];
+		StringId_BlockUsed += size + 1;
+	}
+	CHECK_NOTNULL_F(storage, "Failed to allocate storage for interned string");
+	memcpy(storage, str, size);
+	storage[size] = '\0';
+	return storage;
+}
+
+StringId StringId::intern(uint64_t hash, const char* str, uint32_t size) {
+	if (!str) { return StringId(); }
+	std::lock_guard<std::mutex> lock(StringId_Mutex);
+
+	uint64_t key = hash;
+	while (const uint32_t* existing = StringId_Lookup.find(key)) {
+		const StringIdEntry& entry = GetEntry(*existing);
+		if (entry.size == size && memcmp(entry.cstr, str, size) == 0) {
+			return StringId(*existing);
+		}
+		key++;
+	}
+
+	uint32_t index = StringId_Count;
+	uint32_t chunk_index = index >> StringId_ChunkBits;
+	CHECK_LT_F(chunk_index, StringId_MaxChunks, "Too many interned strings");
+	StringIdEntry* chunk = StringId_Chunks[chunk_index].load(std::memory_order_relaxed);
+	if (!chunk) {
+		chunk = new StringIdEntry[StringId_ChunkSize];
+		StringId_Chunks[chunk_index].store(chunk, std::memory_order_release);
+	}
+	chunk[index & (StringId_ChunkSize - 1)] = StringIdEntry{
+		.cstr = StoreString(str, size),
+		.size = size,
+		.hash = hash,
+	};
+	StringId_Count++;
+	StringId_Lookup[key] = index;
+	return StringId(index);
+}
+
+StringId StringId::intern(const char* str, uint32_t size) {
+	if (!str) { return StringId(); }
+	// Same as Hash64(const char*), but bounded by size instead of a null terminator
+	uint64_t hash = FNV_BASIS;
+	for (uint32_t i = 0; i < size; i++) {
+		hash ^= str[i];
+		hash *= FNV_PRIME;
+	}
+	return intern(hash, str, size);
+}
+
+StringId StringId::intern(const char* str) {
+	if (!str) { return StringId(); }
+	return intern(str, static_cast<uint32_t>(strlen(str)));
+}
+
+const char* StringId::cstr() const {
+	return index ? GetEntry(index).cstr : nullptr;
+}
+
+uint32_t StringId::size() const {
+	return index ? GetEntry(index).size : 0;
+}
+
+uint64_t StringId::hash() const {
+	return index ? GetEntry(index).hash : FNV_BASIS;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "base/base.hh"
+#include "base/hash.hh"
+
+#include <type_traits>
+
+/* Interned string identifier.
+ *
+ * Every distinct string passed to StringId::intern() is copied once into a global table and given
+ * a small integer ID. Interning the same string again returns the same ID, so comparing two
+ * StringIds is a single integer comparison, and a StringId can be used as a hash map key without
+ * hashing the string. Interned strings are never freed, so the pointer returned by cstr() is valid
+ * for the rest of the program.
+ *
+ * Use StringIdLiteral("...") for literals. It hashes the string at compile time and interns it the
+ * first time the expression is evaluated, so later evaluations only cost a static guard check.
+ *
+ * Interning takes a lock and may be done from any thread. Looking up a StringId's string doesn't.
+ * ID 0 is the null string.
+ */
+struct StringId {
+	uint32_t index = 0;
+
+	constexpr StringId() = default;
+	constexpr explicit StringId(uint32_t index): index{index} {}
+
+	// Returns the ID for a null-terminated string. Returns the null ID for nullptr.
+	static StringId intern(const char* str);
+
+	// Returns the ID for a string of the given size, which doesn't need to be null-terminated.
+	static StringId intern(const char* str, uint32_t size);
+
+	// Returns the ID for a string whose Hash64 is already known, e.g. because it was computed at
+	// compile time. The hash must be Hash64(str), where str is null-terminated at str[size].
+	static StringId intern(uint64_t hash, const char* str, uint32_t size);
+
+	// Returns the interned string, or nullptr for the null ID.
+	const char* cstr() const;
+
+	// Returns the size of the interned string in bytes, not including the null terminator.
+	uint32_t size() const;
+
+	// Returns the Hash64 of the interned string.
+	uint64_t hash() const;
+
+	constexpr bool operator==(const StringId rhs) const { return index == rhs.index; }
+	constexpr bool operator!=(const StringId rhs) const { return index != rhs.index; }
+	constexpr explicit operator bool() const { return index != 0; }
+};
+
+// Returns the StringId for a string literal. See the comment on StringId.
+#define StringIdLiteral(literal) ([]() -> StringId { \
+	static const StringId id = StringId::intern( \
+		std::integral_constant<uint64_t, Hash64(literal)>::value, literal, sizeof(literal) - 1); \
+	return id; \
+}())
@@ -0,0 +1,236 @@
+#include "bench/bench.hh"
+#include "base/debug.hh"
+#include "base/jobs.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <SDL.h>
+#include <stb_sprintf.h>
+
+struct BenchEntry {
+	const char* name;
+	BenchFunction function;
+	uint64_t arg;
+	bool has_arg;
+};
+
+struct BenchResult {
+	char name[96];
+	uint64_t arg;
+	uint64_t iterations;
+	double ns_median;
+	double ns_min;
+	double ns_max;
+	double items_per_sec;
+	double bytes_per_sec;
+	const char* counter_name;
+	double counter;
+	const char* skipped;
+};
+
+// Function-local so that registrations from other translation units can't run before it exists.
+static std::vector<BenchEntry>& GetBenchEntries() {
+	static std::vector<BenchEntry> entries;
+	return entries;
+}
+
+BenchRegistration::BenchRegistration(const char* name, BenchFunction function, std::initializer_list<uint64_t> args) {
+	if (args.size() == 0) {
+		GetBenchEntries().push_back({.name = name, .function = function, .arg = 0, .has_arg = false});
+	}
+	for (uint64_t arg : args) {
+		GetBenchEntries().push_back({.name = name, .function = function, .arg = arg, .has_arg = true});
+	}
+}
+
+void Bench::reset_timer() {
+	start_ticks = SDL_GetPerformanceCounter();
+	paused_ticks = 0;
+}
+
+void Bench::pause() {
+	pause_start_ticks = SDL_GetPerformanceCounter();
+}
+
+void Bench::resume() {
+	paused_ticks += SDL_GetPerformanceCounter() - pause_start_ticks;
+}
+
+// Runs a benchmark once with the given number of iterations. Returns the measured time in seconds.
+static double RunBench(const BenchEntry& entry, uint64_t iterations, Bench* bench) {
+	*bench = Bench{.iterations = iterations, .arg = entry.arg};
+	bench->start_ticks = SDL_GetPerformanceCounter();
+	entry.function(*bench);
+	uint64_t ticks = SDL_GetPerformanceCounter() - bench->start_ticks - bench->paused_ticks;
+	return double(ticks) / double(SDL_GetPerformanceFrequency());
+}
+
+static BenchResult MeasureBench(const BenchEntry& entry, const char* name, double min_time, uint32_t repetitions) {
+	BenchResult result = {};
+	stbsp_snprintf(result.name, sizeof(result.name), "%s", name);
+	result.arg = entry.arg;
+
+	// Grow the iteration count until one run takes at least min_time, aiming a bit higher each time
+	// so that we usually get there in two or three steps.
+	Bench bench;
+	uint64_t iterations = 1;
+	for (;;) {
+		double elapsed = RunBench(entry, iterations, &bench);
+		if (bench.skipped) {
+			result.skipped = bench.skipped;
+			return result;
+		}
+		if (elapsed >= min_time || iterations >= 1000000000) { break; }
+		double multiplier = (elapsed > min_time * 0.1) ? (min_time * 1.4 / elapsed) : 10.0;
+		iterations = Max(iterations + 1, uint64_t(double(iterations) * multiplier));
+	}
+
+	std::vector<double> samples(repetitions);
+	for (uint32_t i = 0; i < repetitions; i++) {
+		samples[i] = RunBench(entry, iterations, &bench) * 1e9 / double(iterations);
+	}
+	std::sort(samples.begin(), samples.end());
+
+	result.iterations = iterations;
+	result.ns_median = samples[repetitions / 2];
+	result.ns_min = samples.front();
+	result.ns_max = samples.back();
+	result.items_per_sec = double(bench.items) * 1e9 / result.ns_median;
+	result.bytes_per_sec = double(bench.bytes) * 1e9 / result.ns_median;
+	result.counter_name = bench.counter_name;
+	result.counter = bench.counter;
+	return result;
+}
+
+static void PrintBenchResult(const BenchResult& r) {
+	if (r.skipped) {
+		printf("%-52s skipped: %s\n", r.name, r.skipped);
+		return;
+	}
+
+	char time[32];
+	if      (r.ns_median < 1e3) { stbsp_snprintf(time, sizeof(time), "%.2f ns", r.ns_median); }
+	else if (r.ns_median < 1e6) { stbsp_snprintf(time, sizeof(time), "%.2f us", r.ns_median * 1e-3); }
+	else if (r.ns_median < 1e9) { stbsp_snprintf(time, sizeof(time), "%.2f ms", r.ns_median * 1e-6); }
+	else                        { stbsp_snprintf(time, sizeof(time), "%.2f s",  r.ns_median * 1e-9); }
+
+	char throughput[48] = "";
+	if (r.bytes_per_sec > 0.0) {
+		stbsp_snprintf(throughput, sizeof(throughput), "%.2f GB/s", r.bytes_per_sec * 1e-9);
+	} else if (r.items_per_sec > 0.0) {
+		if      (r.items_per_sec < 1e3) { stbsp_snprintf(throughput, sizeof(throughput), "%.2f items/s",  r.items_per_sec); }
+		else if (r.items_per_sec < 1e6) { stbsp_snprintf(throughput, sizeof(throughput), "%.2f k items/s", r.items_per_sec * 1e-3); }
+		else if (r.items_per_sec < 1e9) { stbsp_snprintf(throughput, sizeof(throughput), "%.2f M items/s", r.items_per_sec * 1e-6); }
+		else                            { stbsp_snprintf(throughput, sizeof(throughput), "%.2f G items/s", r.items_per_sec * 1e-9); }
+	}
+
+	// Spread between the fastest and slowest repetition, relative to the median
+	double spread = (r.ns_max - r.ns_min) / r.ns_median * 100.0;
+	printf("%-52s %12s %7.1f%% %12llu %18s", r.name, time, spread, (unsigned long long)r.iterations, throughput);
+	if (r.counter_name) { printf("  %s: %.4g", r.counter_name, r.counter); }
+	printf("\n");
+}
+
+static bool WriteBenchResults(const char* path, const std::vector<BenchResult>& results) {
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		LOG_F(ERROR, "Can't write benchmark results to %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"platform\": \"%s\",\n", PLATFORM_NAME);
+	fprintf(f, "\t\"job_threads\": %u,\n", GetJobThreadCount());
+	fprintf(f, "\t\"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		fprintf(f, "\t\t{\"name\": \"%s\", \"arg\": %llu, ", r.name, (unsigned long long)r.arg);
+		if (r.skipped) {
+			fprintf(f, "\"skipped\": \"%s\"}", r.skipped);
+		} else {
+			fprintf(f, "\"iterations\": %llu, \"ns_per_iter\": %.3f, \"ns_min\": %.3f, \"ns_max\": %.3f, "
+				"\"items_per_sec\": %.1f, \"bytes_per_sec\": %.1f", (unsigned long long)r.iterations,
+				r.ns_median, r.ns_min, r.ns_max, r.items_per_sec, r.bytes_per_sec);
+			if (r.counter_name) { fprintf(f, ", \"%s\": %g", r.counter_name, r.counter); }
+			fprintf(f, "}");
+		}
+		fprintf(f, "%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+	fprintf(f, "\t]\n}\n");
+
+	bool ok = (ferror(f) == 0);
+	ok &= (fclose(f) == 0);
+	if (ok) {
+		LOG_F(INFO, "Wrote %zu benchmark results to %s", results.size(), path);
+	} else {
+		LOG_F(ERROR, "Failed to write benchmark results to %s", path);
+	}
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+	// Keep loguru's startup messages out of the results table
+	loguru::g_stderr_verbosity = loguru::Verbosity_WARNING;
+	InitDebugSystem(argc, argv);
+	InitJobSystem();
+
+	const char* filter = nullptr;
+	const char* json_path = nullptr;
+	double min_time = 0.1;
+	uint32_t repetitions = 5;
+	bool list = false;
+	for (int i = 1; i < argc; i++) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if (strcmp(argv[i], "--filter") == 0 && value) {
+			filter = value;
+			i++;
+		} else if (strcmp(argv[i], "--json") == 0 && value) {
+			json_path = value;
+			i++;
+		} else if (strcmp(argv[i], "--min-time") == 0 && value) {
+			min_time = Max(1.0, atof(value)) * 0.001;
+			i++;
+		} else if (strcmp(argv[i], "--repetitions") == 0 && value) {
+			repetitions = Max(1U, uint32_t(strtoul(value, nullptr, 10)));
+			i++;
+		} else if (strcmp(argv[i], "--list") == 0) {
+			list = true;
+		} else {
+			fprintf(stderr, "Usage: %s [--filter substring] [--json path.json] [--min-time ms] "
+				"[--repetitions N] [--list]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!list) {
+		printf("%-52s %12s %8s %12s %18s\n", "Benchmark", "Time", "Spread", "Iterations", "Throughput");
+	}
+
+	std::vector<BenchResult> results;
+	for (const BenchEntry& entry : GetBenchEntries()) {
+		char name[96];
+		if (entry.has_arg) {
+			stbsp_snprintf(name, sizeof(name), "%s/%llu", entry.name, (unsigned long long)entry.arg);
+		} else {
+			stbsp_snprintf(name, sizeof(name), "%s", entry.name);
+		}
+		if (filter && !strstr(name, filter)) { continue; }
+		if (list) {
+			printf("%s\n", name);
+			continue;
+		}
+		BenchResult result = MeasureBench(entry, name, min_time, repetitions);
+		PrintBenchResult(result);
+		fflush(stdout);
+		results.push_back(result);
+	}
+
+	if (json_path && !WriteBenchResults(json_path, results)) {
+		return 1;
+	}
+	return 0;
+}
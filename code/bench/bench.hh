@@ -0,0 +1,92 @@
+#pragma once
+#include "base/base.hh"
+
+#include <initializer_list>
+
+#if defined(_MSC_VER)
+	#include <intrin.h>
+#endif
+
+/* Micro-benchmark harness for the IrisBench target.
+ *
+ * A benchmark is a function that runs the code being measured bench.iterations times. The harness
+ * calls it with increasing iteration counts until one call takes long enough to time reliably,
+ * then repeats that call a few times and reports the median time per iteration. Setup work that
+ * shouldn't be measured goes before bench.reset_timer(), or between bench.pause() and bench.resume().
+ *
+ *     static void BenchHashMapFind(Bench& bench) {
+ *         HashMap<uint64_t, uint64_t> map = ...;
+ *         bench.reset_timer();
+ *         for (uint64_t i = 0; i < bench.iterations; i++) {
+ *             BenchKeep(map.find(i));
+ *         }
+ *         bench.items = 1;
+ *     }
+ *     BENCHMARK("HashMap::find", BenchHashMapFind);
+ *
+ * Benchmarks can be registered with a list of arguments, e.g. problem sizes. They're run once per
+ * argument, which is available as bench.arg.
+ *
+ * Usage: IrisBench [--filter substring] [--json path.json] [--min-time ms] [--repetitions N] [--list]
+ * Results are printed as a table, and written as JSON if --json is given.
+ */
+
+struct Bench {
+	// Number of times to run the measured code in this call.
+	uint64_t iterations;
+	// Argument the benchmark was registered with, or 0.
+	uint64_t arg;
+	// Items and bytes processed per iteration. Set these to get throughput in the results.
+	uint64_t items = 0;
+	uint64_t bytes = 0;
+	// Optional extra result that isn't a time, e.g. a collision rate, reported next to the time.
+	// The name must be a string literal.
+	const char* counter_name = nullptr;
+	double counter = 0.0;
+	// Set to skip the benchmark, e.g. because a data file is missing. Must be a string literal.
+	const char* skipped = nullptr;
+
+	// Restarts the measurement, excluding any setup done so far.
+	void reset_timer();
+
+	// Excludes the time until resume() from the measurement.
+	void pause();
+	void resume();
+
+	// Timestamps in performance counter ticks. Internal.
+	uint64_t start_ticks = 0;
+	uint64_t paused_ticks = 0;
+	uint64_t pause_start_ticks = 0;
+};
+
+typedef void (*BenchFunction)(Bench& bench);
+
+// Registers a benchmark at static initialisation time. Use BENCHMARK() instead.
+struct BenchRegistration {
+	BenchRegistration(const char* name, BenchFunction function, std::initializer_list<uint64_t> args = {});
+};
+
+#define BENCH_VAR1(line) bench_registration_ ## line
+#define BENCH_VAR0(line) BENCH_VAR1(line)
+#define BENCHMARK(name, function, ...) \
+	static BenchRegistration BENCH_VAR0(__LINE__)(name, function, {__VA_ARGS__})
+
+// Stops the compiler from optimising away a value that the benchmark computes but doesn't use.
+template <typename T> static FORCEINLINE void BenchKeep(const T& value) {
+	#if defined(_MSC_VER) && !defined(__clang__)
+		const volatile char* p = reinterpret_cast<const volatile char*>(&value);
+		(void)*p;
+	#else
+		asm volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+// Stops the compiler from assuming anything about memory across this point, e.g. that a value
+// written before it is still the same after it.
+static FORCEINLINE void BenchClobber() {
+	#if defined(_MSC_VER) && !defined(__clang__)
+		_ReadWriteBarrier();
+	#else
+		asm volatile("" : : : "memory");
+	#endif
+}
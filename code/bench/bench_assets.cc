@@ -0,0 +1,133 @@
+#include "bench/bench.hh"
+#include "base/filesystem.hh"
+#include "base/jobs.hh"
+#include "assets/mipgen.hh"
+#include "assets/texcompress.hh"
+
+#include <stb_image.h>
+#include <stb_image_resize.h>
+#include <string.h>
+#include <vector>
+
+// Mipmap generation ******************************************************************************
+
+struct BenchMipChain {
+	uint32_t width;
+	uint32_t height;
+	uint8_t channels;
+	uint8_t num_levels;
+	std::vector<uint8_t*> levels; // level 0 is the decoded image
+};
+
+// Decodes Sponza's textures once and allocates their mip levels. Empty if the model isn't there.
+static std::vector<BenchMipChain>& GetSponzaMipChains() {
+	static std::vector<BenchMipChain> chains;
+	static bool loaded = false;
+	if (loaded) { return chains; }
+	loaded = true;
+
+	String dir = "data/models/Sponza";
+	for (String name : DirectoryIterator(dir)) {
+		const char* extension = strrchr(name.cstr, '.');
+		if (!extension || (strcmp(extension, ".jpg") != 0 && strcmp(extension, ".png") != 0)) { continue; }
+		MappedFile file = MapFile(PathJoin(dir, name));
+		int w, h, c;
+		uint8_t* image = file ? stbi_load_from_memory(file.data, int(file.size), &w, &h, &c, 0) : nullptr;
+		if (!image) { continue; }
+
+		BenchMipChain chain = {.width = uint32_t(w), .height = uint32_t(h), .channels = uint8_t(c)};
+		chain.num_levels = 1 + uint8_t(floorf(log2f(float(Max(Max(w, h), 2)))));
+		chain.levels.push_back(image);
+		for (uint32_t i = 1; i < chain.num_levels; i++) {
+			size_t size = size_t(Max(1U, chain.width >> i)) * Max(1U, chain.height >> i) * c;
+			chain.levels.push_back(static_cast<uint8_t*>(malloc(size)));
+		}
+		chains.push_back(std::move(chain));
+	}
+	return chains;
+}
+
+static uint64_t SponzaLevel0Bytes(const std::vector<BenchMipChain>& chains) {
+	uint64_t bytes = 0;
+	for (const BenchMipChain& chain : chains) { bytes += uint64_t(chain.width) * chain.height * chain.channels; }
+	return bytes;
+}
+
+// What the texture loader used to do: each level resized from the one above with stb_image_resize,
+// textures spread across the job system's threads.
+static void BenchMipgenStbir(Bench& bench) {
+	std::vector<BenchMipChain>& chains = GetSponzaMipChains();
+	if (chains.empty()) {
+		bench.skipped = "no textures in data/models/Sponza, run from the repository root";
+		return;
+	}
+	bench.reset_timer();
+	for (uint64_t n = 0; n < bench.iterations; n++) {
+		ParallelFor(uint32_t(chains.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				BenchMipChain& chain = chains[i];
+				int c = chain.channels;
+				for (uint32_t level = 1; level < chain.num_levels; level++) {
+					int src_w = int(Max(1U, chain.width >> (level - 1))), src_h = int(Max(1U, chain.height >> (level - 1)));
+					int dst_w = int(Max(1U, chain.width >> level)), dst_h = int(Max(1U, chain.height >> level));
+					stbir_resize_uint8(chain.levels[level - 1], src_w, src_h, src_w * c,
+						chain.levels[level], dst_w, dst_h, dst_w * c, c);
+				}
+			}
+		});
+	}
+	bench.items = chains.size();
+	bench.bytes = SponzaLevel0Bytes(chains);
+}
+BENCHMARK("Mip chain stbir_resize_uint8 (Sponza textures)", BenchMipgenStbir);
+
+// Same, with GenerateMipChain. bench.arg: 0 = box, 1 = box in sRGB, 2 = Kaiser in sRGB.
+static void BenchMipgen(Bench& bench) {
+	std::vector<BenchMipChain>& chains = GetSponzaMipChains();
+	if (chains.empty()) {
+		bench.skipped = "no textures in data/models/Sponza, run from the repository root";
+		return;
+	}
+	MipgenOptions options;
+	options.srgb = (bench.arg >= 1);
+	options.filter = (bench.arg == 2) ? MipFilter::Kaiser : MipFilter::Box;
+	bench.reset_timer();
+	for (uint64_t n = 0; n < bench.iterations; n++) {
+		ParallelFor(uint32_t(chains.size()), 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t i = begin; i < end; i++) {
+				BenchMipChain& chain = chains[i];
+				GenerateMipChain(chain.levels.data(), chain.width, chain.height, chain.channels, chain.num_levels,
+					options);
+			}
+		});
+	}
+	bench.items = chains.size();
+	bench.bytes = SponzaLevel0Bytes(chains);
+}
+BENCHMARK("GenerateMipChain (Sponza textures, 0=box 1=box sRGB 2=Kaiser sRGB)", BenchMipgen, 0, 1, 2);
+
+// Block compression ******************************************************************************
+
+// Compresses level 0 of each of Sponza's textures. bench.arg is the TextureCompression.
+static void BenchCompressTexture(Bench& bench) {
+	std::vector<BenchMipChain>& chains = GetSponzaMipChains();
+	if (chains.empty()) {
+		bench.skipped = "no textures in data/models/Sponza, run from the repository root";
+		return;
+	}
+	TextureCompression compression = TextureCompression(bench.arg);
+	std::vector<uint8_t> compressed;
+	for (const BenchMipChain& chain : chains) {
+		compressed.resize(Max(compressed.size(), CompressedLevelSize(compression, chain.width, chain.height)));
+	}
+	bench.reset_timer();
+	for (uint64_t n = 0; n < bench.iterations; n++) {
+		for (const BenchMipChain& chain : chains) {
+			CompressTextureLevel(compression, chain.levels[0], chain.width, chain.height, chain.channels,
+				compressed.data());
+		}
+	}
+	bench.items = chains.size();
+	bench.bytes = SponzaLevel0Bytes(chains);
+}
+BENCHMARK("CompressTextureLevel (Sponza textures, 1=BC4 2=BC5 3=BC1 4=BC3)", BenchCompressTexture, 1, 2, 3, 4);
@@ -0,0 +1,350 @@
+#include "bench/bench.hh"
+#include "base/hash.hh"
+#include "base/hashmap.hh"
+#include "base/string.hh"
+#include "base/stringid.hh"
+#include "base/filesystem.hh"
+#include "base/memory.hh"
+#include "base/mpsc_queue.hh"
+#include "base/jobs.hh"
+
+#include <stdlib.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Deterministic pseudo-random numbers (splitmix64), so every run uses the same keys.
+static uint64_t BenchRandom(uint64_t* state) {
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// Hashing ****************************************************************************************
+
+static void BenchHash64Buffer(Bench& bench) {
+	std::vector<uint8_t> buffer(bench.arg);
+	uint64_t state = 1;
+	for (uint8_t& b : buffer) { b = uint8_t(BenchRandom(&state)); }
+	uint64_t h = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		h += Hash64(buffer.data(), buffer.size(), i);
+	}
+	BenchKeep(h);
+	bench.bytes = bench.arg;
+}
+BENCHMARK("Hash64(buffer)", BenchHash64Buffer, 8, 16, 64, 1024, 65536);
+
+static void BenchHashBuffer128(Bench& bench) {
+	std::vector<uint8_t> buffer(bench.arg);
+	uint64_t state = 1;
+	for (uint8_t& b : buffer) { b = uint8_t(BenchRandom(&state)); }
+	uint64_t h = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		buffer[0] = uint8_t(i); // so the hash can't be hoisted out of the loop
+		Hash128 hash = HashBuffer128(buffer.data(), buffer.size());
+		h += hash.lo ^ hash.hi;
+	}
+	BenchKeep(h);
+	bench.bytes = bench.arg;
+}
+BENCHMARK("HashBuffer128", BenchHashBuffer128, 8, 16, 64, 1024, 65536);
+
+static void BenchHash64CString(Bench& bench) {
+	const char* str = "data/models/Sponza/Sponza.gltf";
+	uint64_t h = 0;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		BenchKeep(str); // stops the hash from being computed at compile time
+		h += Hash64(str);
+	}
+	BenchKeep(h);
+	bench.bytes = strlen(str);
+}
+BENCHMARK("Hash64(cstr)", BenchHash64CString);
+
+// Hash maps **************************************************************************************
+
+static void BenchHashMapInsert(Bench& bench) {
+	std::vector<uint64_t> keys(bench.arg);
+	uint64_t state = 1;
+	for (uint64_t& k : keys) { k = BenchRandom(&state); }
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		HashMap<uint64_t, uint64_t> map;
+		for (uint64_t k : keys) { map[k] = k; }
+		BenchKeep(map.size());
+		bench.pause();
+		map = HashMap<uint64_t, uint64_t>();
+		bench.resume();
+	}
+	bench.items = bench.arg;
+}
+BENCHMARK("HashMap::operator[] (insert)", BenchHashMapInsert, 1000, 100000);
+
+static void BenchUnorderedMapInsert(Bench& bench) {
+	std::vector<uint64_t> keys(bench.arg);
+	uint64_t state = 1;
+	for (uint64_t& k : keys) { k = BenchRandom(&state); }
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		std::unordered_map<uint64_t, uint64_t> map;
+		for (uint64_t k : keys) { map[k] = k; }
+		BenchKeep(map.size());
+		bench.pause();
+		map = std::unordered_map<uint64_t, uint64_t>();
+		bench.resume();
+	}
+	bench.items = bench.arg;
+}
+BENCHMARK("std::unordered_map::operator[] (insert)", BenchUnorderedMapInsert, 1000, 100000);
+
+static void BenchHashMapFind(Bench& bench) {
+	std::vector<uint64_t> keys(bench.arg);
+	uint64_t state = 1;
+	for (uint64_t& k : keys) { k = BenchRandom(&state); }
+	HashMap<uint64_t, uint64_t> map;
+	for (uint64_t k : keys) { map[k] = k; }
+	// Half of the lookups miss
+	uint64_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		uint64_t key = (i & 1) ? keys[(i >> 1) % keys.size()] : BenchRandom(&state);
+		const uint64_t* value = map.find(key);
+		sum += value ? *value : 0;
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("HashMap::find", BenchHashMapFind, 1000, 100000);
+
+static void BenchUnorderedMapFind(Bench& bench) {
+	std::vector<uint64_t> keys(bench.arg);
+	uint64_t state = 1;
+	for (uint64_t& k : keys) { k = BenchRandom(&state); }
+	std::unordered_map<uint64_t, uint64_t> map;
+	for (uint64_t k : keys) { map[k] = k; }
+	uint64_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		uint64_t key = (i & 1) ? keys[(i >> 1) % keys.size()] : BenchRandom(&state);
+		auto it = map.find(key);
+		sum += (it != map.end()) ? it->second : 0;
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("std::unordered_map::find", BenchUnorderedMapFind, 1000, 100000);
+
+// Strings and string IDs *************************************************************************
+
+static void BenchStringFormat(Bench& bench) {
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		String s = String::format("%s Shadow Map %u", "DirectionalLight", uint32_t(i));
+		BenchKeep(s.cstr);
+	}
+	bench.items = 1;
+}
+BENCHMARK("String::format", BenchStringFormat);
+
+static void BenchStringFrameFormat(Bench& bench) {
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		// The frame arena only grows until it's reset, so reset it like the main loop would
+		if ((i & 1023) == 0) { BeginFrameArena(); }
+		String s = String::frame_format("%s Shadow Map %u", "DirectionalLight", uint32_t(i));
+		BenchKeep(s.cstr);
+	}
+	bench.items = 1;
+}
+BENCHMARK("String::frame_format", BenchStringFrameFormat);
+
+static void BenchPathJoin(Bench& bench) {
+	String dir = "data/models/Sponza";
+	String file = "textures\\10381718147657362067.jpg";
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		BenchClobber();
+		String path = PathJoin(dir, file);
+		BenchKeep(path.cstr);
+	}
+	bench.items = 1;
+}
+BENCHMARK("PathJoin", BenchPathJoin);
+
+static void BenchStringIdIntern(Bench& bench) {
+	// Interns bench.arg distinct strings once, then measures lookups of existing strings
+	std::vector<const char*> strings(bench.arg);
+	for (uint64_t i = 0; i < bench.arg; i++) {
+		strings[i] = StringId::intern(String::format("bench/stringid/%llu.png", (unsigned long long)i)).cstr();
+	}
+	uint32_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		sum += StringId::intern(strings[i % strings.size()]).index;
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("StringId::intern (existing)", BenchStringIdIntern, 100, 100000);
+
+static void BenchStringIdLiteral(Bench& bench) {
+	uint32_t sum = 0;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		sum += StringIdLiteral("data/shaders/gbuffer.frag").index;
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("StringIdLiteral", BenchStringIdLiteral);
+
+static void BenchStringIdCString(Bench& bench) {
+	StringId id = StringId::intern("data/shaders/core_transform.vert");
+	uint64_t sum = 0;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		BenchKeep(id);
+		sum += uintptr_t(id.cstr());
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("StringId::cstr", BenchStringIdCString);
+
+// Memory *****************************************************************************************
+
+static void BenchArenaAlloc(Bench& bench) {
+	Arena arena = Arena(1 << 20);
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		if ((i & 4095) == 0) { arena.reset(); }
+		void* p = arena.alloc(bench.arg);
+		BenchKeep(p);
+	}
+	bench.items = 1;
+}
+BENCHMARK("Arena::alloc", BenchArenaAlloc, 16, 256);
+
+static void BenchMallocFree(Bench& bench) {
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		void* p = malloc(bench.arg);
+		BenchKeep(p);
+		free(p);
+	}
+	bench.items = 1;
+}
+BENCHMARK("malloc+free", BenchMallocFree, 16, 256);
+
+// Concurrency ************************************************************************************
+
+// bench.arg producer threads push values while this thread pops them. Each iteration is one value.
+static void BenchMPSCQueueContention(Bench& bench) {
+	static MPSCQueue<uint64_t, 4096> queue;
+	uint64_t producers = bench.arg;
+	uint64_t per_producer = (bench.iterations + producers - 1) / producers;
+	uint64_t total = per_producer * producers;
+
+	std::atomic<bool> go = false;
+	std::vector<std::thread> threads;
+	bench.pause();
+	for (uint64_t p = 0; p < producers; p++) {
+		threads.emplace_back([&]() {
+			while (!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+			for (uint64_t i = 0; i < per_producer; i++) {
+				while (!queue.try_push(i)) { std::this_thread::yield(); }
+			}
+		});
+	}
+	bench.resume();
+
+	go.store(true, std::memory_order_release);
+	uint64_t popped = 0, sum = 0, value;
+	while (popped < total) {
+		if (queue.try_pop(&value)) {
+			sum += value;
+			popped++;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+
+	bench.pause();
+	for (std::thread& thread : threads) { thread.join(); }
+	bench.resume();
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("MPSCQueue push/pop (producers)", BenchMPSCQueueContention, 1, 2, 4, 8);
+
+static void BenchStartJob(Bench& bench) {
+	// Empty jobs, so this measures the job system's own overhead per job
+	JobGroup group;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		StartJob(&group, [](void* data) { BenchKeep(data); }, nullptr);
+		if ((i & 1023) == 1023) { WaitForJobs(&group); }
+	}
+	WaitForJobs(&group);
+	bench.items = 1;
+}
+BENCHMARK("StartJob+WaitForJobs", BenchStartJob);
+
+// Sums a large array with ParallelFor, with the given batch size. Shows how well the job system
+// scales across threads for memory-bound work, and how much small batches cost.
+static void BenchParallelFor(Bench& bench) {
+	static std::vector<uint32_t> values;
+	if (values.empty()) {
+		values.resize(1 << 22);
+		uint64_t state = 1;
+		for (uint32_t& v : values) { v = uint32_t(BenchRandom(&state)); }
+	}
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		std::atomic<uint64_t> total = 0;
+		ParallelFor(uint32_t(values.size()), uint32_t(bench.arg), [&](uint32_t begin, uint32_t end) {
+			uint64_t sum = 0;
+			for (uint32_t j = begin; j < end; j++) { sum += values[j]; }
+			total.fetch_add(sum, std::memory_order_relaxed);
+		});
+		BenchKeep(total.load(std::memory_order_relaxed));
+	}
+	bench.bytes = values.size() * sizeof(uint32_t);
+}
+BENCHMARK("ParallelFor sum 16MB (batch size)", BenchParallelFor, 1024, 16384, 262144);
+
+// Runs the same sum as above with a fixed batch size on 1 to N job threads (including the main
+// thread), restarting the job system for each thread count. Shows how ParallelFor scales with
+// worker count rather than with batch size.
+static void BenchParallelForScaling(Bench& bench) {
+	uint32_t threads = uint32_t(bench.arg);
+	if (threads > Max(1U, std::thread::hardware_concurrency())) {
+		bench.skipped = "more threads than the hardware has";
+		return;
+	}
+	static std::vector<uint32_t> values;
+	if (values.empty()) {
+		values.resize(1 << 22);
+		uint64_t state = 1;
+		for (uint32_t& v : values) { v = uint32_t(BenchRandom(&state)); }
+	}
+	if (GetJobThreadCount() != threads) {
+		ShutdownJobSystem();
+		InitJobSystem(threads - 1);
+	}
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		std::atomic<uint64_t> total = 0;
+		ParallelFor(uint32_t(values.size()), 16384, [&](uint32_t begin, uint32_t end) {
+			uint64_t sum = 0;
+			for (uint32_t j = begin; j < end; j++) { sum += values[j]; }
+			total.fetch_add(sum, std::memory_order_relaxed);
+		});
+		BenchKeep(total.load(std::memory_order_relaxed));
+	}
+	bench.bytes = values.size() * sizeof(uint32_t);
+
+	// Leave the job system as main() set it up for the benchmarks that follow
+	bench.pause();
+	ShutdownJobSystem();
+	InitJobSystem();
+	bench.resume();
+}
+BENCHMARK("ParallelFor sum 16MB (threads)", BenchParallelForScaling, 1, 2, 4, 8, 16, 32);
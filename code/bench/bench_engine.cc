@@ -0,0 +1,99 @@
+#include "bench/bench.hh"
+#include "engine/engine.hh"
+#include "engine/deferred.hh"
+#include "engine/metrics.hh"
+#include "engine/profiler.hh"
+
+#include <thread>
+#include <vector>
+
+// Deferred actions *******************************************************************************
+
+static void BenchDeferredAction(Engine& engine, void* data) {
+	BenchKeep(data);
+}
+
+// Defers and then runs batches of bench.arg empty actions. Measures the queue and the per-action
+// bookkeeping (timing and cost estimates) of the scheduler.
+static void BenchDeferAndRun(Bench& bench) {
+	static Engine engine;
+	uint64_t batch = bench.arg;
+	for (uint64_t i = 0; i < bench.iterations; i += batch) {
+		for (uint64_t j = 0; j < batch; j++) {
+			Defer(BenchDeferredAction, nullptr);
+		}
+		RunDeferredActions(engine, INFINITY);
+	}
+	bench.items = 1;
+}
+BENCHMARK("Defer+RunDeferredActions (batch)", BenchDeferAndRun, 1, 64, 1024);
+
+// Same as above, but with the actions deferred from bench.arg worker threads at once.
+static void BenchDeferFromThreads(Bench& bench) {
+	static Engine engine;
+	uint64_t threads_count = bench.arg;
+	// Stays below DeferredActionCapacity per round so that the overflow path isn't measured
+	uint64_t per_thread = Max(uint64_t(1), uint64_t(DeferredActionCapacity / 2) / threads_count);
+	for (uint64_t i = 0; i < bench.iterations; i += per_thread * threads_count) {
+		bench.pause();
+		std::atomic<bool> go = false;
+		std::vector<std::thread> threads;
+		for (uint64_t t = 0; t < threads_count; t++) {
+			threads.emplace_back([&]() {
+				while (!go.load(std::memory_order_acquire)) { std::this_thread::yield(); }
+				for (uint64_t j = 0; j < per_thread; j++) { Defer(BenchDeferredAction, nullptr); }
+			});
+		}
+		bench.resume();
+		go.store(true, std::memory_order_release);
+		for (std::thread& thread : threads) { thread.join(); }
+		RunDeferredActions(engine, INFINITY);
+	}
+	bench.items = 1;
+}
+BENCHMARK("Defer from threads+RunDeferredActions (threads)", BenchDeferFromThreads, 1, 4);
+
+// Profiler ***************************************************************************************
+
+static void BenchProfileZone(Bench& bench) {
+	#if ENABLE_PROFILER
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		ProfileZone("Bench Zone");
+		BenchClobber();
+	}
+	bench.items = 1;
+	#else
+	bench.skipped = "profiler disabled in this build";
+	#endif
+}
+BENCHMARK("ProfileZone (begin+end)", BenchProfileZone);
+
+// Metrics ****************************************************************************************
+
+static void BenchMetricBufferPush(Bench& bench) {
+	MetricBuffer metric = MetricBuffer(uint32_t(bench.arg));
+	float t = 0.0f;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		t += 16.6f;
+		metric.push(t, 10.0f + float(i % 97) * 0.1f);
+	}
+	BenchKeep(metric.max());
+	bench.items = 1;
+}
+BENCHMARK("MetricBuffer::push (frames)", BenchMetricBufferPush, 120, 1000);
+
+static void BenchMetricBufferQuery(Bench& bench) {
+	MetricBuffer metric = MetricBuffer(uint32_t(bench.arg));
+	for (uint64_t i = 0; i < bench.arg; i++) {
+		metric.push(float(i), 10.0f + float(i % 97) * 0.1f);
+	}
+	float sum = 0.0f;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		BenchClobber();
+		sum += metric.avg() + metric.max() + metric.percentile(0.99);
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+BENCHMARK("MetricBuffer avg+max+p99 (frames)", BenchMetricBufferQuery, 120, 1000);
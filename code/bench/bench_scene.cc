@@ -0,0 +1,315 @@
+#include "bench/bench.hh"
+#include "base/filesystem.hh"
+#include "engine/engine.hh"
+#include "scene/gameobject.hh"
+#include "scene/camera.hh"
+#include "assets/mesh.hh"
+#include "assets/material.hh"
+#include "graphics/renderlist.hh"
+#include "graphics/render.hh"
+#include "base/hashmap.hh"
+
+#include <parson.h>
+#include <stdlib.h>
+#include <unordered_map>
+#include <vector>
+
+static float BenchRandomFloat(uint32_t* state, float min, float max) {
+	// xorshift32
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return min + (max - min) * float(*state >> 8) * (1.0f / float(1 << 24));
+}
+
+// Meshes and materials shared by every generated scene. The meshes are never uploaded, but have a
+// fake vertex array handle so that the render list doesn't skip them.
+static constexpr uint32_t BenchScene_MeshCount = 16;
+static constexpr uint32_t BenchScene_MaterialCount = 4;
+static Mesh BenchScene_Meshes[BenchScene_MeshCount];
+static Material BenchScene_Materials[BenchScene_MaterialCount];
+
+// Builds a scene of count objects in a tree with 8 children per node, i.e. about 7 levels deep for
+// a million objects. Every object is a MeshInstance, spread out around the origin.
+static GameObject* BuildBenchScene(uint64_t count) {
+	for (uint32_t i = 0; i < BenchScene_MeshCount; i++) {
+		BenchScene_Meshes[i].gl_vertex_array = 1;
+		BenchScene_Meshes[i].aabb_center = vec3(0.0f);
+		BenchScene_Meshes[i].aabb_half_extents = vec3(0.25f + 0.1f * float(i));
+	}
+
+	uint32_t state = 1;
+	std::vector<GameObject*> objects(count);
+	for (uint64_t i = 0; i < count; i++) {
+		GameObject* object = new MeshInstance(&BenchScene_Meshes[i % BenchScene_MeshCount],
+			&BenchScene_Materials[(i / BenchScene_MeshCount) % BenchScene_MaterialCount]);
+		object->position = vec3(
+			BenchRandomFloat(&state, -10.0f, 10.0f),
+			BenchRandomFloat(&state, -10.0f, 10.0f),
+			BenchRandomFloat(&state, -10.0f, 10.0f));
+		object->rotation = glm::angleAxis(BenchRandomFloat(&state, 0.0f, 6.28f), vec3(0, 1, 0));
+		if (i > 0) { objects[(i - 1) / 8]->Add(object); }
+		objects[i] = object;
+	}
+	return objects[0];
+}
+
+static void DeleteBenchScene(GameObject* scene) {
+	scene->Delete();
+	scene->GarbageCollect();
+}
+
+// Generated scenes are expensive to build, so the last one is kept around for the next benchmark.
+static GameObject* GetBenchScene(uint64_t count) {
+	static GameObject* scene = nullptr;
+	static uint64_t scene_count = 0;
+	if (scene && scene_count == count) { return scene; }
+	if (scene) { DeleteBenchScene(scene); }
+	scene = BuildBenchScene(count);
+	scene_count = count;
+	scene->RecursiveUpdateTransforms();
+	return scene;
+}
+
+// Camera outside the generated scenes, looking towards their centre, so that some but not all
+// objects are visible.
+static Camera* GetBenchCamera(Engine& engine) {
+	static InfPerspectiveRevZCamera* camera = nullptr;
+	if (!camera) {
+		camera = new InfPerspectiveRevZCamera(0.1f, 90.0f);
+		camera->position = vec3(0.0f, 0.0f, 40.0f);
+		camera->RecursiveUpdateTransforms();
+		camera->LateUpdate(engine);
+		camera->LateUpdate(engine); // so that last_frame is valid too
+	}
+	return camera;
+}
+
+// Scene graph ************************************************************************************
+
+static void BenchGameObjectAdd(Bench& bench) {
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		GameObject* scene = BuildBenchScene(bench.arg);
+		bench.pause();
+		DeleteBenchScene(scene);
+		bench.resume();
+	}
+	bench.items = bench.arg;
+}
+BENCHMARK("GameObject::Add (objects)", BenchGameObjectAdd, 1000, 10000, 100000, 1000000);
+
+static void BenchGameObjectRecurse(Bench& bench) {
+	GameObject* scene = GetBenchScene(bench.arg);
+	bench.reset_timer();
+	uint64_t visited = 0;
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		scene->Recurse([&](GameObject& obj) { visited++; });
+	}
+	BenchKeep(visited);
+	bench.items = bench.arg;
+}
+BENCHMARK("GameObject::Recurse (objects)", BenchGameObjectRecurse, 1000, 10000, 100000, 1000000);
+
+static void BenchRecursiveUpdateTransforms(Bench& bench) {
+	GameObject* scene = GetBenchScene(bench.arg);
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		scene->RecursiveUpdateTransforms();
+	}
+	bench.items = bench.arg;
+}
+BENCHMARK("GameObject::RecursiveUpdateTransforms (objects)", BenchRecursiveUpdateTransforms, 1000, 10000, 100000, 1000000);
+
+// Render list ************************************************************************************
+
+static void BenchRenderListUpdate(Bench& bench) {
+	static Engine engine;
+	GameObject* scene = GetBenchScene(bench.arg);
+	Camera* camera = GetBenchCamera(engine);
+	static RenderListPerView view;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		view.UpdateFromScene(engine, scene, camera);
+		BenchKeep(view.mesh_instances.data());
+	}
+	bench.items = bench.arg;
+}
+BENCHMARK("RenderListPerView::UpdateFromScene (objects)", BenchRenderListUpdate, 1000, 10000, 100000, 1000000);
+
+static void BenchCollideAABBFrustum(Bench& bench) {
+	static Engine engine;
+	Camera* camera = GetBenchCamera(engine);
+	constexpr uint32_t BoxCount = 1024;
+	vec3 centers[BoxCount], half_extents[BoxCount];
+	uint32_t state = 1;
+	for (uint32_t i = 0; i < BoxCount; i++) {
+		centers[i] = vec3(
+			BenchRandomFloat(&state, -40.0f, 40.0f),
+			BenchRandomFloat(&state, -40.0f, 40.0f),
+			BenchRandomFloat(&state, -40.0f, 40.0f));
+		half_extents[i] = vec3(BenchRandomFloat(&state, 0.1f, 2.0f));
+	}
+	mat4 vp = camera->this_frame.vp;
+	uint32_t visible = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		uint32_t box = uint32_t(i) & (BoxCount - 1);
+		visible += CollideAABBFrustum(centers[box], half_extents[box], vp, camera->input.znear, camera->input.zfar);
+	}
+	BenchKeep(visible);
+	bench.items = 1;
+}
+BENCHMARK("CollideAABBFrustum", BenchCollideAABBFrustum);
+
+// Render cache keys ******************************************************************************
+
+// Keys for the render list's mesh/material batches and for the framebuffer cache. The pointers in
+// them come from real heap allocations, so they're spaced like the engine's, but they're never
+// dereferenced. Benchmarks use the first bench.arg keys of a fixed list.
+static constexpr uint32_t BenchKeys_MaxCount = 4096;
+
+static void* BenchKeyPointer(size_t size) {
+	// Leaked on purpose: the keys are kept for the lifetime of the process
+	return malloc(size);
+}
+
+template <typename Key> static const std::vector<Key>& GetBenchKeys();
+
+template <> const std::vector<RenderableMeshKey>& GetBenchKeys<RenderableMeshKey>() {
+	static std::vector<RenderableMeshKey> keys;
+	if (keys.empty()) {
+		// About four meshes per material, as in Sponza
+		std::vector<Material*> materials(BenchKeys_MaxCount / 4);
+		for (Material*& material : materials) { material = (Material*)BenchKeyPointer(sizeof(Material)); }
+		uint32_t state = 1;
+		keys.resize(BenchKeys_MaxCount);
+		for (RenderableMeshKey& key : keys) {
+			key.mesh = (Mesh*)BenchKeyPointer(sizeof(Mesh));
+			key.material = materials[uint32_t(BenchRandomFloat(&state, 0.0f, float(materials.size())))];
+		}
+	}
+	return keys;
+}
+
+template <> const std::vector<FramebufferKey>& GetBenchKeys<FramebufferKey>() {
+	static std::vector<FramebufferKey> keys;
+	if (keys.empty()) {
+		// One to four attachments out of a pool of render targets, with the rest left null
+		std::vector<RenderTarget*> targets(64);
+		for (RenderTarget*& target : targets) { target = (RenderTarget*)BenchKeyPointer(sizeof(RenderTarget)); }
+		HashMap<FramebufferKey, bool> seen;
+		uint32_t state = 1;
+		while (keys.size() < BenchKeys_MaxCount) {
+			FramebufferKey key = {};
+			uint32_t count = 1 + uint32_t(keys.size() % 4);
+			for (uint32_t i = 0; i < count; i++) {
+				key.attachments[i] = targets[uint32_t(BenchRandomFloat(&state, 0.0f, float(targets.size())))];
+			}
+			if (!seen.contains(key)) {
+				seen[key] = true;
+				keys.push_back(key);
+			}
+		}
+	}
+	return keys;
+}
+
+template <typename Key> static void BenchHashMapKeyFind(Bench& bench) {
+	const std::vector<Key>& keys = GetBenchKeys<Key>();
+	HashMap<Key, uint32_t> map;
+	for (uint32_t i = 0; i < bench.arg; i++) { map[keys[i]] = i; }
+	uint64_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		sum += *map.find(keys[i % bench.arg]);
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+
+template <typename Key> static void BenchUnorderedMapKeyFind(Bench& bench) {
+	const std::vector<Key>& keys = GetBenchKeys<Key>();
+	std::unordered_map<Key, uint32_t, Hash64T> map;
+	for (uint32_t i = 0; i < bench.arg; i++) { map[keys[i]] = i; }
+	uint64_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		sum += map.find(keys[i % bench.arg])->second;
+	}
+	BenchKeep(sum);
+	bench.items = 1;
+}
+
+BENCHMARK("HashMap<RenderableMeshKey>::find", BenchHashMapKeyFind<RenderableMeshKey>, 64, 1024, 4096);
+BENCHMARK("std::unordered_map<RenderableMeshKey>::find", BenchUnorderedMapKeyFind<RenderableMeshKey>, 64, 1024, 4096);
+BENCHMARK("HashMap<FramebufferKey>::find", BenchHashMapKeyFind<FramebufferKey>, 8, 64);
+BENCHMARK("std::unordered_map<FramebufferKey>::find", BenchUnorderedMapKeyFind<FramebufferKey>, 8, 64);
+
+// Hashes bench.arg keys per iteration. Also reports the fraction of keys whose hash lands in an
+// already occupied bucket of a power-of-two table with at least twice as many buckets as keys.
+// A uniform hash gives about 0.2 at that load; pointer-heavy keys hashed badly give far more.
+template <typename Key> static void BenchKeyHash(Bench& bench) {
+	const std::vector<Key>& keys = GetBenchKeys<Key>();
+	uint32_t bucket_count = 1;
+	while (bucket_count < 2 * bench.arg) { bucket_count *= 2; }
+	std::vector<bool> occupied(bucket_count);
+	uint32_t collisions = 0;
+	for (uint32_t i = 0; i < bench.arg; i++) {
+		uint32_t bucket = uint32_t(Hash64T()(keys[i])) & (bucket_count - 1);
+		collisions += occupied[bucket];
+		occupied[bucket] = true;
+	}
+
+	uint64_t sum = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		for (uint32_t k = 0; k < bench.arg; k++) { sum += Hash64T()(keys[k]); }
+	}
+	BenchKeep(sum);
+	bench.items = bench.arg;
+	bench.counter_name = "collision_rate";
+	bench.counter = double(collisions) / double(bench.arg);
+}
+BENCHMARK("Hash64T(RenderableMeshKey) (keys)", BenchKeyHash<RenderableMeshKey>, 64, 1024, 4096);
+BENCHMARK("Hash64T(FramebufferKey) (keys)", BenchKeyHash<FramebufferKey>, 8, 64, 1024);
+
+// Assets *****************************************************************************************
+
+static void BenchMeshComputeAABB(Bench& bench) {
+	std::vector<vec3> positions(bench.arg);
+	uint32_t state = 1;
+	for (vec3& p : positions) {
+		p = vec3(BenchRandomFloat(&state, -1, 1), BenchRandomFloat(&state, -1, 1), BenchRandomFloat(&state, -1, 1));
+	}
+	Buffer buffer = Buffer(BufferUsage::Vertex, uint32_t(positions.size() * sizeof(vec3)), positions.data());
+	Mesh mesh;
+	BufferView& view = mesh.vertex_attribs[Attributes::Position.index];
+	view.buffer = &buffer;
+	view.etype = ElementType::VEC3;
+	view.ctype = ComponentType::F32;
+	view.elements = uint32_t(positions.size());
+	view.offset = 0;
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		mesh.compute_aabb();
+		BenchKeep(mesh.aabb_half_extents);
+	}
+	bench.bytes = positions.size() * sizeof(vec3);
+}
+BENCHMARK("Mesh::compute_aabb (vertices)", BenchMeshComputeAABB, 1000, 100000);
+
+static void BenchParseGLTF(Bench& bench) {
+	static String json = ReadFile("data/models/Sponza/Sponza.gltf");
+	if (!json) {
+		bench.skipped = "data/models/Sponza/Sponza.gltf not found, run from the repository root";
+		return;
+	}
+	bench.reset_timer();
+	for (uint64_t i = 0; i < bench.iterations; i++) {
+		JSON_Value* root = json_parse_string_with_comments(json.cstr);
+		BenchKeep(root);
+		json_value_free(root);
+	}
+	bench.bytes = json.size();
+}
+BENCHMARK("glTF JSON parse (Sponza.gltf)", BenchParseGLTF);
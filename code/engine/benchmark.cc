@@ -0,0 +1,320 @@
+#include "engine/benchmark.hh"
+#include "engine/engine.hh"
+#include "engine/metrics.hh"
+#include "base/debug.hh"
+#include "base/filesystem.hh"
+#include "base/memory.hh"
+#include "graphics/render.hh"
+#include "assets/texture.hh"
+#include "graphics/upload.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// Keyframes of the camera path, which loops through Sponza's atrium and along both galleries. The
+// path is the same for every model, so other models may need a different scale to be useful.
+struct BenchmarkKeyframe {
+	vec3 position;
+	vec2 rotation; // pitch and yaw in degrees, as for EditorCamera
+};
+
+static const BenchmarkKeyframe Benchmark_Path[] = {
+	{vec3(  0.0f, 5.0f,  0.0f), vec2( 20.0f,  -45.0f)},
+	{vec3(  9.0f, 2.0f,  0.0f), vec2(  5.0f,  -90.0f)},
+	{vec3(  9.0f, 6.0f, -3.5f), vec2( 30.0f, -160.0f)},
+	{vec3( -9.0f, 6.0f, -3.5f), vec2( 25.0f, -200.0f)},
+	{vec3(-10.0f, 2.0f,  0.0f), vec2(  0.0f, -270.0f)},
+	{vec3( -2.0f, 8.0f,  3.5f), vec2(-20.0f, -340.0f)},
+};
+
+// Running stats for a metric over the measured frames.
+struct BenchmarkMetric {
+	MetricHistogram histogram;
+	double sum = 0.0;
+	float max = 0.0f;
+
+	void add(float value) {
+		histogram.add(value);
+		sum += value;
+		max = Max(max, value);
+	}
+};
+
+enum BenchmarkPhase {
+	BenchmarkPhase_Frame,
+	BenchmarkPhase_Poll,
+	BenchmarkPhase_Update,
+	BenchmarkPhase_Render,
+	BenchmarkPhase_Defer,
+	BenchmarkPhase_Swap,
+	BenchmarkPhase_Count,
+};
+
+static const char* Benchmark_PhaseNames[BenchmarkPhase_Count] = {
+	"frame", "poll", "update", "render", "defer", "swap",
+};
+
+static bool Benchmark_Started = false;
+// Frames spent waiting for texture streaming to settle, and how many of the last ones were idle.
+static uint32_t Benchmark_StreamingFrames = 0;
+static uint32_t Benchmark_IdleFrames = 0;
+static uint64_t Benchmark_FirstFrame = 0;
+static uint32_t Benchmark_Frames = 0;
+static uint32_t Benchmark_FramesRecorded = 0;
+static float Benchmark_LoadTime = 0.0f;
+static BenchmarkMetric Benchmark_Phases[BenchmarkPhase_Count];
+static BenchmarkMetric Benchmark_Drawcalls;
+static BenchmarkMetric Benchmark_Polys;
+static BenchmarkMetric Benchmark_Allocations;
+
+// Per-frame GL call counts, see GLCallStats. Names match the values in UpdateBenchmark.
+static const char* Benchmark_GLCallNames[] = {
+	"gl_calls", "gl_redundant_calls", "gl_program_binds", "gl_texture_binds", "gl_sampler_binds",
+	"gl_uniform_uploads", "gl_framebuffer_binds", "gl_vertex_array_binds", "gl_state_changes",
+	"gl_buffer_uploads", "gl_buffer_upload_bytes",
+};
+static BenchmarkMetric Benchmark_GLCalls[CountOf(Benchmark_GLCallNames)];
+
+// Render pass histograms cover the whole session, so they're copied at the start of the benchmark
+// and subtracted at the end. Indices match GetRenderPassTimings(), which is only ever appended to.
+struct BenchmarkPassBaseline {
+	MetricHistogram cpu;
+	MetricHistogram gpu;
+};
+static std::vector<BenchmarkPassBaseline> Benchmark_PassBaselines;
+
+bool ParseBenchmarkArgs(int argc, char* argv[], BenchmarkOptions* options) {
+	bool enabled = false;
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		if (strcmp(arg, "--benchmark") == 0) {
+			enabled = true;
+			if (value && value[0] != '-') { options->model_path = value; i++; }
+		} else if (strcmp(arg, "--frames") == 0 && value) {
+			options->frames = Max(1U, uint32_t(strtoul(value, nullptr, 10)));
+			i++;
+		} else if (strcmp(arg, "--report") == 0 && value) {
+			options->report_path = value;
+			i++;
+		} else if (strcmp(arg, "--size") == 0 && value) {
+			unsigned w, h;
+			if (sscanf(value, "%ux%u", &w, &h) == 2 && w > 0 && h > 0) {
+				options->width = w;
+				options->height = h;
+			} else {
+				LOG_F(WARNING, "Invalid --size %s, expected WxH", value);
+			}
+			i++;
+		}
+	}
+	return enabled;
+}
+
+static FORCEINLINE vec3 CatmullRom(vec3 p0, vec3 p1, vec3 p2, vec3 p3, float t) {
+	float t2 = t * t, t3 = t2 * t;
+	return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+		(3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void BenchmarkCamera::Update(Engine& engine) {
+	const int count = int(CountOf(Benchmark_Path));
+	float u = 0.0f;
+	if (Benchmark_Started && Benchmark_Frames > 0) {
+		u = float(engine.this_frame.n - Benchmark_FirstFrame) / float(Benchmark_Frames) * float(count);
+	}
+	int segment = int(u) % count;
+	float t = u - floorf(u);
+
+	// Returns keyframe segment + offset as (x, y, z, pitch, yaw). Yaw keeps decreasing around the
+	// loop, so it's unwrapped by a full turn for keyframes past the end of the path.
+	auto key = [&](int offset, vec3* position, vec2* rotation) {
+		int i = segment + offset;
+		int wraps = (i < 0) ? -1 : (i / count);
+		const BenchmarkKeyframe& k = Benchmark_Path[i - wraps * count];
+		*position = k.position;
+		*rotation = k.rotation - vec2(0.0f, 360.0f * float(wraps));
+	};
+	vec3 p[4];
+	vec2 r[4];
+	for (int i = 0; i < 4; i++) { key(i - 1, &p[i], &r[i]); }
+
+	position = CatmullRom(p[0], p[1], p[2], p[3], t);
+	vec2 angles = vec2(CatmullRom(vec3(r[0], 0), vec3(r[1], 0), vec3(r[2], 0), vec3(r[3], 0), t));
+	mat4 rot_x = glm::rotate(ToRadians(angles.x), vec3(1, 0, 0));
+	mat4 rot_y = glm::rotate(ToRadians(angles.y), vec3(0, 1, 0));
+	rotation = quat_cast(rot_x * rot_y);
+}
+
+bool StartBenchmark(const Engine& engine, const BenchmarkOptions& options) {
+	// Wait for every texture to be read, decoded and uploaded, so that loading doesn't affect the
+	// results
+	if (engine.this_frame.n < 2 || engine.last_frame.deferred_actions_left > 0 || GetPendingAsyncReadCount() > 0 ||
+		GetPendingTextureLoadCount() > 0)
+	{
+		Benchmark_IdleFrames = 0;
+		return false;
+	}
+
+	// Then wait for texture streaming to settle. A level that has just finished uploading may be
+	// followed by a request for the next finer one, so streaming has to stay idle for a few frames.
+	// If it doesn't settle (e.g. because the budget is too small for the view), start anyway.
+	constexpr uint32_t RequiredIdleFrames = 4;
+	constexpr uint32_t MaxStreamingFrames = 1000;
+	bool streaming = GetPendingTextureLevelCount() > 0 || GetPendingUploadCount() > 0;
+	Benchmark_IdleFrames = streaming ? 0 : Benchmark_IdleFrames + 1;
+	if (Benchmark_IdleFrames < RequiredIdleFrames) {
+		if (++Benchmark_StreamingFrames < MaxStreamingFrames) { return false; }
+		LOG_F(WARNING, "Texture streaming hasn't settled after %u frames, starting the benchmark anyway",
+			MaxStreamingFrames);
+	}
+
+	Benchmark_Started = true;
+	Benchmark_FirstFrame = engine.this_frame.n;
+	Benchmark_Frames = options.frames;
+	Benchmark_LoadTime = engine.this_frame.t;
+
+	const std::vector<RenderPassTiming*>& passes = GetRenderPassTimings();
+	Benchmark_PassBaselines.resize(passes.size());
+	for (size_t i = 0; i < passes.size(); i++) {
+		if (passes[i]->cpu_ms.session_histogram) { Benchmark_PassBaselines[i].cpu = *passes[i]->cpu_ms.session_histogram; }
+		if (passes[i]->gpu_ms.session_histogram) { Benchmark_PassBaselines[i].gpu = *passes[i]->gpu_ms.session_histogram; }
+	}
+
+	LOG_F(INFO, "Loading finished after %.03f ms, measuring %u frames", Benchmark_LoadTime, Benchmark_Frames);
+	return true;
+}
+
+static void WriteJSONString(FILE* f, const char* s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') { fputc('\\', f); }
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void WritePercentiles(FILE* f, const MetricHistogram& histogram) {
+	fprintf(f, "\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"p999\": %.4f",
+		histogram.percentile(0.5), histogram.percentile(0.95), histogram.percentile(0.99), histogram.percentile(0.999));
+}
+
+static void WriteMetric(FILE* f, const char* name, const BenchmarkMetric& metric, const char* separator) {
+	fprintf(f, "\t\t\"%s\": {\"avg\": %.4f, \"max\": %.4f, ", name,
+		metric.sum / double(Max(1U, Benchmark_FramesRecorded)), metric.max);
+	WritePercentiles(f, metric.histogram);
+	fprintf(f, "}%s\n", separator);
+}
+
+// Returns the part of a session histogram that was recorded during the benchmark.
+static MetricHistogram SubtractHistogram(const MetricHistogram* current, const MetricHistogram& baseline) {
+	MetricHistogram result = current ? *current : MetricHistogram();
+	if (!current) { return result; }
+	result.total -= baseline.total;
+	for (uint32_t i = 0; i < MetricHistogram::Octaves; i++) { result.octave_counts[i] -= baseline.octave_counts[i]; }
+	for (uint32_t i = 0; i < MetricHistogram::Buckets; i++) { result.counts[i] -= baseline.counts[i]; }
+	return result;
+}
+
+static bool WriteBenchmarkReport(const BenchmarkOptions& options) {
+	FILE* f = fopen(options.report_path, "wb");
+	if (!f) {
+		LOG_F(ERROR, "Can't write benchmark report to %s: %s", options.report_path, strerror(errno));
+		return false;
+	}
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"model\": ");
+	WriteJSONString(f, options.model_path);
+	fprintf(f, ",\n");
+	fprintf(f, "\t\"platform\": \"%s\",\n", PLATFORM_NAME);
+	fprintf(f, "\t\"width\": %u,\n\t\"height\": %u,\n", options.width, options.height);
+	fprintf(f, "\t\"frames\": %u,\n", Benchmark_FramesRecorded);
+	fprintf(f, "\t\"load_time_ms\": %.3f,\n", Benchmark_LoadTime);
+	fprintf(f, "\t\"peak_rss_bytes\": %llu,\n", (unsigned long long)GetPeakResidentMemory());
+
+	fprintf(f, "\t\"phases_ms\": {\n");
+	for (uint32_t i = 0; i < BenchmarkPhase_Count; i++) {
+		WriteMetric(f, Benchmark_PhaseNames[i], Benchmark_Phases[i], (i + 1 < BenchmarkPhase_Count) ? "," : "");
+	}
+	fprintf(f, "\t},\n");
+
+	fprintf(f, "\t\"passes_ms\": {\n");
+	const std::vector<RenderPassTiming*>& passes = GetRenderPassTimings();
+	bool first = true;
+	for (size_t i = 0; i < passes.size(); i++) {
+		const RenderPassTiming& pass = *passes[i];
+		if (pass.last_frame < Benchmark_FirstFrame) { continue; }
+		BenchmarkPassBaseline baseline = (i < Benchmark_PassBaselines.size()) ? Benchmark_PassBaselines[i] : BenchmarkPassBaseline();
+		MetricHistogram cpu = SubtractHistogram(pass.cpu_ms.session_histogram, baseline.cpu);
+		MetricHistogram gpu = SubtractHistogram(pass.gpu_ms.session_histogram, baseline.gpu);
+		fprintf(f, "%s\t\t", first ? "" : ",\n");
+		WriteJSONString(f, pass.name);
+		fprintf(f, ": {\"cpu\": {");
+		WritePercentiles(f, cpu);
+		fprintf(f, "}, \"gpu\": ");
+		if (gpu.total > 0) {
+			fprintf(f, "{");
+			WritePercentiles(f, gpu);
+			fprintf(f, "}}");
+		} else {
+			fprintf(f, "null}");
+		}
+		first = false;
+	}
+	fprintf(f, "\n\t},\n");
+
+	fprintf(f, "\t\"per_frame\": {\n");
+	WriteMetric(f, "drawcalls", Benchmark_Drawcalls, ",");
+	WriteMetric(f, "polys", Benchmark_Polys, ",");
+	WriteMetric(f, "heap_allocations", Benchmark_Allocations, GLCallStatsEnabled() ? "," : "");
+	if (GLCallStatsEnabled()) {
+		for (uint32_t i = 0; i < CountOf(Benchmark_GLCalls); i++) {
+			WriteMetric(f, Benchmark_GLCallNames[i], Benchmark_GLCalls[i], (i + 1 < CountOf(Benchmark_GLCalls)) ? "," : "");
+		}
+	}
+	fprintf(f, "\t}\n");
+	fprintf(f, "}\n");
+
+	bool ok = (ferror(f) == 0);
+	ok &= (fclose(f) == 0);
+	if (ok) {
+		LOG_F(INFO, "Wrote benchmark report to %s", options.report_path);
+	} else {
+		LOG_F(ERROR, "Failed to write benchmark report to %s", options.report_path);
+	}
+	return ok;
+}
+
+bool UpdateBenchmark(const Engine& engine, const BenchmarkOptions& options, int* exit_code) {
+	// Stats for a frame are complete once the next one has started
+	const FrameState& last = engine.last_frame;
+	if (!Benchmark_Started || last.n < Benchmark_FirstFrame) { return false; }
+
+	Benchmark_Phases[BenchmarkPhase_Frame] .add(engine.this_frame.t - last.t);
+	Benchmark_Phases[BenchmarkPhase_Poll]  .add(last.t_poll   - last.t);
+	Benchmark_Phases[BenchmarkPhase_Update].add(last.t_update - last.t_poll);
+	Benchmark_Phases[BenchmarkPhase_Render].add(last.t_render - last.t_update);
+	Benchmark_Phases[BenchmarkPhase_Defer] .add(last.t_defer  - last.t_render);
+	Benchmark_Phases[BenchmarkPhase_Swap]  .add(engine.this_frame.t - last.t_defer);
+	Benchmark_Drawcalls.add(float(last.total_drawcalls));
+	Benchmark_Polys.add(float(last.total_polys_rendered));
+	Benchmark_Allocations.add(float(last.heap_allocations));
+
+	const GLCallStats& gl = last.gl_calls;
+	float gl_values[] = {
+		float(gl.total()), float(gl.redundant_calls), float(gl.program_binds), float(gl.texture_binds),
+		float(gl.sampler_binds), float(gl.uniform_uploads), float(gl.framebuffer_binds),
+		float(gl.vertex_array_binds), float(gl.state_changes), float(gl.buffer_uploads),
+		float(gl.buffer_upload_bytes),
+	};
+	StaticAssert(CountOf(gl_values) == CountOf(Benchmark_GLCalls));
+	for (uint32_t i = 0; i < CountOf(Benchmark_GLCalls); i++) { Benchmark_GLCalls[i].add(gl_values[i]); }
+
+	if (++Benchmark_FramesRecorded < options.frames) { return false; }
+	*exit_code = WriteBenchmarkReport(options) ? 0 : 1;
+	return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "base/base.hh"
+#include "scene/camera.hh"
+
+struct Engine;
+
+/* Benchmark mode, started with --benchmark on the command line.
+ *
+ * The engine runs without UI or vsync, in a hidden window, and waits until the model and all of
+ * its textures are loaded and texture streaming has gone idle. It then flies the main camera along a fixed path for a given number of
+ * frames, one step per frame rather than per unit of time, so that every run renders the same
+ * frames regardless of how fast the machine is. Finally it writes a JSON report with percentiles
+ * for every frame phase and render pass, draw and GL call counts, load time and peak memory usage.
+ *
+ * Options:
+ *   --benchmark [model.gltf]  enable benchmark mode, optionally with a different model
+ *   --frames N                number of frames to measure (default 1000)
+ *   --report path.json        where to write the report (default benchmark.json)
+ *   --size WxH                window size (default 1280x720)
+ */
+struct BenchmarkOptions {
+	const char* model_path = "data/models/Sponza/Sponza.gltf";
+	const char* report_path = "benchmark.json";
+	uint32_t frames = 1000;
+	uint32_t width = 1280;
+	uint32_t height = 720;
+};
+
+// Returns true if --benchmark was given, filling in options from the command line.
+bool ParseBenchmarkArgs(int argc, char* argv[], BenchmarkOptions* options);
+
+// Camera that flies along the benchmark path. Stays at the start of the path until
+// StartBenchmark() is called.
+struct BenchmarkCamera : InfPerspectiveRevZCamera {
+	// Returns the size of this object. Subclasses must include this exact definition.
+	virtual constexpr size_t Size() const override { return sizeof(*this); }
+
+	BenchmarkCamera() : InfPerspectiveRevZCamera{0.1f, 130.0f} {}
+
+	virtual void Update(Engine& engine) override;
+};
+
+// Checks whether loading has finished and measurement can start, and starts it if so. Call once
+// per frame until it returns true.
+bool StartBenchmark(const Engine& engine, const BenchmarkOptions& options);
+
+// Records the last frame's stats. Returns true once all frames have been measured, at which point
+// the report has been written and the program can exit with *exit_code, which is nonzero if the
+// report couldn't be written. Call once per frame after StartBenchmark.
+bool UpdateBenchmark(const Engine& engine, const BenchmarkOptions& options, int* exit_code);
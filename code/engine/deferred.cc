@@ -1,24 +1,131 @@
 #include "engine/deferred.hh"
+#include "engine/engine.hh"
+#include "base/mpsc_queue.hh"
+#include "base/hashmap.hh"
+#include "base/debug.hh"
+
 #include <deque>
+#include <mutex>
+#include <SDL.h>
 
 struct DeferredAction {
 	DeferredCallback callback;
 	void* data;
 };
 
-std::deque<DeferredAction> DeferredActions;
+struct DeferredQueue {
+	static constexpr uint32_t BatchSize = 32;
+
+	MPSCQueue<DeferredAction, DeferredActionCapacity> ring;
+
+	// Actions that didn't fit into the ring. Only used if a lot of actions are deferred in one go,
+	// e.g. when a large model is loaded, so a lock is fine here. Actions in this list run after
+	// the ones in the ring, even if they were deferred earlier.
+	std::mutex overflow_mutex;
+	std::deque<DeferredAction> overflow;
+	std::atomic<uint32_t> overflow_size = 0;
+
+	// Actions are popped from the ring a batch at a time and kept here until they're run.
+	// Only touched by the main thread.
+	DeferredAction batch[BatchSize];
+	uint32_t batch_next = 0;
+	uint32_t batch_count = 0;
+
+	void push(const DeferredAction& action) {
+		if (ExpectTrue(ring.try_push(action))) { return; }
+		std::lock_guard<std::mutex> lock(overflow_mutex);
+		overflow.push_back(action);
+		overflow_size.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Returns the next action without removing it, or nullptr if there isn't one.
+	const DeferredAction* peek() {
+		if (batch_next == batch_count) {
+			batch_next = 0;
+			batch_count = ring.pop_batch(batch, BatchSize);
+			if (batch_count == 0 && overflow_size.load(std::memory_order_relaxed) > 0) {
+				std::lock_guard<std::mutex> lock(overflow_mutex);
+				while (batch_count < BatchSize && !overflow.empty()) {
+					batch[batch_count++] = overflow.front();
+					overflow.pop_front();
+				}
+				overflow_size.fetch_sub(batch_count, std::memory_order_relaxed);
+			}
+		}
+		return (batch_next < batch_count) ? &batch[batch_next] : nullptr;
+	}
+
+	void pop() {
+		DCHECK_LT_F(batch_next, batch_count);
+		batch_next++;
+	}
+
+	uint32_t size() const {
+		return ring.size() + overflow_size.load(std::memory_order_relaxed) + (batch_count - batch_next);
+	}
+};
+
+static DeferredQueue DeferredQueues[uint32_t(DeferPriority::Count)];
 
-void Defer(DeferredCallback callback, void* data) {
-	DeferredActions.push_back({.callback = callback, .data = data});
+// Running estimate of how long each kind of action takes. Main thread only.
+struct DeferredActionCost {
+	float avg_ms = 0.0f;
+	uint32_t samples = 0;
+};
+static HashMap<DeferredCallback, DeferredActionCost> DeferredActionCosts;
+
+// Weight of the latest sample in the running estimate. Cost varies between actions of the same
+// kind (e.g. textures of different sizes), so this keeps a fair amount of history.
+static constexpr float DeferredActionCost_Alpha = 0.2f;
+
+void Defer(DeferredCallback callback, void* data, DeferPriority priority) {
+	DCHECK_LT_F(uint32_t(priority), uint32_t(DeferPriority::Count));
+	DeferredQueues[uint32_t(priority)].push({.callback = callback, .data = data});
 }
 
-uint32_t RunDeferredAction(Engine& engine) {
-	size_t size = DeferredActions.size();
-	if (size > 0) {
-		DeferredAction& action = DeferredActions.front();
+float GetDeferredActionCost(DeferredCallback callback) {
+	const DeferredActionCost* cost = DeferredActionCosts.find(callback);
+	return cost ? cost->avg_ms : 0.0f;
+}
+
+static void UpdateDeferredActionCost(DeferredCallback callback, float ms) {
+	DeferredActionCost& cost = DeferredActionCosts[callback];
+	if (cost.samples == 0) {
+		cost.avg_ms = ms;
+	} else {
+		cost.avg_ms += (ms - cost.avg_ms) * DeferredActionCost_Alpha;
+	}
+	cost.samples++;
+}
+
+uint32_t RunDeferredActions(Engine& engine, float budget_ms, uint32_t max_actions) {
+	const float msec_per_tick = 1000.0f / float(SDL_GetPerformanceFrequency());
+	uint64_t start = SDL_GetPerformanceCounter();
+	uint32_t count = 0;
+
+	while (count < max_actions) {
+		DeferredQueue* queue = nullptr;
+		const DeferredAction* next = nullptr;
+		for (DeferredQueue& q : DeferredQueues) {
+			if ((next = q.peek())) { queue = &q; break; }
+		}
+		if (!next) { break; }
+
+		uint64_t now = SDL_GetPerformanceCounter();
+		float elapsed_ms = float(now - start) * msec_per_tick;
+		if (count > 0 && elapsed_ms + GetDeferredActionCost(next->callback) > budget_ms) { break; }
+
+		// Copy the action before running it, since it may defer more actions
+		DeferredAction action = *next;
+		queue->pop();
 		action.callback(engine, action.data);
-		DeferredActions.pop_front();
-		size--;
+		UpdateDeferredActionCost(action.callback, float(SDL_GetPerformanceCounter() - now) * msec_per_tick);
+		count++;
 	}
-	return size;
+
+	engine.this_frame.deferred_actions_run += count;
+
+	uint32_t remaining = 0;
+	for (const DeferredQueue& q : DeferredQueues) { remaining += q.size(); }
+	return remaining;
 }
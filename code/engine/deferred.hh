@@ -1,13 +1,40 @@
 #pragma once
 #include "base/base.hh"
 
+#include <math.h>
+
 struct Engine;
 typedef void (*DeferredCallback)(Engine& engine, void* data);
 
-// Defer an action to be run at the end of the frame.
-void Defer(DeferredCallback callback, void* data);
+enum class DeferPriority : uint8_t {
+	// Work whose result the user is waiting to see, e.g. a texture that was just edited.
+	High,
+	Normal,
+	// Background work that can wait until everything else is done.
+	Low,
+	Count,
+};
+
+// Defer an action to be run at the end of the frame, on the main thread. May be called from any
+// thread, which makes this the way for worker threads to hand finished work over to the thread
+// that owns the OpenGL context. Actions of the same priority are run in the order they were
+// deferred, unless more than DeferredActionCapacity are queued at once.
+void Defer(DeferredCallback callback, void* data, DeferPriority priority = DeferPriority::Normal);
+
+static constexpr uint32_t DeferredActionCapacity = 4096;
+
+// Runs queued actions, highest priority first, until the time spent would exceed budget_ms or
+// max_actions have been run. The time each kind of action (i.e. each callback) takes is tracked,
+// and an action isn't started if its estimated cost doesn't fit in what's left of the budget. At
+// least one action is run per call, so that expensive actions can't be starved. Returns the number
+// of remaining actions. Must be called from the main thread.
+uint32_t RunDeferredActions(Engine& engine, float budget_ms, uint32_t max_actions = UINT32_MAX);
+
+// Run a single action queued up using Defer. Returns the number of remaining actions.
+static uint32_t RunDeferredAction(Engine& engine) {
+	return RunDeferredActions(engine, INFINITY, 1);
+}
 
-// Run an action queued up using Defer. Returns the number of remaining actions. This is intended
-// to be called in a loop, either until it returns 0 or until the total time spent exceeds a
-// per-frame maximum. The caller is responsible for tracking time.
-uint32_t RunDeferredAction(Engine& engine);
+// Returns the current cost estimate for the given kind of action, in milliseconds, or 0 if no
+// action of this kind has been run yet.
+float GetDeferredActionCost(DeferredCallback callback);
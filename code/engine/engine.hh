@@ -2,6 +2,7 @@
 #include "base/base.hh"
 #include "scene/camera.hh"
 #include "engine/metrics.hh"
+#include "graphics/glstats.hh"
 
 enum class VSync: int8_t {
 	ADAPTIVE = -1,
@@ -45,6 +46,12 @@ struct FrameState {
 
 	uint32_t total_drawcalls = 0;
 	uint32_t total_polys_rendered = 0;
+	uint32_t heap_allocations = 0; // operator new and String allocations made during the frame
+	uint32_t deferred_actions_run = 0;
+	uint32_t deferred_actions_left = 0; // still queued after the frame's deferred actions were run
+	uint64_t upload_bytes = 0; // texture and buffer data streamed to the GPU
+	uint32_t uploads_left = 0; // texture uploads still queued at the end of the frame
+	GLCallStats gl_calls; // only counted while GLCallStatsEnabled()
 
 	// If true, all timing fata for this frame will be discarded. Used to avoid breaking the
 	// in-game stats display when the game is paused.
@@ -93,6 +100,17 @@ struct Engine {
 	// blur and more time needed to resolve the image.
 	float taa_feedback_factor = 0.85f;
 
+	// Time per frame, in milliseconds, that may be spent running deferred actions such as texture
+	// uploads. Higher values get assets on screen faster at the cost of longer frames while loading.
+	float defer_budget_ms = 4.0f;
+	// Texture and buffer data, in megabytes, that may be streamed to the GPU per frame. Levels that
+	// don't fit are uploaded over several frames.
+	float upload_budget_mb = 16.0f;
+	// GPU memory, in megabytes, that streamed textures may use. When over the budget, the finest
+	// levels of textures that weren't used recently are dropped, and textures that haven't been used
+	// for a while are evicted entirely.
+	float texture_budget_mb = 1024.0f;
+
 	// Strength for the sharpening post-filter. Relevant range is [0, 0.1].
 	// FIXME: The current implementation is quite bad, so it's best to keep this disabled.
 	float sharpen_strength = 0.0f;
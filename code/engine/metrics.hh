@@ -1,7 +1,79 @@
 #pragma once
 #include "base/base.hh"
 
+#include <float.h>
+#include <math.h>
+
+// Histogram of positive values with logarithmically sized buckets, in the style of HdrHistogram.
+// Each power of two is split into SubBuckets linear buckets, so percentiles are accurate to within
+// 1/SubBuckets of the value, between MinValue and MinValue * 2^Octaves. Values outside that range
+// are counted in the first or last bucket.
+struct MetricHistogram {
+	static constexpr uint32_t Octaves = 28;
+	static constexpr uint32_t SubBuckets = 16;
+	static constexpr uint32_t Buckets = Octaves * SubBuckets;
+	// Metrics are usually in milliseconds, so this covers 1us to about 4 minutes.
+	static constexpr float MinValue = 0.001f;
+
+	uint64_t total = 0;
+	// Number of values per octave, so that percentile() can skip most buckets.
+	uint32_t octave_counts[Octaves] = {};
+	uint32_t counts[Buckets] = {};
+
+	static uint32_t bucket(float value) {
+		float scaled = value * (1.0f / MinValue);
+		if (scaled < 1.0f) { return 0; }
+		int exponent;
+		float mantissa = frexpf(scaled, &exponent); // scaled = mantissa * 2^exponent, mantissa in [0.5,1)
+		uint32_t octave = uint32_t(exponent - 1);
+		if (octave >= Octaves) { return Buckets - 1; }
+		uint32_t sub = uint32_t((mantissa * 2.0f - 1.0f) * float(SubBuckets));
+		return octave * SubBuckets + Min(sub, SubBuckets - 1);
+	}
+
+	// Returns the value in the middle of the given bucket.
+	static float bucket_value(uint32_t bucket) {
+		uint32_t octave = bucket / SubBuckets;
+		uint32_t sub = bucket % SubBuckets;
+		return ldexpf(1.0f + (float(sub) + 0.5f) / float(SubBuckets), int(octave)) * MinValue;
+	}
+
+	void add(float value) {
+		uint32_t b = bucket(value);
+		counts[b]++;
+		octave_counts[b / SubBuckets]++;
+		total++;
+	}
+
+	// Removes a value that was previously added.
+	void remove(float value) {
+		uint32_t b = bucket(value);
+		counts[b]--;
+		octave_counts[b / SubBuckets]--;
+		total--;
+	}
+
+	// Returns the value that the given fraction of values are less than or equal to, e.g. 0.99 for
+	// the 99th percentile. Returns 0 if the histogram is empty.
+	float percentile(double fraction) const {
+		if (total == 0) { return 0.0f; }
+		uint64_t rank = Max(uint64_t(1), Min(total, uint64_t(ceil(fraction * double(total)))));
+		uint64_t seen = 0;
+		uint32_t octave = 0;
+		while (octave < Octaves - 1 && seen + octave_counts[octave] < rank) {
+			seen += octave_counts[octave++];
+		}
+		uint32_t b = octave * SubBuckets;
+		while (b < Buckets - 1 && seen + counts[b] < rank) {
+			seen += counts[b++];
+		}
+		return bucket_value(b);
+	}
+};
+
 // Ring-buffer of performance metrics/datapoints, like frame or render pass times.
+// All queries are O(1), apart from percentiles, which take time proportional to the number of
+// histogram buckets rather than the number of datapoints.
 struct MetricBuffer {
 	uint32_t frames;
 	uint32_t next = 0;
@@ -9,60 +81,92 @@ struct MetricBuffer {
 	float* times = nullptr;
 	float* values = nullptr;
 
+	// Running totals over the datapoints currently in the buffer. Double precision, since values
+	// are added and removed again many times over a session.
+	double sum = 0.0;
+
+	// Monotonic queue for max(): indices (counted from the first push) of the datapoints that may
+	// still become the largest in the buffer, with decreasing values from front to back.
+	uint64_t pushed = 0;
+	uint64_t* max_queue = nullptr;
+	uint32_t max_queue_front = 0;
+	uint32_t max_queue_size = 0;
+
+	MetricHistogram* window_histogram = nullptr;  // datapoints currently in the buffer
+	MetricHistogram* session_histogram = nullptr; // every datapoint ever pushed
+
 	MetricBuffer(uint32_t frames) : frames(frames) {}
 
 	void push(float time, float datapoint) {
 		if (ExpectFalse(!values)) {
 			// Leaked because we don't care. If you want to fix the leak, note that MetricBuffer is
 			// copied as part of Engine in the ShaderDefine code. It would need a copy-constructor
-			// that copies or discards this buffer.
+			// that copies or discards these buffers.
 			times = new float[frames];
 			values = new float[frames];
+			max_queue = new uint64_t[frames];
+			window_histogram = new MetricHistogram();
+			session_histogram = new MetricHistogram();
 		}
-		times[next] = time;
-		values[next++] = datapoint;
-		if (next >= frames) {
-			next = 0;
-		} else if (used < frames) {
+
+		if (used == frames) {
+			// Evict the oldest datapoint, which is the one about to be overwritten
+			float evicted = values[next];
+			sum -= evicted;
+			window_histogram->remove(evicted);
+			if (max_queue_size > 0 && max_queue[max_queue_front] == pushed - frames) {
+				max_queue_front = (max_queue_front + 1) % frames;
+				max_queue_size--;
+			}
+		} else {
 			used++;
 		}
+
+		// Datapoints that are smaller than the new one can never be the max again
+		while (max_queue_size > 0) {
+			uint64_t back = max_queue[(max_queue_front + max_queue_size - 1) % frames];
+			if (values[back % frames] > datapoint) { break; }
+			max_queue_size--;
+		}
+		max_queue[(max_queue_front + max_queue_size) % frames] = pushed;
+		max_queue_size++;
+
+		times[next] = time;
+		values[next] = datapoint;
+		next = (next + 1) % frames;
+		pushed++;
+		sum += datapoint;
+		window_histogram->add(datapoint);
+		session_histogram->add(datapoint);
 	}
 
 	float avg() const {
-		float accum = 0.0f;
-		for (uint32_t i = 0; i < used; i++) {
-			accum += values[i];
-		}
-		return accum / float(used);
+		return float(sum / double(used));
 	}
 
 	float max() const {
-		float maxval = 0.0f; // NOTE: all datapoints should be positive
-		for (uint32_t i = 0; i < used; i++) {
-			if (values[i] > maxval) {
-				maxval = values[i];
-			}
-		}
-		return maxval;
+		// NOTE: all datapoints should be positive
+		return (max_queue_size > 0) ? values[max_queue[max_queue_front] % frames] : 0.0f;
 	}
 
+	// Datapoints are pushed in time order, so the oldest and newest ones have the extreme times.
 	float min_time() const {
-		float mintime = FLT_MAX;
-		for (uint32_t i = 0; i < used; i++) {
-			if (times[i] < mintime) {
-				mintime = times[i];
-			}
-		}
-		return mintime;
+		if (used == 0) { return FLT_MAX; }
+		return times[(used == frames) ? next : 0];
 	}
 
 	float max_time() const {
-		float maxtime = FLT_MIN;
-		for (uint32_t i = 0; i < used; i++) {
-			if (times[i] > maxtime) {
-				maxtime = times[i];
-			}
-		}
-		return maxtime;
+		if (used == 0) { return FLT_MIN; }
+		return times[(next + frames - 1) % frames];
+	}
+
+	// Percentiles over the datapoints currently in the buffer, e.g. percentile(0.99) for p99.
+	float percentile(double fraction) const {
+		return window_histogram ? window_histogram->percentile(fraction) : 0.0f;
+	}
+
+	// Percentiles over every datapoint pushed since the buffer was created.
+	float session_percentile(double fraction) const {
+		return session_histogram ? session_histogram->percentile(fraction) : 0.0f;
 	}
 };
@@ -0,0 +1,221 @@
+#include "engine/profiler.hh"
+
+#if ENABLE_PROFILER
+#include "base/debug.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <SDL.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#define PROFILER_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define PROFILER_RDTSC 1
+#else
+	#define PROFILER_RDTSC 0
+#endif
+
+static FORCEINLINE uint64_t ReadProfilerTimestamp() {
+	#if PROFILER_RDTSC
+	return __rdtsc();
+	#elif defined(__aarch64__) && !defined(_MSC_VER)
+	uint64_t t;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+	return t;
+	#else
+	return SDL_GetPerformanceCounter();
+	#endif
+}
+
+// Zones are written by their thread while the main thread may be reading them for a trace, so
+// every field is atomic. Relaxed loads and stores compile to plain moves.
+struct ProfilerZone {
+	std::atomic<const char*> name;
+	std::atomic<uint64_t> start;
+	std::atomic<uint64_t> end;
+};
+
+struct ProfilerThread {
+	uint32_t id;
+	char name[32];
+
+	// Zones that have been started but not finished. Owning thread only.
+	static constexpr uint32_t MaxDepth = 64;
+	const char* open_names[MaxDepth];
+	uint64_t open_starts[MaxDepth];
+	uint32_t depth = 0;
+
+	// Number of zones finished so far. Zone i is kept in zones[i % ProfilerZonesPerThread] until
+	// it's overwritten by zone i + ProfilerZonesPerThread.
+	std::atomic<uint64_t> finished = 0;
+	ProfilerZone zones[ProfilerZonesPerThread];
+};
+
+StaticAssert((ProfilerZonesPerThread & (ProfilerZonesPerThread - 1)) == 0);
+
+// Thread buffers are never freed, since the threads that write to them live as long as the program.
+static constexpr uint32_t Profiler_MaxThreads = 64;
+static std::atomic<ProfilerThread*> Profiler_Threads[Profiler_MaxThreads];
+static std::atomic<uint32_t> Profiler_ThreadCount = 0;
+static thread_local ProfilerThread* Profiler_ThisThread = nullptr;
+
+// Frame start timestamps. Main thread only.
+struct ProfilerFrame {
+	uint64_t n;
+	uint64_t start;
+};
+static ProfilerFrame Profiler_Frames[ProfilerHistoryFrames];
+static uint64_t Profiler_FrameCount = 0;
+
+// Reference point for converting timestamps to real time. The conversion factor is measured
+// between this point and the time a trace is written.
+static uint64_t Profiler_ClockTimestamp = 0;
+static uint64_t Profiler_ClockCounter = 0;
+
+static ProfilerThread* RegisterProfilerThread() {
+	ProfilerThread* thread = new ProfilerThread();
+	loguru::get_thread_name(thread->name, sizeof(thread->name), false);
+	thread->id = Profiler_ThreadCount.fetch_add(1, std::memory_order_relaxed);
+	if (thread->id < Profiler_MaxThreads) {
+		Profiler_Threads[thread->id].store(thread, std::memory_order_release);
+	} else {
+		// Still give the thread a buffer so zones can be recorded, they just won't show up
+		LOG_F(WARNING, "Too many threads for the profiler, zones from %s will be missing", thread->name);
+	}
+	return thread;
+}
+
+void BeginProfileZone(const char* name) {
+	ProfilerThread* thread = Profiler_ThisThread;
+	if (ExpectFalse(!thread)) { thread = Profiler_ThisThread = RegisterProfilerThread(); }
+	uint32_t depth = thread->depth++;
+	if (ExpectTrue(depth < ProfilerThread::MaxDepth)) {
+		thread->open_names[depth] = name;
+		thread->open_starts[depth] = ReadProfilerTimestamp();
+	}
+}
+
+void EndProfileZone() {
+	uint64_t end = ReadProfilerTimestamp();
+	ProfilerThread* thread = Profiler_ThisThread;
+	DCHECK_F(thread && thread->depth > 0, "EndProfileZone called without a matching BeginProfileZone");
+	uint32_t depth = --thread->depth;
+	if (ExpectFalse(depth >= ProfilerThread::MaxDepth)) { return; }
+
+	uint64_t i = thread->finished.load(std::memory_order_relaxed);
+	ProfilerZone& zone = thread->zones[i & (ProfilerZonesPerThread - 1)];
+	// Pairs with the acquire fence in WriteProfilerTrace: a reader that sees any of the stores
+	// below will also see that zone i - ProfilerZonesPerThread has been overwritten.
+	std::atomic_thread_fence(std::memory_order_release);
+	zone.name.store(thread->open_names[depth], std::memory_order_relaxed);
+	zone.start.store(thread->open_starts[depth], std::memory_order_relaxed);
+	zone.end.store(end, std::memory_order_relaxed);
+	thread->finished.store(i + 1, std::memory_order_release);
+}
+
+void ProfilerBeginFrame(uint64_t frame) {
+	uint64_t now = ReadProfilerTimestamp();
+	if (ExpectFalse(Profiler_FrameCount == 0)) {
+		Profiler_ClockTimestamp = now;
+		Profiler_ClockCounter = SDL_GetPerformanceCounter();
+	}
+	Profiler_Frames[Profiler_FrameCount++ % ProfilerHistoryFrames] = {.n = frame, .start = now};
+}
+
+static const ProfilerFrame* FindProfilerFrame(uint64_t n) {
+	for (uint64_t i = 0; i < Min(Profiler_FrameCount, uint64_t(ProfilerHistoryFrames)); i++) {
+		const ProfilerFrame& frame = Profiler_Frames[(Profiler_FrameCount - 1 - i) % ProfilerHistoryFrames];
+		if (frame.n == n) { return &frame; }
+	}
+	return nullptr;
+}
+
+static void WriteJSONString(FILE* f, const char* s) {
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', f);
+			fputc(*s, f);
+		} else if (uint8_t(*s) < 0x20) {
+			fprintf(f, "\\u%04x", uint32_t(*s));
+		} else {
+			fputc(*s, f);
+		}
+	}
+	fputc('"', f);
+}
+
+bool WriteProfilerTrace(const char* path, uint64_t first_frame, uint64_t last_frame) {
+	const ProfilerFrame* first = FindProfilerFrame(first_frame);
+	if (!first) {
+		LOG_F(ERROR, "Can't write trace to %s: frame %llu is no longer in the profiler's history",
+			path, (unsigned long long)first_frame);
+		return false;
+	}
+	const ProfilerFrame* after_last = FindProfilerFrame(last_frame + 1);
+	uint64_t now = ReadProfilerTimestamp();
+	uint64_t range_start = first->start;
+	uint64_t range_end = after_last ? after_last->start : now;
+
+	double elapsed_sec = double(SDL_GetPerformanceCounter() - Profiler_ClockCounter) /
+		double(SDL_GetPerformanceFrequency());
+	double ticks_per_usec = double(now - Profiler_ClockTimestamp) / (elapsed_sec * 1e6);
+	if (!(ticks_per_usec > 0.0)) { ticks_per_usec = 1.0; }
+
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		LOG_F(ERROR, "Can't write trace to %s: %s", path, strerror(errno));
+		return false;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first_event = true;
+	uint64_t total_zones = 0;
+	uint32_t thread_count = Min(Profiler_ThreadCount.load(std::memory_order_relaxed), Profiler_MaxThreads);
+	for (uint32_t t = 0; t < thread_count; t++) {
+		ProfilerThread* thread = Profiler_Threads[t].load(std::memory_order_acquire);
+		if (!thread) { continue; }
+
+		fprintf(f, "%s{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":",
+			first_event ? "" : ",\n", thread->id);
+		WriteJSONString(f, thread->name);
+		fprintf(f, "}}");
+		first_event = false;
+
+		uint64_t finished = thread->finished.load(std::memory_order_acquire);
+		uint64_t oldest = (finished > ProfilerZonesPerThread) ? finished - ProfilerZonesPerThread : 0;
+		for (uint64_t i = oldest; i < finished; i++) {
+			const ProfilerZone& zone = thread->zones[i & (ProfilerZonesPerThread - 1)];
+			const char* name = zone.name.load(std::memory_order_relaxed);
+			uint64_t start = zone.start.load(std::memory_order_relaxed);
+			uint64_t end = zone.end.load(std::memory_order_relaxed);
+
+			// Skip the zone if the thread may have started overwriting it while we were reading
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (thread->finished.load(std::memory_order_relaxed) >= i + ProfilerZonesPerThread) { continue; }
+			if (start < range_start || start >= range_end) { continue; }
+
+			fprintf(f, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+				thread->id, double(start - range_start) / ticks_per_usec, double(end - start) / ticks_per_usec);
+			WriteJSONString(f, name);
+			fputc('}', f);
+			total_zones++;
+		}
+	}
+	fprintf(f, "\n]}\n");
+
+	bool ok = (ferror(f) == 0);
+	ok &= (fclose(f) == 0);
+	if (ok) {
+		LOG_F(INFO, "Wrote %llu zones from frames %llu-%llu to %s", (unsigned long long)total_zones,
+			(unsigned long long)first_frame, (unsigned long long)last_frame, path);
+	} else {
+		LOG_F(ERROR, "Failed to write trace to %s", path);
+	}
+	return ok;
+}
+
+#endif // ENABLE_PROFILER
@@ -0,0 +1,61 @@
+#pragma once
+#include "base/base.hh"
+
+/* Scoped CPU profiler.
+ *
+ * ProfileZone("Name") marks the rest of the enclosing scope as a zone. Zones nest, and each thread
+ * records the zones it finishes into its own ring buffer, so recording never takes a lock. Times
+ * come from the CPU's timestamp counter where there is one. Any range of recent frames can be
+ * written out as a Chrome trace with WriteProfilerTrace(), which can be opened in
+ * chrome://tracing or https://ui.perfetto.dev.
+ *
+ * The profiler is built into debug builds. Define ENABLE_PROFILER to 1 to build it into release
+ * builds too, or to 0 to leave it out of debug builds. When disabled, zones compile to nothing.
+ */
+#if !defined(ENABLE_PROFILER)
+	#define ENABLE_PROFILER DEBUG
+#endif
+
+// Zones kept per thread before the oldest ones are overwritten.
+static constexpr uint32_t ProfilerZonesPerThread = 1 << 16;
+// Number of frames whose start times are kept, i.e. how far back a trace can go.
+static constexpr uint32_t ProfilerHistoryFrames = 1024;
+
+#if ENABLE_PROFILER
+
+// Zone names aren't copied, so they must stay valid for the rest of the program. Use string
+// literals or interned strings.
+void BeginProfileZone(const char* name);
+void EndProfileZone();
+
+// Marks the start of a frame. Must be called from the main thread.
+void ProfilerBeginFrame(uint64_t frame);
+
+// Writes every zone that started between the start of first_frame and the end of last_frame to a
+// Chrome trace JSON file. Returns false if first_frame is too old to be in the history, or if the
+// file can't be written. Must be called from the main thread.
+bool WriteProfilerTrace(const char* path, uint64_t first_frame, uint64_t last_frame);
+
+struct ProfileScope {
+	FORCEINLINE ProfileScope(const char* name) { BeginProfileZone(name); }
+	FORCEINLINE ~ProfileScope() { EndProfileZone(); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
+
+#define PROFILE_ZONE_VAR1(line) profile_zone_ ## line
+#define PROFILE_ZONE_VAR0(line) PROFILE_ZONE_VAR1(line)
+#define ProfileZone(name) ProfileScope PROFILE_ZONE_VAR0(__LINE__)(name)
+
+#else
+
+static FORCEINLINE void BeginProfileZone(const char* name) {}
+static FORCEINLINE void EndProfileZone() {}
+static FORCEINLINE void ProfilerBeginFrame(uint64_t frame) {}
+static FORCEINLINE bool WriteProfilerTrace(const char* path, uint64_t first_frame, uint64_t last_frame) {
+	return false;
+}
+
+#define ProfileZone(name) ((void)0)
+
+#endif
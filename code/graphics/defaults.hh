@@ -27,68 +27,72 @@ namespace Attributes {
 }
 
 namespace Uniforms {
+	// Uniforms are identified by their index into Uniforms::all, which lets programs look up
+	// uniform locations with a single array access. The hash is kept for comparisons with names
+	// that aren't known at compile time.
 	struct Item {
+		uint32_t index;
 		uint64_t hash;
 		const char* name;
-		constexpr Item(const char* name) : hash{Hash64(name)}, name{name} {}
+		constexpr Item(uint32_t index, const char* name): index{index}, hash{Hash64(name)}, name{name} {}
 	};
 
 	// Global parameters
-	static constexpr Item Time = {"Time"};
-	static constexpr Item FramebufferSize = {"FramebufferSize"};
+	static constexpr Item Time = {0, "Time"};
+	static constexpr Item FramebufferSize = {1, "FramebufferSize"};
 
 	// Render targets from previous passes
-	static constexpr Item RTAlbedo = {"RTAlbedo"};
-	static constexpr Item RTNormal = {"RTNormal"};
-	static constexpr Item RTMaterial = {"RTMaterial"};
-	static constexpr Item RTVelocity = {"RTVelocity"};
-	static constexpr Item RTColorHDR = {"RTColorHDR"};
-	static constexpr Item RTPersistTAA = {"RTPersistTAA"};
-	static constexpr Item RTDepth = {"RTDepth"};
-	static constexpr Item RTDebugVis = {"RTDebugVis"};
+	static constexpr Item RTAlbedo = {2, "RTAlbedo"};
+	static constexpr Item RTNormal = {3, "RTNormal"};
+	static constexpr Item RTMaterial = {4, "RTMaterial"};
+	static constexpr Item RTVelocity = {5, "RTVelocity"};
+	static constexpr Item RTColorHDR = {6, "RTColorHDR"};
+	static constexpr Item RTPersistTAA = {7, "RTPersistTAA"};
+	static constexpr Item RTDepth = {8, "RTDepth"};
+	static constexpr Item RTDebugVis = {9, "RTDebugVis"};
 
 	// Transformation matrices
-	static constexpr Item LocalToWorld = {"LocalToWorld"};
-	static constexpr Item LocalToClip = {"LocalToClip"};
-	static constexpr Item LastLocalToClip = {"LastLocalToClip"};
-	static constexpr Item ClipToWorld = {"ClipToWorld"};
-	static constexpr Item ClipToView = {"ClipToView"};
+	static constexpr Item LocalToWorld = {10, "LocalToWorld"};
+	static constexpr Item LocalToClip = {11, "LocalToClip"};
+	static constexpr Item LastLocalToClip = {12, "LastLocalToClip"};
+	static constexpr Item ClipToWorld = {13, "ClipToWorld"};
+	static constexpr Item ClipToView = {14, "ClipToView"};
 
 	// Material sampler bindings
-	static constexpr Item TexAlbedo    = {"TexAlbedo"};
-	static constexpr Item TexNormal    = {"TexNormal"};
-	static constexpr Item TexOcclusion = {"TexOcclusion"};
-	static constexpr Item TexOccRghMet = {"TexOccRghMet"};
+	static constexpr Item TexAlbedo    = {15, "TexAlbedo"};
+	static constexpr Item TexNormal    = {16, "TexNormal"};
+	static constexpr Item TexOcclusion = {17, "TexOcclusion"};
+	static constexpr Item TexOccRghMet = {18, "TexOccRghMet"};
 
 	// Material constant factors
-	static constexpr Item ConstAlbedo       = {"ConstAlbedo"};
-	static constexpr Item ConstMetallic     = {"ConstMetallic"};
-	static constexpr Item ConstRoughness    = {"ConstRoughness"};
-	static constexpr Item StippleHardCutoff = {"StippleHardCutoff"};
-	static constexpr Item StippleSoftCutoff = {"StippleSoftCutoff"};
+	static constexpr Item ConstAlbedo       = {19, "ConstAlbedo"};
+	static constexpr Item ConstMetallic     = {20, "ConstMetallic"};
+	static constexpr Item ConstRoughness    = {21, "ConstRoughness"};
+	static constexpr Item StippleHardCutoff = {22, "StippleHardCutoff"};
+	static constexpr Item StippleSoftCutoff = {23, "StippleSoftCutoff"};
 
 	// Shadow sampler and parameters
-	static constexpr Item ShadowMap = {"ShadowMap"};
-	static constexpr Item ShadowWorldToClip = {"ShadowWorldToClip"};
-	static constexpr Item ShadowBiasMin = {"ShadowBiasMin"};
-	static constexpr Item ShadowBiasMax = {"ShadowBiasMax"};
-	static constexpr Item ShadowPCFTapsX = {"ShadowPCFTapsX"};
-	static constexpr Item ShadowPCFTapsY = {"ShadowPCFTapsY"};
+	static constexpr Item ShadowMap = {24, "ShadowMap"};
+	static constexpr Item ShadowWorldToClip = {25, "ShadowWorldToClip"};
+	static constexpr Item ShadowBiasMin = {26, "ShadowBiasMin"};
+	static constexpr Item ShadowBiasMax = {27, "ShadowBiasMax"};
+	static constexpr Item ShadowPCFTapsX = {28, "ShadowPCFTapsX"};
+	static constexpr Item ShadowPCFTapsY = {29, "ShadowPCFTapsY"};
 
 	// Camera parameters
-	static constexpr Item CameraPosition = {"CameraPosition"};
+	static constexpr Item CameraPosition = {30, "CameraPosition"};
 
 	// Lighting parameters
-	static constexpr Item LightPosition = {"LightPosition"};
-	static constexpr Item LightColor = {"LightColor"};
+	static constexpr Item LightPosition = {31, "LightPosition"};
+	static constexpr Item LightColor = {32, "LightColor"};
 
 	// TAA parameters
-	static constexpr Item Jitter = {"Jitter"};
-	static constexpr Item LastJitter = {"LastJitter"};
-	static constexpr Item TAAFeedbackFactor = {"TAAFeedbackFactor"};
+	static constexpr Item Jitter = {33, "Jitter"};
+	static constexpr Item LastJitter = {34, "LastJitter"};
+	static constexpr Item TAAFeedbackFactor = {35, "TAAFeedbackFactor"};
 
 	// Tonemap & PostFX parameters
-	static constexpr Item TonemapExposure = {"TonemapExposure"};
+	static constexpr Item TonemapExposure = {36, "TonemapExposure"};
 
 	static constexpr Item all[] = {
 		Time, FramebufferSize,
@@ -96,10 +100,18 @@ namespace Uniforms {
 		LocalToWorld, LocalToClip, LastLocalToClip, ClipToWorld, ClipToView,
 		TexAlbedo, TexNormal, TexOcclusion, TexOccRghMet,
 		ConstAlbedo, ConstMetallic, ConstRoughness, StippleHardCutoff, StippleSoftCutoff,
-		ShadowMap, ShadowWorldToClip, ShadowBiasMin, ShadowPCFTapsX, ShadowPCFTapsY,
+		ShadowMap, ShadowWorldToClip, ShadowBiasMin, ShadowBiasMax, ShadowPCFTapsX, ShadowPCFTapsY,
 		CameraPosition,
 		LightPosition, LightColor,
 		Jitter, LastJitter, TAAFeedbackFactor,
 		TonemapExposure,
 	};
+
+	static constexpr bool IndicesMatchPositions() {
+		for (uint32_t i = 0; i < CountOf(all); i++) {
+			if (all[i].index != i) { return false; }
+		}
+		return true;
+	}
+	StaticAssert(IndicesMatchPositions());
 }
@@ -0,0 +1,327 @@
+#define GL_CALL_STATS_IMPLEMENTATION
+#include "graphics/glstats.hh"
+#include "graphics/opengl.hh"
+#include "base/hash.hh"
+#include "base/hashmap.hh"
+
+#include <string.h>
+
+#if ENABLE_GL_CALL_STATS
+
+static constexpr GLuint GLCallStats_Unknown = ~0U;
+static constexpr uint32_t GLCallStats_TextureUnits = 32;
+static constexpr GLenum GLCallStats_TextureTargets[] = {
+	GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D,
+};
+static constexpr GLenum GLCallStats_Capabilities[] = {
+	GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+};
+
+// What we know about the current GL state. Every field is GLCallStats_Unknown (all bits set) until
+// it's set through one of the wrappers, so the state can be forgotten with a memset.
+struct GLTrackedState {
+	GLuint program;
+	GLuint active_texture;
+	GLuint textures[GLCallStats_TextureUnits][CountOf(GLCallStats_TextureTargets)];
+	GLuint samplers[GLCallStats_TextureUnits];
+	GLuint draw_framebuffer;
+	GLuint read_framebuffer;
+	uint64_t draw_buffers; // hash of the last glDrawBuffers call for draw_framebuffer
+	GLuint vertex_array;
+	GLuint capabilities[CountOf(GLCallStats_Capabilities)];
+	GLuint cull_face;
+	GLuint depth_func;
+	GLuint depth_mask;
+	GLuint blend_func[4];
+	GLuint blend_equation[2];
+};
+
+static GLTrackedState UnknownTrackedState() {
+	GLTrackedState state;
+	memset(&state, 0xFF, sizeof(state));
+	return state;
+}
+
+static bool GLCallStats_Enabled = DEBUG;
+static GLCallStats GLCallStats_Counts;
+static GLTrackedState GLCallStats_State = UnknownTrackedState();
+// Hash of the last value uploaded to each (program << 32 | location). Uniform values belong to the
+// program, so unlike the rest of the state these are kept across frames. Only valid while counting
+// is enabled and every upload has been made with a known program bound.
+static HashMap<uint64_t, uint64_t> GLCallStats_Uniforms;
+
+static void ForgetTrackedState() {
+	GLCallStats_State = UnknownTrackedState();
+}
+
+// Records a new value for a tracked piece of state, counting the call as redundant if it didn't
+// change anything.
+static FORCEINLINE void SetTracked(GLuint* tracked, GLuint value) {
+	if (*tracked == value) { GLCallStats_Counts.redundant_calls++; }
+	*tracked = value;
+}
+
+static GLuint* TrackedTexture(GLenum target) {
+	uint32_t unit = GLCallStats_State.active_texture - GL_TEXTURE0;
+	if (GLCallStats_State.active_texture == GLCallStats_Unknown || unit >= GLCallStats_TextureUnits) {
+		return nullptr;
+	}
+	for (uint32_t i = 0; i < CountOf(GLCallStats_TextureTargets); i++) {
+		if (GLCallStats_TextureTargets[i] == target) { return &GLCallStats_State.textures[unit][i]; }
+	}
+	return nullptr;
+}
+
+static GLuint* TrackedCapability(GLenum cap) {
+	for (uint32_t i = 0; i < CountOf(GLCallStats_Capabilities); i++) {
+		if (GLCallStats_Capabilities[i] == cap) { return &GLCallStats_State.capabilities[i]; }
+	}
+	return nullptr;
+}
+
+static void CountUniformUpload(GLint location, uint64_t variant, const void* data, size_t bytes) {
+	GLCallStats_Counts.uniform_uploads++;
+	// Uploads to location -1 are silently ignored by GL, so they're always wasted
+	if (location == -1) {
+		GLCallStats_Counts.redundant_calls++;
+		return;
+	}
+	if (GLCallStats_State.program == GLCallStats_Unknown) {
+		// This changed the uniforms of some program, but there's no telling which one
+		GLCallStats_Uniforms.clear();
+		return;
+	}
+	uint64_t key = (uint64_t(GLCallStats_State.program) << 32) | uint32_t(location);
+	uint64_t value = Hash64(data, bytes, variant);
+	uint64_t& last = GLCallStats_Uniforms[key];
+	if (last == value) { GLCallStats_Counts.redundant_calls++; }
+	last = value;
+}
+
+// Linking or deleting a program resets its uniforms. Programs are only relinked or deleted when
+// shaders are reloaded, so it's simplest to forget every program's uniforms.
+void GLCountedLinkProgram(GLuint program) {
+	if (GLCallStats_Enabled) { GLCallStats_Uniforms.clear(); }
+	glLinkProgram(program);
+}
+
+void GLCountedDeleteProgram(GLuint program) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Uniforms.clear();
+		if (GLCallStats_State.program == program) { GLCallStats_State.program = GLCallStats_Unknown; }
+	}
+	glDeleteProgram(program);
+}
+
+void GLCountedUseProgram(GLuint program) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.program_binds++;
+		SetTracked(&GLCallStats_State.program, program);
+	}
+	glUseProgram(program);
+}
+
+void GLCountedActiveTexture(GLenum texture) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.texture_binds++;
+		SetTracked(&GLCallStats_State.active_texture, texture);
+	}
+	glActiveTexture(texture);
+}
+
+void GLCountedBindTexture(GLenum target, GLuint texture) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.texture_binds++;
+		if (GLuint* tracked = TrackedTexture(target)) { SetTracked(tracked, texture); }
+	}
+	glBindTexture(target, texture);
+}
+
+void GLCountedBindSampler(GLuint unit, GLuint sampler) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.sampler_binds++;
+		if (unit < GLCallStats_TextureUnits) { SetTracked(&GLCallStats_State.samplers[unit], sampler); }
+	}
+	glBindSampler(unit, sampler);
+}
+
+#define GL_CALL_STATS_UNIFORM_SCALAR(name, T) \
+	void GLCounted##name(GLint location, T v0) { \
+		if (GLCallStats_Enabled) { CountUniformUpload(location, Hash64(#name), &v0, sizeof(v0)); } \
+		gl##name(location, v0); \
+	}
+#define GL_CALL_STATS_UNIFORM_VECTOR(name, T, N) \
+	void GLCounted##name(GLint location, GLsizei count, const T* value) { \
+		if (GLCallStats_Enabled) { CountUniformUpload(location, Hash64(#name), value, sizeof(T) * N * count); } \
+		gl##name(location, count, value); \
+	}
+#define GL_CALL_STATS_UNIFORM_MATRIX(name, N) \
+	void GLCounted##name(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) { \
+		if (GLCallStats_Enabled) { \
+			CountUniformUpload(location, Hash64(#name) + transpose, value, sizeof(GLfloat) * N * N * count); \
+		} \
+		gl##name(location, count, transpose, value); \
+	}
+
+GL_CALL_STATS_UNIFORM_SCALAR(Uniform1f,  GLfloat)
+GL_CALL_STATS_UNIFORM_SCALAR(Uniform1i,  GLint)
+GL_CALL_STATS_UNIFORM_SCALAR(Uniform1ui, GLuint)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform2fv,  GLfloat, 2)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform2iv,  GLint,   2)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform2uiv, GLuint,  2)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform3fv,  GLfloat, 3)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform3iv,  GLint,   3)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform3uiv, GLuint,  3)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform4fv,  GLfloat, 4)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform4iv,  GLint,   4)
+GL_CALL_STATS_UNIFORM_VECTOR(Uniform4uiv, GLuint,  4)
+GL_CALL_STATS_UNIFORM_MATRIX(UniformMatrix2fv, 2)
+GL_CALL_STATS_UNIFORM_MATRIX(UniformMatrix3fv, 3)
+GL_CALL_STATS_UNIFORM_MATRIX(UniformMatrix4fv, 4)
+
+void GLCountedBindFramebuffer(GLenum target, GLuint framebuffer) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.framebuffer_binds++;
+		GLTrackedState& state = GLCallStats_State;
+		bool draw = (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER);
+		bool read = (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER);
+		if ((!draw || state.draw_framebuffer == framebuffer) && (!read || state.read_framebuffer == framebuffer)) {
+			GLCallStats_Counts.redundant_calls++;
+		}
+		if (draw && state.draw_framebuffer != framebuffer) {
+			state.draw_framebuffer = framebuffer;
+			state.draw_buffers = UINT64_MAX;
+		}
+		if (read) { state.read_framebuffer = framebuffer; }
+	}
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLCountedDrawBuffers(GLsizei n, const GLenum* bufs) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.framebuffer_binds++;
+		// Draw buffers belong to the framebuffer, so they're only known while it stays bound
+		uint64_t h = Hash64(bufs, sizeof(GLenum) * n);
+		if (GLCallStats_State.draw_framebuffer != GLCallStats_Unknown && GLCallStats_State.draw_buffers == h) {
+			GLCallStats_Counts.redundant_calls++;
+		}
+		GLCallStats_State.draw_buffers = h;
+	}
+	glDrawBuffers(n, bufs);
+}
+
+void GLCountedBindVertexArray(GLuint array) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.vertex_array_binds++;
+		SetTracked(&GLCallStats_State.vertex_array, array);
+	}
+	glBindVertexArray(array);
+}
+
+void GLCountedEnable(GLenum cap) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		if (GLuint* tracked = TrackedCapability(cap)) { SetTracked(tracked, GL_TRUE); }
+	}
+	glEnable(cap);
+}
+
+void GLCountedDisable(GLenum cap) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		if (GLuint* tracked = TrackedCapability(cap)) { SetTracked(tracked, GL_FALSE); }
+	}
+	glDisable(cap);
+}
+
+void GLCountedCullFace(GLenum mode) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		SetTracked(&GLCallStats_State.cull_face, mode);
+	}
+	glCullFace(mode);
+}
+
+void GLCountedDepthFunc(GLenum func) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		SetTracked(&GLCallStats_State.depth_func, func);
+	}
+	glDepthFunc(func);
+}
+
+void GLCountedDepthMask(GLboolean flag) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		SetTracked(&GLCallStats_State.depth_mask, flag);
+	}
+	glDepthMask(flag);
+}
+
+void GLCountedBlendFuncSeparate(GLenum srgb, GLenum drgb, GLenum salpha, GLenum dalpha) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		GLuint* tracked = GLCallStats_State.blend_func;
+		if (tracked[0] == srgb && tracked[1] == drgb && tracked[2] == salpha && tracked[3] == dalpha) {
+			GLCallStats_Counts.redundant_calls++;
+		}
+		tracked[0] = srgb; tracked[1] = drgb; tracked[2] = salpha; tracked[3] = dalpha;
+	}
+	glBlendFuncSeparate(srgb, drgb, salpha, dalpha);
+}
+
+void GLCountedBlendEquationSeparate(GLenum rgb, GLenum alpha) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.state_changes++;
+		GLuint* tracked = GLCallStats_State.blend_equation;
+		if (tracked[0] == rgb && tracked[1] == alpha) { GLCallStats_Counts.redundant_calls++; }
+		tracked[0] = rgb; tracked[1] = alpha;
+	}
+	glBlendEquationSeparate(rgb, alpha);
+}
+
+void GLCountedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.buffer_uploads++;
+		// Without data, this only allocates storage
+		if (data) { GLCallStats_Counts.buffer_upload_bytes += uint64_t(size); }
+	}
+	glBufferData(target, size, data, usage);
+}
+
+void GLCountedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+	if (GLCallStats_Enabled) {
+		GLCallStats_Counts.buffer_uploads++;
+		GLCallStats_Counts.buffer_upload_bytes += uint64_t(size);
+	}
+	glBufferSubData(target, offset, size, data);
+}
+
+void EnableGLCallStats(bool enable) {
+	if (enable) {
+		// State and uniforms may have changed while we weren't looking. Done even if counting was
+		// already on, so enabling it always starts from a clean slate.
+		ForgetTrackedState();
+		GLCallStats_Uniforms.clear();
+	}
+	GLCallStats_Enabled = enable;
+}
+
+bool GLCallStatsEnabled() {
+	return GLCallStats_Enabled;
+}
+
+GLCallStats EndGLCallStatsFrame() {
+	GLCallStats stats = GLCallStats_Counts;
+	GLCallStats_Counts = GLCallStats();
+	ForgetTrackedState();
+	return stats;
+}
+
+#else
+
+void EnableGLCallStats(bool enable) {}
+bool GLCallStatsEnabled() { return false; }
+GLCallStats EndGLCallStatsFrame() { return GLCallStats(); }
+
+#endif
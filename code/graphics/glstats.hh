@@ -0,0 +1,47 @@
+#pragma once
+#include "base/base.hh"
+
+/* Per-frame GL call counters.
+ *
+ * Counts the GL calls that change bindings, uniforms or fixed-function state, and how many of them
+ * were redundant, i.e. set something to the value it already had. graphics/opengl.hh redirects the
+ * tracked functions (glUseProgram, glBindTexture, glUniform* and so on) to thin wrappers that count
+ * the call if counting is enabled, then make it. Counting is enabled by default in debug builds and
+ * in benchmark mode, and can be toggled from the Draw Stats window. Define ENABLE_GL_CALL_STATS to
+ * 0 to call GL directly instead.
+ *
+ * The tracked state is forgotten at the start of every frame, since other code (e.g. the ImGui
+ * renderer) changes GL state without going through the wrappers. The first call of each kind in a
+ * frame is therefore never counted as redundant.
+ */
+#if !defined(ENABLE_GL_CALL_STATS)
+	#define ENABLE_GL_CALL_STATS 1
+#endif
+
+struct GLCallStats {
+	uint32_t program_binds = 0;      // glUseProgram
+	uint32_t texture_binds = 0;      // glBindTexture, glActiveTexture
+	uint32_t sampler_binds = 0;      // glBindSampler
+	uint32_t uniform_uploads = 0;    // glUniform*
+	uint32_t framebuffer_binds = 0;  // glBindFramebuffer, glDrawBuffers
+	uint32_t vertex_array_binds = 0; // glBindVertexArray
+	uint32_t state_changes = 0;      // glEnable, glDisable, depth, culling and blending state
+	uint32_t buffer_uploads = 0;     // glBufferData, glBufferSubData
+	uint64_t buffer_upload_bytes = 0;
+	// Calls in any of the categories above that didn't change anything.
+	uint32_t redundant_calls = 0;
+
+	uint32_t total() const {
+		return program_binds + texture_binds + sampler_binds + uniform_uploads + framebuffer_binds +
+			vertex_array_binds + state_changes + buffer_uploads;
+	}
+};
+
+// Enables or disables counting. Takes effect immediately. Enabling forgets the tracked state and
+// uniform values, since they can't be kept up to date while counting is off.
+void EnableGLCallStats(bool enable);
+bool GLCallStatsEnabled();
+
+// Returns the calls counted since the last call to this function, then resets the counters and
+// forgets the tracked state. Call once at the start of every frame.
+GLCallStats EndGLCallStatsFrame();
@@ -2,6 +2,8 @@
 
 #include "base/debug.hh"
 
+#include <stdio.h>
+
 #if DEBUG && PLATFORM_DESKTOP
 	#define ENABLE_GL_DEBUG_MODE 1
 
@@ -22,6 +24,15 @@
 	}
 #endif
 
+#if !PLATFORM_DESKTOP
+	PFNGLQUERYCOUNTERPROC glQueryCounter = nullptr;
+	PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v = nullptr;
+#endif
+
+bool GLSupport_S3TC = false;
+bool GLSupport_RGTC = false;
+bool GLSupport_TimerQueryDisjoint = false;
+
 SDL_GLContext GLCreateContext(SDL_Window* window) {
 	#if PLATFORM_DESKTOP || PLATFORM_MOBILE
 		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
@@ -46,8 +57,34 @@ void GLMakeContextCurrent(SDL_Window* window, SDL_GLContext context) {
 	#if PLATFORM_DESKTOP
 		int gl_version = gladLoadGL((GLADloadfunc)SDL_GL_GetProcAddress);
 		CHECK_NE_F(gl_version, 0, "Failed to load OpenGL functions");
+	#elif !PLATFORM_WEB
+		// Builds that use the GLES headers may still get a desktop context (e.g. on Linux, where SDL
+		// creates one by default), which has timestamp queries in core 3.3 and ARB_timer_query
+		// rather than EXT_disjoint_timer_query. GLES version strings start with "OpenGL ES".
+		const char* version = reinterpret_cast<const char*>(glGetString(GL_VERSION));
+		int major = 0, minor = 0;
+		bool desktop = version && strncmp(version, "OpenGL ES", 9) != 0 &&
+			sscanf(version, "%d.%d", &major, &minor) == 2;
+		bool desktop_33 = desktop && (major > 3 || (major == 3 && minor >= 3));
+		if (desktop_33 || SDL_GL_ExtensionSupported("GL_ARB_timer_query")) {
+			glQueryCounter = (PFNGLQUERYCOUNTERPROC)SDL_GL_GetProcAddress("glQueryCounter");
+			glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)SDL_GL_GetProcAddress("glGetQueryObjectui64v");
+		} else if (SDL_GL_ExtensionSupported("GL_EXT_disjoint_timer_query")) {
+			glQueryCounter = (PFNGLQUERYCOUNTERPROC)SDL_GL_GetProcAddress("glQueryCounterEXT");
+			glGetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)SDL_GL_GetProcAddress("glGetQueryObjectui64vEXT");
+			GLSupport_TimerQueryDisjoint = true;
+		}
+		LOG_F(INFO, "Timestamp queries: %s", !glQueryCounter ? "no" :
+			GLSupport_TimerQueryDisjoint ? "EXT_disjoint_timer_query" : "core/ARB_timer_query");
 	#endif
 
+	// WebGL extension names are reported with a GL_ prefix by Emscripten
+	GLSupport_S3TC = SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc") ||
+		SDL_GL_ExtensionSupported("GL_WEBGL_compressed_texture_s3tc");
+	GLSupport_RGTC = PLATFORM_DESKTOP || SDL_GL_ExtensionSupported("GL_EXT_texture_compression_rgtc");
+	LOG_F(INFO, "Texture compression: S3TC %s, RGTC %s", GLSupport_S3TC ? "yes" : "no",
+		GLSupport_RGTC ? "yes" : "no");
+
 	#if ENABLE_GL_DEBUG_MODE
 		if (glDebugMessageCallback) {
 			glDebugMessageCallback(GLDebugMessageCallback, nullptr);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base/base.hh"
+#include "graphics/glstats.hh"
 
 #if PLATFORM_DESKTOP
 	#include <glad/gl.h>
@@ -36,4 +37,144 @@ void GLPopDebugGroup();
 
 	typedef void (GLAD_API_PTR *PFNGLDEPTHRANGEDNVPROC)(GLdouble zNear, GLdouble zFar);
 	static PFNGLDEPTHRANGEDNVPROC glDepthRangedNV = nullptr;
+
+	// Timestamp queries. Loaded by GLMakeContextCurrent from the core or ARB_timer_query entry
+	// points on desktop contexts (e.g. Linux, which is built against the GLES headers), or from
+	// https://registry.khronos.org/OpenGL/extensions/EXT/EXT_disjoint_timer_query.txt on GLES.
+	// Never available on WebGL, which doesn't support timestamp queries.
+	#define GL_TIMESTAMP    0x8E28
+	#define GL_GPU_DISJOINT 0x8FBB
+	typedef void (GLAD_API_PTR *PFNGLQUERYCOUNTERPROC)(GLuint id, GLenum target);
+	typedef void (GLAD_API_PTR *PFNGLGETQUERYOBJECTUI64VPROC)(GLuint id, GLenum pname, GLuint64* params);
+	extern PFNGLQUERYCOUNTERPROC glQueryCounter;
+	extern PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+#endif
+
+// Block-compressed texture formats, which come from extensions everywhere except for RGTC on
+// desktop GL. Check GLSupport_S3TC and GLSupport_RGTC before using them.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+	#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+	#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+	#define GL_COMPRESSED_RG_RGTC2  0x8DBD
+#endif
+
+// Optional texture formats supported by the current context. Set by GLMakeContextCurrent.
+extern bool GLSupport_S3TC; // BC1 and BC3
+extern bool GLSupport_RGTC; // BC4 and BC5
+// Set if timestamp queries come from EXT_disjoint_timer_query, in which case GL_GPU_DISJOINT has to
+// be checked before using their results. It's not a valid enum on desktop contexts.
+extern bool GLSupport_TimerQueryDisjoint;
+
+// Wrappers that count GL calls, see graphics/glstats.hh. The tracked functions are redirected to
+// them everywhere except in glstats.cc, which defines GL_CALL_STATS_IMPLEMENTATION to call the
+// real functions.
+#if ENABLE_GL_CALL_STATS
+	void GLCountedUseProgram(GLuint program);
+	void GLCountedLinkProgram(GLuint program);
+	void GLCountedDeleteProgram(GLuint program);
+	void GLCountedActiveTexture(GLenum texture);
+	void GLCountedBindTexture(GLenum target, GLuint texture);
+	void GLCountedBindSampler(GLuint unit, GLuint sampler);
+	void GLCountedUniform1f(GLint location, GLfloat v0);
+	void GLCountedUniform1i(GLint location, GLint v0);
+	void GLCountedUniform1ui(GLint location, GLuint v0);
+	void GLCountedUniform2fv(GLint location, GLsizei count, const GLfloat* value);
+	void GLCountedUniform2iv(GLint location, GLsizei count, const GLint* value);
+	void GLCountedUniform2uiv(GLint location, GLsizei count, const GLuint* value);
+	void GLCountedUniform3fv(GLint location, GLsizei count, const GLfloat* value);
+	void GLCountedUniform3iv(GLint location, GLsizei count, const GLint* value);
+	void GLCountedUniform3uiv(GLint location, GLsizei count, const GLuint* value);
+	void GLCountedUniform4fv(GLint location, GLsizei count, const GLfloat* value);
+	void GLCountedUniform4iv(GLint location, GLsizei count, const GLint* value);
+	void GLCountedUniform4uiv(GLint location, GLsizei count, const GLuint* value);
+	void GLCountedUniformMatrix2fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+	void GLCountedUniformMatrix3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+	void GLCountedUniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+	void GLCountedBindFramebuffer(GLenum target, GLuint framebuffer);
+	void GLCountedDrawBuffers(GLsizei n, const GLenum* bufs);
+	void GLCountedBindVertexArray(GLuint array);
+	void GLCountedEnable(GLenum cap);
+	void GLCountedDisable(GLenum cap);
+	void GLCountedCullFace(GLenum mode);
+	void GLCountedDepthFunc(GLenum func);
+	void GLCountedDepthMask(GLboolean flag);
+	void GLCountedBlendFuncSeparate(GLenum srgb, GLenum drgb, GLenum salpha, GLenum dalpha);
+	void GLCountedBlendEquationSeparate(GLenum rgb, GLenum alpha);
+	void GLCountedBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+	void GLCountedBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+	#if !defined(GL_CALL_STATS_IMPLEMENTATION)
+		#undef glUseProgram
+		#define glUseProgram GLCountedUseProgram
+		#undef glLinkProgram
+		#define glLinkProgram GLCountedLinkProgram
+		#undef glDeleteProgram
+		#define glDeleteProgram GLCountedDeleteProgram
+		#undef glActiveTexture
+		#define glActiveTexture GLCountedActiveTexture
+		#undef glBindTexture
+		#define glBindTexture GLCountedBindTexture
+		#undef glBindSampler
+		#define glBindSampler GLCountedBindSampler
+		#undef glUniform1f
+		#define glUniform1f GLCountedUniform1f
+		#undef glUniform1i
+		#define glUniform1i GLCountedUniform1i
+		#undef glUniform1ui
+		#define glUniform1ui GLCountedUniform1ui
+		#undef glUniform2fv
+		#define glUniform2fv GLCountedUniform2fv
+		#undef glUniform2iv
+		#define glUniform2iv GLCountedUniform2iv
+		#undef glUniform2uiv
+		#define glUniform2uiv GLCountedUniform2uiv
+		#undef glUniform3fv
+		#define glUniform3fv GLCountedUniform3fv
+		#undef glUniform3iv
+		#define glUniform3iv GLCountedUniform3iv
+		#undef glUniform3uiv
+		#define glUniform3uiv GLCountedUniform3uiv
+		#undef glUniform4fv
+		#define glUniform4fv GLCountedUniform4fv
+		#undef glUniform4iv
+		#define glUniform4iv GLCountedUniform4iv
+		#undef glUniform4uiv
+		#define glUniform4uiv GLCountedUniform4uiv
+		#undef glUniformMatrix2fv
+		#define glUniformMatrix2fv GLCountedUniformMatrix2fv
+		#undef glUniformMatrix3fv
+		#define glUniformMatrix3fv GLCountedUniformMatrix3fv
+		#undef glUniformMatrix4fv
+		#define glUniformMatrix4fv GLCountedUniformMatrix4fv
+		#undef glBindFramebuffer
+		#define glBindFramebuffer GLCountedBindFramebuffer
+		#undef glDrawBuffers
+		#define glDrawBuffers GLCountedDrawBuffers
+		#undef glBindVertexArray
+		#define glBindVertexArray GLCountedBindVertexArray
+		#undef glEnable
+		#define glEnable GLCountedEnable
+		#undef glDisable
+		#define glDisable GLCountedDisable
+		#undef glCullFace
+		#define glCullFace GLCountedCullFace
+		#undef glDepthFunc
+		#define glDepthFunc GLCountedDepthFunc
+		#undef glDepthMask
+		#define glDepthMask GLCountedDepthMask
+		#undef glBlendFuncSeparate
+		#define glBlendFuncSeparate GLCountedBlendFuncSeparate
+		#undef glBlendEquationSeparate
+		#define glBlendEquationSeparate GLCountedBlendEquationSeparate
+		#undef glBufferData
+		#define glBufferData GLCountedBufferData
+		#undef glBufferSubData
+		#define glBufferSubData GLCountedBufferSubData
+	#endif
 #endif
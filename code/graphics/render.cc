@@ -1,7 +1,9 @@
 #include "graphics/render.hh"
 #include "engine/engine.hh"
 #include "scene/light.hh"
-#include <unordered_map>
+#include "base/hashmap.hh"
+#include "base/stringid.hh"
+#include "engine/profiler.hh"
 
 // NOTE: Must use formats that are colour-renderable on WebGL2 / GLES 3.0
 namespace RenderTargets {
@@ -17,22 +19,12 @@ namespace RenderTargets {
 	RenderTarget DebugVis   = RenderTarget(ImageFormat::RGB8,    &Uniforms::RTDebugVis);
 };
 
-struct FramebufferKey {
-	RenderTarget* attachments [Framebuffer::MaxAttachments];
-	constexpr bool operator==(const FramebufferKey& rhs) const {
-		for (uint32_t i = 0; i < CountOf(attachments); i++) {
-			if (attachments[i] != rhs.attachments[i]) return false;
-		}
-		return true;
-	}
-	constexpr bool operator!=(const FramebufferKey& rhs) const { return !(*this == rhs); }
-};
-std::unordered_map<FramebufferKey, Framebuffer, Hash64T> FramebufferCache;
+HashMap<FramebufferKey, Framebuffer*> FramebufferCache;
 
 static void ClearFramebufferCache() {
 	for (auto& [key, framebuffer] : FramebufferCache) {
-		glDeleteFramebuffers(1, &framebuffer.gl_framebuffer);
-		framebuffer.gl_framebuffer = 0;
+		glDeleteFramebuffers(1, &framebuffer->gl_framebuffer);
+		framebuffer->gl_framebuffer = 0;
 	}
 }
 
@@ -92,7 +84,9 @@ Framebuffer* GetFramebuffer(std::initializer_list<RenderTarget*> attachments) {
 		CHECK_LT_F(num_attachments, Framebuffer::MaxAttachments);
 		key.attachments[num_attachments++] = attachment;
 	}
-	Framebuffer& framebuffer = FramebufferCache[key];
+	Framebuffer*& cached = FramebufferCache[key];
+	if (!cached) { cached = new Framebuffer(); }
+	Framebuffer& framebuffer = *cached;
 	if (framebuffer.gl_framebuffer == 0) {
 		glGenFramebuffers(1, &framebuffer.gl_framebuffer);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.gl_framebuffer);
@@ -167,10 +161,9 @@ void Render(Engine& engine, RenderList& rlist, Camera* camera, Program* program,
 	program->set({Uniforms::ClipToView, camera->this_frame.inv_proj});
 
 	// Find per-view render list for this camera
-	auto viewlist_iter = std::find_if(rlist.views.cbegin(), rlist.views.cend(),
-		[&](const RenderListPerView& v) { return v.camera == camera; });
-	CHECK_NE_F(viewlist_iter, rlist.views.end());
-	const RenderListPerView& viewlist = *viewlist_iter;
+	const RenderListPerView* viewlist_ptr = rlist.GetView(camera);
+	CHECK_NOTNULL_F(viewlist_ptr, "No render list for camera %p", camera);
+	const RenderListPerView& viewlist = *viewlist_ptr;
 
 	Material* last_material = nullptr;
 	uint32_t next_texture_unit = 0;
@@ -221,7 +214,9 @@ void Render(Engine& engine, RenderList& rlist, Camera* camera, Program* program,
 				bool is_albedo = mat.samplers[i].uniform.hash == Uniforms::TexAlbedo.hash;
 				if (is_albedo && (flags & RenderFlags::UseOriginalAlbedo)) { continue; }
 				glActiveTexture(GL_TEXTURE0 + next_texture_unit);
-				glBindTexture(GL_TEXTURE_2D, mat.samplers[i].texture->gl_texture);
+				Texture* texture = mat.samplers[i].texture->resolve();
+				texture->last_used_frame = engine.this_frame.n;
+				glBindTexture(GL_TEXTURE_2D, texture->gl_texture);
 				glBindSampler(next_texture_unit, mat.samplers[i].sampler->gl_sampler);
 				program->set({mat.samplers[i].uniform, int32_t(next_texture_unit)});
 				next_texture_unit++;
@@ -247,7 +242,9 @@ void Render(Engine& engine, RenderList& rlist, Camera* camera, Program* program,
 					bool is_albedo = mat.samplers[i].uniform.hash == Uniforms::TexAlbedo.hash;
 					if (is_albedo) {
 						glActiveTexture(GL_TEXTURE0 + next_texture_unit);
-						glBindTexture(GL_TEXTURE_2D, mat.samplers[i].texture->gl_texture);
+						Texture* texture = mat.samplers[i].texture->resolve();
+						texture->last_used_frame = engine.this_frame.n;
+						glBindTexture(GL_TEXTURE_2D, texture->gl_texture);
 						glBindSampler(next_texture_unit, mat.samplers[i].sampler->gl_sampler);
 						program->set({mat.samplers[i].uniform, int32_t(next_texture_unit)});
 						next_texture_unit++;
@@ -310,7 +307,7 @@ void RenderEffect(Engine& engine, FragShader* fsh, Framebuffer* input, Framebuff
 {
 	BindFramebuffer(output);
 
-	VertShader* vsh = GetVertShader("data/shaders/core_fullscreen.vert");
+	VertShader* vsh = GetVertShader(StringIdLiteral("data/shaders/core_fullscreen.vert"));
 	Program* program = GetProgram(vsh, fsh);
 	glUseProgram(program->gl_program);
 
@@ -338,12 +335,125 @@ void RenderEffect(Engine& engine, FragShader* fsh, Framebuffer* input, Framebuff
 		Meshes::QuadXZ.index_buffer.ctype.gl_enum(), nullptr);
 }
 
+// Each render pass gets a pair of GL_TIMESTAMP queries rather than a GL_TIME_ELAPSED query, since
+// only one GL_TIME_ELAPSED query can be active at a time and passes may be nested. Queries are
+// issued into one of several per-frame slots and read back when the slot comes around again, by
+// which point the GPU has almost always finished with them. If it hasn't, the results are dropped
+// rather than stalling the CPU.
+static constexpr uint32_t RenderPassTimer_FramesInFlight = 3;
+static constexpr uint32_t RenderPassTimer_MaxPassesPerFrame = 32;
+
+struct RenderPassHandle {
+	RenderPassTiming* timing;
+	uint64_t cpu_start;
+	GLuint gl_queries[2]; // timestamps at the start and end of the pass
+};
+
+struct RenderPassTimerFrame {
+	float t; // frame start time, see FrameState::t
+	uint32_t count = 0;
+	GLuint last_query = 0; // query issued last, which is the last one the GPU will complete
+	RenderPassHandle passes[RenderPassTimer_MaxPassesPerFrame];
+};
+
+static bool RenderPassTimer_Initialised = false;
+static bool RenderPassTimer_GPU = false;
+static RenderPassTimerFrame RenderPassTimer_Frames[RenderPassTimer_FramesInFlight];
+static uint32_t RenderPassTimer_Current = 0;
+static uint64_t RenderPassTimer_FrameNumber = 0;
+static HashMap<StringId, RenderPassTiming*> RenderPassTimer_Cache;
+static std::vector<RenderPassTiming*> RenderPassTimer_List;
+
+static void InitRenderPassTimer() {
+	RenderPassTimer_Initialised = true;
+	RenderPassTimer_GPU = (glQueryCounter != nullptr && glGetQueryObjectui64v != nullptr);
+	if (!RenderPassTimer_GPU) {
+		LOG_F(INFO, "Timestamp queries not supported, GPU render pass times won't be available");
+		return;
+	}
+	for (RenderPassTimerFrame& frame : RenderPassTimer_Frames) {
+		for (RenderPassHandle& pass : frame.passes) {
+			glGenQueries(CountOf(pass.gl_queries), pass.gl_queries);
+		}
+	}
+}
+
+static void ReadRenderPassTimes(RenderPassTimerFrame& frame) {
+	if (!RenderPassTimer_GPU || frame.last_query == 0) { return; }
+
+	// Queries complete in order, so if the last one is done, all of them are
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(frame.last_query, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) { return; }
+
+	#if !PLATFORM_DESKTOP
+	// Timestamps are meaningless if the GPU changed frequency or was reset while they were taken
+	if (GLSupport_TimerQueryDisjoint) {
+		GLint disjoint = GL_FALSE;
+		glGetIntegerv(GL_GPU_DISJOINT, &disjoint);
+		if (disjoint) { return; }
+	}
+	#endif
+
+	for (uint32_t i = 0; i < frame.count; i++) {
+		RenderPassHandle& pass = frame.passes[i];
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(pass.gl_queries[0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(pass.gl_queries[1], GL_QUERY_RESULT, &end);
+		pass.timing->gpu_ms.push(frame.t, float(double(end - start) * 1e-6));
+	}
+}
+
+void BeginRenderPassTimings(const Engine& engine) {
+	if (ExpectFalse(!RenderPassTimer_Initialised)) { InitRenderPassTimer(); }
+	RenderPassTimer_Current = (RenderPassTimer_Current + 1) % RenderPassTimer_FramesInFlight;
+	RenderPassTimer_FrameNumber = engine.this_frame.n;
+
+	RenderPassTimerFrame& frame = RenderPassTimer_Frames[RenderPassTimer_Current];
+	ReadRenderPassTimes(frame);
+	frame.t = engine.this_frame.t;
+	frame.count = 0;
+	frame.last_query = 0;
+}
+
+const std::vector<RenderPassTiming*>& GetRenderPassTimings() {
+	return RenderPassTimer_List;
+}
+
 void* StartRenderPass(const char* name) {
+	// Pass names may be built every frame, but timing and profiler zone names have to stay valid
+	StringId name_id = StringId::intern(name);
+	BeginProfileZone(name_id.cstr());
 	GLPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, name);
-	return nullptr;
+
+	RenderPassTimerFrame& frame = RenderPassTimer_Frames[RenderPassTimer_Current];
+	if (ExpectFalse(frame.count == RenderPassTimer_MaxPassesPerFrame)) { return nullptr; }
+	RenderPassHandle& pass = frame.passes[frame.count++];
+
+	RenderPassTiming*& timing = RenderPassTimer_Cache[name_id];
+	if (ExpectFalse(!timing)) {
+		timing = new RenderPassTiming(name_id.cstr());
+		RenderPassTimer_List.push_back(timing);
+	}
+	timing->last_frame = RenderPassTimer_FrameNumber;
+	pass.timing = timing;
+
+	if (RenderPassTimer_GPU) { glQueryCounter(pass.gl_queries[0], GL_TIMESTAMP); }
+	pass.cpu_start = SDL_GetPerformanceCounter();
+	return &pass;
 }
 
 void EndRenderPass(void* render_pass_handle) {
-	(void)(render_pass_handle); // unused
+	if (RenderPassHandle* pass = static_cast<RenderPassHandle*>(render_pass_handle)) {
+		uint64_t cpu_end = SDL_GetPerformanceCounter();
+		RenderPassTimerFrame& frame = RenderPassTimer_Frames[RenderPassTimer_Current];
+		if (RenderPassTimer_GPU) {
+			glQueryCounter(pass->gl_queries[1], GL_TIMESTAMP);
+			frame.last_query = pass->gl_queries[1];
+		}
+		float msec_per_tick = 1000.0f / float(SDL_GetPerformanceFrequency());
+		pass->timing->cpu_ms.push(frame.t, float(cpu_end - pass->cpu_start) * msec_per_tick);
+	}
 	GLPopDebugGroup();
+	EndProfileZone();
 }
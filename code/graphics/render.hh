@@ -8,6 +8,9 @@
 #include "assets/model.hh"
 #include "assets/shader.hh"
 #include "scene/camera.hh"
+#include "engine/metrics.hh"
+
+#include <vector>
 
 struct Engine;
 struct DirectionalLight;
@@ -42,6 +45,18 @@ struct Framebuffer {
 	GLuint drawbufferForAttachment(const RenderTarget* rt);
 };
 
+// Key for the framebuffer cache used by GetFramebuffer().
+struct FramebufferKey {
+	RenderTarget* attachments [Framebuffer::MaxAttachments];
+	constexpr bool operator==(const FramebufferKey& rhs) const {
+		for (uint32_t i = 0; i < CountOf(attachments); i++) {
+			if (attachments[i] != rhs.attachments[i]) return false;
+		}
+		return true;
+	}
+	constexpr bool operator!=(const FramebufferKey& rhs) const { return !(*this == rhs); }
+};
+
 void UpdateRenderTargets(const Engine& engine);
 void UpdateShadowRenderTargets(const DirectionalLight& light);
 
@@ -66,6 +81,25 @@ namespace RenderEffectFlags {
 void RenderEffect(Engine& engine, FragShader* fsh, Framebuffer* input, Framebuffer* output,
 	std::initializer_list<UniformValue> uniforms, RenderEffectFlags::Flag flags = 0);
 
+// Time taken by all render passes with a given name, in milliseconds. CPU time is the time spent
+// submitting the pass's commands. GPU time is measured with timestamp queries, which are read back
+// a few frames later, and isn't available on the web or on GLES drivers without
+// EXT_disjoint_timer_query.
+struct RenderPassTiming {
+	const char* name;
+	uint64_t last_frame = 0; // last frame the pass ran in
+	MetricBuffer cpu_ms = MetricBuffer(120);
+	MetricBuffer gpu_ms = MetricBuffer(120);
+	RenderPassTiming(const char* name): name{name} {}
+};
+
+// Starts timing this frame's render passes and reads back GPU times from earlier frames without
+// waiting for the GPU. Must be called once per frame, before the first render pass.
+void BeginRenderPassTimings(const Engine& engine);
+
+// Returns the timings for every render pass that has ever run, in order of first use.
+const std::vector<RenderPassTiming*>& GetRenderPassTimings();
+
 void* StartRenderPass(const char* name);
 void EndRenderPass(void* render_pass_handle);
 
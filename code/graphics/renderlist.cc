@@ -4,8 +4,11 @@
 #include "scene/camera.hh"
 #include "scene/light.hh"
 #include "assets/mesh.hh"
+#include "assets/material.hh"
+#include "assets/texture.hh"
+#include "engine/profiler.hh"
 
-static bool CollideAABBFrustum(vec3 aabb_center, vec3 aabb_half_extents, mat4 local_to_clip, float zn, float zf) {
+bool CollideAABBFrustum(vec3 aabb_center, vec3 aabb_half_extents, mat4 local_to_clip, float zn, float zf) {
 	// See https://fgiesen.wordpress.com/2010/10/17/view-frustum-culling/
 	// Using "method 3" for now, since we don't compute world-space frustum planes yet.
 	vec3 center = aabb_center, half = aabb_half_extents;
@@ -44,7 +47,8 @@ static bool MeshInstanceShouldBeRendered(const MeshInstance& mi, const Camera& c
 }
 
 void RenderListPerView::UpdateFromScene(const Engine& engine, GameObject* scene, Camera* camera) {
-	// TODO: Should reuse generated renderlist objects when possible; for now, just clear them
+	ProfileZone("Cull View");
+	// Clearing keeps the allocated memory, so this doesn't allocate in the steady state
 	Clear();
 
 	this->camera = camera;
@@ -74,7 +78,9 @@ void RenderListPerView::UpdateFromScene(const Engine& engine, GameObject* scene,
 	mesh_instances.resize(num_mesh_instances);
 	uint32_t next_mesh_instance_slot = 0;
 
-	scene->Recurse([&](GameObject& obj) {
+	// Only two pointers are captured, so std::function can store the lambda inline instead of
+	// allocating. The camera is read through this->camera for the same reason.
+	scene->Recurse([this, &next_mesh_instance_slot](GameObject& obj) {
 		// Copy instance world transforms into the just-allocated slots in mesh_instances
 		if (MeshInstance* mi = dynamic_cast<MeshInstance*>(&obj)) {
 			if (!mi->mesh || mi->mesh->gl_vertex_array == 0) { return; }
@@ -88,26 +94,85 @@ void RenderListPerView::UpdateFromScene(const Engine& engine, GameObject* scene,
 				rmesh.instance_count = 0;
 			}
 			// Compute local-to-clip (MVP) transform for this instance
-			mat4 local_to_clip = camera->this_frame.vp * mi->world_transform;
-			if (MeshInstanceShouldBeRendered(*mi, *camera, local_to_clip)) {
+			mat4 local_to_clip = this->camera->this_frame.vp * mi->world_transform;
+			if (MeshInstanceShouldBeRendered(*mi, *this->camera, local_to_clip)) {
 				mesh_instances[rmesh.first_instance + (rmesh.instance_count++)] = RenderableMeshInstanceData{
 					.local_to_world = mi->world_transform,
 					.local_to_clip = local_to_clip,
-					.last_local_to_clip = camera->last_frame.vp * mi->world_transform,
+					.last_local_to_clip = this->camera->last_frame.vp * mi->world_transform,
 				};
 			}
 		}
 	});
 }
 
+// Asks for the textures of each visible material to be streamed in down to the level they'll be
+// sampled from. A mesh with uv_density texture-space units per local-space unit, seen at view depth
+// d, covers (texture size * uv_density * d) / (scale * pixels per unit at depth 1) texels per pixel,
+// and the level the GPU samples is the log2 of that. The nearest point of each instance's bounding
+// sphere is used, so large meshes get enough detail close to the camera.
+static void RequestTextureLevels(const Engine& engine, const RenderListPerView& view) {
+	ProfileZone("Request Texture Levels");
+	if (!view.camera) { return; }
+	const mat4& proj = view.camera->this_frame.proj;
+	// Only perspective projections have a depth-dependent footprint
+	if (proj[2][3] == 0.0f) { return; }
+	float pixels_per_unit = 0.5f * float(engine.display_h) * proj[1][1];
+	float znear = view.camera->input.znear;
+
+	for (const auto& [key, rmesh] : view.meshes) {
+		const Mesh& mesh = *rmesh.mesh;
+		if (!rmesh.material || rmesh.material->num_samplers == 0 || rmesh.instance_count == 0) { continue; }
+
+		// Smallest number of texture-space units per pixel over all visible instances
+		float uv_per_pixel = INFINITY;
+		if (mesh.uv_density > 0.0f) {
+			for (uint32_t i = rmesh.first_instance; i < rmesh.first_instance + rmesh.instance_count; i++) {
+				const RenderableMeshInstanceData& instance = view.mesh_instances[i];
+				const mat4& m = instance.local_to_world;
+				float scale = Max(Max(glm::length(vec3(m[0])), glm::length(vec3(m[1]))), glm::length(vec3(m[2])));
+				float radius = glm::length(mesh.aabb_half_extents) * scale;
+				float depth = (instance.local_to_clip * vec4(mesh.aabb_center, 1.0f)).w - radius;
+				depth = Max(depth, znear);
+				uv_per_pixel = Min(uv_per_pixel, mesh.uv_density * depth / (scale * pixels_per_unit));
+			}
+		} else {
+			// Unknown density, so assume the worst
+			uv_per_pixel = 0.0f;
+		}
+
+		for (uint32_t i = 0; i < rmesh.material->num_samplers; i++) {
+			Texture* texture = rmesh.material->samplers[i].texture;
+			if (!texture) { continue; }
+			texture = texture->resolve();
+			float texels_per_pixel = uv_per_pixel * float(Max(texture->width, texture->height));
+			float level = (texels_per_pixel > 1.0f) ? floorf(log2f(texels_per_pixel)) : 0.0f;
+			RequestTextureLevel(texture, uint8_t(Min(level, float(Texture::MaxLevels))));
+		}
+	}
+}
+
+RenderListPerView& RenderList::AddView(Camera* camera) {
+	if (num_views == views.size()) { views.emplace_back(); }
+	RenderListPerView& view = views[num_views++];
+	view.camera = camera;
+	return view;
+}
+
+const RenderListPerView* RenderList::GetView(const Camera* camera) const {
+	for (uint32_t i = 0; i < num_views; i++) {
+		if (views[i].camera == camera) { return &views[i]; }
+	}
+	return nullptr;
+}
+
 void RenderList::UpdateFromScene(const Engine& engine, GameObject* scene, Camera* main_camera) {
-	// TODO: Should reuse generated renderlist objects when possible; for now, just clear them
+	ProfileZone("Build Render List");
 	Clear();
 
 	this->main_camera = main_camera;
 
-	RenderListPerView& main_view = views.emplace_back();
-	main_view.camera = main_camera;
+	AddView(main_camera);
 
 	scene->Recurse([&](GameObject& obj) {
 		if (DirectionalLight* light = dynamic_cast<DirectionalLight*>(&obj)) {
@@ -118,8 +183,7 @@ void RenderList::UpdateFromScene(const Engine& engine, GameObject* scene, Camera
 			// engine does, rather than its position. But this is a bit simpler to implement.
 			r.position = glm::normalize(light->world_position);
 			// Directional lights are shadowcasters, so we need to consider another view.
-			RenderListPerView& light_view = views.emplace_back();
-			light_view.camera = static_cast<Camera*>(light);
+			AddView(static_cast<Camera*>(light));
 		}
 		else if (PointLight* light = dynamic_cast<PointLight*>(&obj)) {
 			RenderablePointLight& r = point_lights.emplace_back();
@@ -133,7 +197,10 @@ void RenderList::UpdateFromScene(const Engine& engine, GameObject* scene, Camera
 		}
 	});
 
-	for (RenderListPerView& view : views) {
-		view.UpdateFromScene(engine, scene, view.camera);
+	for (uint32_t i = 0; i < num_views; i++) {
+		views[i].UpdateFromScene(engine, scene, views[i].camera);
 	}
+
+	// Shadow views don't sample material textures (apart from alpha), so only the main view counts
+	RequestTextureLevels(engine, views[0]);
 }
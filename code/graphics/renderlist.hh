@@ -2,10 +2,10 @@
 #include "base/base.hh"
 #include "base/math.hh"
 #include "base/hash.hh"
+#include "base/hashmap.hh"
 #include "graphics/opengl.hh"
 
 #include <vector>
-#include <unordered_map>
 
 struct Engine;
 struct GameObject;
@@ -65,9 +65,14 @@ struct RenderableAmbientCube {
 	};
 };
 
+// Returns true if the given local-space AABB may be visible through the frustum of the given MVP
+// transform, whose view-space depth range is [zn, zf]. Conservative: can return true for boxes that
+// are just outside the frustum near its corners.
+bool CollideAABBFrustum(vec3 aabb_center, vec3 aabb_half_extents, mat4 local_to_clip, float zn, float zf);
+
 struct RenderListPerView {
 	Camera* camera;
-	std::unordered_map<RenderableMeshKey, RenderableMesh, Hash64T> meshes;
+	HashMap<RenderableMeshKey, RenderableMesh> meshes;
 	std::vector<RenderableMeshInstanceData> mesh_instances;
 
 	RenderListPerView() {
@@ -84,7 +89,10 @@ struct RenderListPerView {
 
 struct RenderList {
 	Camera* main_camera;
+	// Per-view lists are kept around between frames so their buffers can be reused. Only the first
+	// num_views entries are in use; use GetView() to look one up by camera.
 	std::vector<RenderListPerView> views;
+	uint32_t num_views = 0;
 	std::vector<RenderableDirectionalLight> directional_lights;
 	std::vector<RenderablePointLight> point_lights;
 	std::vector<RenderableAmbientCube> ambient_cubes;
@@ -98,11 +106,18 @@ struct RenderList {
 
 	void Clear() {
 		main_camera = nullptr;
-		views.clear();
+		for (RenderListPerView& view : views) { view.camera = nullptr; }
+		num_views = 0;
 		directional_lights.clear();
 		point_lights.clear();
 		ambient_cubes.clear();
 	}
 
+	// Returns an unused per-view list, reusing one from a previous frame if possible.
+	RenderListPerView& AddView(Camera* camera);
+
+	// Returns the per-view list for the given camera, or nullptr if there isn't one.
+	const RenderListPerView* GetView(const Camera* camera) const;
+
 	void UpdateFromScene(const Engine& engine, GameObject* scene, Camera* main_camera);
 };
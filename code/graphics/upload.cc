@@ -0,0 +1,308 @@
+#include "graphics/upload.hh"
+
+#include "base/debug.hh"
+#include "base/jobs.hh"
+#include "engine/profiler.hh"
+
+#include <deque>
+
+// A queued texture level, or a callback if callback is set.
+struct UploadRequest {
+	DeferredCallback callback = nullptr;
+	void* callback_data = nullptr;
+
+	GLuint texture = 0;
+	uint32_t level = 0;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	GLenum format = 0; // internal format if compressed
+	GLenum type = 0;
+	bool compressed = false;
+	// Rows of texels, or of blocks if compressed. Rows are tightly packed.
+	uint32_t row_count = 0;
+	uint32_t row_size = 0; // in bytes
+	const uint8_t* data = nullptr;
+	uint32_t rows_done = 0;
+};
+
+static std::deque<UploadRequest> Upload_Queue;
+
+// Positions in the ring only ever increase, the offset into the buffer is position % UploadRingSize.
+// Everything between tail and head may still be read by uploads the GPU hasn't finished yet.
+static struct {
+	bool initialised = false;
+	bool enabled = false;
+	GLuint pbo = 0;
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	uint64_t fenced = 0; // head when the last fence was inserted
+} Upload_Ring;
+
+// Fences inserted after each frame's uploads, oldest first. Signalled in order, so once a fence is
+// signalled, the ring can be reclaimed up to its end.
+struct UploadFence {
+	GLsync sync;
+	uint64_t end;
+};
+static constexpr uint32_t UploadFenceCapacity = 8;
+static UploadFence Upload_Fences[UploadFenceCapacity];
+static uint32_t Upload_FenceFirst = 0;
+static uint32_t Upload_FenceCount = 0;
+
+// Texture uploads are split into bands of at most this many bytes, so that one level can't take up
+// the whole ring and the budget can be kept reasonably precisely.
+static constexpr uint32_t UploadMaxBandSize = UploadRingSize / 4;
+// Copies into the ring of at least this many bytes are split across the job system's threads.
+static constexpr uint32_t UploadParallelCopySize = 1 << 20;
+static constexpr uint32_t UploadParallelCopyBatch = 256 << 10;
+
+// Bytes uploaded since the last call to ProcessUploads.
+static uint64_t Upload_FrameBytes = 0;
+
+static void InitUploadRing() {
+	Upload_Ring.initialised = true;
+	if (PLATFORM_WEB) {
+		// WebGL 2 doesn't have glMapBufferRange, only glGetBufferSubData.
+		LOG_F(INFO, "Streaming uploads: no buffer mapping on WebGL, uploading from client memory");
+		return;
+	}
+	glGenBuffers(1, &Upload_Ring.pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Upload_Ring.pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, UploadRingSize, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	GLObjectLabel(GL_BUFFER, Upload_Ring.pbo, "Upload Ring");
+	Upload_Ring.enabled = true;
+}
+
+// Advances the tail past every frame whose fence has been signalled.
+static void ReclaimRing() {
+	while (Upload_FenceCount > 0) {
+		UploadFence& fence = Upload_Fences[Upload_FenceFirst];
+		GLenum status = glClientWaitSync(fence.sync, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) { break; }
+		glDeleteSync(fence.sync);
+		Upload_Ring.tail = fence.end;
+		Upload_FenceFirst = (Upload_FenceFirst + 1) % UploadFenceCapacity;
+		Upload_FenceCount--;
+	}
+}
+
+// Inserts a fence covering everything written to the ring since the last one. If there are too many
+// fences in flight already, the next fence covers this frame's writes as well.
+static void FenceRing() {
+	if (Upload_Ring.head == Upload_Ring.fenced || Upload_FenceCount == UploadFenceCapacity) { return; }
+	UploadFence& fence = Upload_Fences[(Upload_FenceFirst + Upload_FenceCount) % UploadFenceCapacity];
+	fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	fence.end = Upload_Ring.head;
+	Upload_FenceCount++;
+	Upload_Ring.fenced = Upload_Ring.head;
+}
+
+// Allocates size contiguous bytes from the ring. Returns false if the ring is full.
+static bool AllocateRing(uint32_t size, uint32_t* offset) {
+	if (size > UploadRingSize) { return false; }
+	uint64_t head = (Upload_Ring.head + 63) & ~uint64_t(63);
+	uint32_t head_offset = uint32_t(head % UploadRingSize);
+	if (head_offset + size > UploadRingSize) {
+		// Doesn't fit before the end of the buffer, skip to the start
+		head += UploadRingSize - head_offset;
+		head_offset = 0;
+	}
+	if (head + size - Upload_Ring.tail > UploadRingSize) { return false; }
+	Upload_Ring.head = head + size;
+	*offset = head_offset;
+	return true;
+}
+
+// Copies data into the ring, which must be bound to target. Nothing can be reading this part of
+// the ring, so it's mapped unsynchronized. Disables the ring if it can't be mapped.
+static bool CopyToRing(GLenum target, uint32_t offset, const void* data, uint32_t size) {
+	GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+	uint8_t* dst = static_cast<uint8_t*>(glMapBufferRange(target, offset, size, access));
+	if (ExpectFalse(!dst)) {
+		LOG_F(WARNING, "Streaming uploads: can't map the upload ring (error 0x%x), uploading from client "
+			"memory from now on", glGetError());
+		Upload_Ring.enabled = false;
+		return false;
+	}
+
+	const uint8_t* src = static_cast<const uint8_t*>(data);
+	if (size >= UploadParallelCopySize) {
+		ParallelFor(size, UploadParallelCopyBatch, [&](uint32_t begin, uint32_t end) {
+			memcpy(&dst[begin], &src[begin], end - begin);
+		});
+	} else {
+		memcpy(dst, src, size);
+	}
+
+	// Can only fail if the buffer's contents were lost, e.g. due to a display mode change
+	if (ExpectFalse(!glUnmapBuffer(target))) {
+		LOG_F(WARNING, "Streaming uploads: upload ring contents lost, retrying from client memory");
+		return false;
+	}
+	return true;
+}
+
+void QueueTextureUpload(GLuint texture, uint32_t level, uint32_t width, uint32_t height,
+	GLenum format, GLenum type, uint32_t bytes_per_pixel, const void* data)
+{
+	UploadRequest& request = Upload_Queue.emplace_back();
+	request.texture = texture;
+	request.level = level;
+	request.width = width;
+	request.height = height;
+	request.format = format;
+	request.type = type;
+	request.row_count = height;
+	request.row_size = width * bytes_per_pixel;
+	request.data = static_cast<const uint8_t*>(data);
+}
+
+void QueueCompressedTextureUpload(GLuint texture, uint32_t level, uint32_t width, uint32_t height,
+	GLenum internalformat, uint32_t block_bytes, const void* data)
+{
+	UploadRequest& request = Upload_Queue.emplace_back();
+	request.texture = texture;
+	request.level = level;
+	request.width = width;
+	request.height = height;
+	request.format = internalformat;
+	request.compressed = true;
+	request.row_count = (height + 3) / 4;
+	request.row_size = ((width + 3) / 4) * block_bytes;
+	request.data = static_cast<const uint8_t*>(data);
+}
+
+void QueueUploadCallback(DeferredCallback callback, void* data) {
+	UploadRequest& request = Upload_Queue.emplace_back();
+	request.callback = callback;
+	request.callback_data = data;
+}
+
+void UploadBufferData(GLuint buffer, uint32_t offset, uint32_t size, const void* data) {
+	if (!Upload_Ring.initialised) { InitUploadRing(); }
+	Upload_FrameBytes += size;
+
+	// COPY_READ/COPY_WRITE are used here since binding them doesn't change the bound vertex array.
+	uint32_t ring_offset;
+	if (Upload_Ring.enabled && AllocateRing(size, &ring_offset)) {
+		glBindBuffer(GL_COPY_READ_BUFFER, Upload_Ring.pbo);
+		bool copied = CopyToRing(GL_COPY_READ_BUFFER, ring_offset, data, size);
+		if (copied) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, ring_offset, offset, size);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		if (copied) { return; }
+	}
+
+	// Unlike textures, this can't wait for space in the ring, since the caller frees the data
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+#if DEBUG && !PLATFORM_WEB && !PLATFORM_MOBILE
+// Checks that the level a request uploads to has been specified with the request's size and format.
+// WebGL and GLES 3.0 have no glGetTexLevelParameteriv. Expects the texture to be bound.
+static void CheckTextureLevel(const UploadRequest& request) {
+	GLint width = 0, height = 0, compressed = 0, internalformat = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, request.level, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, request.level, GL_TEXTURE_HEIGHT, &height);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, request.level, GL_TEXTURE_COMPRESSED, &compressed);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, request.level, GL_TEXTURE_INTERNAL_FORMAT, &internalformat);
+	DCHECK_F(uint32_t(width) == request.width && uint32_t(height) == request.height,
+		"Texture %u level %u is %dx%d, but the queued upload is %ux%u", request.texture, request.level,
+		width, height, request.width, request.height);
+	DCHECK_F(bool(compressed) == request.compressed, "Texture %u level %u is %scompressed, but the queued upload %s",
+		request.texture, request.level, compressed ? "" : "un", request.compressed ? "is" : "isn't");
+	if (request.compressed) {
+		DCHECK_EQ_F(GLenum(internalformat), request.format, "Texture %u level %u has the wrong format",
+			request.texture, request.level);
+	}
+}
+#endif
+
+// Uploads the next band of rows of a texture level, at most max_bytes unless a single row is larger.
+// Returns the number of bytes uploaded, or 0 if the ring is full.
+static uint32_t UploadTextureRows(UploadRequest& request, uint32_t max_bytes) {
+	uint32_t rows = Min(request.row_count - request.rows_done, Max(1U, max_bytes / request.row_size));
+	uint32_t size = rows * request.row_size;
+	const void* pixels = &request.data[size_t(request.rows_done) * request.row_size];
+
+	bool from_ring = false;
+	uint32_t ring_offset;
+	if (Upload_Ring.enabled && size <= UploadRingSize) {
+		if (!AllocateRing(size, &ring_offset)) { return 0; }
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Upload_Ring.pbo);
+		from_ring = CopyToRing(GL_PIXEL_UNPACK_BUFFER, ring_offset, pixels, size);
+		if (from_ring) {
+			pixels = reinterpret_cast<const void*>(uintptr_t(ring_offset));
+		} else {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, request.texture);
+	#if DEBUG && !PLATFORM_WEB && !PLATFORM_MOBILE
+		if (request.rows_done == 0) { CheckTextureLevel(request); }
+	#endif
+	if (request.compressed) {
+		// Bands start on a block boundary, only the last one can end inside a block
+		uint32_t y = request.rows_done * 4;
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, request.level, 0, y, request.width,
+			Min(rows * 4, request.height - y), request.format, size, pixels);
+	} else {
+		glTexSubImage2D(GL_TEXTURE_2D, request.level, 0, request.rows_done, request.width, rows,
+			request.format, request.type, pixels);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (from_ring) { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+
+	request.rows_done += rows;
+	return size;
+}
+
+uint64_t ProcessUploads(Engine& engine, uint64_t budget_bytes) {
+	if (!Upload_Ring.initialised) { InitUploadRing(); }
+	ReclaimRing();
+
+	// Staged rows are tightly packed, which the default alignment of 4 doesn't allow for RGB
+	// textures with odd widths.
+	bool unpack_alignment_set = false;
+	while (!Upload_Queue.empty()) {
+		UploadRequest& request = Upload_Queue.front();
+		if (request.callback) {
+			// The callback may queue more uploads, so the request is popped first
+			DeferredCallback callback = request.callback;
+			void* data = request.callback_data;
+			Upload_Queue.pop_front();
+			callback(engine, data);
+			continue;
+		}
+
+		uint64_t left = (budget_bytes > Upload_FrameBytes) ? (budget_bytes - Upload_FrameBytes) : 0;
+		if (left < request.row_size && Upload_FrameBytes > 0) { break; }
+
+		if (!unpack_alignment_set) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			unpack_alignment_set = true;
+		}
+		uint32_t bytes = UploadTextureRows(request, uint32_t(Min(left, uint64_t(UploadMaxBandSize))));
+		if (bytes == 0) { break; }
+		Upload_FrameBytes += bytes;
+		if (request.rows_done == request.row_count) { Upload_Queue.pop_front(); }
+	}
+	if (unpack_alignment_set) { glPixelStorei(GL_UNPACK_ALIGNMENT, 4); }
+
+	if (Upload_Ring.enabled) { FenceRing(); }
+
+	uint64_t bytes = Upload_FrameBytes;
+	Upload_FrameBytes = 0;
+	return bytes;
+}
+
+uint32_t GetPendingUploadCount() {
+	return uint32_t(Upload_Queue.size());
+}
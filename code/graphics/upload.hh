@@ -0,0 +1,56 @@
+#pragma once
+#include "base/base.hh"
+#include "graphics/opengl.hh"
+#include "engine/deferred.hh"
+
+/* Streaming uploads through a staging ring.
+ *
+ * Texture levels and buffer contents are copied into a ring of pixel buffer object memory, mapped
+ * with GL_MAP_UNSYNCHRONIZED_BIT, and uploaded from there. The copy from the ring to the texture or
+ * buffer then happens asynchronously on the GPU instead of inside the glTexSubImage2D/glBufferData
+ * call. A fence is inserted after each frame's uploads, and that frame's part of the ring is only
+ * reused once the fence has been signalled. Large copies into the ring are split across the job
+ * system's threads.
+ *
+ * Texture uploads are queued and issued by ProcessUploads, which stops once the frame's byte budget
+ * has been used up. Levels that don't fit are uploaded in bands of rows over several frames. Buffer
+ * uploads are issued immediately, since meshes need their buffers as soon as they're created; they
+ * still count against the budget of the frame they were made in.
+ *
+ * If the ring can't be used (e.g. on WebGL, which has no glMapBufferRange), uploads fall back to
+ * glTexSubImage2D and glBufferSubData straight from client memory, with the same budgeting.
+ * Everything here must be called from the main thread.
+ */
+
+static constexpr uint32_t UploadRingSize = 32 << 20;
+
+// Queues an upload of one level of a texture. The level must already have been specified (e.g. with
+// glTexImage2D and null data) with the same size and a matching format, and must stay that way until
+// the upload has been issued; debug builds check this where glGetTexLevelParameteriv is available.
+// The data is read when the upload is issued, so it must stay valid until a callback queued
+// afterwards has been run.
+void QueueTextureUpload(GLuint texture, uint32_t level, uint32_t width, uint32_t height,
+	GLenum format, GLenum type, uint32_t bytes_per_pixel, const void* data);
+
+// Same as QueueTextureUpload, for a level in a block-compressed format. The data holds rows of 4x4
+// blocks, which are uploaded in bands of whole block rows.
+void QueueCompressedTextureUpload(GLuint texture, uint32_t level, uint32_t width, uint32_t height,
+	GLenum internalformat, uint32_t block_bytes, const void* data);
+
+// Queues a callback that is run on the main thread by ProcessUploads once every upload queued
+// before it has been issued. Use this to free the uploaded data, or to start using the texture.
+void QueueUploadCallback(DeferredCallback callback, void* data);
+
+// Uploads size bytes to a buffer object at the given offset, right away. The buffer must already
+// have storage for them. The data may be freed as soon as this returns.
+void UploadBufferData(GLuint buffer, uint32_t offset, uint32_t size, const void* data);
+
+// Reclaims ring space whose uploads have completed, then issues queued uploads and runs queued
+// callbacks until budget_bytes have been uploaded this frame, counting buffer uploads made since the
+// last call. Unless buffer uploads have used up the budget already, at least one band of rows is
+// uploaded per call, so that large textures can't be starved. Returns the number of bytes uploaded
+// this frame.
+uint64_t ProcessUploads(Engine& engine, uint64_t budget_bytes);
+
+// Returns the number of queued texture uploads and callbacks.
+uint32_t GetPendingUploadCount();
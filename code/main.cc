@@ -10,8 +10,13 @@
 #include "base/math.hh"
 #include "base/string.hh"
 #include "base/filesystem.hh"
+#include "base/filewatch.hh"
+#include "base/jobs.hh"
+#include "base/memory.hh"
 #include "engine/engine.hh"
+#include "engine/benchmark.hh"
 #include "engine/deferred.hh"
+#include "engine/profiler.hh"
 #include "graphics/opengl.hh"
 #include "scene/gameobject.hh"
 #include "scene/light.hh"
@@ -21,6 +26,7 @@
 #include "assets/model.hh"
 #include "assets/shader.hh"
 #include "graphics/render.hh"
+#include "graphics/upload.hh"
 #include "editor/editor_camera.hh"
 
 #if PLATFORM_WEB
@@ -28,6 +34,7 @@
 #endif
 
 static void loop(void);
+static void UpdateEditorUI(void);
 
 static SDL_Window* window;
 static SDL_GLContext gl_context;
@@ -35,19 +42,46 @@ static Engine engine;
 static ImFont* font_inter_16;
 static ImFont* font_inter_14;
 static GameObject* scene;
+static bool benchmark_mode;
+static BenchmarkOptions benchmark_options;
 
 SDLMAIN_DECLSPEC int main(int argc, char* argv[]) {
 	InitDebugSystem(argc, argv);
+	InitJobSystem();
+
+	// Cook textures ahead of time and exit, without opening a window
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--cook-textures") == 0) {
+			return CookTextures(String::view(argv[i + 1])) ? 0 : 1;
+		}
+	}
+
+	benchmark_mode = ParseBenchmarkArgs(argc, argv, &benchmark_options);
+	#if defined(__linux__) && !defined(__ANDROID__)
+	// Without a display server, render through SDL's offscreen (EGL pbuffer) driver instead
+	if (benchmark_mode && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY") && !getenv("SDL_VIDEODRIVER")) {
+		SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+	}
+	#endif
+
 	SDL_Init(SDL_INIT_EVERYTHING);
 
 	engine = Engine();
 	engine.initial_t = SDL_GetPerformanceCounter();
 	engine.this_frame.ignore_for_timing = true;
 
+	uint32_t window_flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL;
+	if (benchmark_mode) {
+		// Fixed size so that runs are comparable, hidden so the compositor doesn't get involved
+		engine.display_w = benchmark_options.width;
+		engine.display_h = benchmark_options.height;
+		window_flags = SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL;
+		EnableGLCallStats(true);
+	}
+
 	window = SDL_CreateWindow("Iris",
 		SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-		engine.display_w, engine.display_h,
-		SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL);
+		engine.display_w, engine.display_h, window_flags);
 	CHECK_NOTNULL_F(window, "Failed to create SDL window");
 
 	gl_context = GLCreateContext(window);
@@ -66,7 +100,10 @@ SDLMAIN_DECLSPEC int main(int argc, char* argv[]) {
 		glDepthRangedNV(-1.0f, 1.0f);
 	}
 
-	if (SDL_GL_SetSwapInterval(-1) == -1) {
+	if (benchmark_mode) {
+		engine.vsync = VSync::DISABLED;
+		SDL_GL_SetSwapInterval(0);
+	} else if (SDL_GL_SetSwapInterval(-1) == -1) {
 		SDL_GL_SetSwapInterval(1);
 	}
 
@@ -96,11 +133,15 @@ SDLMAIN_DECLSPEC int main(int argc, char* argv[]) {
 	scene = new GameObject();
 
 	// znear=0.5f results in reasonably high depth precision even without clip-control support
-	engine.cam_main = scene->Add(new EditorCamera());
+	if (benchmark_mode) {
+		engine.cam_main = scene->Add(new BenchmarkCamera());
+	} else {
+		engine.cam_main = scene->Add(new EditorCamera());
+	}
 	engine.cam_main->position = vec3(0.0f, 5.0f, 0.0f);
 
-	Model* sponza = GetModelFromGLTF("data/models/Sponza/Sponza.gltf");
-	scene->AddCopy(sponza->root_object);
+	Model* model = GetModelFromGLTF(benchmark_options.model_path);
+	scene->AddCopy(model->root_object);
 
 	DirectionalLight* dl = scene->Add(new DirectionalLight());
 	dl->position = vec3(0.1, 1.0, 0.1);
@@ -120,6 +161,15 @@ static void loop(void) {
 	float frame_start_t = (SDL_GetPerformanceCounter() - engine.initial_t) * msec_per_tick;
 	engine.last_frame = engine.this_frame;
 	engine.this_frame = FrameState(engine.last_frame, frame_start_t);
+	BeginFrameArena();
+	ProfilerBeginFrame(engine.this_frame.n);
+	ProfileZone("Frame");
+
+	static uint64_t heap_allocations_at_frame_start = 0;
+	uint64_t heap_allocations = GetHeapAllocationCount();
+	engine.last_frame.heap_allocations = uint32_t(heap_allocations - heap_allocations_at_frame_start);
+	heap_allocations_at_frame_start = heap_allocations;
+	engine.last_frame.gl_calls = EndGLCallStatsFrame();
 
 	// Poll and swap times are dependent on the platform and may take abnormally long because of
 	// things outside our control (e.g. window resize or webpage focus loss).
@@ -142,6 +192,17 @@ static void loop(void) {
 		engine.metrics_poll_plt  .push(frame_start_t, engine.this_frame.t - engine.last_frame.t);
 	}
 
+	if (benchmark_mode) {
+		static bool started = false;
+		int exit_code = 0;
+		if (!started) {
+			started = StartBenchmark(engine, benchmark_options);
+		} else if (UpdateBenchmark(engine, benchmark_options, &exit_code)) {
+			exit(exit_code);
+		}
+	}
+
+	BeginProfileZone("Poll Events");
 	SDL_Event event = {0};
 	while (SDL_PollEvent(&event)) {
 		switch (event.type) {
@@ -161,6 +222,7 @@ static void loop(void) {
 
 	SDL_GL_GetDrawableSize(window, (int*)&engine.display_w, (int*)&engine.display_h);
 	UpdateRenderTargets(engine);
+	EndProfileZone();
 
 	engine.this_frame.t_poll = (SDL_GetPerformanceCounter() - engine.initial_t) * msec_per_tick;
 	if (engine.this_frame.t_poll - engine.this_frame.t > 100.0f) {
@@ -168,136 +230,38 @@ static void loop(void) {
 	}
 
 	// Start ImGUI frame early to allow the various update functions to use it
-	ImGui_ImplOpenGL3_NewFrame();
-	ImGui_ImplSDL2_NewFrame();
-	ImGui::NewFrame();
-
-	ProcessShaderUpdates(engine);
-
-	ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
-	ImGui::BeginMainMenuBar();
-	ImVec2 menu_size = ImGui::GetWindowSize();
-	ImGui::PopStyleVar();
-
-	if (ImGui::BeginMenu("Windows")) {
-		ImGui::MenuItem("Performance Stats", NULL, &engine.ui_show_perf_graph);
-		ImGui::EndMenu();
+	if (!benchmark_mode) {
+		ImGui_ImplOpenGL3_NewFrame();
+		ImGui_ImplSDL2_NewFrame();
+		ImGui::NewFrame();
 	}
 
-	if (ImGui::BeginMenu("Buffers")) {
-		auto bufferVisMenuItem = [](Engine& engine, const char* name, DebugVisBuffer buffer) {
-			if (ImGui::MenuItem(name, NULL, engine.debugvis_buffer == buffer)) {
-				engine.debugvis_buffer = (engine.debugvis_buffer == buffer) ? DebugVisBuffer::NONE : buffer;
-			}
-		};
-		bufferVisMenuItem(engine, "GBuffer Diffuse",  DebugVisBuffer::GBUF_COLOR);
-		bufferVisMenuItem(engine, "GBuffer Material", DebugVisBuffer::GBUF_MATERIAL);
-		bufferVisMenuItem(engine, "GBuffer Normal",   DebugVisBuffer::GBUF_NORMAL);
-		bufferVisMenuItem(engine, "GBuffer Velocity", DebugVisBuffer::GBUF_VELOCITY);
-		bufferVisMenuItem(engine, "Depth (Linear)", DebugVisBuffer::DEPTH_LINEAR);
-		bufferVisMenuItem(engine, "Depth (Raw)", DebugVisBuffer::DEPTH_RAW);
-		ImGui::EndMenu();
-	}
-
-	if (ImGui::BeginMenu("Tonemapper")) {
-		auto tonemapperMenuItem = [](Engine& engine, const char* name, Tonemapper::Type tonemapper) {
-			if (ImGui::MenuItem(name, NULL, engine.tonemapper.type == tonemapper)) {
-				engine.tonemapper.type = tonemapper;
-			}
-		};
-		tonemapperMenuItem(engine, "Linear",   Tonemapper::LINEAR);
-		tonemapperMenuItem(engine, "Reinhard", Tonemapper::REINHARD);
-		tonemapperMenuItem(engine, "Hable",    Tonemapper::HABLE);
-		tonemapperMenuItem(engine, "ACES",     Tonemapper::ACES);
-		ImGui::SliderFloat("Exposure", &engine.tonemapper.exposure, 0.0f, 30.0f);
-		ImGui::EndMenu();
-	}
-
-	const char* helptext = "Use WASDQE/Shift/Space to move, hold RMB to rotate camera";
-	float helptext_width = ImGui::CalcTextSize(helptext).x;
-	ImGui::SameLine(menu_size.x - helptext_width - 18);
-	ImGui::TextUnformatted(helptext);
-
-	ImGui::EndMainMenuBar();
-
-	if (engine.ui_show_perf_graph) {
-		ImGui::PushFont(font_inter_14);
-		ImGui::SetNextWindowPos(ImVec2(10, menu_size.y + 10));
-		ImGui::SetNextWindowBgAlpha(0.5f);
-		ImGui::Begin("Stats", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoDecoration |
-			ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
-			ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
-		ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0,0));
-		if (engine.metrics_poll.used != 0 &&
-			ImPlot::BeginPlot("Stats Plot", ImVec2(320, 140), ImPlotFlags_NoMouseText | ImPlotFlags_NoTitle |
-				ImPlotFlags_NoFrame | ImPlotFlags_NoInputs))
-		{
-			ImPlot::SetupAxes(NULL, NULL, ImPlotAxisFlags_NoTickLabels, ImPlotAxisFlags_NoTickLabels);
-			double time_min = INFINITY, time_max = -INFINITY, val_max = -INFINITY;
-			auto metric_minmax = [](double& time_min, double& time_max, double& val_max, const MetricBuffer& metric) {
-				double tmin = double(metric.min_time()), tmax = double(metric.max_time()), vmax = double(metric.max());
-				if (tmin < time_min) { time_min = tmin; }
-				if (tmax > time_max) { time_max = tmax; }
-				if (vmax > val_max)  { val_max  = vmax; }
-			};
-			metric_minmax(time_min, time_max, val_max, engine.metrics_poll);
-			metric_minmax(time_min, time_max, val_max, engine.metrics_update);
-			metric_minmax(time_min, time_max, val_max, engine.metrics_render);
-			metric_minmax(time_min, time_max, val_max, engine.metrics_defer);
-			metric_minmax(time_min, time_max, val_max, engine.metrics_swap);
-			double min_plot_time = Min(time_min, time_max - float(engine.metrics_poll.frames) * 4.0);
-			ImPlot::SetupAxisLimits(ImAxis_X1, min_plot_time, time_max, ImPlotCond_Always);
-
-			// Default plot Y-axis range suitable for 30FPS frames, with gradual transitions when needed
-			static double max_plot_val = 33.3333;
-			max_plot_val = (19.0 * max_plot_val + Max(val_max, 33.3333)) / 20.0;
-			ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0, max_plot_val, ImPlotCond_Always);
+	BeginProfileZone("Process File Changes");
+	ProcessFileChanges();
+	ProcessShaderUpdates(engine);
+	EndProfileZone();
 
-			// Plotting from cumulative arrays. Order is important to get the correct overlap.
-			// Have to set colours manually because they're derived from the label by default.
-			auto plot = [](const char* name, const MetricBuffer& region, const MetricBuffer& cumulative, ImVec4 color) {
-				static char label[64];
-				stbsp_snprintf(label, sizeof(label), "%s %.03fms max %.03fms", name, region.avg(), region.max());
-				ImPlot::SetNextFillStyle(color, 1.0f);
-				const float* xs = cumulative.times;
-				const float* ys = cumulative.values;
-				int offset = cumulative.next;
-				ImPlot::PlotShaded<float>(label, xs, ys, cumulative.used, -INFINITY, 0, offset);
-			};
-			plot("poll",   engine.metrics_poll,   engine.metrics_poll_plt,   {0.32f, 0.80f, 0.96f, 1.0f});
-			plot("update", engine.metrics_update, engine.metrics_update_plt, {0.87f, 0.36f, 0.91f, 1.0f});
-			plot("render", engine.metrics_render, engine.metrics_render_plt, {0.65f, 0.96f, 0.38f, 1.0f});
-			plot("defer",  engine.metrics_defer,  engine.metrics_defer_plt,  {0.95f, 0.40f, 0.20f, 1.0f});
-			plot("swap",   engine.metrics_swap,   engine.metrics_swap,       {0.96f, 0.69f, 0.41f, 1.0f});
-			ImPlot::EndPlot();
-		}
-		ImPlot::PopStyleVar();
-		ImGui::End();
-		ImGui::SetNextWindowPos(ImVec2(10, menu_size.y + 170));
-		ImGui::SetNextWindowBgAlpha(0.5f);
-		if (ImGui::Begin("Draw Stats", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoDecoration |
-			ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
-			ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
-		{
-			ImGui::Text("Draws: %u", engine.last_frame.total_drawcalls);
-			ImGui::SameLine(80);
-			ImGui::Text("Polys: %u", engine.last_frame.total_polys_rendered);
-		}
-		ImGui::End();
-		ImGui::PopFont();
+	if (!benchmark_mode) {
+		UpdateEditorUI();
 	}
 
+	BeginProfileZone("Scene Update");
 	scene->RecursiveUpdate(engine);
 	scene->RecursiveUpdateTransforms();
 	scene->RecursiveLateUpdate(engine);
+	EndProfileZone();
 
-	ImGui::Render(); // doesn't emit drawcalls, so it belongs in the update section; should be last
+	if (!benchmark_mode) {
+		ImGui::Render(); // doesn't emit drawcalls, so it belongs in the update section; should be last
+	}
 
 	engine.this_frame.t_update = (SDL_GetPerformanceCounter() - engine.initial_t) * msec_per_tick;
 
 	static RenderList render_list;
 	render_list.UpdateFromScene(engine, scene, engine.cam_main);
 
+	BeginRenderPassTimings(engine);
+
 	glViewport(0, 0, engine.display_w, engine.display_h);
 
 	Framebuffer* gbuffer = GetFramebuffer({
@@ -326,8 +290,8 @@ static void loop(void) {
 	});
 
 	RenderPass("GBuffer", [&]() {
-		VertShader* vsh = GetVertShader("data/shaders/core_transform.vert");
-		FragShader* fsh = GetFragShader("data/shaders/gbuffer.frag");
+		VertShader* vsh = GetVertShader(StringIdLiteral("data/shaders/core_transform.vert"));
+		FragShader* fsh = GetFragShader(StringIdLiteral("data/shaders/gbuffer.frag"));
 		Program* program = GetProgram(vsh, fsh);
 		Render(engine, render_list, engine.cam_main, program, nullptr, gbuffer, {});
 	});
@@ -348,7 +312,7 @@ static void loop(void) {
 		case DebugVisBuffer::DEPTH_LINEAR:
 		case DebugVisBuffer::DEPTH_RAW: {
 			RenderPass("DebugVis GBuffer Read", [&]() {
-				FragShader* fsh = GetFragShader("data/shaders/debugvis.frag");
+				FragShader* fsh = GetFragShader(StringIdLiteral("data/shaders/debugvis.frag"));
 				RenderEffect(engine, fsh, gbuffer, debugvis, {});
 			});
 		} break;
@@ -375,23 +339,23 @@ static void loop(void) {
 			shadow_material->blend_mode = BlendMode::Stippled;
 		}
 
-		String pass_name_shadowmap = String::format("%s Shadow Map", light.object->Name().cstr);
+		String pass_name_shadowmap = String::frame_format("%s Shadow Map", light.object->Name().cstr);
 		RenderPass(pass_name_shadowmap.cstr, [&]() {
 			BindFramebuffer(shadowmap);
 			glViewport(0, 0, light.object->shadowmap_size, light.object->shadowmap_size);
 			glClearDepth(0.0f); // reverse Z
 			glClear(GL_DEPTH_BUFFER_BIT);
-			VertShader* vsh = GetVertShader("data/shaders/core_transform_min.vert");
-			FragShader* fsh = GetFragShader("data/shaders/shadowmap.frag");
+			VertShader* vsh = GetVertShader(StringIdLiteral("data/shaders/core_transform_min.vert"));
+			FragShader* fsh = GetFragShader(StringIdLiteral("data/shaders/shadowmap.frag"));
 			Program* program = GetProgram(vsh, fsh);
 			Render(engine, render_list, light.object, program, nullptr, shadowmap, {}, shadow_material,
 				RenderFlags::UseOriginalAlbedo | RenderFlags::UseOriginalStippleParams);
 			glViewport(0, 0, engine.display_w, engine.display_h);
 		});
 
-		String pass_name_accumulation = String::format("%s Accumulation", light.object->Name().cstr);
+		String pass_name_accumulation = String::frame_format("%s Accumulation", light.object->Name().cstr);
 		RenderPass(pass_name_accumulation.cstr, [&]() {
-			FragShader* fsh = GetFragShader("data/shaders/light_directional.frag");
+			FragShader* fsh = GetFragShader(StringIdLiteral("data/shaders/light_directional.frag"));
 			RenderEffect(engine, fsh, gbuffer_plus_shadowmap, fb_color_hdr, {
 				UniformValue(Uniforms::LightPosition, light.position),
 				UniformValue(Uniforms::LightColor, light.color),
@@ -405,7 +369,7 @@ static void loop(void) {
 	}
 
 	RenderPass("Tonemap & PostFX", [&]() {
-		FragShader* fsh = GetFragShader("data/shaders/tonemap_postfx.frag");
+		FragShader* fsh = GetFragShader(StringIdLiteral("data/shaders/tonemap_postfx.frag"));
 		RenderEffect(engine, fsh, fb_color_hdr, nullptr, {
 			UniformValue(Uniforms::TonemapExposure, engine.tonemapper.exposure),
 		});
@@ -423,19 +387,233 @@ static void loop(void) {
 		});
 	}
 
-	RenderPass("Editor UI", [&]() {
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-	});
+	if (!benchmark_mode) {
+		RenderPass("Editor UI", [&]() {
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		});
+	}
 
 	engine.this_frame.t_render = (SDL_GetPerformanceCounter() - engine.initial_t) * msec_per_tick;
 
-	// Run one deferred action.
-	// TODO: Run multiple actions if there's time. The logic for that might be nontrivial.
-	RunDeferredAction(engine);
+	// Hand finished file reads over to whoever requested them.
+	BeginProfileZone("Poll Async Reads");
+	PollAsyncReads();
+	EndProfileZone();
+
+	// Run jobs that other threads have handed over to the main thread, e.g. for OpenGL calls.
+	BeginProfileZone("Main Thread Jobs");
+	RunMainThreadJobs();
+	EndProfileZone();
+
+	// Run as many deferred actions as fit into the frame's budget.
+	BeginProfileZone("Deferred Actions");
+	engine.this_frame.deferred_actions_left = RunDeferredActions(engine, engine.defer_budget_ms);
+	EndProfileZone();
+
+	// Stream as much texture data to the GPU as fits into the frame's budget, including any finer
+	// texture levels the render list asked for.
+	BeginProfileZone("Streaming Uploads");
+	UpdateTextureStreaming(engine);
+	uint64_t upload_budget = uint64_t(engine.upload_budget_mb * 1024.0f * 1024.0f);
+	engine.this_frame.upload_bytes = ProcessUploads(engine, upload_budget);
+	engine.this_frame.uploads_left = GetPendingUploadCount();
+	EndProfileZone();
 
 	engine.this_frame.t_defer = (SDL_GetPerformanceCounter() - engine.initial_t) * msec_per_tick;
 
+	BeginProfileZone("Swap");
 	SDL_GL_SwapWindow(window);
+	EndProfileZone();
+}
+
+static void UpdateEditorUI(void) {
+	ImGui::PushStyleVar(ImGuiStyleVar_WindowBorderSize, 0);
+	ImGui::BeginMainMenuBar();
+	ImVec2 menu_size = ImGui::GetWindowSize();
+	ImGui::PopStyleVar();
+
+	if (ImGui::BeginMenu("Windows")) {
+		ImGui::MenuItem("Performance Stats", NULL, &engine.ui_show_perf_graph);
+		ImGui::SliderFloat("Defer Budget (ms)", &engine.defer_budget_ms, 0.0f, 16.0f);
+		ImGui::SliderFloat("Upload Budget (MB)", &engine.upload_budget_mb, 1.0f, 64.0f);
+		ImGui::SliderFloat("Texture Budget (MB)", &engine.texture_budget_mb, 64.0f, 4096.0f);
+		ImGui::EndMenu();
+	}
+
+	if (ImGui::BeginMenu("Buffers")) {
+		auto bufferVisMenuItem = [](Engine& engine, const char* name, DebugVisBuffer buffer) {
+			if (ImGui::MenuItem(name, NULL, engine.debugvis_buffer == buffer)) {
+				engine.debugvis_buffer = (engine.debugvis_buffer == buffer) ? DebugVisBuffer::NONE : buffer;
+			}
+		};
+		bufferVisMenuItem(engine, "GBuffer Diffuse",  DebugVisBuffer::GBUF_COLOR);
+		bufferVisMenuItem(engine, "GBuffer Material", DebugVisBuffer::GBUF_MATERIAL);
+		bufferVisMenuItem(engine, "GBuffer Normal",   DebugVisBuffer::GBUF_NORMAL);
+		bufferVisMenuItem(engine, "GBuffer Velocity", DebugVisBuffer::GBUF_VELOCITY);
+		bufferVisMenuItem(engine, "Depth (Linear)", DebugVisBuffer::DEPTH_LINEAR);
+		bufferVisMenuItem(engine, "Depth (Raw)", DebugVisBuffer::DEPTH_RAW);
+		ImGui::EndMenu();
+	}
+
+	if (ImGui::BeginMenu("Tonemapper")) {
+		auto tonemapperMenuItem = [](Engine& engine, const char* name, Tonemapper::Type tonemapper) {
+			if (ImGui::MenuItem(name, NULL, engine.tonemapper.type == tonemapper)) {
+				engine.tonemapper.type = tonemapper;
+			}
+		};
+		tonemapperMenuItem(engine, "Linear",   Tonemapper::LINEAR);
+		tonemapperMenuItem(engine, "Reinhard", Tonemapper::REINHARD);
+		tonemapperMenuItem(engine, "Hable",    Tonemapper::HABLE);
+		tonemapperMenuItem(engine, "ACES",     Tonemapper::ACES);
+		ImGui::SliderFloat("Exposure", &engine.tonemapper.exposure, 0.0f, 30.0f);
+		ImGui::EndMenu();
+	}
+
+	#if ENABLE_PROFILER
+	if (ImGui::BeginMenu("Profiler")) {
+		auto traceMenuItem = [](Engine& engine, const char* name, uint64_t frames) {
+			uint64_t last = engine.this_frame.n - 1;
+			uint64_t first = (last > frames) ? last - frames + 1 : 1;
+			if (ImGui::MenuItem(name)) {
+				WriteProfilerTrace(String::frame_format("trace_%llu.json", (unsigned long long)last), first, last);
+			}
+		};
+		traceMenuItem(engine, "Save Trace (Last 60 Frames)",  60);
+		traceMenuItem(engine, "Save Trace (Last 600 Frames)", 600);
+		ImGui::EndMenu();
+	}
+	#endif
+
+	const char* helptext = "Use WASDQE/Shift/Space to move, hold RMB to rotate camera";
+	float helptext_width = ImGui::CalcTextSize(helptext).x;
+	ImGui::SameLine(menu_size.x - helptext_width - 18);
+	ImGui::TextUnformatted(helptext);
+
+	ImGui::EndMainMenuBar();
+
+	if (engine.ui_show_perf_graph) {
+		ImGui::PushFont(font_inter_14);
+		ImGui::SetNextWindowPos(ImVec2(10, menu_size.y + 10));
+		ImGui::SetNextWindowBgAlpha(0.5f);
+		ImGui::Begin("Stats", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoDecoration |
+			ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+			ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+		ImPlot::PushStyleVar(ImPlotStyleVar_PlotPadding, ImVec2(0,0));
+		if (engine.metrics_poll.used != 0 &&
+			ImPlot::BeginPlot("Stats Plot", ImVec2(320, 140), ImPlotFlags_NoMouseText | ImPlotFlags_NoTitle |
+				ImPlotFlags_NoFrame | ImPlotFlags_NoInputs))
+		{
+			ImPlot::SetupAxes(NULL, NULL, ImPlotAxisFlags_NoTickLabels, ImPlotAxisFlags_NoTickLabels);
+			double time_min = INFINITY, time_max = -INFINITY, val_max = -INFINITY;
+			auto metric_minmax = [](double& time_min, double& time_max, double& val_max, const MetricBuffer& metric) {
+				double tmin = double(metric.min_time()), tmax = double(metric.max_time()), vmax = double(metric.max());
+				if (tmin < time_min) { time_min = tmin; }
+				if (tmax > time_max) { time_max = tmax; }
+				if (vmax > val_max)  { val_max  = vmax; }
+			};
+			metric_minmax(time_min, time_max, val_max, engine.metrics_poll);
+			metric_minmax(time_min, time_max, val_max, engine.metrics_update);
+			metric_minmax(time_min, time_max, val_max, engine.metrics_render);
+			metric_minmax(time_min, time_max, val_max, engine.metrics_defer);
+			metric_minmax(time_min, time_max, val_max, engine.metrics_swap);
+			double min_plot_time = Min(time_min, time_max - float(engine.metrics_poll.frames) * 4.0);
+			ImPlot::SetupAxisLimits(ImAxis_X1, min_plot_time, time_max, ImPlotCond_Always);
+
+			// Default plot Y-axis range suitable for 30FPS frames, with gradual transitions when needed
+			static double max_plot_val = 33.3333;
+			max_plot_val = (19.0 * max_plot_val + Max(val_max, 33.3333)) / 20.0;
+			ImPlot::SetupAxisLimits(ImAxis_Y1, 0.0, max_plot_val, ImPlotCond_Always);
+
+			// Plotting from cumulative arrays. Order is important to get the correct overlap.
+			// Have to set colours manually because they're derived from the label by default.
+			auto plot = [](const char* name, const MetricBuffer& region, const MetricBuffer& cumulative, ImVec4 color) {
+				static char label[96];
+				stbsp_snprintf(label, sizeof(label), "%s %.03fms p99 %.03fms max %.03fms", name, region.avg(),
+					region.percentile(0.99), region.max());
+				ImPlot::SetNextFillStyle(color, 1.0f);
+				const float* xs = cumulative.times;
+				const float* ys = cumulative.values;
+				int offset = cumulative.next;
+				ImPlot::PlotShaded<float>(label, xs, ys, cumulative.used, -INFINITY, 0, offset);
+			};
+			plot("poll",   engine.metrics_poll,   engine.metrics_poll_plt,   {0.32f, 0.80f, 0.96f, 1.0f});
+			plot("update", engine.metrics_update, engine.metrics_update_plt, {0.87f, 0.36f, 0.91f, 1.0f});
+			plot("render", engine.metrics_render, engine.metrics_render_plt, {0.65f, 0.96f, 0.38f, 1.0f});
+			plot("defer",  engine.metrics_defer,  engine.metrics_defer_plt,  {0.95f, 0.40f, 0.20f, 1.0f});
+			plot("swap",   engine.metrics_swap,   engine.metrics_swap,       {0.96f, 0.69f, 0.41f, 1.0f});
+			ImPlot::EndPlot();
+		}
+		ImPlot::PopStyleVar();
+		ImGui::End();
+		ImGui::SetNextWindowPos(ImVec2(10, menu_size.y + 170));
+		ImGui::SetNextWindowBgAlpha(0.5f);
+		if (ImGui::Begin("Draw Stats", NULL, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoDecoration |
+			ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+			ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav))
+		{
+			ImGui::Text("Draws: %u", engine.last_frame.total_drawcalls);
+			ImGui::SameLine(80);
+			ImGui::Text("Polys: %u", engine.last_frame.total_polys_rendered);
+			ImGui::SameLine(200);
+			ImGui::Text("Allocs: %u", engine.last_frame.heap_allocations);
+			ImGui::Text("Deferred: %u run, %u queued", engine.last_frame.deferred_actions_run,
+				engine.last_frame.deferred_actions_left);
+			ImGui::Text("Uploads: %.2f MB, %u queued", float(engine.last_frame.upload_bytes) / (1024.0f * 1024.0f),
+				engine.last_frame.uploads_left);
+			ImGui::Text("Textures: %.1f / %.0f MB", float(GetTextureMemoryUsage()) / (1024.0f * 1024.0f),
+				engine.texture_budget_mb);
+
+			#if ENABLE_GL_CALL_STATS
+			bool count_gl_calls = GLCallStatsEnabled();
+			if (ImGui::Checkbox("Count GL calls", &count_gl_calls)) {
+				EnableGLCallStats(count_gl_calls);
+			}
+			if (count_gl_calls) {
+				const GLCallStats& gl = engine.last_frame.gl_calls;
+				ImGui::SameLine();
+				ImGui::Text("%u calls, %u redundant", gl.total(), gl.redundant_calls);
+				ImGui::Text("Programs: %u", gl.program_binds);
+				ImGui::SameLine(120);
+				ImGui::Text("Textures: %u", gl.texture_binds);
+				ImGui::SameLine(240);
+				ImGui::Text("Samplers: %u", gl.sampler_binds);
+				ImGui::Text("Uniforms: %u", gl.uniform_uploads);
+				ImGui::SameLine(120);
+				ImGui::Text("FBOs: %u", gl.framebuffer_binds);
+				ImGui::SameLine(240);
+				ImGui::Text("VAOs: %u", gl.vertex_array_binds);
+				ImGui::Text("State: %u", gl.state_changes);
+				ImGui::SameLine(120);
+				ImGui::Text("Buffers: %u (%.1f KB)", gl.buffer_uploads, double(gl.buffer_upload_bytes) / 1024.0);
+			}
+			#endif
+
+			if (ImGui::BeginTable("Render Passes", 3, ImGuiTableFlags_SizingFixedFit)) {
+				ImGui::TableSetupColumn("Pass");
+				ImGui::TableSetupColumn("CPU ms");
+				ImGui::TableSetupColumn("GPU ms");
+				ImGui::TableHeadersRow();
+				for (const RenderPassTiming* pass : GetRenderPassTimings()) {
+					// Skip passes that haven't run recently, e.g. disabled debug visualisations
+					if (pass->last_frame + 60 < engine.this_frame.n) { continue; }
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(pass->name);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass->cpu_ms.used ? pass->cpu_ms.avg() : 0.0f);
+					ImGui::TableNextColumn();
+					if (pass->gpu_ms.used) {
+						ImGui::Text("%.3f", pass->gpu_ms.avg());
+					} else {
+						ImGui::TextUnformatted("-");
+					}
+				}
+				ImGui::EndTable();
+			}
+		}
+		ImGui::End();
+		ImGui::PopFont();
+	}
 }
@@ -5,12 +5,12 @@
 
 static uint32_t GameObject_NextUniqueID = 1;
 
-GameObject::GameObject(const char* name) : assigned_name{name ? String::copy(name) : nullptr} {
+GameObject::GameObject(const char* name) : assigned_name{StringId::intern(name)} {
 	const_cast<uint32_t&>(unique_id) = GameObject_NextUniqueID++;
 }
 
 String GameObject::Name() const {
-	if (assigned_name) { return String::view(assigned_name); }
+	if (assigned_name) { return String::view(assigned_name.cstr()); }
 	const char* type_name = typeid(*this).name();
 	// std::type_info::name() is compiler-dependent. MSVC uses "struct GameObject", Clang uses a
 	// mangled version that starts with a size indicator. Try to extract a meaningful string from it
@@ -21,12 +21,12 @@ String GameObject::Name() const {
 			break;
 		}
 	}
-	return String::format("%s#%u", type_name, unique_id);
+	return String::frame_format("%s#%u", type_name, unique_id);
 }
 
 String GameObject::Name() {
-	if (!assigned_name) { assigned_name = const_cast<const GameObject*>(this)->Name(); }
-	return String::view(assigned_name);
+	if (!assigned_name) { assigned_name = StringId::intern(const_cast<const GameObject*>(this)->Name()); }
+	return String::view(assigned_name.cstr());
 }
 
 bool GameObject::HasChildren() const {
@@ -110,7 +110,6 @@ GameObject* GameObject::AddCopy(GameObject* blueprint) {
 	GameObject* copy = reinterpret_cast<GameObject*>(dst);
 	copy->parent = this;
 	copy->blueprint = blueprint;
-	copy->assigned_name = String::copy(blueprint->assigned_name);
 	const_cast<uint32_t&>(copy->unique_id) = GameObject_NextUniqueID++;
 
 	memset(&copy->child_list, 0, sizeof(copy->child_list));
@@ -172,7 +171,7 @@ GameObject::~GameObject() {
 	}
 }
 
-void GameObject::Recurse(std::function<void(GameObject&)> before, std::function<void(GameObject&)> after) {
+void GameObject::Recurse(const std::function<void(GameObject&)>& before, const std::function<void(GameObject&)>& after) {
 	if (before) { before(*this); }
 	for (GameObject& child : *this) {
 		child.Recurse(before, after);
@@ -3,6 +3,7 @@
 #include "base/debug.hh"
 #include "base/hash.hh"
 #include "base/string.hh"
+#include "base/stringid.hh"
 #include "base/math.hh"
 
 #include <functional>
@@ -62,8 +63,9 @@ struct GameObject: GameObjectBase {
 	// read-only property that is set based on the local transform after Update.
 	mat4 world_transform = mat4(1);
 
-	// Name assigned to this object, or nullptr if none. Use Name() to get a printable version.
-	String assigned_name = nullptr;
+	// Name assigned to this object, or the null ID if none. Use Name() to get a printable version.
+	// Interned, so objects with the same name (e.g. copies of a model) share one string.
+	StringId assigned_name = {};
 
 	// Unique number assigned to this object. Set by the base constructor, shouldn't be changed.
 	const uint32_t unique_id = 0;
@@ -73,7 +75,9 @@ struct GameObject: GameObjectBase {
 
 	GameObject(const char* name = nullptr);
 
-	// Returns the name assigned to this object, or an auto-generated one.
+	// Returns the name assigned to this object, or an auto-generated one. The const version
+	// allocates auto-generated names from the frame arena, so they're only valid until the end of
+	// the next frame. The non-const version assigns the generated name to the object.
 	String Name() const;
 	String Name();
 
@@ -140,7 +144,8 @@ struct GameObject: GameObjectBase {
 
 	// Recursively calls a function for every object reachable from this one. Calls one function
 	// before recursing over this object's children, and one function after.
-	void Recurse(std::function<void(GameObject&)> before, std::function<void(GameObject&)> after = nullptr);
+	// The functions are taken by reference so that recursing doesn't copy them for every object.
+	void Recurse(const std::function<void(GameObject&)>& before, const std::function<void(GameObject&)>& after = nullptr);
 
 	// Recursively calls Update for every object reachable from this one. Should be called once
 	// from the engine's update phase, on a scene graph root.
@@ -72,14 +72,18 @@ void main() {
 
 	OutAlbedo = albedo.rgb;
 
-	vec3 tex_normal = texture(TexNormal, VTexcoord0).rgb;
+	// Normal maps may be stored as BC5, which only keeps X and Y, so Z is always reconstructed.
+	vec2 tex_normal_xy = texture(TexNormal, VTexcoord0).rg;
 	// If the model doesn't specify a normal map, we'll bind a 1x1 white texture to TexNormal. We
 	// can and should just copy over the normal that core_transform.vert generates in this case.
-	if (tex_normal == vec3(1)) {
+	if (tex_normal_xy == vec2(1)) {
 		OutNormal = OctahedronNormalEncode(TangentBasisNormal[2]);
 	} else {
+		vec3 tex_normal;
+		tex_normal.xy = tex_normal_xy * 2.0 - 1.0;
+		tex_normal.z = sqrt(max(0.0, 1.0 - dot(tex_normal.xy, tex_normal.xy)));
 		// FIXME: Is this broken on WebGL2? Retest once we have models with actual normal maps.
-		vec3 normal = normalize(TangentBasisNormal * normalize(tex_normal * 2.0 - 1.0));
+		vec3 normal = normalize(TangentBasisNormal * normalize(tex_normal));
 		OutNormal = OctahedronNormalEncode(normal);
 	}
 